@@ -0,0 +1,343 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "mem.h"
+
+/** An archive being appended to */
+struct archive_writer {
+  FILE*          f;           /**< the archive                          */
+  uint64_t       pos;         /**< offset of the end of the archive     */
+  unsigned char* index;       /**< the index, old entries then new ones */
+  int            numEntries;  /**< number of entries of the index       */
+  int            capEntries;  /**< number of entries allocated          */
+  int            error;       /**< errno value of the first failure     */
+};
+
+/** Store a 32-bit little-endian integer */
+static unsigned char* put_u32 (unsigned char* p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+  return p + 4;
+}
+
+/** Store a 64-bit little-endian integer */
+static unsigned char* put_u64 (unsigned char* p, uint64_t value) {
+  put_u32(p, (uint32_t) value);
+  return put_u32(p + 4, (uint32_t) (value >> 32));
+}
+
+/** Read a 32-bit little-endian integer */
+static uint32_t get_u32 (const unsigned char* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/** Read a 64-bit little-endian integer */
+static uint64_t get_u64 (const unsigned char* p) {
+  return get_u32(p) | ((uint64_t) get_u32(p + 4) << 32);
+}
+
+/** Check the header and the trailer of an archive
+ *  @param data - the first bytes of the archive (at least the header)
+ *  @param trailer - its last bytes
+ *  @param length - its length
+ *  @return the offset of the index, or 0 if the archive is not valid
+ */
+static uint64_t check_trailer (const unsigned char* data,
+                               const unsigned char* trailer, uint64_t length) {
+  if (length < ARCHIVE_HEADER + ARCHIVE_TRAILER ||
+      memcmp(data, "LC3A", 4) != 0 || data[4] != ARCHIVE_VERSION ||
+      memcmp(trailer + 12, "LC3Z", 4) != 0)
+    return 0;
+
+  uint64_t indexOffset = get_u64(trailer);
+  uint64_t numEntries  = get_u32(trailer + 8);
+
+  if (indexOffset < ARCHIVE_HEADER || indexOffset > length ||
+      (length - indexOffset - ARCHIVE_TRAILER) !=
+      numEntries * ARCHIVE_INDEX_ENTRY)
+    return 0;
+
+  return indexOffset;
+}
+
+/** Write bytes at the end of the archive, keeping the first error */
+static void append (archive_writer_t* w, const void* data, size_t length) {
+  if (w->error == 0 && fwrite(data, 1, length, w->f) != length)
+    w->error = (errno != 0) ? errno : EIO;
+
+  w->pos += length;
+}
+
+/** Write the header of a new archive */
+static void write_header (archive_writer_t* w) {
+  unsigned char header[ARCHIVE_HEADER] = { 'L', 'C', '3', 'A',
+                                           ARCHIVE_VERSION, 0, 0, 0 };
+  append(w, header, sizeof(header));
+}
+
+/** Read the index of an existing archive
+ *  @return 0 on success, else the errno value of the failure
+ */
+static int read_index (archive_writer_t* w) {
+  unsigned char header[ARCHIVE_HEADER];
+  unsigned char trailer[ARCHIVE_TRAILER];
+
+  if (fseek(w->f, 0, SEEK_END) != 0)
+    return errno;
+
+  long length = ftell(w->f);
+
+  if (length == 0) { // as if it did not exist
+    write_header(w);
+    return w->error;
+  }
+
+  if (length < ARCHIVE_HEADER + ARCHIVE_TRAILER)
+    return EINVAL;
+
+  rewind(w->f);
+
+  if (fread(header, 1, sizeof(header), w->f) != sizeof(header) ||
+      fseek(w->f, length - ARCHIVE_TRAILER, SEEK_SET) != 0 ||
+      fread(trailer, 1, sizeof(trailer), w->f) != sizeof(trailer))
+    return EIO;
+
+  uint64_t indexOffset = check_trailer(header, trailer, length);
+
+  if (indexOffset == 0)
+    return EINVAL;
+
+  w->numEntries = w->capEntries = get_u32(trailer + 8);
+  w->index      = mem_alloc(MEM_OUTPUT,
+                            (w->capEntries + 1) * ARCHIVE_INDEX_ENTRY);
+
+  if (fseek(w->f, indexOffset, SEEK_SET) != 0 ||
+      fread(w->index, ARCHIVE_INDEX_ENTRY, w->numEntries, w->f) !=
+      (size_t) w->numEntries)
+    return EIO;
+
+  // the new entries follow the old trailer
+  if (fseek(w->f, 0, SEEK_END) != 0)
+    return errno;
+
+  w->pos = length;
+  return 0;
+}
+
+int archive_create (const char* file_name, archive_writer_t** writer) {
+  archive_writer_t* w = mem_calloc(MEM_OUTPUT, 1, sizeof(archive_writer_t));
+  int               error;
+
+  *writer = NULL;
+  w->f    = fopen(file_name, "r+b");
+
+  if (w->f != NULL) {
+    error = read_index(w);
+  }
+  else if (errno == ENOENT && (w->f = fopen(file_name, "w+b")) != NULL) {
+    write_header(w);
+    error = w->error;
+  }
+  else {
+    error = errno;
+  }
+
+  if (error != 0) {
+    if (w->f != NULL)
+      fclose(w->f);
+
+    mem_free(w->index);
+    mem_free(w);
+    return error;
+  }
+
+  *writer = w;
+  return 0;
+}
+
+int archive_add (archive_writer_t* w, const char* source, int numErrors,
+                 archive_member_t* members, int count) {
+  unsigned char buf[12];
+  uint64_t      start   = w->pos;
+  size_t        nameLen = strlen(source) + 1;
+
+  put_u32(put_u32(put_u32(buf, nameLen), numErrors), count);
+  append(w, buf, 12);
+  append(w, source, nameLen);
+
+  for (int i = 0; i < count; i++) {
+    size_t memberLen = strlen(members[i].name) + 1;
+
+    put_u32(put_u32(buf, memberLen), members[i].length);
+    append(w, buf, 8);
+    append(w, members[i].name, memberLen);
+    append(w, members[i].data, members[i].length);
+  }
+
+  if (w->numEntries == w->capEntries) {
+    w->capEntries = 2 * w->capEntries + 64;
+    w->index      = mem_realloc(MEM_OUTPUT, w->index,
+                                w->capEntries * ARCHIVE_INDEX_ENTRY);
+  }
+
+  unsigned char* p = w->index + w->numEntries++ * ARCHIVE_INDEX_ENTRY;
+
+  put_u32(put_u32(put_u64(p, start), w->pos - start), numErrors);
+  return w->error == 0;
+}
+
+int archive_close (archive_writer_t* w) {
+  unsigned char trailer[ARCHIVE_TRAILER];
+
+  put_u32(put_u64(trailer, w->pos), w->numEntries);
+  memcpy(trailer + 12, "LC3Z", 4);
+  append(w, w->index, (size_t) w->numEntries * ARCHIVE_INDEX_ENTRY);
+  append(w, trailer, sizeof(trailer));
+
+  // one sync for the whole batch
+  if (w->error == 0 && (fflush(w->f) != 0 || fsync(fileno(w->f)) != 0))
+    w->error = errno;
+
+  if (fclose(w->f) != 0 && w->error == 0)
+    w->error = errno;
+
+  int error = w->error;
+
+  mem_free(w->index);
+  mem_free(w);
+  return error;
+}
+
+int archive_open (const char* file_name, lc3_archive_t* ar) {
+  struct stat st;
+  int         fd = open(file_name, O_RDONLY);
+
+  memset(ar, 0, sizeof(lc3_archive_t));
+
+  if (fd < 0)
+    return errno;
+
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    return error;
+  }
+
+  if (st.st_size < ARCHIVE_HEADER + ARCHIVE_TRAILER) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t         length = st.st_size;
+  unsigned char* data   = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping stays valid
+
+  if (data == MAP_FAILED)
+    return errno;
+
+  uint64_t indexOffset = check_trailer(data, data + length - ARCHIVE_TRAILER,
+                                       length);
+
+  if (indexOffset == 0) {
+    munmap(data, length);
+    return EINVAL;
+  }
+
+  ar->data       = data;
+  ar->length     = length;
+  ar->index      = data + indexOffset;
+  ar->numEntries = get_u32(data + length - ARCHIVE_TRAILER + 8);
+  return 0;
+}
+
+int archive_entry (lc3_archive_t* ar, int i, archive_entry_t* entry) {
+  if (i < 0 || i >= ar->numEntries)
+    return 0;
+
+  const unsigned char* p      = ar->index + (size_t) i * ARCHIVE_INDEX_ENTRY;
+  uint64_t             offset = get_u64(p);
+  uint64_t             length = get_u32(p + 8);
+  uint64_t             limit  = ar->index - ar->data;
+
+  if (offset < ARCHIVE_HEADER || offset > limit || length < 12 ||
+      length > limit - offset)
+    return 0;
+
+  const unsigned char* start   = ar->data + offset;
+  uint32_t             nameLen = get_u32(start);
+
+  if (nameLen == 0 || nameLen > length - 12 || start[12 + nameLen - 1] != 0)
+    return 0;
+
+  entry->source     = (const char*) start + 12;
+  entry->numErrors  = get_u32(start + 4);
+  entry->numMembers = get_u32(start + 8);
+  entry->members    = start + 12 + nameLen;
+  entry->end        = start + length;
+  return 1;
+}
+
+int archive_find (lc3_archive_t* ar, const char* source) {
+  archive_entry_t entry;
+
+  for (int i = ar->numEntries - 1; i >= 0; i--) {
+    if (archive_entry(ar, i, &entry) && strcmp(entry.source, source) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+const unsigned char* archive_next_member (archive_entry_t* entry,
+                                          const unsigned char* pos,
+                                          archive_member_t* member) {
+  if (pos == NULL || entry->end - pos < 8)
+    return NULL;
+
+  size_t left    = entry->end - pos - 8;
+  size_t nameLen = get_u32(pos);
+  size_t dataLen = get_u32(pos + 4);
+
+  if (nameLen == 0 || nameLen > left || dataLen > left - nameLen ||
+      pos[8 + nameLen - 1] != 0)
+    return NULL;
+
+  member->name   = (const char*) pos + 8;
+  member->data   = (const char*) pos + 8 + nameLen;
+  member->length = dataLen;
+  return pos + 8 + nameLen + dataLen;
+}
+
+int archive_find_member (archive_entry_t* entry, const char* suffix,
+                         archive_member_t* member) {
+  const unsigned char* pos       = entry->members;
+  size_t               suffixLen = strlen(suffix);
+
+  while ((pos = archive_next_member(entry, pos, member)) != NULL) {
+    size_t nameLen = strlen(member->name);
+
+    if (nameLen >= suffixLen &&
+        strcmp(member->name + nameLen - suffixLen, suffix) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+void archive_unmap (lc3_archive_t* ar) {
+  if (ar->data != NULL)
+    munmap((void*) ar->data, ar->length);
+
+  memset(ar, 0, sizeof(lc3_archive_t));
+}
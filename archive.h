@@ -0,0 +1,163 @@
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+/** @file archive.h
+ *  @brief interface to the archive of the results of a batch
+ *  @details Selected by <code>mylc3as --archive file.lc3a</code>: instead of
+ *  writing the outputs of each source to files of their own, a batch (see
+ *  <code>batch.h</code>) appends one entry per source to a single archive,
+ *  holding its outputs (<code>.obj</code>, <code>.sym</code> ...) and its
+ *  diagnostics. A batch of thousands of small sources then creates one
+ *  file, and a grader or a simulator maps it once instead of walking a
+ *  directory tree.
+ *  <p>
+ *  The archive is only appended to. All integers are little-endian:
+ *  <pre>
+ *  "LC3A" version 0 0 0                  identifies the format (version 1)
+ *  entry*                                one per source assembled:
+ *    nameLength numErrors numMembers     name of the source, its errors
+ *    name                                (failed sources are kept too)
+ *    (nameLength length name data)*      each output, named as the file it
+ *                                        replaces, and the diagnostics
+ *                                        (named after the source, .diag)
+ *  index                                 for each entry, in order:
+ *    offset(64) length numErrors         where it starts and its size
+ *  trailer                               the last 16 bytes of the file:
+ *    indexOffset(64) numEntries "LC3Z"
+ *  </pre>
+ *  Integers are 32 bits unless noted, and names are followed by a 0, so
+ *  they can be used in place. A later batch appends its entries after the
+ *  trailer, then an index of all entries and a new trailer, so the archive
+ *  is valid at every step even if the batch stops, and a reader only looks
+ *  at the last trailer. When a source is in the archive several times, its
+ *  last entry is the current one.
+ *  <p>
+ *  The reader maps the archive and returns pointers into the mapping, so
+ *  reading an entry copies nothing. The tool <code>lc3ar</code> lists an
+ *  archive and extracts its entries to files.
+ */
+
+#include <stddef.h>
+
+/** Version of the format written */
+#define ARCHIVE_VERSION 1
+
+/** Bytes of the header at the start of the archive */
+#define ARCHIVE_HEADER 8
+
+/** Bytes of the trailer at the end of the archive */
+#define ARCHIVE_TRAILER 16
+
+/** Bytes of an entry of the index */
+#define ARCHIVE_INDEX_ENTRY 16
+
+/** Typedef of structure type */
+typedef struct archive_member archive_member_t;
+
+/** An output of a source, or its diagnostics */
+struct archive_member {
+  const char* name;    /**< name of the file it replaces */
+  const char* data;    /**< its content                  */
+  size_t      length;  /**< number of bytes of data      */
+};
+
+/** Typedef of structure type */
+typedef struct archive_writer archive_writer_t;
+
+/** Open an archive to append entries, creating it if it does not exist
+ *  @param file_name - name of the archive
+ *  @param writer - set to the writer, to close with
+ *  <code>archive_close()</code>
+ *  @return 0 on success, else the errno value of the failure (EINVAL if the
+ *  file exists and is not an archive)
+ */
+int archive_create (const char* file_name, archive_writer_t** writer);
+
+/** Append the entry of a source
+ *  @param writer - the writer
+ *  @param source - name of the source
+ *  @param numErrors - the number of errors found
+ *  @param members - the outputs and diagnostics
+ *  @param count - the number of members
+ *  @return 1 on success, 0 on a write error
+ */
+int archive_add (archive_writer_t* writer, const char* source, int numErrors,
+                 archive_member_t* members, int count);
+
+/** Write the index and the trailer, and close the archive
+ *  @param writer - the writer, freed
+ *  @return 0 on success, else the errno value of the failure (also of an
+ *  earlier <code>archive_add()</code>)
+ */
+int archive_close (archive_writer_t* writer);
+
+/** Typedef of structure type */
+typedef struct lc3_archive lc3_archive_t;
+
+/** An archive opened by <code>archive_open()</code> */
+struct lc3_archive {
+  const unsigned char* data;        /**< the mapped file              */
+  size_t               length;      /**< its length                   */
+  const unsigned char* index;       /**< the index, in the mapping    */
+  int                  numEntries;  /**< number of entries            */
+};
+
+/** Typedef of structure type */
+typedef struct archive_entry archive_entry_t;
+
+/** The entry of a source, read by <code>archive_entry()</code> */
+struct archive_entry {
+  const char*          source;      /**< name of the source            */
+  int                  numErrors;   /**< errors found in it            */
+  int                  numMembers;  /**< number of members             */
+  const unsigned char* members;     /**< the first member, in the map  */
+  const unsigned char* end;         /**< end of the entry              */
+};
+
+/** Open and map an archive
+ *  @param file_name - name of the archive
+ *  @param ar - set to the archive, to close with
+ *  <code>archive_unmap()</code>
+ *  @return 0 on success, else the errno value of the failure (EINVAL if the
+ *  file is not an archive)
+ */
+int archive_open (const char* file_name, lc3_archive_t* ar);
+
+/** Read an entry
+ *  @param ar - the archive
+ *  @param i - the index of the entry, from 0 to <code>numEntries</code> - 1
+ *  @param entry - set to the entry
+ *  @return 1 on success, 0 if the entry is not valid
+ */
+int archive_entry (lc3_archive_t* ar, int i, archive_entry_t* entry);
+
+/** Find the last entry of a source
+ *  @return its index, or -1 if the source is not in the archive
+ */
+int archive_find (lc3_archive_t* ar, const char* source);
+
+/** Read the members of an entry, one after the other
+ *  @param entry - the entry
+ *  @param pos - the position of the member, <code>entry->members</code>
+ *  for the first one, then the value returned
+ *  @param member - set to the member
+ *  @return the position of the next member, or NULL if there is no member
+ *  at <code>pos</code> or it is not valid
+ */
+const unsigned char* archive_next_member (archive_entry_t* entry,
+                                          const unsigned char* pos,
+                                          archive_member_t* member);
+
+/** Find the member of an entry whose name ends with a suffix
+ *  @param entry - the entry
+ *  @param suffix - the end of the name, e.g. ".obj"
+ *  @param member - set to the member
+ *  @return 1 if it was found, 0 otherwise
+ */
+int archive_find_member (archive_entry_t* entry, const char* suffix,
+                         archive_member_t* member);
+
+/** Unmap an archive opened by <code>archive_open()</code> */
+void archive_unmap (lc3_archive_t* ar);
+
+#endif /* __ARCHIVE_H__ */
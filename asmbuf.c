@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "asmbuf.h"
+#include "assembler.h"
+#include "diag.h"
+#include "image.h"
+#include "include.h"
+#include "mem.h"
+#include "objfile.h"
+
+/** Serializes use of the assembler, which is built on global state */
+static pthread_mutex_t bufLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Round a size up so the part that follows it is aligned */
+#define ALIGN_UP(n) (((n) + 7) & ~(size_t) 7)
+
+/** Typedef of structure type */
+typedef struct sym_list sym_list_t;
+
+/** The symbols of the program, collected from the symbol table */
+struct sym_list {
+  asmbuf_symbol_t* syms;       /**< the symbols, names in the table   */
+  int              count;      /**< number of symbols                 */
+  int              capacity;   /**< number of entries allocated       */
+  size_t           nameBytes;  /**< length of the names, with the '\0' */
+};
+
+/** Add a symbol of the table to the list (see symbol_iterate()) */
+static void collect_symbol (symbol_t* sym, void* data) {
+  sym_list_t* list = data;
+
+  if (list->count == list->capacity) {
+    list->capacity = 2 * list->capacity + 16;
+    list->syms     = mem_realloc(MEM_OUTPUT, list->syms,
+                                 list->capacity * sizeof(asmbuf_symbol_t));
+  }
+
+  list->syms[list->count++] = (asmbuf_symbol_t) { sym->name, sym->addr };
+  list->nameBytes          += strlen(sym->name) + 1;
+}
+
+/** Order symbols by address, then by name */
+static int compare_symbol (const void* a, const void* b) {
+  const asmbuf_symbol_t* s1 = a;
+  const asmbuf_symbol_t* s2 = b;
+
+  if (s1->addr != s2->addr)
+    return (s1->addr < s2->addr) ? -1 : 1;
+
+  return strcmp(s1->name, s2->name);
+}
+
+/** Copy the results of the assembly into the block
+ *  @param block - where the results are stored, NULL to only measure them
+ *  @return the size of the block needed
+ */
+static size_t store_results (char* block, asmbuf_result_t* result,
+                             LC3_WORD* words, int numWords,
+                             sym_list_t* list) {
+  size_t wordBytes = ALIGN_UP(numWords * sizeof(LC3_WORD));
+  size_t objBytes  = ALIGN_UP((numWords + 1) * sizeof(LC3_WORD));
+  size_t symBytes  = ALIGN_UP(list->count * sizeof(asmbuf_symbol_t) +
+                              list->nameBytes);
+  int    numDiags  = diag_count();
+  size_t diagBytes = numDiags * sizeof(asmbuf_diag_t);
+
+  for (int i = 0; i < numDiags; i++)
+    diagBytes += diag_format(diag_get(i), NULL, 0) + 1;
+
+  if (block == NULL)
+    return wordBytes + objBytes + symBytes + ALIGN_UP(diagBytes);
+
+  char* p = block;
+
+  // the words, and the object file: the origin and the words, big-endian
+  result->words    = (LC3_WORD*) p;
+  result->numWords = numWords;
+  result->obj      = (unsigned char*) p + wordBytes;
+  result->objLen   = (numWords > 0) ? (numWords + 1) * sizeof(LC3_WORD) : 0;
+
+  if (numWords > 0) {
+    LC3_WORD origin = result->origin;
+
+    memcpy(result->words, words, numWords * sizeof(LC3_WORD));
+    objfile_swap(result->obj, &origin, 1);
+    objfile_swap(result->obj + sizeof(LC3_WORD), words, numWords);
+  }
+
+  p += wordBytes + objBytes;
+
+  // the symbols, then their names
+  char* name = p + list->count * sizeof(asmbuf_symbol_t);
+
+  result->symbols    = (asmbuf_symbol_t*) p;
+  result->numSymbols = list->count;
+
+  for (int i = 0; i < list->count; i++) {
+    int len = strlen(list->syms[i].name) + 1;
+
+    memcpy(name, list->syms[i].name, len);
+    result->symbols[i] = (asmbuf_symbol_t) { name, list->syms[i].addr };
+    name += len;
+  }
+
+  p += symBytes;
+
+  // the diagnostics, then their text
+  char* text = p + numDiags * sizeof(asmbuf_diag_t);
+
+  result->diags    = (asmbuf_diag_t*) p;
+  result->numDiags = numDiags;
+
+  for (int i = 0; i < numDiags; i++) {
+    diag_t* d   = diag_get(i);
+    int     len = diag_format(d, text, diag_format(d, NULL, 0) + 1);
+
+    text[len - 1]    = '\0'; // the newline
+    result->diags[i] = (asmbuf_diag_t) { d->lineNum, d->column, text };
+    text += len + 1;
+  }
+
+  return wordBytes + objBytes + symBytes + ALIGN_UP(diagBytes);
+}
+
+int asmbuf_assemble (const char* src, int length, int maxErrors,
+                     void* buf, size_t size, asmbuf_result_t* result) {
+  sym_list_t list     = { NULL };
+  LC3_WORD*  dense    = NULL;
+  LC3_WORD*  words    = NULL;
+  int        numWords = 0;
+  int        status;
+
+  memset(result, 0, sizeof(asmbuf_result_t));
+  pthread_mutex_lock(&bufLock);
+
+  asm_reset();
+  diag_init(maxErrors);
+  include_allow_files(0); // nothing is read but the buffer
+  asm_pass_one_text(src, length);
+
+  if (numErrors == 0)
+    asm_generate(NULL);
+
+  include_allow_files(1);
+  diag_sort();
+
+  if (numErrors == 0) {
+    words = image_flatten(asm_get_image(), &result->origin, &numWords, &dense);
+    symbol_iterate(lc3_sym_tab, collect_symbol, &list);
+    qsort(list.syms, list.count, sizeof(asmbuf_symbol_t), compare_symbol);
+  }
+
+  result->numErrors = numErrors;
+  result->stopped   = diag_limit_reached();
+  result->size      = store_results(NULL, result, words, numWords, &list);
+
+  if (buf == NULL)
+    buf = result->block = mem_alloc(MEM_OUTPUT, result->size);
+  else if (result->size > size)
+    buf = NULL;
+
+  if (buf == NULL) {
+    status = ASMBUF_TOO_SMALL;
+  }
+  else {
+    store_results(buf, result, words, numWords, &list);
+    status = (numErrors == 0) ? ASMBUF_OK : ASMBUF_ERRORS;
+  }
+
+  diag_init(maxErrors); // the diagnostics were returned
+  pthread_mutex_unlock(&bufLock);
+  mem_free(list.syms);
+  mem_free(dense);
+  return status;
+}
+
+void asmbuf_free (asmbuf_result_t* result) {
+  mem_free(result->block);
+  memset(result, 0, sizeof(asmbuf_result_t));
+}
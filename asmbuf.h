@@ -0,0 +1,110 @@
+#ifndef __ASMBUF_H__
+#define __ASMBUF_H__
+
+/** @file asmbuf.h
+ *  @brief interface to assembling a source held in memory
+ *  @details Tools that already hold the source (fuzzers, graders) call
+ *  <code>asmbuf_assemble()</code> instead of writing a file for the
+ *  assembler to read back. The source is passed as a buffer and the results
+ *  are returned in memory: the words of the program, the bytes of the
+ *  object file, the symbols and the diagnostics. No file is opened (an
+ *  <code>.INCLUDE</code> is an error) and nothing is printed.
+ *  <p>
+ *  Every result is stored in one block of memory, either a buffer given by
+ *  the caller or one allocated by the call and freed by
+ *  <code>asmbuf_free()</code>. A caller assembling many sources can reuse
+ *  one buffer, and the results need no other cleanup. If the buffer given
+ *  is too small, the size needed is returned and the call can be repeated.
+ *  <p>
+ *  The assembler must already be initialized using <code>asm_init()</code>.
+ *  It is built on global state, so calls are serialized.
+ *  <p>
+ *  The globals of the assembler (<code>srcLineNum</code>,
+ *  <code>numErrors</code> ...) are defined by the program, as in
+ *  <code>main.c</code>: exactly one of its files must define
+ *  <code>LC3AS_VAR</code> before including <code>assembler.h</code>.
+ *  <pre><code>
+ *  #define LC3AS_VAR
+ *  #include "assembler.h"
+ *  #include "asmbuf.h"
+ *  </code></pre>
+ *  A fuzzer linking <code>asmbuf.o</code> and the other objects without
+ *  such a file fails to link with these names undefined.
+ */
+
+#include <stddef.h>
+
+#include "lc3.h"
+
+/** The program was assembled without errors */
+#define ASMBUF_OK        0
+
+/** The program contained errors, see the diagnostics */
+#define ASMBUF_ERRORS    1
+
+/** The buffer given is too small, <code>size</code> is the size needed */
+#define ASMBUF_TOO_SMALL 2
+
+/** Typedef of structure type */
+typedef struct asmbuf_symbol asmbuf_symbol_t;
+
+/** A label and its address */
+struct asmbuf_symbol {
+  const char* name;  /**< name of the label      */
+  int         addr;  /**< LC3 address of the label */
+};
+
+/** Typedef of structure type */
+typedef struct asmbuf_diag asmbuf_diag_t;
+
+/** A diagnostic */
+struct asmbuf_diag {
+  int         lineNum;  /**< line in the source (0 if none)           */
+  int         column;   /**< column in the line (0 if unknown)        */
+  const char* text;     /**< the message, as written by the assembler,
+                             without the newline                      */
+};
+
+/** Typedef of structure type */
+typedef struct asmbuf_result asmbuf_result_t;
+
+/** The results of an assembly. Everything it points to is in one block. */
+struct asmbuf_result {
+  int              numErrors;   /**< number of errors found              */
+  int              stopped;     /**< the limit on errors was reached     */
+  int              origin;      /**< LC3 address of the first word      */
+  LC3_WORD*        words;       /**< words of the program, in host order,
+                                     segments laid out as in the object
+                                     file                               */
+  int              numWords;    /**< number of words                     */
+  unsigned char*   obj;         /**< the bytes of the object file        */
+  size_t           objLen;      /**< number of bytes of obj              */
+  asmbuf_symbol_t* symbols;     /**< the labels, ordered by address      */
+  int              numSymbols;  /**< number of labels                    */
+  asmbuf_diag_t*   diags;       /**< the diagnostics, ordered by line    */
+  int              numDiags;    /**< number of diagnostics               */
+  size_t           size;        /**< bytes of the block used (or needed) */
+  void*            block;       /**< the block allocated by the call, or
+                                     NULL if the caller gave a buffer   */
+};
+
+/** Assemble a source held in memory. Words, object file and symbols are
+ *  only set when no errors are found.
+ *  @param src - the source text (it need not end with '\0')
+ *  @param length - the number of characters of the source
+ *  @param maxErrors - the number of errors after which the assembly stops,
+ *  0 for no limit
+ *  @param buf - where the results are stored, or NULL to allocate a block
+ *  @param size - the size of <code>buf</code>
+ *  @param result - set to the results
+ *  @return one of the <code>ASMBUF_*</code> values
+ */
+int asmbuf_assemble (const char* src, int length, int maxErrors,
+                     void* buf, size_t size, asmbuf_result_t* result);
+
+/** Free the block allocated by <code>asmbuf_assemble()</code>, if any
+ *  @param result - the results, cleared on return
+ */
+void asmbuf_free (asmbuf_result_t* result);
+
+#endif /* __ASMBUF_H__ */
@@ -1,15 +1,35 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "assembler.h"
+#include "cost.h"
+#include "dbgmap.h"
+#include "diag.h"
+#include "encode.h"
+#include "expr.h"
 #include "field.h"
+#include "image.h"
+#include "include.h"
+#include "ir.h"
 #include "lc3.h"
+#include "lexer.h"
+#include "listing.h"
+#include "literal.h"
+#include "mem.h"
+#include "opt.h"
+#include "perf.h"
+#include "pool.h"
 #include "symbol.h"
 #include "tokens.h"
 #include "util.h"
+#include "xref.h"
 
 /** Global variable containing the head of the linked list of structures */
 static line_info_t* infoHead;
@@ -20,6 +40,66 @@ static line_info_t* infoTail;
 /** Global variable containing information about the current line */
 static line_info_t* currInfo;
 
+/** Number of errors before the current line was checked */
+static int errorsBefore;
+
+/** The program generated by pass two */
+static lc3_image_t progImage;
+
+/** The source line being assembled, used to locate errors within it */
+static __thread char* currLine;
+
+/** The number of characters in <code>currLine</code> */
+static __thread int currLineLength;
+
+/** Estimated bytes used by the symbol table itself (see mem.h) */
+#define SYM_TABLE_BYTES (SYMBOL_SIZE * sizeof(void*) + 2 * sizeof(void*))
+
+/** Estimated bytes used by the node of a symbol, excluding its name */
+#define SYM_NODE_BYTES  (2 * sizeof(void*) + sizeof(symbol_t))
+
+/** Estimated bytes used by the symbols added since the last reset */
+static long symbolBytes;
+
+/** Number of symbols added since the last reset */
+static int symbolCount;
+
+/** An operand of .ORIG or .BLKW depends on the address of a label, so the
+ *  addresses cannot be recomputed after the optimizer changes the code
+ */
+static int layoutUsesLabels;
+
+/** Set by asm_set_pool_strings(): pass one pools the strings (see pool.h) */
+static int poolStrings;
+
+/** The literals of LD of the current block (see literal.h) */
+static lit_pool_t lits;
+
+/** The line before the current line, a pool closing the block goes after it */
+static line_info_t* prevInfo;
+
+/** Protects the symbol table and the constants, which the threads of the
+ *  pipelined assembler (see pipeline.h) share
+ */
+static pthread_mutex_t symLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** The included file being parsed (see include.h), or NULL */
+static inc_unit_t* unit;
+
+/** The text of the source file, read once by pass one */
+static char* srcText;
+
+/** The number of characters in <code>srcText</code> */
+static int srcLength;
+
+/** Length of a source line without its line terminator */
+static int text_length (const char* text, int length) {
+  while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == '\r'))
+    length--;
+
+  return length;
+}
+
 void asm_init_line_info (line_info_t* info) {
   if (info) {
     info->next        = NULL;
@@ -33,6 +113,14 @@ void asm_init_line_info (line_info_t* info) {
     info->reg3        = -1;
     info->immediate   = 0;
     info->reference   = NULL;
+    info->immWidth    = 0;
+    info->immSigned   = 0;
+    info->label       = NULL;
+    info->srcOffset   = 0;
+    info->srcLength   = 0;
+    info->srcFile     = srcFileNum;
+    info->pooledIn    = NULL;
+    info->literal     = NULL;
   }
 }
 
@@ -45,298 +133,1279 @@ void asm_print_line_info (line_info_t* info) {
   }
 }
 
+/** Find the column of the token that is the argument of an error message
+ *  in the line being assembled.
+ *  @return the column (1 based), or 0 if it can not be found
+ */
+static int error_column (char* msg, va_list args) {
+  char* conv = strchr(msg, '%');
+
+  if (currLine == NULL || conv == NULL || conv[1] != 's')
+    return 0;
+
+  char*        token = va_arg(args, char*);
+  int          len   = (token != NULL) ? strlen(token) : 0;
+  lex_token_t* curr  = lex_current();
+
+  if (curr != NULL && token == curr->text)
+    return curr->column;
+
+  for (int col = 0; len > 0 && col + len <= currLineLength; col++) {
+    if (strncmp(currLine + col, token, len) == 0)
+      return col + 1;
+  }
+
+  return 0;
+}
+
 /* based on code from http://www.eskimo.com/~scs/cclass/int/sx11c.html */
 void asm_error (char* msg, ...) {
- numErrors++;
- va_list argp;
- fprintf(stderr, "ERROR %3d: ", srcLineNum);
+ __atomic_add_fetch(&numErrors, 1, __ATOMIC_RELAXED);
+ va_list argp, copy;
  va_start(argp, msg);
- vfprintf(stderr, msg, argp);
+ va_copy(copy, argp);
+ int column = error_column(msg, copy);
+ va_end(copy);
+ if (srcFileNum != 0)
+   diag_report(include_source_line(srcFileNum, srcLineNum),
+               include_unit(srcFileNum)->name, srcLineNum, column, msg, argp);
+ else
+   diag_report(srcLineNum, NULL, 0, column, msg, argp);
  va_end(argp);
- fprintf(stderr, "\n");
 }
 
 void asm_init (void) {
   infoHead = infoTail = currInfo = NULL; 
-  tokens_init();
+  image_init(&progImage, 0);
+  encode_init();
   lc3_sym_tab = symbol_init(0); 
+  mem_note(MEM_SYMBOL, SYM_TABLE_BYTES, 1);
+}
+
+/** Signature of a function that writes the content of an output file */
+typedef int (*write_fnc_t)(FILE* f, void* data);
+
+/** Write the symbol table (data is unused) */
+static int write_sym_file (FILE* f, void* data) {
+  lc3_write_sym_table(f);
+  return ! ferror(f);
+}
+
+/** Write an image as a binary object file */
+static int write_obj_file (FILE* f, void* data) {
+  return image_write_obj(f, (lc3_image_t*) data);
+}
+
+/** Write an image as a compact object file */
+static int write_sobj_file (FILE* f, void* data) {
+  return image_write_sobj(f, (lc3_image_t*) data);
+}
+
+/** Write the static cost report of the lines found by pass one */
+static int write_cost_file (FILE* f, void* data) {
+  return cost_write(f, (line_info_t*) data);
+}
+
+/** Write the debug map of the lines found by pass one */
+static int write_dbg_file (FILE* f, void* data) {
+  return dbgmap_write(f, (line_info_t*) data);
+}
+
+/** Write the cross-reference index of the lines found by pass one */
+static int write_xref_file (FILE* f, void* data) {
+  return xref_write(f, (line_info_t*) data);
+}
+
+/** Write the intermediate representation of the lines found by pass one */
+static int write_ir_file (FILE* f, void* data) {
+  return ir_write(f, (line_info_t*) data, srcText, srcLength,
+                  layoutUsesLabels ? IR_LAYOUT_USES_LABELS : 0);
+}
+
+/** Write an image as a hex file */
+static int write_hex_file (FILE* f, void* data) {
+  return image_write_hex(f, (lc3_image_t*) data);
+}
+
+/** Function receiving the outputs, or NULL to write them to files */
+static asm_output_fnc_t outputFnc;
+
+void asm_set_output_fnc (asm_output_fnc_t fnc) {
+  outputFnc = fnc;
+}
+
+/** Open an output file, or a memory stream if outputs go to the function
+ *  set by <code>asm_set_output_fnc()</code>
+ *  @param file_name - name of the output file
+ *  @param data - set to the text of the memory stream when it is closed
+ *  @param length - set to the length of the text when it is closed
+ *  @return the stream, or NULL on error (reported)
+ */
+static FILE* open_output (char* file_name, char** data, size_t* length) {
+  if (outputFnc == NULL)
+    return open_write_or_error(file_name);
+
+  *data = NULL;
+  FILE* f = open_memstream(data, length);
+
+  if (f == NULL)
+    asm_error(ERR_OPEN_WRITE, file_name);
+
+  return f;
+}
+
+/** Close a stream returned by <code>open_output()</code>, passing the text
+ *  of a memory stream to the output function. Errors are reported.
+ *  @param ok - the content was written without error
+ */
+static void close_output (FILE* f, char* file_name, char** data,
+                          size_t* length, int ok) {
+  if (fclose(f) != 0 || ! ok) {
+    asm_error(ERR_WRITE, file_name);
+    ok = 0;
+  }
+
+  if (outputFnc != NULL) {
+    if (ok)
+      outputFnc(file_name, *data, *length); // which now owns the text
+    else
+      free(*data);
+  }
+}
+
+/** Open an output file, fill it using the writer and close it. Errors are
+ *  reported using <code>asm_error()</code>.
+ */
+static void write_file (char* file_name, write_fnc_t writer, void* data) {
+  char*  text;
+  size_t length;
+  FILE*  f = open_output(file_name, &text, &length);
+
+  if (f != NULL)
+    close_output(f, file_name, &text, &length, writer(f, data));
+}
+
+/** Read the entire source file into memory. The text is kept until
+ *  <code>asm_term()</code> so that pass two can refer back to it.
+ *  @param file_name - name of the source file
+ *  @return 1 on success, 0 on error
+ */
+static int read_source_or_error (char* file_name) {
+  FILE* fp = open_read_or_error(file_name);
+
+  if (fp == NULL)
+    return 0;
+
+  int   capacity = 8192;
+  char* text     = mem_alloc(MEM_SOURCE, capacity);
+  int   length   = 0;
+  int   count;
+
+  while ((count = fread(text + length, 1, capacity - length - 1, fp)) > 0) {
+    length += count;
+
+    if (length == capacity - 1) {
+      capacity *= 2;
+      text = mem_realloc(MEM_SOURCE, text, capacity);
+    }
+  }
+
+  fclose(fp);
+  text[length] = '\0';
+  mem_free(srcText);
+  srcText   = text;
+  srcLength = length;
+  return 1;
+}
+
+/** The addresses occupied by one <code>.ORIG</code> block */
+typedef struct block {
+  int start;    /**< address of the first word        */
+  int end;      /**< address after the last word      */
+  int lineNum;  /**< line of the <code>.ORIG</code>   */
+} block_t;
+
+/** Order blocks by their start address */
+static int compare_block (const void* a, const void* b) {
+  return ((const block_t*) a)->start - ((const block_t*) b)->start;
+}
+
+/** Report every <code>.ORIG</code> block that shares addresses with a
+ *  block starting before it. Empty blocks never overlap.
+ */
+static void check_blocks (void) {
+  int numBlocks = 0;
+
+  for (line_info_t* info = infoHead; info != NULL; info = info->next) {
+    if (info->opcode == OP_ORIG)
+      numBlocks++;
+  }
+
+  if (numBlocks < 2)
+    return;
+
+  block_t* blocks = mem_alloc(MEM_LINE_INFO, numBlocks * sizeof(block_t));
+  block_t* curr   = NULL;
+  int      n      = 0;
+
+  for (line_info_t* info = infoHead; info != NULL; info = info->next) {
+    if (info->opcode == OP_ORIG) {
+      curr          = &blocks[n++];
+      curr->start   = curr->end = info->address;
+      curr->lineNum = info->lineNum;
+    }
+    else if (info->opcode == OP_END) {
+      curr = NULL;
+    }
+    else if (curr != NULL && line_size(info) > 0) {
+      curr->end = info->address + line_size(info);
+    }
+  }
+
+  qsort(blocks, numBlocks, sizeof(block_t), compare_block);
+
+  block_t* last = NULL; // the block reaching the highest address so far
+
+  for (int i = 0; i < numBlocks; i++) {
+    block_t* b = &blocks[i];
+
+    if (b->end == b->start)
+      continue;
+
+    if (last != NULL && b->start < last->end) {
+      int later   = (b->lineNum > last->lineNum);
+      srcLineNum  = later ? b->lineNum : last->lineNum;
+      asm_error(ERR_SEG_OVERLAP, later ? last->lineNum : b->lineNum);
+    }
+
+    if (last == NULL || b->end > last->end)
+      last = b;
+  }
+
+  srcLineNum = 0;
+  mem_free(blocks);
+}
+
+/** Determine if a value fits in an immediate field. A 16 bit field holds
+ *  either a signed or an unsigned value.
+ */
+static int immediate_fits (int value, int width, int isSigned) {
+  return fieldFits(value, width, isSigned) ||
+         (width == 16 && fieldFits(value, 16, 0));
+}
+
+/** Evaluate the immediates that were given by a constant, label or
+ *  expression, once every constant has been resolved
+ */
+static void resolve_immediates (void) {
+  expr_resolve();
+
+  for (line_info_t* info = infoHead; info != NULL; info = info->next) {
+    if (info->immWidth == 0)
+      continue;
+
+    int value;
+    srcLineNum = info->lineNum;
+    srcFileNum = info->srcFile;
+
+    if (! expr_eval(info->reference, &value))
+      continue;
+
+    if (immediate_fits(value, info->immWidth, info->immSigned))
+      info->immediate = value;
+    else
+      asm_error(ERR_IMM_TOO_BIG, info->reference);
+  }
+
+  srcLineNum = 0;
+  srcFileNum = 0;
+}
+
+/** Place the literals waiting for a pool (see literal.h) after a line
+ *  @param after - the line
+ *  @param addr - the address after the line
+ */
+static void place_literals (line_info_t* after, int addr) {
+  int words = lit_place(&lits, after, addr);
+
+  if (words == 0)
+    return;
+
+  currAddr += words;
+
+  while (infoTail->next != NULL)
+    infoTail = infoTail->next;
+}
+
+line_info_t* asm_scan_line (int pos, int end, line_info_t** last) {
+  char         line[MAX_LINE_LENGTH];
+  lex_token_t* token      = NULL;
+  int          lineLength = end - pos;
+  line_info_t* first      = NULL;
+
+  srcLineNum++;
+  currInfo = NULL;
+
+  if (lineLength >= MAX_LINE_LENGTH) {
+    asm_error(ERR_LINE_TOO_LONG, MAX_LINE_LENGTH - 1);
+    return NULL;
+  }
+
+  memcpy(line, srcText + pos, lineLength);
+  line[lineLength] = '\0';
+  currLine       = srcText + pos;
+  currLineLength = lineLength;
+  //convert to a list of classified tokens
+  token = lex_line (line);
+  //while my token is not null
+  if(token != NULL){
+    //allocate memory currInfo
+    currInfo = mem_alloc(MEM_LINE_INFO, sizeof(struct line_info));
+    //idk what this does but i'm doing it
+    asm_init_line_info(currInfo);
+    currInfo->srcOffset = pos;
+    currInfo->srcLength = text_length(srcText + pos, lineLength);
+    prevInfo            = infoTail;
+
+    //set up link list, before the lines of a .INCLUDE
+    if(infoHead == NULL){
+      infoHead = currInfo;
+      infoTail = currInfo;
+    } else{
+      //get the next of the info tail
+      infoTail -> next= currInfo;
+      //set it equal to currinfo
+      infoTail = currInfo;
+    }
+
+    //check line syntax
+    errorsBefore = numErrors;
+
+    if(unit == NULL) // else the lock is held by the line including it
+      pthread_mutex_lock(&symLock);
+
+    check_line_syntax(token);
+
+    if(unit == NULL)
+      pthread_mutex_unlock(&symLock);
+
+    update_address();
+
+    // a pool closing the block is before the line
+    first = (prevInfo != NULL) ? prevInfo->next : infoHead;
+  }
+
+  currLine = NULL;
+
+  if (last != NULL)
+    *last = infoTail;
+
+  return first;
+}
+
+line_info_t* asm_scan_end (line_info_t** last) {
+  line_info_t* before = infoTail;
+
+  pthread_mutex_lock(&symLock);
+
+  if (infoTail != NULL)
+    place_literals(infoTail, currAddr);
+
+  pthread_mutex_unlock(&symLock);
+
+  if (last != NULL)
+    *last = infoTail;
+
+  return (infoTail != before) ? before->next : NULL;
+}
+
+void asm_scan_finish (void) {
+  pthread_mutex_lock(&symLock);
+  check_blocks();
+  resolve_immediates();
+
+  if (poolStrings && numErrors == 0 && ! layoutUsesLabels &&
+      pool_run(infoHead) > 0) {
+    while (infoTail->next != NULL) // copies may be added at the end
+      infoTail = infoTail->next;
+
+    asm_layout();
+    check_blocks();
+    resolve_immediates(); // e.g. .FILL of a label that moved
+  }
+
+  pthread_mutex_unlock(&symLock);
+}
+
+void asm_set_pool_strings (int enable) {
+  poolStrings = enable;
+}
+
+/** Assemble the lines of <code>srcText</code>, checking their syntax,
+ *  building the symbol table and the list of <code>line_info_t</code>.
+ */
+static void scan_source (void) {
+  int end;
+
+  for (int pos = 0; pos < srcLength && ! diag_limit_reached(); pos = end) {
+    char* eol = memchr(srcText + pos, '\n', srcLength - pos);
+    end = (eol != NULL) ? (eol - srcText) + 1 : srcLength;
+    asm_scan_line(pos, end, NULL);
+  }
+
+  asm_scan_end(NULL);
+  asm_scan_finish();
+}
+
+char* asm_source_buffer (int length) {
+  mem_free(srcText);
+  srcText   = mem_calloc(MEM_SOURCE, length + 1, 1);
+  srcLength = length;
+  return srcText;
 }
 
 /** @todo implement this function */
 //done
 void asm_pass_one (char* asm_file_name, char* sym_file_name) {
-	char line[MAX_LINE_LENGTH];
-	char* token = NULL;	
-	//open the souce file
-	FILE* fp = open_read_or_error(asm_file_name);
-	//while there are still lines to read
-	//call fgets to store the fp into line	
-	while(fgets(line,MAX_LINE_LENGTH,fp)){	
-    printf("%s",line);
-		//convert to a list of tokens
-		token = tokenize_line (line);
-    //while my token is not null
-    if(token != NULL){
-      //if(util_get_opcode(token) != -1){
-      //allocate memory currInfo
-      currInfo = malloc(sizeof(struct line_info));
-      //idk what this does but i'm doing it
-      asm_init_line_info(currInfo);
-
-      //check line syntax
-      check_line_syntax(token);
-      update_address();
-      
-      //set up link list
-      
-        if(infoHead == NULL){
-          infoHead = currInfo;
-          infoTail = currInfo;
-        } else{
-          //if the head is not null;
-          //temp to inc count
-          //get the next of the info tail
-          infoTail -> next= currInfo;
-          //set it equal to currinfo
-          infoTail = currInfo;
-          //inc that address
-        }
-      //} 
-    }
+	//read the whole souce file, lines are taken from the buffer
+	if (! read_source_or_error(asm_file_name))
+		return;
+
+  include_set_source(asm_file_name);
+  scan_source();
+  //write the symbol table file
+  if(numErrors == 0 && sym_file_name != NULL){
+    write_file(sym_file_name, write_sym_file, NULL);
+  }
+}
+
+void asm_pass_one_text (const char* text, int length) {
+  mem_free(srcText);
+  srcText   = mem_alloc(MEM_SOURCE, length + 1);
+  srcLength = length;
+  memcpy(srcText, text, length);
+  srcText[length] = '\0';
+  scan_source();
+}
+
+/** Place the word(s) generated by a line in the image */
+static void emit_line (lc3_image_t* image, line_info_t* info) {
+  switch (info->opcode) {
+    case OP_ORIG:
+      image_start_segment(image, info->immediate);
+      break;
+    case OP_BLKW:
+      image_add_words(image, 0, info->immediate);
+      break;
+    case OP_NEG:
+      image_add_word(image, info->machineCode);
+      image_add_word(image, ENCODE_NEG_ADD(info->reg1));
+      break;
+    case OP_STRINGZ:
+      // reference keeps the quotes, so skip the first and last character
+      for (char* c = info->reference + 1; c[1] != '\0'; c++)
+        image_add_word(image, (unsigned char) *c);
+      image_add_word(image, 0);
+      break;
+    default:
+      image_add_word(image, info->machineCode);
+      break;
   }
-  //write the symbol talble file 
-  if(numErrors == 0){
-    lc3_write_sym_table(fp);
+}
+
+/** Set by asm_generate_line(): lines between .END and the next .ORIG are
+ *  ignored. Lines before the first .ORIG are assembled at x0000.
+ */
+static int inBlock;
+
+void asm_generate_begin (FILE* lst) {
+  image_term(&progImage);
+  inBlock = 1;
+
+  if (lst != NULL)
+    listing_start(lst, srcText, srcLength);
+}
+
+void asm_generate_line (line_info_t* info, FILE* lst) {
+  if (info->opcode == OP_END)
+    inBlock = 0;
+  else if (info->opcode == OP_ORIG)
+    inBlock = 1;
+
+  if (! inBlock)
+    return;
+
+  srcLineNum     = info->lineNum;
+  srcFileNum     = info->srcFile;
+  currLine       = srcText + info->srcOffset;
+  currLineLength = info->srcLength;
+
+  if (info->srcFile != 0)
+    currLine = (char*) include_line_text(info, &currLineLength);
+
+  if (info->opcode == OP_INVALID) { // line containing only a label
+    if (lst != NULL)
+      listing_write_line(lst, info, NULL, 0);
+    return;
   }
-  fclose(fp);
+
+  pthread_mutex_lock(&symLock);
+  encode_line(info);
+  pthread_mutex_unlock(&symLock);
+
+  int first = progImage.numWords;
+  emit_line(&progImage, info);
+
+  if (lst != NULL)
+    listing_write_line(lst, info, progImage.words + first,
+                       progImage.numWords - first);
 }
 
+void asm_generate_end (FILE* lst) {
+  srcLineNum = 0;
+  srcFileNum = 0;
+  currLine   = NULL;
 
-/** @todo implement this function */
-void asm_pass_two (char* obj_file_name) {
-	//do?
-  FILE* fw = open_write_or_error(obj_file_name);
-  for(currInfo = infoHead; currInfo->opcode != 17; currInfo = currInfo->next){
-    
-    //asm_print_line_info(currInfo);
-    LC3_inst_t* inst = lc3_get_inst_info(currInfo -> opcode);
-    printf("WHY IS ADD WRONG %p\n", inst);
-    operands_t operands = inst->forms[currInfo->form].operands;
-   printf("form is: %d\n", currInfo->form);
-    currInfo->machineCode = inst->forms[currInfo->form].prototype;
-    for (operand_t op = FMT_R1; op <= FMT_STR; op <<= 1) {
-        if(op & operands){
-          printf("op is %d\n", op );
-          if(currInfo->opcode == OP_BR){
-            currInfo->machineCode = setField(currInfo->machineCode,11,9,currInfo->reg1);
-            encode_PC_offset_or_error(9);
-          }
-
-          encode_operand(op);
-         // printf("making it?\n");
-        }
+  if (lst != NULL)
+    listing_finish(lst, infoHead);
+}
+
+void asm_generate (FILE* lst) {
+  asm_generate_begin(lst);
+
+  for (line_info_t* info = infoHead;
+       info != NULL && ! diag_limit_reached(); info = info->next)
+    asm_generate_line(info, lst);
+
+  asm_generate_end(lst);
+}
+
+/** Store the address of the label of a line in the symbol table */
+static void move_label (line_info_t* info) {
+  symbol_t* sym = symbol_find_by_name(lc3_sym_tab, info->label);
+
+  if (sym != NULL)
+    sym->addr = info->address;
+}
+
+void asm_layout (void) {
+  int addr   = 0;
+  int pooled = 0;
+
+  for (line_info_t* info = infoHead; info != NULL; info = info->next) {
+    if (info->opcode == OP_ORIG)
+      addr = info->immediate;
+
+    info->address = addr;
+    addr         += line_size(info);
+    pooled       |= (info->pooledIn != NULL);
+
+    if (info->label != NULL)
+      move_label(info);
+  }
+
+  // a pooled string is in a copy placed after it (see pool.h)
+  for (line_info_t* info = infoHead; pooled && info != NULL;
+       info = info->next) {
+    if (info->pooledIn != NULL) {
+      info->address = info->pooledIn->address + info->immediate;
+
+      if (info->label != NULL)
+        move_label(info);
     }
-    asm_print_line_info(currInfo);
-    if(currInfo->opcode == OP_BLKW){
-      for(int i = 0; i < currInfo->immediate;i++){
-        lc3_write_LC3_word(fw,0000);
-      }
-    }else{
-     lc3_write_LC3_word(fw,currInfo->machineCode);
-      }
+  }
+
+  expr_invalidate();
+  expr_resolve();
+}
+
+void asm_write_sym (char* sym_file_name) {
+  write_file(sym_file_name, write_sym_file, NULL);
+}
+
+int asm_optimize (void) {
+  if (numErrors != 0 || layoutUsesLabels)
+    return -1;
+
+  int changes = opt_run(infoHead);
+
+  while (infoTail != NULL && infoTail->next != NULL) // lines may be added
+    infoTail = infoTail->next;
+
+  if (changes > 0) {
+    check_blocks();
+    resolve_immediates(); // e.g. .FILL of a label that moved
+  }
+
+  return changes;
+}
+
+int asm_get_target (line_info_t* info, int* target) {
+  if (info->literal != NULL) {
+    *target = info->literal->address;
+    return 1;
+  }
 
+  if (info->reference == NULL) {
+    *target = info->address + 1 + info->immediate;
+    return 1;
   }
+
+  return expr_eval_quiet(info->reference, target);
+}
+
+int asm_can_encode (line_info_t* info) {
+  if (__atomic_load_n(&numErrors, __ATOMIC_RELAXED) != 0 ||
+      info->immWidth != 0)
+    return 0;
+
+  if (info->literal != NULL && info->opcode == OP_LD) {
+    pthread_mutex_lock(&symLock); // the literal may not be placed yet
+
+    int addr = info->literal->address;
+    int ok   = addr >= 0 && fieldFits(addr - info->address - 1, 9, 1);
+
+    pthread_mutex_unlock(&symLock);
+    return ok;
+  }
+
+  if (info->reference == NULL || info->opcode == OP_STRINGZ)
+    return 1;
+
+  if (expr_is_expression(info->reference))
+    return 0;
+
+  pthread_mutex_lock(&symLock);
+
+  symbol_t* sym   = NULL;
+  int       width = (info->opcode == OP_JSR_JSRR) ? 11 : 9;
+
+  if (! expr_is_constant(info->reference))
+    sym = symbol_find_by_name(lc3_sym_tab, info->reference);
+
+  int ok = (sym != NULL) && // not a forward reference
+           fieldFits(sym->addr - info->address - 1, width, 1);
+
+  pthread_mutex_unlock(&symLock);
+  return ok;
+}
+
+lc3_image_t* asm_get_image (void) {
+  return &progImage;
+}
+
+void asm_pass_two (asm_outputs_t* outputs) {
+  FILE*  lst = NULL;
+  char*  text;
+  size_t length;
+
+  if (outputs->lst_file_name != NULL)
+    lst = open_output(outputs->lst_file_name, &text, &length);
+
+  asm_generate(lst);
+
+  if (lst != NULL)
+    close_output(lst, outputs->lst_file_name, &text, &length, 1);
+
+  asm_write_outputs(outputs);
+}
+
+void asm_write_outputs (asm_outputs_t* outputs) {
+  perf_set_phase(PERF_OUTPUT);
+
+  if (numErrors == 0) {
+    if (outputs->obj_file_name != NULL)
+      write_file(outputs->obj_file_name, write_obj_file, &progImage);
+
+    if (outputs->hex_file_name != NULL)
+      write_file(outputs->hex_file_name, write_hex_file, &progImage);
+
+    if (outputs->sobj_file_name != NULL)
+      write_file(outputs->sobj_file_name, write_sobj_file, &progImage);
+
+    if (outputs->cost_file_name != NULL)
+      write_file(outputs->cost_file_name, write_cost_file, infoHead);
+
+    if (outputs->dbg_file_name != NULL)
+      write_file(outputs->dbg_file_name, write_dbg_file, infoHead);
+
+    if (outputs->xref_file_name != NULL)
+      write_file(outputs->xref_file_name, write_xref_file, infoHead);
+
+    if (outputs->ir_file_name != NULL)
+      write_file(outputs->ir_file_name, write_ir_file, infoHead);
+  }
+}
+
+/** Free the lines, symbols, constants, literals, inclusions and image of
+ *  the last program, and clear the state of the assembly
+ */
+void asm_reset (void) {
+  line_info_t* next;
+
+  for (line_info_t* info = infoHead; info != NULL; info = next) {
+    next = info->next;
+    mem_free(info->reference);
+    mem_free(info->label);
+    mem_free(info);
+  }
+
+  infoHead = infoTail = currInfo = NULL;
+  symbol_reset(lc3_sym_tab);
+  expr_reset();
+  mem_note(MEM_SYMBOL, -symbolBytes, -2 * symbolCount);
+  symbolBytes = symbolCount = 0;
+  image_term(&progImage);
+  mem_free(srcText);
+  srcText    = NULL;
+  srcLength  = 0;
+  currAddr   = 0;
+  srcLineNum = 0;
+  srcFileNum = 0;
+  numErrors  = 0;
+  layoutUsesLabels = 0;
+  prevInfo   = NULL;
+  lit_term(&lits);
+  include_reset();
 }
 
 /** @todo implement this function */
 void asm_term (void) {
+  asm_reset();
+  include_term();
+  symbol_term(lc3_sym_tab);
+  mem_note(MEM_SYMBOL, - (long) SYM_TABLE_BYTES, -1);
+  lc3_sym_tab = NULL;
+}
 
+/** Add a label to the symbol table, reporting a duplicate */
+static void define_label (char* name, int addr) {
+  if(expr_is_constant(name) || symbol_add(lc3_sym_tab,name,addr) == 0){
+    asm_error(ERR_DUPLICATE_LABEL,name);
+  }
+  else{
+    // the node and a copy of the name are allocated by symbol_add()
+    long bytes = SYM_NODE_BYTES + strlen(name) + 1;
+    symbolBytes += bytes;
+    symbolCount++;
+    mem_note(MEM_SYMBOL, bytes, 2);
+  }
 }
 
-/** @todo implement this function */ //bob
-//done
-char* check_for_label (char* token) {
-  if(util_get_opcode (token) == -1){
+/** Restore the source text, inclusions, symbols, constants and lines of a
+ *  program from its intermediate representation (see ir.h)
+ */
+static void load_ir (lc3_ir_t* ir) {
+  mem_free(srcText);
+  srcText   = mem_alloc(MEM_SOURCE, ir->srcLength + 1);
+  srcLength = ir->srcLength;
+  memcpy(srcText, ir->text, srcLength);
+  srcText[srcLength] = '\0';
+
+  inc_unit_t** units = mem_alloc(MEM_SOURCE,
+                                 (ir->numUnits + 1) * sizeof(inc_unit_t*));
+
+  for (int i = 0; i < ir->numUnits; i++)
+    units[i] = include_add_unit(ir_string(ir, ir->units[i].name),
+                                ir->text + ir->units[i].text,
+                                ir->units[i].length);
+
+  for (int i = 0; i < ir->numInclusions; i++)
+    include_record(units[ir->inclusions[i].unit], ir->inclusions[i].lineNum);
+
+  mem_free(units);
+
+  for (int i = 0; i < ir->numSymbols; i++)
+    define_label((char*) ir_string(ir, ir->symbols[i].name),
+                 ir->symbols[i].addr);
+
+  for (int i = 0; i < ir->numConsts; i++) {
+    srcLineNum = ir->consts[i].lineNum;
+    srcFileNum = ir->consts[i].fileNum;
+    expr_define(ir_string(ir, ir->consts[i].name),
+                ir_string(ir, ir->consts[i].text));
+  }
+
+  line_info_t** lines = mem_alloc(MEM_LINE_INFO,
+                                  (ir->numLines + 1) * sizeof(line_info_t*));
+
+  for (int i = 0; i < ir->numLines; i++) {
+    const ir_line_t* line = &ir->lines[i];
+    line_info_t*     info = mem_alloc(MEM_LINE_INFO, sizeof(line_info_t));
+
+    *info = (line_info_t) {
+      NULL, line->lineNum, line->address, line->machineCode, line->opcode,
+      line->form, line->reg1, line->reg2, line->reg3, line->immediate, NULL,
+      line->immWidth, line->immSigned, NULL, line->srcOffset,
+      line->srcLength, line->srcFile, NULL, NULL
+    };
+
+    if (line->reference != IR_NONE)
+      info->reference = mem_strdup(MEM_STRING,
+                                   ir_string(ir, line->reference));
+
+    if (line->label != IR_NONE)
+      info->label = mem_strdup(MEM_STRING, ir_string(ir, line->label));
+
+    if (infoHead == NULL)
+      infoHead = info;
+    else
+      infoTail->next = info;
+
+    infoTail = lines[i] = info;
+  }
+
+  for (int i = 0; i < ir->numLines; i++) {
+    if (ir->lines[i].pooledIn != IR_NONE)
+      lines[i]->pooledIn = lines[ir->lines[i].pooledIn];
+
+    if (ir->lines[i].literal != IR_NONE)
+      lines[i]->literal = lines[ir->lines[i].literal];
+  }
+
+  mem_free(lines);
+  layoutUsesLabels = (ir->flags & IR_LAYOUT_USES_LABELS) != 0;
+  expr_resolve();
+  srcLineNum = 0;
+  srcFileNum = 0;
+}
+
+void asm_pass_one_ir (char* ir_file_name, char* sym_file_name) {
+  lc3_ir_t ir;
+  int      error = ir_open(ir_file_name, &ir);
+
+  if (error != 0) {
+    asm_error((error == EINVAL) ? ERR_BAD_IR : ERR_OPEN_READ, ir_file_name);
+    return;
+  }
+
+  load_ir(&ir);
+  ir_unmap(&ir);
+
+  if (numErrors == 0 && sym_file_name != NULL)
+    write_file(sym_file_name, write_sym_file, NULL);
+}
+
+lex_token_t* check_for_label (lex_token_t* token) {
+  if(token->type != LEX_OP && token->type != LEX_INCLUDE &&
+     token->type != LEX_LTORG){
 		//if it is then is it a vaild label?		
-    if(util_is_valid_label(token)){
-			//if it is a vaild label add that shit
-			//return the next token broski
-      //fprintf(stderr, "adding symbol: %s\n",token);
-      if(symbol_add(lc3_sym_tab,token,currAddr) == 0){
-        asm_error(ERR_DUPLICATE_LABEL,token);
-      }
-      return next_token();
+    if(token->isLabel){
+      if(unit == NULL) // labels of a unit are defined where it is included
+        define_label(token->text,currAddr);
+
+      currInfo->label = mem_strdup(MEM_STRING, token->text);
+      return lex_next();
     }	else{
-      //damn that shit anint wokring right
-    asm_error(ERR_BAD_LABEL,token);
+    asm_error(ERR_BAD_LABEL,token->text);
     }		
   }
 
   return token;
 }
 
+/** Check a line defining a constant, in either of the forms
+ *  <code>.EQU NAME, value</code> or <code>NAME .EQU value</code>
+ *  @param token - the first token of the line
+ *  @return 1 if the line defines a constant, 0 otherwise
+ */
+static int check_for_equ (lex_token_t* token) {
+  lex_token_t* name;
+  lex_token_t* next = lex_peek();
+
+  if(token->type == LEX_EQU){
+    name = lex_next();
+
+    if(name == NULL){
+      asm_error(ERR_MISSING_OPERAND);
+      return 1;
+    }
+
+    get_comma_or_error();
+  }
+  else if(next != NULL && next->type == LEX_EQU){
+    name = token;
+    lex_next();
+  }
+  else{
+    return 0;
+  }
+
+  if(numErrors != errorsBefore)
+    return 1;
+
+  if(name->type != LEX_LABEL){
+    asm_error(ERR_BAD_LABEL,name->text);
+    return 1;
+  }
+
+  lex_token_t* value = lex_next();
+
+  if(value == NULL)
+    asm_error(ERR_MISSING_OPERAND);
+  else if(value->type != LEX_IMM && value->type != LEX_LABEL &&
+          value->type != LEX_EXPR)
+    asm_error(ERR_BAD_IMM,value->text);
+  else if((token = lex_next()) != NULL)
+    asm_error(ERR_EXTRA_OPERAND,token->text);
+  else if(unit != NULL) // defined where the unit is included
+    include_add_constant(unit, name->text, value->text);
+  else
+    expr_define(name->text, value->text);
+
+  return 1;
+}
+
+/** Copy the lines of a unit after the last line, relocated to the current
+ *  address, and define its labels and constants, unless a unit is being
+ *  parsed. The lines are then part of that unit.
+ */
+static void splice_unit (inc_unit_t* inc) {
+  int          base     = currAddr;
+  int          lineNum  = include_source_line(srcFileNum, srcLineNum);
+  int          saveLine = srcLineNum;
+  int          saveFile = srcFileNum;
+  int*         files    = mem_alloc(MEM_LINE_INFO, inc->numDeps * sizeof(int));
+  line_info_t* first    = NULL;
+
+  for (int i = 0; i < inc->numDeps; i++)
+    files[i] = include_record(inc->deps[i], lineNum);
+
+  for (line_info_t* line = inc->lines; line != NULL; line = line->next) {
+    line_info_t* info = mem_alloc(MEM_LINE_INFO, sizeof(line_info_t));
+
+    *info           = *line;
+    info->next      = NULL;
+    info->address   = base + line->address;
+    info->srcFile   = files[line->srcFile];
+    info->label     = (line->label != NULL) ?
+                      mem_strdup(MEM_STRING, line->label) : NULL;
+    info->reference = (line->reference != NULL) ?
+                      mem_strdup(MEM_STRING, line->reference) : NULL;
+    infoTail->next  = info; // the .INCLUDE line is before
+    infoTail        = info;
+
+    if (first == NULL)
+      first = info;
+
+    if (info->label != NULL && unit == NULL) {
+      srcLineNum = info->lineNum;
+      srcFileNum = info->srcFile;
+      currLine   = (char*) include_line_text(info, &currLineLength);
+      define_label(info->label, info->address);
+    }
+  }
+
+  lit_relink(inc->lines, first);
+
+  for (int i = 0; i < inc->numConsts; i++) {
+    inc_const_t* c = &inc->consts[i];
+
+    srcLineNum = c->lineNum;
+    srcFileNum = files[c->dep];
+    currLine   = NULL;
+
+    if (unit != NULL)
+      include_add_constant(unit, c->name, c->value);
+    else
+      expr_define(c->name, c->value);
+  }
+
+  mem_free(files);
+  srcLineNum = saveLine;
+  srcFileNum = saveFile;
+  currAddr   = base + inc->numWords;
+}
+
+/** Check a line including a file, <code>.INCLUDE "file"</code>, and add
+ *  the lines of the file
+ */
+static void check_include (void) {
+  lex_token_t* name = lex_next();
+  lex_token_t* token;
+
+  if(name == NULL){
+    asm_error(ERR_MISSING_OPERAND);
+  }
+  else if(name->type != LEX_STRING){
+    asm_error(ERR_EXPECTED_STR,name->text);
+  }
+  else if(! name->isClosed){
+    asm_error(ERR_BAD_STR,name->text);
+  }
+  else if((token = lex_next()) != NULL){
+    asm_error(ERR_EXTRA_OPERAND,token->text);
+  }
+  else{
+    int  length = strlen(name->text) - 2; // without the quotes
+    char file_name[MAX_LINE_LENGTH];
+
+    memcpy(file_name, name->text + 1, length); // the lexer is used again
+    file_name[length] = '\0';
+
+    inc_unit_t* inc = include_load(file_name);
+
+    if(inc != NULL)
+      splice_unit(inc);
+  }
+}
+
+int asm_parse_unit (inc_unit_t* inc) {
+  char*        saveText    = srcText;
+  int          saveLength  = srcLength;
+  int          saveLine    = srcLineNum;
+  int          saveFile    = srcFileNum;
+  int          saveAddr    = currAddr;
+  int          saveErrors  = errorsBefore;
+  line_info_t* saveHead    = infoHead;
+  line_info_t* saveTail    = infoTail;
+  line_info_t* saveInfo    = currInfo;
+  inc_unit_t*  saveUnit    = unit;
+  line_info_t* savePrev    = prevInfo;
+  lit_pool_t   saveLits    = lits;
+  int          errors      = numErrors;
+  int          end;
+
+  srcFileNum = include_record(inc, include_source_line(srcFileNum, srcLineNum));
+  srcText    = inc->text;
+  srcLength  = inc->length;
+  srcLineNum = 0;
+  currAddr   = 0;
+  infoHead   = infoTail = NULL;
+  unit       = inc;
+  memset(&lits, 0, sizeof(lits));
+
+  for (int pos = 0; pos < srcLength && ! diag_limit_reached(); pos = end) {
+    char* eol = memchr(srcText + pos, '\n', srcLength - pos);
+    end = (eol != NULL) ? (eol - srcText) + 1 : srcLength;
+    asm_scan_line(pos, end, NULL);
+  }
+
+  if (lits.numWaiting > 0) { // its lines are used wherever it is included
+    srcLineNum = lits.waiting[0]->lineNum;
+    currLine   = NULL;
+    asm_error(ERR_INCLUDE_LTORG);
+    place_literals(infoTail, currAddr);
+  }
+
+  lit_term(&lits);
+  inc->lines    = infoHead;
+  inc->numWords = currAddr;
+  include_finish_unit(inc);
+
+  srcText      = saveText;
+  srcLength    = saveLength;
+  srcLineNum   = saveLine;
+  srcFileNum   = saveFile;
+  currAddr     = saveAddr;
+  errorsBefore = saveErrors;
+  infoHead     = saveHead;
+  infoTail     = saveTail;
+  currInfo     = saveInfo;
+  unit         = saveUnit;
+  prevInfo     = savePrev;
+  lits         = saveLits;
+  return numErrors == errors;
+}
+
+/** Determine if execution never continues after a line, so literals can be
+ *  placed after it: BR (nzp), JMP, RET, RTI or HALT
+ */
+static int ends_flow (line_info_t* info) {
+  switch (info->opcode) {
+    case OP_BR:
+      return (info->reg1 & 7) == 7;
+    case OP_JMP_RET:
+    case OP_RTI:
+    case OP_HALT:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
 /** @todo implement this function */
 //done
-void check_line_syntax (char* token) {
-  printf("check_line_syntax('%s')\n", token);
+void check_line_syntax (lex_token_t* token) {
+  if(check_for_equ(token))
+    return;
+
   //check if its a label
   token = check_for_label(token);
-  printf(" my token is %s \n ", token);
-  //store the op in an int
-  if(token == NULL)
+  if(token == NULL || numErrors != errorsBefore)
     return;
-  int myop = util_get_opcode(token);
-  printf("opcode is: %d\n", myop );
-  //store it itno my data structure..
-  currInfo -> opcode = myop;
 
-  if(myop == OP_BR){
-    currInfo->reg1 = util_parse_cond(token+2);
-    token = next_token();
-    currInfo->reference = strdup(token);
-    //get_operand(op,token);
+  if(token->type == LEX_INCLUDE){
+    check_include();
+    return;
   }
 
-  LC3_inst_t* inst = lc3_get_inst_info(myop);
-  printf("inst is:  %p \n" , inst);
+  if(token->type == LEX_LTORG){
+    if((token = lex_next()) != NULL)
+      asm_error(ERR_EXTRA_OPERAND,token->text);
+    else
+      place_literals(currInfo,currAddr);
+    return;
+  }
 
-  int position = 0;
-  if(strcasecmp(inst ->forms[0].name,token) != 0){
-    position = 1;
+  if(token->type != LEX_OP){
+    asm_error(ERR_MISSING_OP,token->text);
+    return;
   }
-  
-  /*if(inst ->forms[1].name != NULL &&strcasecmp(inst ->forms[1].name,token) == 0){
-    position = 1;
-    if(strcasecmp(inst ->forms[0].name,token) != 0)
-    position = 1;
-  }*/
- if(myop != OP_BR){
-  currInfo->form=position;}
+  //the lexer already knows the opcode and which form the name selects
+  currInfo->opcode = token->value;
+  currInfo->form   = token->form;
 
-printf("%d\n whats my position", position);
-  operands_t format =  inst -> forms[position].operands;
-  scan_operands(format);
+  if(currInfo->opcode == OP_BR)
+    currInfo->reg1 = token->cond;
 
-  
-}
+  if(unit != NULL && (currInfo->opcode == OP_ORIG || currInfo->opcode == OP_END)){
+    asm_error(ERR_INCLUDE_OP,token->text);
+    currInfo->opcode = OP_INVALID; // the unit is still used
+    return;
+  }
 
-/** @todo implement this function */
-//done
-void encode_operand (operand_t operand) {
-  switch(operand){
-  case FMT_R1:
-    currInfo->machineCode = setField(currInfo->machineCode,11,9,currInfo->reg1);
-    break;
-  case FMT_R2:
-    currInfo -> machineCode = setField(currInfo->machineCode,8,6,currInfo->reg2);
-    break;
-  case FMT_R3:
-    currInfo -> machineCode = setField(currInfo->machineCode,2,0,currInfo->reg3);
-    break;
-  case FMT_IMM5:
-    currInfo -> machineCode = setField(currInfo->machineCode,4,0,currInfo->immediate);
-    currInfo->form=1;
-    break;
-  case FMT_IMM6:
-    currInfo -> machineCode = setField(currInfo->machineCode,5,0,currInfo->immediate);
-    break;
-  case FMT_VEC8:
-     currInfo -> machineCode = setField(currInfo->machineCode,7,0,currInfo->immediate);
-     currInfo->form=1;
-    break;
-  case FMT_ASC8:
-    currInfo -> machineCode = setField(currInfo->machineCode,7,0,currInfo->immediate);
-    break;
-  case FMT_PCO9:
-    encode_PC_offset_or_error(9);
-    break;
-  case FMT_PCO11:
-    encode_PC_offset_or_error(11);
-    break;
-  case FMT_IMM16:
-    currInfo -> machineCode = setField(currInfo->machineCode,15,0,currInfo->immediate);
-    break;
-  case FMT_CC:
-    printf("enter\n");
-    //currInfo->machineCode = setField(currInfo->machineCode,11,9,currInfo->reg1);
-    break;
-  case FMT_STR:
-    //do somehting
-  default:
-    break;
+  if(currInfo->opcode == OP_ORIG || currInfo->opcode == OP_END){
+    place_literals(prevInfo,currAddr); // the block ends before the line
+    currInfo->address = currAddr;
+    lit_new_block(&lits);
   }
-}
 
-/** @todo implement this function */
-void encode_PC_offset_or_error (int width) {
-  printf("REFERENCE: %s\n",currInfo->reference);
-  symbol_t* symbol = symbol_find_by_name (lc3_sym_tab, currInfo->reference);
-  printf("SYMBOL: %s,%d\n",symbol->name,symbol->addr);
-  if(symbol != NULL){
-      int offset = symbol->addr-currInfo->address-1;
-      int whatever = fieldFits(offset,width,1);
-      if(whatever == 1){
-        currInfo -> machineCode = setField(currInfo->machineCode,width-1,0,offset);
-      }
-      else{
-        asm_error(ERR_BAD_PCOFFSET,currInfo->reference);
-      }
+  LC3_inst_t* inst = lc3_get_inst_info(currInfo->opcode);
+  scan_operands(inst->forms[currInfo->form].operands);
 
-  }
+  if(numErrors == errorsBefore && (token = lex_next()) != NULL)
+    asm_error(ERR_EXTRA_OPERAND,token->text);
+
+  if(numErrors == errorsBefore && ends_flow(currInfo))
+    place_literals(currInfo,currAddr + line_size(currInfo));
 }
 
 /** @todo implement this function */
 //done
 void get_comma_or_error (void) {
-  char* token = next_token();
-  if(strcasecmp(token,",") != 0){
-    asm_error(ERR_EXPECTED_COMMA);
+  lex_token_t* token = lex_next();
+  if(token == NULL){
+    asm_error(ERR_MISSING_OPERAND);
+  }
+  else if(token->type != LEX_COMMA){
+    asm_error(ERR_EXPECTED_COMMA,token->text);
   }
 }
 
 /** @todo implement this function */
 //done
-void get_immediate_or_error (char* token, int width, int isSigned) {
-  //field fits
-  //value widith issighned
- int value = 0;
- int bob = lc3_get_int(token,&value);
+void get_immediate_or_error (lex_token_t* token, int width, int isSigned) {
+  int value = token->value;
+
+  if(token->type == LEX_EXPR || token->type == LEX_LABEL){
+    if(! expr_check(token->text))
+      return;
+
+    if(currInfo->opcode != OP_ORIG && currInfo->opcode != OP_BLKW){
+      // evaluated once every constant and label is known
+      currInfo -> reference = mem_strdup(MEM_STRING, token->text);
+      currInfo -> immWidth  = width;
+      currInfo -> immSigned = isSigned;
+      return;
+    }
 
- if(!bob)
-  asm_error(ERR_BAD_IMM,token);
+    if(unit != NULL){ // the layout of a unit must not depend on its use
+      asm_error(ERR_INCLUDE_BLKW,token->text);
+      return;
+    }
+
+    int usesLabel;
+
+    if(! expr_eval_now(token->text, &value, &usesLabel))
+      return;
+
+    layoutUsesLabels |= usesLabel;
+  }
+  else if(! token->isNumber){
+    asm_error(ERR_BAD_IMM,token->text);
+    return;
+  }
 
-  if(fieldFits (value,width,isSigned) != 0){
-      //set something equal to it 
-      currInfo -> immediate = value; 
+  if(immediate_fits(value,width,isSigned)){
+    currInfo -> immediate = value; 
   }
   else{
-    asm_error(ERR_EXPECT_REG_IMM);
+    asm_error(ERR_IMM_TOO_BIG,token->text);
   }
 }
-/** @todo implement this function */
-//done
-void get_PC_offset_or_error (char* token) {
-  //PCoffset..
-  printf("TOKEN %s\n",token);
-  if(util_is_valid_label(token) != 0){
-    currInfo -> reference = strdup(token);
+/** Check the operand <code>=value</code> of an LD and give the line its
+ *  literal (see literal.h)
+ */
+static void get_literal_or_error (lex_token_t* token) {
+  char* text = token->text + 1;
+
+  if(currInfo->opcode != OP_LD){
+    asm_error(ERR_LITERAL_OP,token->text);
+    return;
+  }
+
+  if(token->isNumber){
+    if(! immediate_fits(token->value,16,1)){
+      asm_error(ERR_IMM_TOO_BIG,text);
+      return;
+    }
+  }
+  else if(! token->isLabel && ! expr_is_expression(text)){
+    asm_error(ERR_BAD_IMM,text);
+    return;
+  }
+  else if(! expr_check(text)){
+    return;
+  }
+
+  // a .FILL listed with the LD, as the lines added by the optimizer
+  line_info_t* value = mem_alloc(MEM_LINE_INFO, sizeof(line_info_t));
+
+  asm_init_line_info(value);
+  value->address   = -1; // not placed
+  value->opcode    = OP_FILL;
+  value->srcOffset = currInfo->srcOffset;
+
+  if(token->isNumber){
+    value->immediate = token->value;
   }
   else{
-    asm_error(ERR_BAD_LABEL,token);
+    value->reference = mem_strdup(MEM_STRING, text);
+    value->immWidth  = 16;
+    value->immSigned = 1;
   }
 
+  lit_use(&lits, currInfo, value);
+}
 
+/** @todo implement this function */
+//done
+void get_PC_offset_or_error (lex_token_t* token) {
+  if(token->type == LEX_LITERAL){
+    get_literal_or_error(token);
+  }
+  else if(token->type == LEX_EXPR){
+    if(expr_check(token->text))
+      currInfo -> reference = mem_strdup(MEM_STRING, token->text);
+  }
+  else if(token->isLabel){
+    currInfo -> reference = mem_strdup(MEM_STRING, token->text);
+  }
+  else{
+    asm_error(ERR_BAD_LABEL,token->text);
+  }
 }
 
 /** @todo implement this function */
 //done
-int get_reg_or_error (char *token) {
-  int get = util_get_reg(token);
-  if(get == -1){
-    asm_error(ERR_EXPECTED_REG,token);
+int get_reg_or_error (lex_token_t* token) {
+  if(token->type != LEX_REG){
+    asm_error(ERR_EXPECTED_REG,token->text);
+    return -1;
   }
 
-  return get;
+  return token->value;
 }
 
 /** @todo implement this function */
@@ -362,7 +1431,7 @@ FILE *open_write_or_error (char* file_name) {
 
 /** @todo implement this function */
 //done
-void get_operand (operand_t operand, char* token) {
+void get_operand (operand_t operand, lex_token_t* token) {
   switch (operand) {
     case FMT_R1:
     currInfo->reg1 = get_reg_or_error(token);
@@ -372,11 +1441,14 @@ void get_operand (operand_t operand, char* token) {
     break;
     case FMT_R3:
     case FMT_IMM5:
-      if(util_get_reg(token) != -1){
-        currInfo->reg3 = util_get_reg(token);
-      }else{
+      if(token->type == LEX_REG){
+        currInfo->reg3 = token->value;
+      }else if(token->isNumber || token->type == LEX_LABEL ||
+               token->type == LEX_EXPR){
         get_immediate_or_error(token,5,1);
         currInfo->form=1;
+      }else{
+        asm_error(ERR_EXPECT_REG_IMM,token->text);
       }
       break;
     case FMT_IMM6:
@@ -384,28 +1456,24 @@ void get_operand (operand_t operand, char* token) {
       break;
     case FMT_VEC8:
       get_immediate_or_error(token,8,0);
-      //currInfo->form = 1;
       break;
     case FMT_ASC8:
       get_immediate_or_error(token,8,0);
       break;
     case FMT_PCO9:
-      get_PC_offset_or_error(token);
-      currInfo -> reference = strdup(token);
-      break;
     case FMT_PCO11:
       get_PC_offset_or_error(token);
-      currInfo -> reference = strdup(token);
       break;
     case FMT_IMM16:
       get_immediate_or_error(token,16,1);
-      /*if(currInfo -> opcode == 16){
-        currInfo -> address = currInfo -> immediate;
-      }*/
       break;
     case FMT_STR:
-      printf("this is the probelm");
-      currInfo -> reference = strdup(token);
+      if(token->type != LEX_STRING)
+        asm_error(ERR_EXPECTED_STR,token->text);
+      else if(! token->isClosed)
+        asm_error(ERR_BAD_STR,token->text);
+      else
+        currInfo -> reference = mem_strdup(MEM_STRING, token->text);
       break;
     default:
     break;
@@ -429,55 +1497,56 @@ return c;
 /** @todo implement this function */
 //done
 void scan_operands (operands_t operands) {
-  printf("scan_operands() for %s\n", lc3_get_format_name(operands));
   int operandCount = 0;
   int numOperands  = count_bits(operands);
   int errorCount   = numErrors;
   for (operand_t op = FMT_R1; op <= FMT_STR; op <<= 1) {
     //if the bits are set
-    //printf(" ");
     if(op & operands){
-      //create a token
-      char* token = next_token();
-      //get the operand of that token
-      if(token != NULL){
+      lex_token_t* token = lex_next();
+      if(token == NULL){
+        asm_error(ERR_MISSING_OPERAND);
+        return;
+      }
       get_operand(op,token);
-      
-        //if errorocunt is not equal return
-       if (errorCount != numErrors)
+      if (errorCount != numErrors)
         return; // error, so skip processing remainder of line
-      //inc operand count
       operandCount++;
-      //if the count is less then the operands 
       if(operandCount < numOperands){
-        //get comma or error
         get_comma_or_error();
       }
-      //check errorcount again
       if (errorCount != numErrors)
-      return; // error, so skip processing remainder of line
-
+        return; // error, so skip processing remainder of line
     }
   }
-  }
 }
 
 /** @todo implement this function */
 //done..
+int line_size (line_info_t* info) {
+  switch (info->opcode) {
+    case OP_INVALID: // a line containing only a label
+    case OP_ORIG:
+    case OP_END:
+      return 0;
+    case OP_BLKW:
+      return info->immediate;
+    case OP_STRINGZ: // reference is NULL if the string had an error
+      return (info->reference != NULL) ? strlen(info->reference) - 1 : 0;
+    case OP_NEG: // NOT DR,DR and ADD DR,DR,#1
+      return 2;
+    default:
+      return 1;
+  }
+}
+
 void update_address (void) {
-  int op = currInfo -> opcode;
-  if(op == OP_ORIG){
+  if(currInfo -> opcode == OP_ORIG){
     currAddr = currInfo -> immediate;
     currInfo->address = currInfo -> immediate;
   } 
-  else if(op == OP_BLKW){
-    currAddr += currInfo->immediate;
-  }
-  else if(op == OP_STRINGZ){
-    currAddr += strlen(currInfo->reference)-1;
-  }
   else{
-    currAddr++;
+    currAddr += line_size(currInfo);
   }
 }
 
@@ -54,7 +54,9 @@
  *  @author Fritz Sieker
  */
 
+#include "image.h"
 #include "lc3.h"
+#include "lexer.h"
 
 #include "symbol.h"
 
@@ -65,6 +67,7 @@
 /** Error messages passed to function <code>asm_error()</code> */
 #define ERR_OPEN_READ       "could not open '%s' for reading."
 #define ERR_OPEN_WRITE      "could not open '%s' for writing."
+#define ERR_WRITE           "error writing '%s'"
 #define ERR_LINE_TOO_LONG   "source line too long (max is %d)"
 #define ERR_NO_ORIG         "no .ORIG directive found"
 #define ERR_NO_END          "no .END directive found"
@@ -86,9 +89,29 @@
 #define ERR_IMM_TOO_BIG     "immediate '%s' out of range"
 #define ERR_EXPECTED_STR    "expected quoted string, got '%s'"
 #define ERR_BAD_STR         "unterminated string '%s'"
+#define ERR_BAD_EXPR        "bad expression '%s'"
+#define ERR_EQU_CYCLE       "circular definition of '%s'"
+#define ERR_EXPR_NOT_KNOWN  "value of '%s' is not known on this line"
+#define ERR_SEG_OVERLAP     ".ORIG block overlaps the block starting on line %d"
+#define ERR_INCLUDE_CYCLE   "'%s' is already being included"
+#define ERR_INCLUDE_DEPTH   "includes nested too deeply at '%s'"
+#define ERR_INCLUDE_OP      "'%s' is not allowed in an included file"
+#define ERR_INCLUDE_BLKW    ".BLKW count '%s' must be a number in an included file"
+#define ERR_INCLUDE_NO_FILE "'%s' can not be included, files are not read"
+#define ERR_INCLUDE_LTORG   "literal not placed in the included file, add a .LTORG"
+#define ERR_LITERAL_OP      "literal '%s' is only allowed with LD"
+#define ERR_LITERAL_RANGE   "literal pool out of range, add a .LTORG closer"
+#define ERR_BAD_IR          "'%s' is not a valid intermediate representation"
+
+/** A global variable defining the line in the source file. Each thread of
+ *  the pipelined assembler (see <code>pipeline.h</code>) has its own.
+ */
+LC3AS_VAR __thread int srcLineNum;
 
-/** A global variable defining the line in the source file */
-LC3AS_VAR int srcLineNum;
+/** A global variable defining the file of <code>srcLineNum</code>: 0 for the
+ *  source file, else an inclusion (see <code>include.h</code>)
+ */
+LC3AS_VAR __thread int srcFileNum;
 
 /** A global variable defining the LC3 address of the current instruction */
 LC3AS_VAR int currAddr;
@@ -115,9 +138,39 @@ struct line_info {
   int          reg3;         /**< SR2, if present                         */
   int          immediate;    /**< Immediate value if present              */
   char*        reference;    /**< Label referenced by instruction, if any */
+  int          immWidth;     /**< Width of an immediate whose value is the
+                                  expression in reference, 0 if none      */
+  int          immSigned;    /**< The immediate of immWidth is signed     */
+  char*        label;        /**< Label defined on this line, if any      */
+  int          srcOffset;    /**< Offset of the line in the source text   */
+  int          srcLength;    /**< Length of the line, without newline     */
+  int          srcFile;      /**< 0, or the inclusion (see include.h) whose
+                                  file contains the line                  */
+  line_info_t* pooledIn;     /**< The copy holding the string of a pooled
+                                  .STRINGZ (see pool.h), else NULL        */
+  line_info_t* literal;      /**< The .FILL loaded by LD =value, itself
+                                  for a literal (see literal.h)           */
 };
 
 
+/** Typedef of structure type */
+typedef struct asm_outputs asm_outputs_t;
+
+/** The names of the files produced by <code>asm_pass_two()</code>. Any
+ *  combination of outputs may be requested in a single run. A
+ *  <code>NULL</code> name means the corresponding file is not written.
+ */
+struct asm_outputs {
+  char* obj_file_name;  /**< binary object file (.obj)           */
+  char* hex_file_name;  /**< object file as hex text (.hex)      */
+  char* lst_file_name;  /**< listing of addresses and code (.lst) */
+  char* sobj_file_name; /**< compact object file (.sobj)         */
+  char* cost_file_name; /**< static cost report (.cost.json)     */
+  char* dbg_file_name;  /**< debug map of source lines (.dbg)    */
+  char* xref_file_name; /**< cross-reference index (.xref)       */
+  char* ir_file_name;   /**< intermediate representation (.lc3ir) */
+};
+
 /** A function to print error messages. This function takes a minimum of one
  *  parameter. It is exaclty like the <code>printf()</code> function. The first
  *  parameter is a formatting string. The remaining parameters (if any) are
@@ -166,18 +219,168 @@ void asm_init_line_info (line_info_t* info);
  *      </li>
  *  </ol>
  *  @param asm_file_name - name of the file to assemble
- *  @param sym_file_name - name of the symbol table file
+ *  @param sym_file_name - name of the symbol table file, or <code>NULL</code>
+ *  if the symbol table should not be written
  */
 void asm_pass_one (char* asm_file_name, char* sym_file_name);
 
+/** Perform the first pass on source text that is already in memory. This
+ *  is identical to <code>asm_pass_one()</code> except that no file is read
+ *  and no symbol table file is written.
+ *  @param text - the source text (need not be terminated)
+ *  @param length - the number of characters in the text
+ */
+void asm_pass_one_text (const char* text, int length);
+
+/** Perform the first pass from the intermediate representation written by
+ *  <code>-ir</code> (see <code>ir.h</code>) instead of the source. The
+ *  lines, symbols, constants and source text are restored as pass one left
+ *  them, so <code>asm_optimize()</code> and <code>asm_pass_two()</code> may
+ *  follow. Nothing is lexed or parsed.
+ *  @param ir_file_name - name of the file to load
+ *  @param sym_file_name - name of the symbol table file, or <code>NULL</code>
+ *  if the symbol table should not be written
+ */
+void asm_pass_one_ir (char* ir_file_name, char* sym_file_name);
+
+/** Provide a buffer for the source text, which the caller fills. Used by
+ *  the pipelined assembler, which checks lines while the file is read.
+ *  @param length - the number of characters in the source
+ *  @return a zero filled buffer of <code>length + 1</code> characters, kept
+ *  until <code>asm_reset()</code>
+ */
+char* asm_source_buffer (int length);
+
+/** Check one line of the source buffer as the first pass does: classify
+ *  its tokens, check its syntax, define its label and assign its address.
+ *  The line is added to the end of the list of lines, followed by the lines
+ *  of the file it includes, if any (see include.h), or preceded or followed
+ *  by a pool of literals (see literal.h).
+ *  @param pos - offset of the line in the source buffer
+ *  @param end - offset after the line, including its newline
+ *  @param last - if not <code>NULL</code>, set to the last line added
+ *  @return the first line added, or <code>NULL</code> if the line is blank
+ *  or too long
+ */
+line_info_t* asm_scan_line (int pos, int end, line_info_t** last);
+
+/** Place the literals still waiting for a pool (see literal.h) after the
+ *  last line, once every line has been checked
+ *  @param last - if not <code>NULL</code>, set to the last line added
+ *  @return the first line added, or <code>NULL</code> if none was waiting
+ */
+line_info_t* asm_scan_end (line_info_t** last);
+
+/** Complete the first pass once every line has been checked: check the
+ *  <code>.ORIG</code> blocks and evaluate the constants and immediates that
+ *  depend on labels
+ */
+void asm_scan_finish (void);
+
+/** Select whether <code>asm_scan_finish()</code> pools the strings of
+ *  <code>.STRINGZ</code> (see <code>pool.h</code>). It is not applied if
+ *  pass one found errors, or if an operand of <code>.ORIG</code> or
+ *  <code>.BLKW</code> depends on the address of a label. Off by default.
+ *  @param enable - 1 to pool the strings, 0 to keep every copy
+ */
+void asm_set_pool_strings (int enable);
+
+/** Optimize the lines found by the first pass (see <code>opt.h</code>) and
+ *  recompute their addresses. It is not applied if pass one found errors,
+ *  or if an operand of <code>.ORIG</code> or <code>.BLKW</code> depends on
+ *  the address of a label, because moving code would change it.
+ *  @return the number of changes made, or -1 if the optimizer was not run
+ */
+int asm_optimize (void);
+
+/** Write the symbol table file, as <code>asm_pass_one()</code> does. Used
+ *  to write it after <code>asm_optimize()</code> has moved the labels.
+ *  @param sym_file_name - name of the file
+ */
+void asm_write_sym (char* sym_file_name);
+
+/** Recompute the address of every line from the words each occupies, store
+ *  the new address of every label in the symbol table and evaluate the
+ *  constants again. Used by the optimizer after it changes the lines, and
+ *  after the strings are pooled. A pooled <code>.STRINGZ</code> and its
+ *  label are placed in the copy holding the string.
+ */
+void asm_layout (void);
+
+/** Get the address a line with a PC offset refers to, after pass one. The
+ *  target of a line added by the optimizer is computed from its immediate.
+ *  @param info - a line with a PC offset (e.g. BR or JSR)
+ *  @param target - where the address is stored
+ *  @return 1 on success, 0 if the reference cannot be evaluated
+ */
+int asm_get_target (line_info_t* info, int* target);
+
+/** Determine if a line can be encoded before the first pass is complete:
+ *  no error has been found so far and anything it refers to is a label
+ *  already defined (not a forward reference or a constant) whose offset
+ *  fits. Such a line cannot report an error when it is encoded.
+ *  @param info - a line found by <code>asm_scan_line()</code>
+ *  @return 1 if the line can be encoded now, 0 otherwise
+ */
+int asm_can_encode (line_info_t* info);
+
+/** Encode every line found by the first pass into the program image
+ *  returned by <code>asm_get_image()</code>. No files are written. It is
+ *  <code>asm_generate_begin()</code>, then <code>asm_generate_line()</code>
+ *  for each line in order, then <code>asm_generate_end()</code>.
+ *  @param lst - if not <code>NULL</code>, the listing is written here
+ */
+void asm_generate (FILE* lst);
+
+/** Start a new program image and listing */
+void asm_generate_begin (FILE* lst);
+
+/** Encode one line into the image and write its listing rows
+ *  @param info - the line, which follows the line of the previous call
+ *  @param lst - if not <code>NULL</code>, the listing is written here
+ */
+void asm_generate_line (line_info_t* info, FILE* lst);
+
+/** Write the end of the listing */
+void asm_generate_end (FILE* lst);
+
+/** Write the object, hex, compact object and cost files requested, from
+ *  the image built by <code>asm_generate()</code>. Nothing is written if
+ *  errors were found.
+ *  @param outputs - names of the files to produce
+ */
+void asm_write_outputs (asm_outputs_t* outputs);
+
+/** Signature of a function receiving an output instead of its file
+ *  @param file_name - name of the file the output is for
+ *  @param data - the text of the output, which the function must free()
+ *  @param length - the length of the text
+ */
+typedef void (*asm_output_fnc_t)(char* file_name, char* data, size_t length);
+
+/** Pass the outputs of <code>asm_pass_one()</code>,
+ *  <code>asm_write_sym()</code> and <code>asm_pass_two()</code> to a
+ *  function instead of writing their files. Used by the batch assembler,
+ *  which writes them with its own I/O.
+ *  @param fnc - the function, or <code>NULL</code> to write files again
+ */
+void asm_set_output_fnc (asm_output_fnc_t fnc);
+
+/** Return the image built by <code>asm_generate()</code>. It remains valid
+ *  until the next call to <code>asm_reset()</code> or <code>asm_term()</code>.
+ */
+lc3_image_t* asm_get_image (void);
+
 /** This function generates the object file. It is only called if no errors were
  *  found during <code>asm_pass_one()</code>. The basic structure of this code
  *  is to loop over the data structure created in <code>asm_pass_one()</code>,
- *  generate object code (16 bit LC3 instructions) and write it to the object
- *  file.
- *  @param obj_file_name - name of the object file for this source code
+ *  generate object code (16 bit LC3 instructions) and place it in an image of
+ *  the program. When the loop is complete, the image is written to each of
+ *  the requested output files. Listing rows are written as each line is
+ *  encoded.
+ *  @param outputs - names of the files to produce
  */
-void asm_pass_two(char* obj_file_name);
+void asm_pass_two(asm_outputs_t* outputs);
 
 /** A function to print the infomation extracted from a source line. This is
  *  used for debugging.
@@ -189,19 +392,26 @@ void asm_print_line_info (line_info_t* info);
 /** Initialze everything used by the assembler */
 void asm_init (void);
 
+/** Discard everything from the previous assembly (source lines, symbols,
+ *  image, error count) so another program can be assembled. The opcode
+ *  and token tables set up by <code>asm_init()</code> are kept.
+ */
+void asm_reset (void);
+
 /** Cleanup everything used by the assembler */
 void asm_term (void);
 
 /** A function to check if the token is a label. In LC3 assembly language,
  *  the optional label may preceed the opcode. Therefore, if the token is
- *  <b>not</b> a valid opcode, assume it is label. If it is a valid label,
+ *  <b>not</b> an opcode, assume it is label. If it is a valid label,
  *  add it to the symbol table. Report any errors found using
- *  <code>asm_error()</code>.
+ *  <code>asm_error()</code>. The lexer has already classified the token, so
+ *  no names are compared here.
  *  @param token - the token to consider
  *  @return If the token <b>is</b> a label, then return the <b>next</b> token.
  *  Otherwise, return the parameter.
  */
-char* check_for_label (char* token);
+lex_token_t* check_for_label (lex_token_t* token);
 
 /** A function to check the syntax of a source line. At the conclusion of this
  *  function, the appropriate fields of the global <code>currInfo</code> are
@@ -222,24 +432,7 @@ char* check_for_label (char* token);
  *  @param token - the first token on the line. This could be a label or an
  *  operator (e.g. <code>ADD</code> or <code>.FILL</code>).
  */
-void check_line_syntax (char *token);
-
-/** A second pass function to take one field from the <code>currInfo</code>
- *  structure and place it in the <code>machineCode<field>. The flow of
- *  this function mirrors the code of pass one function
- *  <code>get_operand()</code>.
- *  @param operand - the type of operand
- */
-void encode_operand (operand_t operand);
-
-/** This second pass function is used to convert the reference into a PC offset.
- *  There are several errors that may occur. The reference may not occur in
- *  the symbol table, or the offset may be out of range. If successful, this
- *  function puts the PC offset in the <code>machineCode</code> field of
- *  <code>currInfo</code>.
- *  @param width - the number of bits that hold the PC offset
- */
-void encode_PC_offset_or_error (int width);
+void check_line_syntax (lex_token_t* token);
 
 /** A convenience function to make sure the next token is a comma and report
  *  an error if it is not.
@@ -247,42 +440,47 @@ void encode_PC_offset_or_error (int width);
 void get_comma_or_error (void);
 
 /** A convenience function to convert an token to an immediate value. Used for
- *  the imm5/offset6/trapvect8/.ORIG values. The value is obtained by calling a
- *  function provided for you in the <code>lc3</code> module. If
- *  the value is not in the correct format, or out of range, report an error
- *  using <code>lc3_as_error()</code>. If it is good, store it in the
- *  <code>immediate</code> field of <code>currInfo</code>
- *  @param token - the string to be converted to an immediate
+ *  the imm5/offset6/trapvect8/.ORIG values. The value was converted by the
+ *  lexer. If the value is not in the correct format, or out of range, report
+ *  an error using <code>asm_error()</code>. If it is good, store it in the
+ *  <code>immediate</code> field of <code>currInfo</code>.
+ *  <p>
+ *  A constant, label or expression is stored in <code>reference</code> and
+ *  evaluated once pass one has resolved every constant, except for the
+ *  operands of <code>.ORIG</code> and <code>.BLKW</code>, whose value must be
+ *  known immediately. A 16 bit value may be given signed or unsigned.
+ *  @param token - the token to be converted to an immediate
  *  @param width - how many bits are used to store the value
  *  @param isSigned - specifies if number is signed or unsigned
  */
-void get_immediate_or_error (char* token, int width, int isSigned);
+void get_immediate_or_error (lex_token_t* token, int width, int isSigned);
 
 /** A convenience function to get the label reference used in the
  *  <code>BR/LD/LDI/LEA/ST/STI/JSR</code> instructions.
  *  The code should make sure it is a
  *  valid label. If it is valid, store it in the <code>reference</code> field of
- *  <code>currInfo</code>. If is not a valid label, report an error. You should
+ *  <code>currInfo</code>. If is not a valid label, report an error. An
+ *  expression such as <code>TABLE+3</code> is also accepted. You should
  *  understand why this routine may not be able to directly calculate the
  *  PCoffset.
  *  @param token - the reference to check
  */
-void get_PC_offset_or_error (char* token);
+void get_PC_offset_or_error (lex_token_t* token);
 
 /** A convenience function to convert the token to a value and store it in
  *  the <code>currInfo</code> data structure.
  *  @param operand - the type of operand that is expected
  *  @param token - the token to be converted
  */
-void get_operand (operand_t operand, char* token);
+void get_operand (operand_t operand, lex_token_t* token);
 
-/** A function to convert a string to a register number and report an error
- *  if the string does <b>not</b> represent an register.  Use the function
+/** A function to get the register number of a token and report an error
+ *  if the token does <b>not</b> represent an register.  Use the function
  *  <code>asm_error()</code> to report errors.
- *  @param token - the string to convert to a register
+ *  @param token - the token to convert to a register
  *  @return the register number, or -1 on an error
  */
-int get_reg_or_error (char* token);
+int get_reg_or_error (lex_token_t* token);
 
 /** Open file for reading and report an error on failure. Use the C function
  *  <code>fopen()</code> and report errors using <code>asm_error()</code>.
@@ -330,14 +528,23 @@ void scan_operands (operands_t operands);
  *  <ul>
  *  <li>a line containing only a label does not change <code>currAddr</code></li>
  *  <li><code>.ORIG</code> replaces the value of <code>currAddr</code> by
- *  its operand</li>
+ *  its operand. A program may contain several <code>.ORIG</code>/<code>.END
+ *  </code> blocks; pass one reports blocks whose addresses overlap.</li>
+ *  <li><code>.END</code> does not change <code>currAddr</code></li>
  *  <li><code>.BLKW</code> uses the number of words specified by its operand</li>
  *  <li><code>.STRINGZ</code> uses the length of the string minus one words.
         Make sure you understand how many word(s) a string uses.</li>
  *  <li>Some pseudo ops may expand to multiple LC3 instructions. For example,
- *  if the was a <code>.PUSH</code> pseudo-op, it would use two words.
+ *  <code>.NEG</code> uses two words (NOT and ADD).
  *  </ul>
  */
 void update_address (void);
 
+/** Return the number of words a line occupies in LC3 memory, as used by
+ *  <code>update_address()</code>. <code>.ORIG</code> occupies none.
+ *  @param info - the line
+ *  @return the number of words
+ */
+int line_size (line_info_t* info);
+
 #endif
@@ -0,0 +1,278 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+#include "batch.h"
+#include "bio.h"
+#include "diag.h"
+#include "include.h"
+#include "mem.h"
+
+/** The state of a file of the batch */
+typedef struct batch_state {
+  bio_req_t  read;    /**< the read of its source                  */
+  int        ready;   /**< the read was returned by bio_wait()     */
+  int        failed;  /**< it could not be assembled or written     */
+} batch_state_t;
+
+/** Outputs of the file being assembled, not yet submitted */
+static bio_req_t* outHead;
+static bio_req_t* outTail;
+
+/** The state of the file being assembled */
+static batch_state_t* current;
+
+/** The archive receiving the results, or NULL (see archive.h) */
+static archive_writer_t* archive;
+
+/** Diagnostics of the file being assembled, kept for the archive */
+static char*  diagText;
+static size_t diagLength;
+
+/** Keep an output of the file being assembled (see asm_set_output_fnc) */
+static void keep_output (char* file_name, char* data, size_t length) {
+  bio_req_t* req = mem_calloc(MEM_BATCH, 1, sizeof(bio_req_t));
+
+  req->isWrite = 1;
+  req->name    = file_name;
+  req->data    = data;
+  req->length  = length;
+  req->user    = current;
+
+  if (outTail != NULL)
+    outTail->next = req;
+  else
+    outHead = req;
+
+  outTail = req;
+}
+
+/** Submit the outputs kept, or discard them */
+static void flush_outputs (int submit) {
+  bio_req_t* next;
+
+  for (bio_req_t* req = outHead; req != NULL; req = next) {
+    next = req->next;
+
+    if (submit) {
+      bio_submit(req);
+    }
+    else {
+      free(req->data);
+      mem_free(req);
+    }
+  }
+
+  outHead = outTail = NULL;
+}
+
+/** Keep the diagnostics of the file being assembled for the archive, and
+ *  print them
+ */
+static void keep_diagnostics (void) {
+  FILE* f = open_memstream(&diagText, &diagLength);
+
+  if (f == NULL) {
+    diag_flush(stderr);
+    return;
+  }
+
+  diag_flush(f);
+  fclose(f);
+  fputs(diagText, stderr);
+}
+
+/** Append the entry of a file to the archive: its outputs kept, unless it
+ *  failed, and its diagnostics. They are then freed.
+ */
+static void archive_outputs (batch_file_t* file, batch_state_t* state) {
+  int n = 0;
+
+  for (bio_req_t* req = outHead; req != NULL; req = req->next)
+    n++;
+
+  archive_member_t* members  = mem_calloc(MEM_BATCH, n + 1,
+                                          sizeof(archive_member_t));
+  char*             diagName = NULL;
+
+  n = 0;
+
+  for (bio_req_t* req = outHead; req != NULL && ! state->failed;
+       req = req->next)
+    members[n++] = (archive_member_t) { req->name, req->data, req->length };
+
+  if (diagText != NULL) {
+    const char* dot = strrchr(file->asm_file_name, '.');
+    int         len = (dot != NULL) ? dot - file->asm_file_name
+                                    : (int) strlen(file->asm_file_name);
+
+    diagName = mem_alloc(MEM_BATCH, len + sizeof(".diag"));
+    memcpy(diagName, file->asm_file_name, len);
+    strcpy(diagName + len, ".diag");
+    members[n++] = (archive_member_t) { diagName, diagText, diagLength };
+  }
+
+  // a write error is reported when the archive is closed
+  archive_add(archive, file->asm_file_name, numErrors, members, n);
+  flush_outputs(0);
+  mem_free(members);
+  mem_free(diagName);
+  free(diagText);
+  diagText = NULL;
+}
+
+/** Handle a request returned by bio_wait() */
+static void complete (bio_req_t* req) {
+  batch_state_t* state = req->user;
+
+  if (! req->isWrite) {
+    state->ready = 1;
+    return;
+  }
+
+  if (req->error != 0) {
+    fprintf(stderr, "ERROR: ");
+    fprintf(stderr, ERR_WRITE, req->name);
+    fprintf(stderr, " (%s)\n", strerror(req->error));
+    state->failed = 1;
+  }
+
+  free(req->data);
+  mem_free(req);
+}
+
+/** Remove the outputs left by an earlier assembly of a file that failed */
+static void remove_outputs (batch_file_t* file) {
+  char* names[] = { file->sym_file_name, file->outputs.obj_file_name,
+                    file->outputs.hex_file_name, file->outputs.lst_file_name,
+                    file->outputs.sobj_file_name, file->outputs.cost_file_name,
+                    file->outputs.dbg_file_name,
+                    file->outputs.xref_file_name, file->outputs.ir_file_name };
+
+  for (int i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+    if (names[i] != NULL)
+      remove(names[i]); // errors ignored
+  }
+}
+
+/** Assemble one file whose source was read, keeping its outputs */
+static void assemble (batch_file_t* file, batch_state_t* state,
+                      int maxErrors, int optimize) {
+  asm_reset();
+  diag_init(maxErrors);
+
+  if (state->read.error != 0)
+    asm_error(ERR_OPEN_READ, file->asm_file_name);
+  else {
+    include_set_source(file->asm_file_name);
+    asm_pass_one_text(state->read.data, state->read.length);
+  }
+
+  free(state->read.data);
+  state->read.data = NULL;
+
+  if (numErrors == 0 && optimize)
+    asm_optimize();
+
+  if (numErrors == 0 && file->sym_file_name != NULL)
+    asm_write_sym(file->sym_file_name);
+
+  if (numErrors == 0) {
+    srcLineNum = 0;
+    asm_pass_two(&file->outputs);
+  }
+
+  if (diag_count() > 0) {
+    fprintf(stderr, "%s:\n", file->asm_file_name);
+
+    if (archive != NULL)
+      keep_diagnostics();
+    else
+      diag_flush(stderr);
+  }
+
+  state->failed = (numErrors != 0);
+  printf("%s: %d errors found\n", file->asm_file_name, numErrors);
+}
+
+int batch_run (batch_file_t* files, int count, int maxErrors, int optimize,
+               int backend, const char* archiveName) {
+  batch_state_t* states = mem_calloc(MEM_BATCH, count, sizeof(batch_state_t));
+  int            next   = 0; // next source to read
+  int            failed = 0;
+  bio_req_t*     req;
+
+  if (bio_init(backend) < 0) {
+    mem_free(states);
+    return -1;
+  }
+
+  if (archiveName != NULL) {
+    int error = archive_create(archiveName, &archive);
+
+    if (error != 0) {
+      fprintf(stderr, "ERROR: ");
+      fprintf(stderr, ERR_OPEN_WRITE, archiveName);
+      fprintf(stderr, " (%s)\n", strerror(error));
+      bio_term();
+      mem_free(states);
+      return count;
+    }
+  }
+
+  asm_set_output_fnc(keep_output);
+
+  for (int i = 0; i < count; i++) {
+    for (; next < count && next < i + BATCH_READ_AHEAD; next++) {
+      states[next].read.name = files[next].asm_file_name;
+      states[next].read.user = &states[next];
+      bio_submit(&states[next].read);
+    }
+
+    while (! states[i].ready && (req = bio_wait()) != NULL)
+      complete(req);
+
+    current = &states[i];
+    assemble(&files[i], &states[i], maxErrors, optimize);
+
+    if (archive != NULL)
+      archive_outputs(&files[i], &states[i]);
+    else
+      flush_outputs(! states[i].failed);
+  }
+
+  while ((req = bio_wait()) != NULL)
+    complete(req);
+
+  asm_set_output_fnc(NULL);
+
+  for (int i = 0; i < count; i++) {
+    if (states[i].failed) {
+      if (archive == NULL) // nothing else is written with an archive
+        remove_outputs(&files[i]);
+      failed++;
+    }
+  }
+
+  if (archive != NULL) {
+    int error = archive_close(archive);
+
+    archive = NULL;
+
+    if (error != 0) {
+      fprintf(stderr, "ERROR: ");
+      fprintf(stderr, ERR_WRITE, archiveName);
+      fprintf(stderr, " (%s)\n", strerror(error));
+      failed = count;
+    }
+  }
+
+  printf("%d of %d files assembled (%s I/O)\n", count - failed, count,
+         bio_backend_name());
+  bio_term();
+  mem_free(states);
+  return failed;
+}
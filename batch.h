@@ -0,0 +1,51 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+/** @file batch.h
+ *  @brief interface to the batch assembler
+ *  @details Selected when <code>mylc3as</code> is given several source
+ *  files. The files are assembled one after the other by the sequential
+ *  assembler, while their I/O is done by <code>bio.h</code>: the sources of
+ *  the next <code>BATCH_READ_AHEAD</code> files are read while a file is
+ *  assembled, and the outputs of each file are kept in memory (see
+ *  <code>asm_set_output_fnc()</code>) and written together once it is
+ *  assembled without errors. With io_uring, reading or writing a file costs
+ *  a share of one <code>io_uring_enter()</code> instead of an
+ *  <code>open/fstat/read/close</code> or <code>open/write/close</code>
+ *  sequence of system calls.
+ *  <p>
+ *  With an archive (see <code>archive.h</code>), the outputs of every file
+ *  and its diagnostics are appended to it instead, and no other file is
+ *  written.
+ */
+
+#include "assembler.h"
+
+/** Number of sources read ahead of the file being assembled */
+#define BATCH_READ_AHEAD 32
+
+/** Typedef of structure type */
+typedef struct batch_file batch_file_t;
+
+/** A source file and the outputs to produce from it */
+struct batch_file {
+  char*         asm_file_name;  /**< name of the source                    */
+  char*         sym_file_name;  /**< symbol table file, or <code>NULL</code> */
+  asm_outputs_t outputs;        /**< names of the other outputs            */
+};
+
+/** Assemble each file, printing the errors of each and a summary
+ *  @param files - the files to assemble
+ *  @param count - the number of files
+ *  @param maxErrors - limit on errors reported per file (0 for no limit)
+ *  @param optimize - run the optimizer (<code>-O</code>)
+ *  @param backend - the I/O backend (see <code>bio_init()</code>)
+ *  @param archiveName - the archive receiving the results, or
+ *  <code>NULL</code> to write the outputs to their files
+ *  @return the number of files that could not be assembled (all of them if
+ *  the archive could not be written), or -1 if the backend is not available
+ */
+int batch_run (batch_file_t* files, int count, int maxErrors, int optimize,
+               int backend, const char* archiveName);
+
+#endif /* __BATCH_H__ */
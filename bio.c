@@ -0,0 +1,588 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "bio.h"
+
+/** Number of submission queue entries (three per request) */
+#define URING_ENTRIES 256
+
+/** The operation of a submission, kept in the low bits of its user_data */
+#define OP_OPEN  0
+#define OP_RW    1
+#define OP_CLOSE 2
+#define OP_MASK  3
+
+/** The backend started */
+static int backend = -1;
+
+/** Requests queued, not yet started (io_uring: waiting for a slot) */
+static bio_req_t* queueHead;
+static bio_req_t* queueTail;
+
+/** Requests complete, not yet returned by bio_wait() */
+static bio_req_t* doneHead;
+static bio_req_t* doneTail;
+
+/** Requests submitted and not yet returned by bio_wait() */
+static int inProgress;
+
+/** Append a request to a queue */
+static void enqueue (bio_req_t** head, bio_req_t** tail, bio_req_t* req) {
+  req->next = NULL;
+
+  if (*tail != NULL)
+    (*tail)->next = req;
+  else
+    *head = req;
+
+  *tail = req;
+}
+
+/** Remove the first request of a queue, NULL if it is empty */
+static bio_req_t* dequeue (bio_req_t** head, bio_req_t** tail) {
+  bio_req_t* req = *head;
+
+  if (req != NULL) {
+    *head = req->next;
+
+    if (*head == NULL)
+      *tail = NULL;
+  }
+
+  return req;
+}
+
+/** Read the whole of a file, starting at <code>req->length</code> bytes
+ *  that were already read, using ordinary system calls
+ */
+static void read_rest (bio_req_t* req) {
+  int         fd = open(req->name, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    req->error = errno;
+
+    if (fd >= 0)
+      close(fd);
+
+    return;
+  }
+
+  size_t size = (st.st_size > (off_t) req->length) ? st.st_size : req->length;
+  char*  data = realloc(req->data, size + 1);
+
+  if (data == NULL) {
+    req->error = ENOMEM;
+    close(fd);
+    return;
+  }
+
+  req->data = data;
+
+  while (req->length < size) {
+    ssize_t count = pread(fd, data + req->length, size - req->length,
+                          req->length);
+
+    if (count < 0 && errno == EINTR)
+      continue;
+
+    if (count <= 0) {
+      if (count < 0)
+        req->error = errno;
+      break;
+    }
+
+    req->length += count;
+  }
+
+  data[req->length] = '\0';
+  close(fd);
+}
+
+/** Write the whole of a file using ordinary system calls */
+static void write_all (bio_req_t* req) {
+  int    fd   = open(req->name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  size_t done = 0;
+
+  if (fd < 0) {
+    req->error = errno;
+    return;
+  }
+
+  while (done < req->length) {
+    ssize_t count = pwrite(fd, req->data + done, req->length - done, done);
+
+    if (count < 0 && errno == EINTR)
+      continue;
+
+    if (count < 0) {
+      req->error = errno;
+      break;
+    }
+
+    done += count;
+  }
+
+  if (close(fd) != 0 && req->error == 0)
+    req->error = errno;
+}
+
+/* ---------------------------- io_uring --------------------------------- */
+
+/** The io_uring instance */
+static int ringFd = -1;
+
+/** The submission ring */
+static unsigned*            sqHead;
+static unsigned*            sqTail;
+static unsigned*            sqMask;
+static unsigned*            sqArray;
+static struct io_uring_sqe* sqes;
+
+/** The completion ring */
+static unsigned*            cqHead;
+static unsigned*            cqTail;
+static unsigned*            cqMask;
+static struct io_uring_cqe* cqes;
+
+/** The mapped rings and their sizes */
+static void*  sqRing;
+static size_t sqRingSize;
+static void*  cqRing;
+static size_t cqRingSize;
+static size_t sqesSize;
+
+/** Submissions written to the ring and not yet passed to the kernel */
+static unsigned toSubmit;
+
+/** Direct descriptors not in use */
+static int freeSlots[BIO_DEPTH];
+static int numFree;
+
+/** The request using each direct descriptor, NULL if it is not in use */
+static bio_req_t* slotReqs[BIO_DEPTH];
+
+static int uring_setup (unsigned entries, struct io_uring_params* p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter (unsigned submit, unsigned wait, unsigned flags) {
+  return syscall(__NR_io_uring_enter, ringFd, submit, wait, flags, NULL, 0);
+}
+
+static int uring_register (unsigned op, void* arg, unsigned count) {
+  return syscall(__NR_io_uring_register, ringFd, op, arg, count);
+}
+
+/** Release the io_uring instance and its rings */
+static void uring_term (void) {
+  if (sqes != NULL && sqes != MAP_FAILED)
+    munmap(sqes, sqesSize);
+
+  if (cqRing != NULL && cqRing != MAP_FAILED && cqRing != sqRing)
+    munmap(cqRing, cqRingSize);
+
+  if (sqRing != NULL && sqRing != MAP_FAILED)
+    munmap(sqRing, sqRingSize);
+
+  if (ringFd >= 0)
+    close(ringFd);
+
+  ringFd = -1;
+  sqRing = cqRing = NULL;
+  sqes   = NULL;
+}
+
+/** Create an io_uring instance with a table of direct descriptors
+ *  @return 1 on success, 0 if io_uring can not be used
+ */
+static int uring_init (void) {
+  struct io_uring_params p;
+  int                    fds[BIO_DEPTH];
+
+  memset(&p, 0, sizeof(p));
+  ringFd = uring_setup(URING_ENTRIES, &p);
+
+  if (ringFd < 0 || ! (p.features & IORING_FEAT_SINGLE_MMAP)) {
+    uring_term();
+    return 0;
+  }
+
+  sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+  if (cqRingSize > sqRingSize)
+    sqRingSize = cqRingSize;
+
+  sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  sqRing   = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  cqRing   = sqRing;
+  sqes     = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+  if (sqRing == MAP_FAILED || sqes == MAP_FAILED) {
+    uring_term();
+    return 0;
+  }
+
+  sqHead  = (unsigned*) ((char*) sqRing + p.sq_off.head);
+  sqTail  = (unsigned*) ((char*) sqRing + p.sq_off.tail);
+  sqMask  = (unsigned*) ((char*) sqRing + p.sq_off.ring_mask);
+  sqArray = (unsigned*) ((char*) sqRing + p.sq_off.array);
+  cqHead  = (unsigned*) ((char*) cqRing + p.cq_off.head);
+  cqTail  = (unsigned*) ((char*) cqRing + p.cq_off.tail);
+  cqMask  = (unsigned*) ((char*) cqRing + p.cq_off.ring_mask);
+  cqes    = (struct io_uring_cqe*) ((char*) cqRing + p.cq_off.cqes);
+
+  for (int i = 0; i < BIO_DEPTH; i++) {
+    fds[i]       = -1; // an empty slot
+    freeSlots[i] = i;
+    slotReqs[i]  = NULL;
+  }
+
+  numFree  = BIO_DEPTH;
+  toSubmit = 0;
+
+  if (uring_register(IORING_REGISTER_FILES, fds, BIO_DEPTH) != 0) {
+    uring_term();
+    return 0;
+  }
+
+  return 1;
+}
+
+/** Get the next submission queue entry, cleared */
+static struct io_uring_sqe* uring_sqe (bio_req_t* req, int op) {
+  unsigned             tail = *sqTail + toSubmit;
+  unsigned             idx  = tail & *sqMask;
+  struct io_uring_sqe* sqe  = &sqes[idx];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = (unsigned long long) (size_t) req | op;
+  sqArray[idx]   = idx;
+  toSubmit++;
+  return sqe;
+}
+
+static int threads_init (void);
+static void uring_reap (void);
+
+/** Give up the ring after a failure: the requests in it fail with the
+ *  error, and the threads carry out the requests still queued
+ */
+static void uring_fail (int error) {
+  uring_reap(); // the completions already posted
+
+  for (int i = 0; i < BIO_DEPTH; i++) {
+    bio_req_t* req = slotReqs[i];
+
+    if (req == NULL)
+      continue;
+
+    // the kernel may still write the buffer of a read, so it is not freed
+    if (! req->isWrite) {
+      req->data   = NULL;
+      req->length = 0;
+    }
+
+    slotReqs[i] = NULL;
+    req->error  = error;
+    req->done   = 1;
+    enqueue(&doneHead, &doneTail, req);
+  }
+
+  toSubmit = 0;
+  uring_term();
+  backend = threads_init() ? BIO_THREADS : -1;
+}
+
+/** Pass the entries written to the kernel, and wait for completions
+ *  @param wait - number of completions to wait for
+ *  @return 1 on success, 0 if the ring failed (see uring_fail())
+ */
+static int uring_flush (unsigned wait) {
+  __atomic_store_n(sqTail, *sqTail + toSubmit, __ATOMIC_RELEASE);
+
+  while (toSubmit > 0 || wait > 0) {
+    int count = uring_enter(toSubmit, wait,
+                            (wait > 0) ? IORING_ENTER_GETEVENTS : 0);
+
+    if (count < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        continue;
+
+      uring_fail(errno);
+      return 0;
+    }
+
+    toSubmit -= count;
+
+    if (toSubmit == 0)
+      break;
+  }
+
+  return 1;
+}
+
+/** Write the chain of a request: open, read or write, close */
+static void uring_start (bio_req_t* req) {
+  struct io_uring_sqe* sqe;
+
+  req->slot    = freeSlots[--numFree];
+  req->pending = 3;
+
+  if (! req->isWrite) {
+    req->data = malloc(BIO_READ_SIZE + 1);
+
+    if (req->data == NULL) {
+      req->error = ENOMEM;
+      req->pending = 0;
+      freeSlots[numFree++] = req->slot;
+      enqueue(&doneHead, &doneTail, req);
+      return;
+    }
+  }
+
+  slotReqs[req->slot] = req;
+
+  sqe              = uring_sqe(req, OP_OPEN);
+  sqe->opcode      = IORING_OP_OPENAT;
+  sqe->fd          = AT_FDCWD;
+  sqe->addr        = (unsigned long long) (size_t) req->name;
+  sqe->open_flags  = req->isWrite ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+  sqe->len         = req->isWrite ? 0666 : 0;
+  sqe->file_index  = req->slot + 1;
+  sqe->flags       = IOSQE_IO_LINK; // on failure, the rest is cancelled
+
+  sqe              = uring_sqe(req, OP_RW);
+  sqe->opcode      = req->isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd          = req->slot;
+  sqe->addr        = (unsigned long long) (size_t) req->data;
+  sqe->len         = req->isWrite ? req->length : BIO_READ_SIZE;
+  sqe->off         = 0;
+  sqe->flags       = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK; // always close
+
+  sqe              = uring_sqe(req, OP_CLOSE);
+  sqe->opcode      = IORING_OP_CLOSE;
+  sqe->file_index  = req->slot + 1;
+}
+
+/** Start queued requests while there are free slots */
+static void uring_start_queued (void) {
+  while (queueHead != NULL && numFree > 0)
+    uring_start(dequeue(&queueHead, &queueTail));
+
+  if (toSubmit >= 3 * BIO_BATCH)
+    uring_flush(0);
+}
+
+/** Record one completion */
+static void uring_complete (struct io_uring_cqe* cqe) {
+  bio_req_t* req = (bio_req_t*) (size_t) (cqe->user_data & ~OP_MASK);
+  int        op  = cqe->user_data & OP_MASK;
+  int        res = cqe->res;
+
+  if (op == OP_OPEN && res < 0) {
+    req->error = -res;
+  }
+  else if (op == OP_RW && req->error == 0) {
+    if (res < 0)
+      req->error = -res;
+    else if (req->isWrite && (size_t) res != req->length)
+      req->error = EIO;
+    else if (! req->isWrite)
+      req->length = res;
+  }
+
+  if (--req->pending > 0)
+    return;
+
+  freeSlots[numFree++] = req->slot;
+  slotReqs[req->slot]  = NULL;
+
+  if (! req->isWrite && req->error == 0) {
+    if (req->length == BIO_READ_SIZE) // there may be more
+      read_rest(req);
+    else
+      req->data[req->length] = '\0';
+  }
+
+  if (! req->isWrite && req->error != 0) {
+    free(req->data);
+    req->data   = NULL;
+    req->length = 0;
+  }
+
+  req->done = 1;
+  enqueue(&doneHead, &doneTail, req);
+}
+
+/** Record every completion available */
+static void uring_reap (void) {
+  unsigned head = *cqHead;
+  unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++)
+    uring_complete(&cqes[head & *cqMask]);
+
+  __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+/* ---------------------------- threads ---------------------------------- */
+
+static pthread_t       workers[BIO_THREADS_NUM];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  workReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  workDone  = PTHREAD_COND_INITIALIZER;
+static int             stopping;
+
+/** A worker: carry out queued requests until stopped */
+static void* work (void* arg) {
+  pthread_mutex_lock(&lock);
+
+  for (;;) {
+    while (queueHead == NULL && ! stopping)
+      pthread_cond_wait(&workReady, &lock);
+
+    if (queueHead == NULL)
+      break;
+
+    bio_req_t* req = dequeue(&queueHead, &queueTail);
+    pthread_mutex_unlock(&lock);
+
+    if (req->isWrite) {
+      write_all(req);
+    }
+    else {
+      req->length = 0;
+      read_rest(req);
+
+      if (req->error != 0) {
+        free(req->data);
+        req->data = NULL;
+      }
+    }
+
+    pthread_mutex_lock(&lock);
+    req->done = 1;
+    enqueue(&doneHead, &doneTail, req);
+    pthread_cond_signal(&workDone);
+  }
+
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+static int threads_init (void) {
+  stopping = 0;
+
+  for (int i = 0; i < BIO_THREADS_NUM; i++)
+    pthread_create(&workers[i], NULL, work, NULL);
+
+  return 1;
+}
+
+static void threads_term (void) {
+  pthread_mutex_lock(&lock);
+  stopping = 1;
+  pthread_cond_broadcast(&workReady);
+  pthread_mutex_unlock(&lock);
+
+  for (int i = 0; i < BIO_THREADS_NUM; i++)
+    pthread_join(workers[i], NULL);
+}
+
+/* ---------------------------- interface -------------------------------- */
+
+int bio_init (int which) {
+  queueHead = queueTail = doneHead = doneTail = NULL;
+  inProgress = 0;
+
+  if (which != BIO_THREADS && uring_init())
+    backend = BIO_URING;
+  else if (which != BIO_URING && threads_init())
+    backend = BIO_THREADS;
+  else
+    backend = -1;
+
+  return backend;
+}
+
+const char* bio_backend_name (void) {
+  switch (backend) {
+    case BIO_URING:   return "io_uring";
+    case BIO_THREADS: return "threads";
+    default:          return "none";
+  }
+}
+
+void bio_submit (bio_req_t* req) {
+  req->error = 0;
+  req->done  = 0;
+  req->data  = req->isWrite ? req->data : NULL;
+  inProgress++;
+
+  if (backend == BIO_URING) {
+    enqueue(&queueHead, &queueTail, req);
+    uring_start_queued();
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  enqueue(&queueHead, &queueTail, req);
+  pthread_cond_signal(&workReady);
+  pthread_mutex_unlock(&lock);
+}
+
+bio_req_t* bio_wait (void) {
+  bio_req_t* req;
+
+  if (inProgress == 0)
+    return NULL;
+
+  if (backend == BIO_URING) {
+    uring_reap();
+
+    while (doneHead == NULL && uring_flush(1)) {
+      uring_reap();
+      uring_start_queued();
+    }
+  }
+
+  // the ring may have failed, leaving the rest to the threads
+  if (backend == BIO_URING) {
+    req = dequeue(&doneHead, &doneTail);
+  }
+  else {
+    pthread_mutex_lock(&lock);
+
+    while (doneHead == NULL)
+      pthread_cond_wait(&workDone, &lock);
+
+    req = dequeue(&doneHead, &doneTail);
+    pthread_mutex_unlock(&lock);
+  }
+
+  inProgress--;
+  return req;
+}
+
+void bio_term (void) {
+  if (backend == BIO_URING)
+    uring_term();
+  else if (backend == BIO_THREADS)
+    threads_term();
+
+  backend = -1;
+}
@@ -0,0 +1,87 @@
+#ifndef __BIO_H__
+#define __BIO_H__
+
+/** @file bio.h
+ *  @brief interface to batched file I/O, used to assemble many files
+ *  @details Reading a source or writing an output is a request, which is
+ *  queued and later returned by <code>bio_wait()</code> once complete.
+ *  Requests are carried out by one of two backends:
+ *  <ul>
+ *  <li><b>io_uring</b> (Linux 5.15 or later, used directly through its
+ *      system calls). A read is a linked chain <code>OPENAT</code>,
+ *      <code>READ</code>, <code>CLOSE</code> and a write is a chain
+ *      <code>OPENAT</code>, <code>WRITE</code>, <code>CLOSE</code>, all on
+ *      a direct descriptor, so the file is never seen by the program. The
+ *      chains queued are submitted together by a single
+ *      <code>io_uring_enter()</code> when <code>BIO_BATCH</code> requests
+ *      are queued or the program waits, which reaps every completion
+ *      available at the same time. A file larger than
+ *      <code>BIO_READ_SIZE</code> is completed by ordinary reads. If the
+ *      ring fails, the requests in it complete with the error and the
+ *      threads backend carries out the others.</li>
+ *  <li><b>threads</b>, used when io_uring is not available: a pool of
+ *      <code>BIO_THREADS_NUM</code> threads carrying out each request with
+ *      <code>open/pread/close</code> or <code>open/pwrite/close</code>.</li>
+ *  </ul>
+ */
+
+#include <stddef.h>
+
+/** Backends, for <code>bio_init()</code> */
+#define BIO_AUTO    0  /**< io_uring if available, else threads */
+#define BIO_URING   1  /**< io_uring                            */
+#define BIO_THREADS 2  /**< a pool of threads                   */
+
+/** Maximum number of requests in progress with io_uring */
+#define BIO_DEPTH 64
+
+/** Number of requests queued before they are submitted */
+#define BIO_BATCH 32
+
+/** Size of the first read of a file */
+#define BIO_READ_SIZE 65536
+
+/** Number of threads of the thread backend */
+#define BIO_THREADS_NUM 4
+
+/** Typedef of structure type */
+typedef struct bio_req bio_req_t;
+
+/** A request to read or write a whole file */
+struct bio_req {
+  int        isWrite;  /**< write data to the file, else read it         */
+  char*      name;     /**< name of the file                             */
+  char*      data;     /**< text read (allocated by bio, freed by the
+                            caller with free()) or written               */
+  size_t     length;   /**< number of bytes read or to write             */
+  int        error;    /**< 0 or the errno value of the failure          */
+  int        done;     /**< set when the request is complete             */
+  void*      user;     /**< for use by the caller                        */
+  int        pending;  /**< completions not yet received (internal)      */
+  int        slot;     /**< direct descriptor used (internal)            */
+  bio_req_t* next;     /**< next request in a queue (internal)           */
+};
+
+/** Start a backend
+ *  @param backend - BIO_AUTO, BIO_URING or BIO_THREADS
+ *  @return the backend started, or -1 if the requested one is not available
+ */
+int bio_init (int backend);
+
+/** Get the name of the backend started */
+const char* bio_backend_name (void);
+
+/** Queue a request. The request and its name and data must stay valid
+ *  until it is returned by <code>bio_wait()</code>.
+ */
+void bio_submit (bio_req_t* req);
+
+/** Wait for a request to complete
+ *  @return a completed request, or NULL if no request is in progress
+ */
+bio_req_t* bio_wait (void);
+
+/** Stop the backend. Every request must be complete. */
+void bio_term (void);
+
+#endif /* __BIO_H__ */
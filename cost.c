@@ -0,0 +1,583 @@
+#include <string.h>
+
+#include "cost.h"
+#include "mem.h"
+
+/** Number of LC3 addresses */
+#define NUM_ADDRESSES 0x10000
+
+/** Marks in <code>leader</code> */
+#define LEAD_BLOCK 1 /**< a basic block starts at the address  */
+#define LEAD_ENTRY 2 /**< a subroutine starts at the address   */
+
+/** States of a block or subroutine during a depth first search */
+#define DFS_NEW    0
+#define DFS_ACTIVE 1
+#define DFS_DONE   2
+
+/** Typedef of structure type */
+typedef struct cost_block cost_block_t;
+
+/** A basic block */
+struct cost_block {
+  line_info_t* first;     /**< first line of the block                  */
+  line_info_t* last;      /**< last line of the block                   */
+  int          words;     /**< instructions executed by the block       */
+  int          isEntry;   /**< a subroutine starts here                 */
+  int          succ[2];   /**< blocks executed next, -1 if none         */
+  int          callee;    /**< block called by a JSR ending the block   */
+  int          sub;       /**< subroutine of the block, -1 if none      */
+  int          state;     /**< DFS_NEW, DFS_ACTIVE or DFS_DONE          */
+  int          cursor;    /**< next successor examined by the search    */
+  int          longest;   /**< instructions on the longest path to exit */
+  int          nextLoop;  /**< next loop header of the subroutine or -1 */
+};
+
+/** Typedef of structure type */
+typedef struct cost_sub cost_sub_t;
+
+/** A subroutine */
+struct cost_sub {
+  int entry;                   /**< block where the subroutine starts     */
+  int numBlocks;               /**< blocks in the subroutine              */
+  int words;                   /**< instructions in the subroutine        */
+  int loads;                   /**< LD, LDI, LDR                          */
+  int stores;                  /**< ST, STI, STR                          */
+  int accesses;                /**< data memory accesses                  */
+  int mix[NUM_OPCODES][2];     /**< count of each opcode and form         */
+  int firstLoop;               /**< first loop header, or -1              */
+  int lastLoop;                /**< last loop header, or -1               */
+  int firstCall;               /**< index of its calls in the call list   */
+  int numCalls;                /**< number of calls made                  */
+  int state;                   /**< DFS_NEW, DFS_ACTIVE or DFS_DONE       */
+  int cursor;                  /**< next call examined by the search      */
+  int depth;                   /**< deepest chain of calls it starts      */
+  int recursive;               /**< it calls a subroutine that is active  */
+};
+
+/** Mark of each address starting a block or subroutine */
+static unsigned char* leader;
+
+/** The block starting at each address, or -1 */
+static int* blockAt;
+
+/** The basic blocks, in the order of the source */
+static cost_block_t* blocks;
+static int           numBlocks;
+
+/** The subroutines, in the order of their entries in the source */
+static cost_sub_t* subs;
+static int         numSubs;
+
+/** The subroutines called by each subroutine, grouped by caller */
+static int* calls;
+
+/** Stack used by the depth first searches */
+static int* stack;
+
+/** The last subroutine (plus 1) whose calls listed each subroutine */
+static int* listedBy;
+
+/** Determine if a line is an instruction (as opposed to data) */
+static int is_code (line_info_t* info) {
+  switch (info->opcode) {
+    case OP_BLKW: case OP_FILL: case OP_STRINGZ:
+      return 0;
+    default:
+      return line_size(info) > 0;
+  }
+}
+
+/** Determine if an instruction ends a basic block */
+static int ends_block (line_info_t* info) {
+  switch (info->opcode) {
+    case OP_BR:  case OP_JSR_JSRR: case OP_JMP_RET:
+    case OP_RTI: case OP_HALT:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/** Get the target of a BR or JSR, -1 if there is none or it is unknown */
+static int direct_target (line_info_t* info) {
+  int target;
+
+  if ((info->opcode == OP_BR && (info->reg1 & 7) != 0) ||
+      (info->opcode == OP_JSR_JSRR && info->form == 1)) {
+    if (asm_get_target(info, &target))
+      return target & 0xFFFF;
+  }
+
+  return -1;
+}
+
+/** Mark the addresses where blocks and subroutines start */
+static void find_leaders (line_info_t* head) {
+  int prevEnd  = -1; // address after the previous instruction
+  int newBlock = 1;  // a .ORIG block was just started
+
+  memset(leader, 0, NUM_ADDRESSES);
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    if (info->opcode == OP_ORIG || info->opcode == OP_END) {
+      prevEnd  = -1;
+      newBlock = 1;
+      continue;
+    }
+
+    if (! is_code(info)) {
+      if (line_size(info) > 0)
+        prevEnd = -1;
+
+      continue;
+    }
+
+    int addr   = info->address & 0xFFFF;
+    int target = direct_target(info);
+
+    if (newBlock)
+      leader[addr] = LEAD_ENTRY;
+    else if (addr != prevEnd && leader[addr] == 0)
+      leader[addr] = LEAD_BLOCK;
+
+    if (target >= 0) {
+      if (info->opcode == OP_JSR_JSRR)
+        leader[target] = LEAD_ENTRY;
+      else if (leader[target] == 0)
+        leader[target] = LEAD_BLOCK;
+    }
+
+    newBlock = 0;
+    prevEnd  = (addr + line_size(info)) & 0xFFFF;
+
+    if (ends_block(info) && leader[prevEnd] == 0)
+      leader[prevEnd] = LEAD_BLOCK;
+  }
+}
+
+/** Start a new basic block at a line */
+static cost_block_t* new_block (line_info_t* info, int* capacity) {
+  if (numBlocks == *capacity) {
+    *capacity = (*capacity == 0) ? 64 : 2 * *capacity;
+    blocks    = mem_realloc(MEM_ANALYSIS, blocks,
+                            *capacity * sizeof(cost_block_t));
+  }
+
+  cost_block_t* block = &blocks[numBlocks];
+  memset(block, 0, sizeof(cost_block_t));
+  block->first    = info;
+  block->isEntry  = (leader[info->address & 0xFFFF] == LEAD_ENTRY);
+  block->sub      = -1;
+  block->nextLoop = -1;
+  blockAt[info->address & 0xFFFF] = numBlocks++;
+  return block;
+}
+
+/** Split the instructions into basic blocks */
+static void find_blocks (line_info_t* head) {
+  cost_block_t* block    = NULL;
+  int           capacity = 0;
+
+  for (int i = 0; i < NUM_ADDRESSES; i++)
+    blockAt[i] = -1;
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    if (! is_code(info)) {
+      if (line_size(info) > 0 || info->opcode == OP_ORIG ||
+          info->opcode == OP_END)
+        block = NULL;
+
+      continue;
+    }
+
+    if (block == NULL || leader[info->address & 0xFFFF] != 0)
+      block = new_block(info, &capacity);
+
+    block->last   = info;
+    block->words += line_size(info);
+
+    if (ends_block(info))
+      block = NULL;
+  }
+}
+
+/** Find the blocks executed after each block, and the blocks called */
+static void find_edges (void) {
+  for (int b = 0; b < numBlocks; b++) {
+    cost_block_t* block  = &blocks[b];
+    line_info_t*  last   = block->last;
+    int           next   = blockAt[(last->address + line_size(last)) & 0xFFFF];
+    int           target = direct_target(last);
+    int           cond   = last->reg1 & 7;
+
+    block->succ[0] = block->succ[1] = block->callee = -1;
+
+    switch (last->opcode) {
+      case OP_BR:
+        if (target >= 0)
+          block->succ[0] = blockAt[target];
+
+        if (cond != 7)
+          block->succ[1] = next;
+        break;
+
+      case OP_JSR_JSRR:
+        if (target >= 0)
+          block->callee = blockAt[target];
+
+        block->succ[0] = next;
+        break;
+
+      case OP_JMP_RET: case OP_RTI: case OP_HALT:
+        break;
+
+      default:
+        block->succ[0] = next;
+        break;
+    }
+  }
+}
+
+/** Assign each block to the first subroutine reaching it */
+static void find_subroutines (void) {
+  numSubs = 0;
+
+  for (int b = 0; b < numBlocks; b++) {
+    if (blocks[b].isEntry)
+      numSubs++;
+  }
+
+  subs    = mem_calloc(MEM_ANALYSIS, numSubs + 1, sizeof(cost_sub_t));
+  numSubs = 0;
+
+  for (int b = 0; b < numBlocks; b++) {
+    if (! blocks[b].isEntry)
+      continue;
+
+    int top = 0;
+
+    subs[numSubs].entry = b;
+    blocks[b].sub       = numSubs;
+    stack[top++]        = b;
+
+    while (top > 0) {
+      cost_block_t* block = &blocks[stack[--top]];
+
+      for (int i = 0; i < 2; i++) {
+        int s = block->succ[i];
+
+        if (s >= 0 && blocks[s].sub < 0 && ! blocks[s].isEntry) {
+          blocks[s].sub = numSubs;
+          stack[top++]  = s;
+        }
+      }
+    }
+
+    numSubs++;
+  }
+}
+
+/** Find the loop headers of a subroutine and the longest path from each of
+ *  its blocks, using a depth first search from its entry. A successor that
+ *  is still active when a block is finished is reached by a back edge.
+ */
+static void find_paths (int sub) {
+  int top = 0;
+
+  stack[top++] = subs[sub].entry;
+  blocks[subs[sub].entry].state = DFS_ACTIVE;
+
+  while (top > 0) {
+    cost_block_t* block = &blocks[stack[top - 1]];
+
+    if (block->cursor < 2) {
+      int s = block->succ[block->cursor++];
+
+      if (s < 0 || blocks[s].sub != sub)
+        continue;
+
+      if (blocks[s].state == DFS_NEW) {
+        blocks[s].state = DFS_ACTIVE;
+        stack[top++]    = s;
+      }
+      else if (blocks[s].state == DFS_ACTIVE && blocks[s].nextLoop == -1 &&
+               subs[sub].lastLoop != s) { // new loop header
+        if (subs[sub].lastLoop < 0)
+          subs[sub].firstLoop = s;
+        else
+          blocks[subs[sub].lastLoop].nextLoop = s;
+
+        subs[sub].lastLoop = s;
+      }
+
+      continue;
+    }
+
+    int longest = 0;
+
+    for (int i = 0; i < 2; i++) {
+      int s = block->succ[i];
+
+      if (s >= 0 && blocks[s].sub == sub && blocks[s].state == DFS_DONE &&
+          blocks[s].longest > longest)
+        longest = blocks[s].longest;
+    }
+
+    block->longest = block->words + longest;
+    block->state   = DFS_DONE;
+    top--;
+  }
+}
+
+/** Add the instructions of a block to the counts of its subroutine */
+static void count_block (cost_block_t* block) {
+  cost_sub_t* sub = &subs[block->sub];
+
+  sub->numBlocks++;
+  sub->words += block->words;
+
+  for (line_info_t* info = block->first; ; info = info->next) {
+    if (is_code(info)) {
+      sub->mix[info->opcode][info->form & 1]++;
+
+      switch (info->opcode) {
+        case OP_LD:  case OP_LDR:
+          sub->loads++;    sub->accesses++;    break;
+        case OP_LDI:
+          sub->loads++;    sub->accesses += 2; break;
+        case OP_ST:  case OP_STR:
+          sub->stores++;   sub->accesses++;    break;
+        case OP_STI:
+          sub->stores++;   sub->accesses += 2; break;
+        default:
+          break;
+      }
+    }
+
+    if (info == block->last)
+      break;
+  }
+}
+
+/** List the subroutines called by each subroutine, grouped by caller */
+static void find_calls (void) {
+  int total = 0;
+
+  for (int b = 0; b < numBlocks; b++) {
+    if (blocks[b].sub >= 0 && blocks[b].callee >= 0 &&
+        blocks[blocks[b].callee].sub >= 0) {
+      subs[blocks[b].sub].numCalls++;
+      total++;
+    }
+  }
+
+  calls = mem_alloc(MEM_ANALYSIS, (total + 1) * sizeof(int));
+  total = 0;
+
+  for (int s = 0; s < numSubs; s++) {
+    subs[s].firstCall = total;
+    total            += subs[s].numCalls;
+    subs[s].numCalls  = 0;
+  }
+
+  for (int b = 0; b < numBlocks; b++) {
+    if (blocks[b].sub >= 0 && blocks[b].callee >= 0 &&
+        blocks[blocks[b].callee].sub >= 0) {
+      cost_sub_t* sub = &subs[blocks[b].sub];
+      calls[sub->firstCall + sub->numCalls++] = blocks[blocks[b].callee].sub;
+    }
+  }
+}
+
+/** Find the deepest chain of calls started by each subroutine, using a
+ *  depth first search of the call graph. A call to an active subroutine is
+ *  recursion and is not followed.
+ */
+static void find_depths (void) {
+  for (int root = 0; root < numSubs; root++) {
+    int top = 0;
+
+    if (subs[root].state != DFS_NEW)
+      continue;
+
+    stack[top++]     = root;
+    subs[root].state = DFS_ACTIVE;
+
+    while (top > 0) {
+      cost_sub_t* sub = &subs[stack[top - 1]];
+
+      if (sub->cursor < sub->numCalls) {
+        cost_sub_t* callee = &subs[calls[sub->firstCall + sub->cursor++]];
+
+        if (callee->state == DFS_NEW) {
+          callee->state = DFS_ACTIVE;
+          stack[top++]  = callee - subs;
+        }
+        else if (callee->state == DFS_ACTIVE) {
+          sub->recursive = 1;
+        }
+        else if (callee->depth + 1 > sub->depth) {
+          sub->depth = callee->depth + 1;
+        }
+
+        continue;
+      }
+
+      sub->state = DFS_DONE;
+
+      if (--top > 0) {
+        cost_sub_t* caller = &subs[stack[top - 1]];
+
+        if (sub->depth + 1 > caller->depth)
+          caller->depth = sub->depth + 1;
+      }
+    }
+  }
+}
+
+/** Write the name of a subroutine: the label at its entry or its address */
+static void write_name (FILE* f, cost_sub_t* sub) {
+  line_info_t* info = blocks[sub->entry].first;
+
+  if (info->label != NULL)
+    fprintf(f, "\"%s\"", info->label);
+  else
+    fprintf(f, "\"x%04X\"", info->address & 0xFFFF);
+}
+
+/** Write one entry of the mix of instructions, if its count is not 0 */
+static void write_count (FILE* f, const char* name, int count,
+                         const char** sep) {
+  if (count > 0) {
+    fprintf(f, "%s\"%s\": %d", *sep, name, count);
+    *sep = ", ";
+  }
+}
+
+/** Write the mix of instructions of a subroutine. The forms of an opcode
+ *  are counted separately when they have different names (JSR/JSRR).
+ */
+static void write_mix (FILE* f, cost_sub_t* sub) {
+  const char* sep = "";
+
+  fprintf(f, "      \"mix\": {");
+
+  for (int op = 0; op < NUM_OPCODES; op++) {
+    inst_format_t* forms = lc3_get_inst_info(op)->forms;
+
+    if (forms[1].name != NULL && strcmp(forms[0].name, forms[1].name) != 0) {
+      write_count(f, forms[0].name, sub->mix[op][0], &sep);
+      write_count(f, forms[1].name, sub->mix[op][1], &sep);
+    }
+    else {
+      write_count(f, forms[0].name, sub->mix[op][0] + sub->mix[op][1], &sep);
+    }
+  }
+
+  fprintf(f, "},\n");
+}
+
+/** Write the report for one subroutine */
+static void write_sub (FILE* f, cost_sub_t* sub, int isLast) {
+  cost_block_t* entry = &blocks[sub->entry];
+  const char*   sep   = "";
+
+  fprintf(f, "    {\n      \"name\": ");
+  write_name(f, sub);
+  fprintf(f, ",\n      \"address\": \"x%04X\",\n",
+          entry->first->address & 0xFFFF);
+  fprintf(f, "      \"blocks\": %d,\n", sub->numBlocks);
+  fprintf(f, "      \"instructions\": %d,\n", sub->words);
+  fprintf(f, "      \"loads\": %d,\n", sub->loads);
+  fprintf(f, "      \"stores\": %d,\n", sub->stores);
+  fprintf(f, "      \"memoryAccesses\": %d,\n", sub->accesses);
+  write_mix(f, sub);
+  fprintf(f, "      \"worstPath\": %d,\n", entry->longest);
+  fprintf(f, "      \"loopHeaders\": [");
+
+  for (int b = sub->firstLoop; b >= 0; b = blocks[b].nextLoop) {
+    fprintf(f, "%s\"x%04X\"", sep, blocks[b].first->address & 0xFFFF);
+    sep = ", ";
+  }
+
+  fprintf(f, "],\n      \"calls\": [");
+  sep = "";
+
+  for (int i = 0; i < sub->numCalls; i++) {
+    int callee = calls[sub->firstCall + i];
+
+    if (listedBy[callee] != sub - subs + 1) { // each callee listed once
+      listedBy[callee] = sub - subs + 1;
+      fputs(sep, f);
+      write_name(f, &subs[callee]);
+      sep = ", ";
+    }
+  }
+
+  fprintf(f, "],\n      \"callDepth\": %d,\n", sub->depth);
+  fprintf(f, "      \"recursive\": %s\n", sub->recursive ? "true" : "false");
+  fprintf(f, "    }%s\n", isLast ? "" : ",");
+}
+
+int cost_write (FILE* f, line_info_t* head) {
+  leader    = mem_alloc(MEM_ANALYSIS, NUM_ADDRESSES);
+  blockAt   = mem_alloc(MEM_ANALYSIS, NUM_ADDRESSES * sizeof(int));
+  blocks    = NULL;
+  numBlocks = 0;
+
+  find_leaders(head);
+  find_blocks(head);
+  find_edges();
+
+  stack = mem_alloc(MEM_ANALYSIS, (numBlocks + 1) * sizeof(int));
+  find_subroutines();
+
+  int unreachable = 0;
+  int maxDepth    = 0;
+  int recursive   = 0;
+
+  for (int s = 0; s < numSubs; s++) {
+    subs[s].firstLoop = subs[s].lastLoop = -1;
+    find_paths(s);
+  }
+
+  for (int b = 0; b < numBlocks; b++) {
+    if (blocks[b].sub >= 0)
+      count_block(&blocks[b]);
+    else
+      unreachable += blocks[b].words;
+  }
+
+  find_calls();
+  find_depths();
+  listedBy = mem_calloc(MEM_ANALYSIS, numSubs + 1, sizeof(int));
+
+  fprintf(f, "{\n  \"subroutines\": [\n");
+
+  for (int s = 0; s < numSubs; s++) {
+    write_sub(f, &subs[s], s == numSubs - 1);
+
+    if (subs[s].depth > maxDepth)
+      maxDepth = subs[s].depth;
+
+    recursive |= subs[s].recursive;
+  }
+
+  fprintf(f, "  ],\n  \"maxCallDepth\": %d,\n", maxDepth);
+  fprintf(f, "  \"recursive\": %s,\n", recursive ? "true" : "false");
+  fprintf(f, "  \"unreachableInstructions\": %d\n}\n", unreachable);
+
+  mem_free(leader);
+  mem_free(blockAt);
+  mem_free(blocks);
+  mem_free(subs);
+  mem_free(calls);
+  mem_free(stack);
+  mem_free(listedBy);
+  leader  = NULL;
+  blockAt = stack = calls = listedBy = NULL;
+  blocks  = NULL;
+  subs    = NULL;
+  return ! ferror(f);
+}
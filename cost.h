@@ -0,0 +1,47 @@
+#ifndef __COST_H__
+#define __COST_H__
+
+/** @file cost.h
+ *  @brief interface to the static cost report of a program
+ *  @details The report is selected by <code>mylc3as -cost</code> and written
+ *  to a <code>.cost.json</code> file. It is computed from the lines found by
+ *  pass one, without running the program:
+ *  <ul>
+ *  <li>The instructions are split into <b>basic blocks</b>. A block starts
+ *      at the first instruction after a <code>.ORIG</code> or data, at the
+ *      target of a <code>BR</code> or <code>JSR</code> and after a
+ *      <code>BR</code>, <code>JSR/JSRR</code>, <code>JMP/RET</code>,
+ *      <code>RTI</code> or <code>HALT</code>.</li>
+ *  <li>A <b>subroutine</b> starts at the first instruction of each
+ *      <code>.ORIG</code> block and at each <code>JSR</code> target. It is
+ *      made of the blocks reached from its entry by branches and falling
+ *      through, without entering another subroutine. Code reached from more
+ *      than one subroutine is counted in the first one. <code>JMP</code>,
+ *      <code>JSRR</code> and <code>RET</code> have no known target, so they
+ *      end a path.</li>
+ *  <li>For each subroutine the report gives the number of blocks and
+ *      instructions, the mix of instructions, the loads, stores and memory
+ *      accesses (<code>LDI/STI</code> access memory twice), the loop
+ *      headers (targets of back edges found by a depth first search), the
+ *      subroutines it calls and the deepest chain of calls it starts.</li>
+ *  <li><code>worstPath</code> is the number of instructions on the longest
+ *      path from the entry to an exit of the subroutine, counting each loop
+ *      once and not counting the subroutines called.</li>
+ *  </ul>
+ *  Every block and edge is visited a constant number of times, so the
+ *  report is computed in time linear in the size of the program.
+ */
+
+#include <stdio.h>
+
+#include "assembler.h"
+
+/** Write the cost report of a program as JSON. Pass one must have completed
+ *  without errors.
+ *  @param f - the file to write to
+ *  @param head - the first line of the program
+ *  @return 1 on success, 0 if there was a write error
+ */
+int cost_write (FILE* f, line_info_t* head);
+
+#endif /* __COST_H__ */
@@ -0,0 +1,340 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dbgmap.h"
+#include "include.h"
+#include "mem.h"
+
+/** Bytes of the longest variable-length integer written (32 bits) */
+#define VARINT_MAX 5
+
+/** Typedef of structure type */
+typedef struct dbg_reader dbg_reader_t;
+
+/** Position in the content of a map being decoded */
+struct dbg_reader {
+  const unsigned char* p;    /**< next byte                        */
+  const unsigned char* end;  /**< end of the content               */
+  int                  bad;  /**< the content ended or was invalid */
+};
+
+/** Store an unsigned variable-length integer */
+static unsigned char* put_varint (unsigned char* p, unsigned int value) {
+  while (value >= 0x80) {
+    *p++    = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+
+  *p++ = value;
+  return p;
+}
+
+/** Read an unsigned variable-length integer */
+static unsigned int get_varint (dbg_reader_t* r) {
+  unsigned int value = 0;
+
+  for (int shift = 0; shift < 7 * VARINT_MAX && r->p < r->end; shift += 7) {
+    unsigned char b = *r->p++;
+
+    value |= (unsigned int) (b & 0x7F) << shift;
+
+    if ((b & 0x80) == 0)
+      return value;
+  }
+
+  r->bad = 1;
+  return 0;
+}
+
+/** Order ranges by address */
+static int compare_range (const void* a, const void* b) {
+  return ((const dbg_range_t*) a)->addr - ((const dbg_range_t*) b)->addr;
+}
+
+/** Find the index of the file of a line, adding it to the files
+ *  @param units - the units of the files (units[0] is NULL, the source)
+ *  @param numUnits - the number of files
+ */
+static int file_index (int srcFile, inc_unit_t** units, int* numUnits) {
+  if (srcFile == 0)
+    return 0;
+
+  inc_unit_t* unit = include_unit(srcFile);
+
+  for (int i = 1; i < *numUnits; i++) {
+    if (units[i] == unit)
+      return i;
+  }
+
+  units[*numUnits] = unit;
+  return (*numUnits)++;
+}
+
+int dbgmap_write (FILE* f, line_info_t* head) {
+  int numLines = 0;
+
+  for (line_info_t* info = head; info != NULL; info = info->next)
+    numLines++;
+
+  dbg_range_t* ranges   = mem_alloc(MEM_OUTPUT,
+                                    (numLines + 1) * sizeof(dbg_range_t));
+  inc_unit_t** units    = mem_alloc(MEM_OUTPUT,
+                                    (numLines + 1) * sizeof(inc_unit_t*));
+  int          numUnits = 1;
+  int          n        = 0;
+  int          inBlock  = 0;
+
+  units[0] = NULL;
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    if (info->opcode == OP_ORIG)
+      inBlock = 1;
+    else if (info->opcode == OP_END)
+      inBlock = 0;
+
+    int size = line_size(info);
+    int addr = info->address;
+
+    if (! inBlock || size <= 0 || addr > 0xFFFF)
+      continue;
+
+    if (size > 0x10000 - addr) // the rest is not in LC3 memory
+      size = 0x10000 - addr;
+
+    int          file = file_index(info->srcFile, units, &numUnits);
+    dbg_range_t* last = (n > 0) ? &ranges[n - 1] : NULL;
+
+    if (last != NULL && last->addr + last->length == addr &&
+        last->lineNum == info->lineNum && last->file == file)
+      last->length += size; // e.g. lines added by the optimizer
+    else
+      ranges[n++] = (dbg_range_t) { addr, size, info->lineNum, file };
+  }
+
+  qsort(ranges, n, sizeof(dbg_range_t), compare_range);
+
+  int kept = 0;
+
+  for (int i = 0; i < n; i++) { // drop what overlaps a range before
+    int end = (kept > 0) ? ranges[kept - 1].addr + ranges[kept - 1].length : 0;
+
+    if (ranges[i].addr + ranges[i].length <= end)
+      continue;
+
+    if (ranges[i].addr < end) {
+      ranges[i].length -= end - ranges[i].addr;
+      ranges[i].addr    = end;
+    }
+
+    ranges[kept++] = ranges[i];
+  }
+
+  n = kept;
+
+  size_t len = 5 + VARINT_MAX * (2 + 4 * (size_t) n);
+
+  for (int i = 1; i < numUnits; i++)
+    len += VARINT_MAX + strlen(units[i]->name);
+
+  unsigned char* buf  = mem_alloc(MEM_OUTPUT, len);
+  unsigned char* p    = buf;
+  int            end  = 0;
+  int            line = 0;
+
+  memcpy(p, "LC3D", 4);
+  p[4] = DBG_VERSION;
+  p    = put_varint(p + 5, numUnits);
+  p    = put_varint(p, 0); // the source file
+
+  for (int i = 1; i < numUnits; i++) {
+    int nameLen = strlen(units[i]->name);
+
+    p = put_varint(p, nameLen);
+    memcpy(p, units[i]->name, nameLen);
+    p += nameLen;
+  }
+
+  p = put_varint(p, n);
+
+  for (int i = 0; i < n; i++) {
+    int delta = ranges[i].lineNum - line;
+
+    p    = put_varint(p, ranges[i].addr - end);
+    p    = put_varint(p, ranges[i].length);
+    p    = put_varint(p, (delta >= 0) ? 2 * delta : -2 * delta - 1);
+    p    = put_varint(p, ranges[i].file);
+    end  = ranges[i].addr + ranges[i].length;
+    line = ranges[i].lineNum;
+  }
+
+  int ok = fwrite(buf, 1, p - buf, f) == (size_t) (p - buf);
+
+  mem_free(buf);
+  mem_free(units);
+  mem_free(ranges);
+  return ok;
+}
+
+/** Decode the content of a map
+ *  @return 1 on success, 0 if the content is not valid
+ */
+static int decode_map (const unsigned char* data, size_t length,
+                       dbg_map_t* map) {
+  dbg_reader_t r = { data + 5, data + length, 0 };
+
+  if (length < 5 || memcmp(data, "LC3D", 4) != 0 || data[4] != DBG_VERSION)
+    return 0;
+
+  unsigned int numFiles = get_varint(&r);
+
+  if (r.bad || numFiles == 0 || numFiles > length)
+    return 0;
+
+  // the names are kept after the pointers, in one block
+  map->files    = mem_alloc(MEM_IMAGE, numFiles * sizeof(char*) + length);
+  map->numFiles = numFiles;
+  char* names   = (char*) (map->files + numFiles);
+
+  for (unsigned int i = 0; i < numFiles; i++) {
+    unsigned int nameLen = get_varint(&r);
+
+    if (r.bad || nameLen > (size_t) (r.end - r.p))
+      return 0;
+
+    map->files[i] = names;
+    memcpy(names, r.p, nameLen);
+    names[nameLen] = '\0';
+    names += nameLen + 1;
+    r.p   += nameLen;
+  }
+
+  unsigned int numRanges = get_varint(&r);
+
+  if (r.bad || numRanges > length)
+    return 0;
+
+  map->ranges    = mem_alloc(MEM_IMAGE, (numRanges + 1) * sizeof(dbg_range_t));
+  map->numRanges = numRanges;
+
+  unsigned int end  = 0;
+  int          line = 0;
+
+  for (unsigned int i = 0; i < numRanges; i++) {
+    dbg_range_t* range = &map->ranges[i];
+    unsigned int gap   = get_varint(&r);
+    unsigned int size  = get_varint(&r);
+    unsigned int delta = get_varint(&r);
+
+    range->file    = get_varint(&r);
+    range->addr    = end + gap;
+    range->length  = size;
+    range->lineNum = line + ((delta & 1) ? -(int) (delta >> 1) - 1
+                                         : (int) (delta >> 1));
+
+    if (r.bad || gap > 0x10000 || size == 0 || size > 0x10000 ||
+        range->addr + size > 0x10000 || range->file >= numFiles)
+      return 0;
+
+    end  = range->addr + size;
+    line = range->lineNum;
+  }
+
+  // the first range ending after the start of each page
+  int first = 0;
+
+  for (int page = 0; page < DBG_NUM_PAGES; page++) {
+    while (first < map->numRanges &&
+           map->ranges[first].addr + map->ranges[first].length <=
+           page * DBG_PAGE_SIZE)
+      first++;
+
+    map->pages[page] = first;
+  }
+
+  map->pages[DBG_NUM_PAGES] = map->numRanges;
+  return 1;
+}
+
+int dbgmap_load (const char* file_name, dbg_map_t* map) {
+  struct stat st;
+  int         fd = open(file_name, O_RDONLY);
+
+  memset(map, 0, sizeof(dbg_map_t));
+
+  if (fd < 0)
+    return errno;
+
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    return error;
+  }
+
+  if (st.st_size < 5) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t         length = st.st_size;
+  unsigned char* data   = mmap(NULL, length, PROT_READ,
+                               MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd); // the mapping stays valid
+
+  if (data == MAP_FAILED)
+    return errno;
+
+  int ok = decode_map(data, length, map);
+
+  munmap(data, length);
+
+  if (! ok) {
+    dbgmap_free(map);
+    return EINVAL;
+  }
+
+  return 0;
+}
+
+dbg_range_t* dbgmap_lookup (dbg_map_t* map, int addr) {
+  if (addr < 0 || addr > 0xFFFF || map->numRanges == 0)
+    return NULL;
+
+  // the range containing addr is one of these (see dbgmap.h)
+  int page = addr >> DBG_PAGE_BITS;
+  int lo   = map->pages[page];
+  int hi   = map->pages[page + 1];
+
+  if (hi >= map->numRanges)
+    hi = map->numRanges - 1;
+
+  // the last range starting at or before addr
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+
+    if (map->ranges[mid].addr <= addr)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  dbg_range_t* range = &map->ranges[lo];
+
+  if (lo >= map->numRanges || range->addr > addr ||
+      addr >= range->addr + range->length)
+    return NULL;
+
+  return range;
+}
+
+void dbgmap_free (dbg_map_t* map) {
+  mem_free(map->ranges);
+  mem_free(map->files);
+  memset(map, 0, sizeof(dbg_map_t));
+}
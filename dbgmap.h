@@ -0,0 +1,102 @@
+#ifndef __DBGMAP_H__
+#define __DBGMAP_H__
+
+/** @file dbgmap.h
+ *  @brief interface to the debug map, from addresses to source lines
+ *  @details Selected by <code>-dbg</code>, pass two writes a
+ *  <code>.dbg</code> file next to the object file. A debugger or simulator
+ *  loads it to show the source line of the PC on every step or breakpoint.
+ *  <p>
+ *  The map is a list of address ranges, sorted by address, each generated
+ *  by one source line: an instruction is a range of one word (two for
+ *  <code>NEG</code>), and a <code>.BLKW</code> or <code>.STRINGZ</code> is
+ *  one range covering all its words. Lines of included files (see
+ *  <code>include.h</code>) refer to their file and their line in it. Every
+ *  value is delta-encoded from the previous range and written as a
+ *  variable-length integer (7 bits per byte, low bits first, high bit set
+ *  on all bytes but the last), so most ranges take three or four bytes:
+ *  <pre>
+ *  "LC3D" version                     identifies the format (version 1)
+ *  numFiles (length name)*            names of the files, file 0 is the
+ *                                     source file (its name is empty)
+ *  numRanges                          then, for each range:
+ *    gap                              start - end of the previous range
+ *    length                           number of words
+ *    lineDelta                        line - line of the previous range,
+ *                                     zigzag encoded (0, -1, 1, -2 ...)
+ *    file                             index in the names
+ *  </pre>
+ *  <code>dbgmap_load()</code> decodes the ranges into an array and builds
+ *  a page table: for each page of <code>DBG_PAGE_SIZE</code> addresses,
+ *  the first range that ends in or after it. A lookup only searches the
+ *  ranges of one page, so it takes a few comparisons whatever the size of
+ *  the program.
+ */
+
+#include <stdio.h>
+
+#include "assembler.h"
+
+/** Version of the format written */
+#define DBG_VERSION 1
+
+/** log2 of the number of addresses of a page of the page table */
+#define DBG_PAGE_BITS 8
+
+/** Number of addresses of a page */
+#define DBG_PAGE_SIZE (1 << DBG_PAGE_BITS)
+
+/** Number of pages covering LC3 memory */
+#define DBG_NUM_PAGES (0x10000 >> DBG_PAGE_BITS)
+
+/** Typedef of structure type */
+typedef struct dbg_range dbg_range_t;
+
+/** Words generated by one source line */
+struct dbg_range {
+  int addr;     /**< LC3 address of the first word               */
+  int length;   /**< number of words                             */
+  int lineNum;  /**< line in its file                            */
+  int file;     /**< index of the file in the names of the map   */
+};
+
+/** Typedef of structure type */
+typedef struct dbg_map dbg_map_t;
+
+/** A debug map loaded by <code>dbgmap_load()</code> */
+struct dbg_map {
+  dbg_range_t* ranges;                   /**< the ranges, sorted by address */
+  int          numRanges;                /**< number of ranges              */
+  char**       files;                    /**< names of the files, the first
+                                              is "" (the source file)      */
+  int          numFiles;                 /**< number of files               */
+  int          pages[DBG_NUM_PAGES + 1]; /**< first range ending after the
+                                              start of each page           */
+};
+
+/** Write the debug map of the lines of the program
+ *  @param f - the file to write to
+ *  @param head - the first line of the program
+ *  @return 1 on success, 0 on a write error
+ */
+int dbgmap_write (FILE* f, line_info_t* head);
+
+/** Load a debug map
+ *  @param file_name - name of the file
+ *  @param map - set to the map, to free with <code>dbgmap_free()</code>
+ *  @return 0 on success, else the errno value of the failure (EINVAL if the
+ *  file is not a valid debug map)
+ */
+int dbgmap_load (const char* file_name, dbg_map_t* map);
+
+/** Find the range containing an address
+ *  @param map - the map
+ *  @param addr - an LC3 address
+ *  @return the range, or NULL if no line generated the word at the address
+ */
+dbg_range_t* dbgmap_lookup (dbg_map_t* map, int addr);
+
+/** Free a map loaded by <code>dbgmap_load()</code> */
+void dbgmap_free (dbg_map_t* map);
+
+#endif /* __DBGMAP_H__ */
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "diag.h"
+#include "mem.h"
+
+/** The recorded diagnostics */
+static diag_t* diags;
+
+/** Number of diagnostics recorded */
+static int numDiags;
+
+/** Number of entries allocated in <code>diags</code> */
+static int capacity;
+
+/** Number of diagnostics reported since <code>diag_init()</code> */
+static int numReported;
+
+/** Number of errors after which the assembly stops (0 for no limit) */
+static int maxErrors = DIAG_MAX_ERRORS;
+
+/** Protects the records, errors may be reported by several threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+void diag_init (int max) {
+  pthread_mutex_lock(&lock);
+  numDiags    = 0;
+  numReported = 0;
+  maxErrors   = max;
+  pthread_mutex_unlock(&lock);
+}
+
+/** Find the conversion (%s/%d) in a message format, or NULL if none */
+static const char* find_conversion (const char* code) {
+  const char* p = strchr(code, '%');
+  return (p != NULL && (p[1] == 's' || p[1] == 'd')) ? p : NULL;
+}
+
+/** Determine if the limit is reached, with the lock held */
+static int limit_reached (void) {
+  return (maxErrors > 0) && (numReported >= maxErrors);
+}
+
+void diag_report (int lineNum, const char* file, int fileLine, int column,
+                  const char* code, va_list args) {
+  pthread_mutex_lock(&lock);
+  numReported++;
+
+  if (maxErrors > 0 && numDiags >= maxErrors) {
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+
+  if (numDiags == capacity) {
+    capacity = (capacity > 0) ? 2 * capacity : 64;
+    diags    = mem_realloc(MEM_DIAG, diags, capacity * sizeof(diag_t));
+  }
+
+  diag_t*     d    = &diags[numDiags];
+  const char* conv = find_conversion(code);
+
+  d->lineNum  = lineNum;
+  d->file     = file;
+  d->fileLine = fileLine;
+  d->column  = column;
+  d->seq     = numDiags++;
+  d->code    = code;
+  d->arg[0]  = '\0';
+
+  if (conv != NULL && conv[1] == 'd') {
+    snprintf(d->arg, DIAG_MAX_ARG, "%d", va_arg(args, int));
+  }
+  else if (conv != NULL) {
+    const char* s = va_arg(args, const char*);
+    snprintf(d->arg, DIAG_MAX_ARG, "%s", (s != NULL) ? s : "");
+  }
+
+  pthread_mutex_unlock(&lock);
+}
+
+int diag_limit_reached (void) {
+  pthread_mutex_lock(&lock);
+  int reached = limit_reached();
+  pthread_mutex_unlock(&lock);
+  return reached;
+}
+
+int diag_count (void) {
+  pthread_mutex_lock(&lock);
+  int count = numDiags;
+  pthread_mutex_unlock(&lock);
+  return count;
+}
+
+diag_t* diag_get (int index) {
+  return (index >= 0 && index < numDiags) ? &diags[index] : NULL;
+}
+
+int diag_format (diag_t* d, char* buf, int size) {
+  const char* conv = find_conversion(d->code);
+  int         len  = (conv != NULL) ? conv - d->code : (int) strlen(d->code);
+  const char* rest = (conv != NULL) ? conv + 2 : "";
+  char        where[32 + DIAG_MAX_ARG];
+
+  if (d->file != NULL && d->column > 0)
+    snprintf(where, sizeof(where), "%.*s:%d:%d", DIAG_MAX_ARG, d->file,
+             d->fileLine, d->column);
+  else if (d->file != NULL)
+    snprintf(where, sizeof(where), "%.*s:%d", DIAG_MAX_ARG, d->file,
+             d->fileLine);
+  else if (d->column > 0)
+    snprintf(where, sizeof(where), "%3d:%d", d->lineNum, d->column);
+  else
+    snprintf(where, sizeof(where), "%3d", d->lineNum);
+
+  return snprintf(buf, size, "ERROR %s: %.*s%s%s\n", where, len, d->code,
+                  d->arg, rest);
+}
+
+/** Order diagnostics by line, keeping the reporting order within a line */
+static int compare_diag (const void* a, const void* b) {
+  const diag_t* d1 = a;
+  const diag_t* d2 = b;
+
+  if (d1->lineNum != d2->lineNum)
+    return (d1->lineNum < d2->lineNum) ? -1 : 1;
+
+  return d1->seq - d2->seq;
+}
+
+void diag_sort (void) {
+  pthread_mutex_lock(&lock);
+
+  if (numDiags > 1)
+    qsort(diags, numDiags, sizeof(diag_t), compare_diag);
+
+  pthread_mutex_unlock(&lock);
+}
+
+void diag_flush (FILE* f) {
+  diag_sort();
+  pthread_mutex_lock(&lock);
+
+  if (numDiags == 0) {
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+
+  int   size = numDiags * 128 + 128;
+  char* buf  = mem_alloc(MEM_OUTPUT, size);
+  int   len  = 0;
+
+  for (int i = 0; i < numDiags; i++) {
+    int n = diag_format(&diags[i], buf + len, size - len);
+
+    if (n >= size - len) { // truncated, make room and redo this one
+      size = 2 * size + n;
+      buf  = mem_realloc(MEM_OUTPUT, buf, size);
+      n    = diag_format(&diags[i], buf + len, size - len);
+    }
+
+    len += n;
+  }
+
+  if (limit_reached()) {
+    if (size - len < 128) {
+      size = len + 128;
+      buf  = mem_realloc(MEM_OUTPUT, buf, size);
+    }
+
+    len += snprintf(buf + len, size - len,
+                    "ERROR: too many errors (max %d), assembly stopped\n",
+                    maxErrors);
+  }
+
+  fwrite(buf, 1, len, f);
+  fflush(f);
+  mem_free(buf);
+  numDiags = 0;
+  pthread_mutex_unlock(&lock);
+}
+
+void diag_term (void) {
+  pthread_mutex_lock(&lock);
+  mem_free(diags);
+  diags    = NULL;
+  numDiags = capacity = 0;
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,95 @@
+#ifndef __DIAG_H__
+#define __DIAG_H__
+
+/** @file diag.h
+ *  @brief interface to the diagnostics engine of the assembler
+ *  @details Errors are not printed when they are found. Instead each one is
+ *  recorded as a structured record (line, column, code and argument text).
+ *  When a pass completes, the records are ordered by line and written with
+ *  a single call to <code>fwrite()</code>. The number of records kept is
+ *  bounded. Once the limit set by <code>diag_init()</code> is reached the
+ *  assembler stops, so malformed input can not produce an unbounded
+ *  amount of output. Errors may be reported from any thread.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+
+/** Default maximum number of errors before the assembly is stopped */
+#define DIAG_MAX_ERRORS 100
+
+/** Maximum length of the text of one argument */
+#define DIAG_MAX_ARG 64
+
+/** Typedef of structure type */
+typedef struct diag diag_t;
+
+/** A single diagnostic */
+struct diag {
+  int         lineNum;            /**< line in the source file (0 if none) */
+  const char* file;               /**< included file of the error, or NULL */
+  int         fileLine;           /**< line in the included file           */
+  int         column;             /**< column in the line (0 if unknown)   */
+  int         seq;                /**< order in which it was reported      */
+  const char* code;               /**< message format (e.g. ERR_BAD_IMM)   */
+  char        arg[DIAG_MAX_ARG];  /**< text of the argument of the format  */
+};
+
+/** Reset the engine, discarding any unflushed diagnostics
+ *  @param maxErrors - the number of errors after which the assembly stops,
+ *  0 for no limit
+ */
+void diag_init (int maxErrors);
+
+/** Record a diagnostic. The message format contains at most one conversion
+ *  (<code>%s</code> or <code>%d</code>), whose value is taken from
+ *  <code>args</code>.
+ *  @param lineNum - line in the source file
+ *  @param file - the included file the error is in, or NULL. It must stay
+ *  valid until the diagnostic is flushed.
+ *  @param fileLine - the line in the included file
+ *  @param column - column in the line, or 0 if not known
+ *  @param code - the message format
+ *  @param args - the argument of the format (if any)
+ */
+void diag_report (int lineNum, const char* file, int fileLine, int column,
+                  const char* code, va_list args);
+
+/** Determine if the maximum number of errors has been reached
+ *  @return non-zero if the assembly should stop
+ */
+int diag_limit_reached (void);
+
+/** Return the number of diagnostics recorded and not yet flushed */
+int diag_count (void);
+
+/** Return a recorded diagnostic
+ *  @param index - which diagnostic (0 to <code>diag_count() - 1</code>)
+ *  @return the diagnostic, or NULL if the index is out of range
+ */
+diag_t* diag_get (int index);
+
+/** Format a diagnostic in the form <code>ERROR line: message</code>
+ *  @param d - the diagnostic
+ *  @param buf - where the text is stored
+ *  @param size - the size of the buffer
+ *  @return the length of the text (as <code>snprintf()</code>)
+ */
+int diag_format (diag_t* d, char* buf, int size);
+
+/** Sort the recorded diagnostics by line, keeping the order in which those
+ *  of a line were reported, so <code>diag_get()</code> returns them in the
+ *  order they are written
+ */
+void diag_sort (void);
+
+/** Sort the recorded diagnostics by line, write them to the file with a
+ *  single write and discard them
+ *  @param f - the file to write to (normally stderr)
+ */
+void diag_flush (FILE* f);
+
+/** Free all memory used by the engine */
+void diag_term (void);
+
+#endif /* __DIAG_H__ */
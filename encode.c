@@ -0,0 +1,211 @@
+#include <stdio.h>
+
+#include "encode.h"
+#include "expr.h"
+#include "field.h"
+
+/** The encoder for every (opcode, form) pair */
+static encoder_t encoders[NUM_OPCODES][2];
+
+/** Convert the reference (a label or expression) of a line to a PC offset
+ *  of the given width. A line without a reference was created by the
+ *  optimizer, and its offset is in <code>immediate</code>, or loads a
+ *  literal.
+ *  @return the offset, masked to the width, or 0 on an error
+ */
+static int pc_offset (line_info_t* info, int width) {
+  int target;
+
+  if (info->literal != NULL) { // LD R1,=value (see literal.h)
+    int offset = info->literal->address - info->address - 1;
+
+    if (! fieldFits(offset, width, 1)) {
+      asm_error(ERR_LITERAL_RANGE);
+      return 0;
+    }
+
+    return offset & ((1 << width) - 1);
+  }
+
+  if (info->reference == NULL)
+    return info->immediate & ((1 << width) - 1);
+
+  if (! expr_eval(info->reference, &target))
+    return 0;
+
+  int offset = target - info->address - 1;
+
+  if (! fieldFits(offset, width, 1)) {
+    asm_error(ERR_BAD_PCOFFSET, info->reference);
+    return 0;
+  }
+
+  return offset & ((1 << width) - 1);
+}
+
+/** Register fields in their usual positions */
+#define DR(info)  (((info)->reg1 & 7) << 9)
+#define SR1(info) (((info)->reg2 & 7) << 6)
+#define SR2(info) ((info)->reg3 & 7)
+
+/** Encode FMT_ (no operands) and FMT_S (string, emitted separately) */
+static int encode_none (line_info_t* info, encoder_t* enc) {
+  return enc->prototype;
+}
+
+/** Encode FMT_RRR (e.g. ADD DR,SR1,SR2) */
+static int encode_rrr (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | DR(info) | SR1(info) | SR2(info);
+}
+
+/** Encode FMT_RRI5 (e.g. ADD DR,SR1,imm5) */
+static int encode_rri5 (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | DR(info) | SR1(info) | (info->immediate & 0x1F);
+}
+
+/** Encode FMT_RRI6 (e.g. LDR DR,BaseR,offset6) */
+static int encode_rri6 (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | DR(info) | SR1(info) | (info->immediate & 0x3F);
+}
+
+/** Encode FMT_RR (e.g. NOT DR,SR) */
+static int encode_rr (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | DR(info) | SR1(info);
+}
+
+/** Encode FMT_R1 alone */
+static int encode_r1 (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | DR(info);
+}
+
+/** Encode .ZERO DR as AND DR,DR,#0 */
+static int encode_zero (line_info_t* info, encoder_t* enc) {
+  return 0x5020 | DR(info) | ((info->reg1 & 7) << 6);
+}
+
+/** Encode .COPY DR,SR as ADD DR,SR,#0 */
+static int encode_copy (line_info_t* info, encoder_t* enc) {
+  return 0x1020 | DR(info) | SR1(info);
+}
+
+/** Encode the first word of .NEG DR, NOT DR,DR (see ENCODE_NEG_ADD) */
+static int encode_neg (line_info_t* info, encoder_t* enc) {
+  return 0x903F | DR(info) | ((info->reg1 & 7) << 6);
+}
+
+/** Encode FMT_R (e.g. JMP BaseR) */
+static int encode_r (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | SR1(info);
+}
+
+/** Encode FMT_RL (e.g. LD DR,label) */
+static int encode_rl (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | DR(info) | pc_offset(info, 9);
+}
+
+/** Encode FMT_L, used by BR, whose condition code is stored in reg1 */
+static int encode_br (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | DR(info) | pc_offset(info, 9);
+}
+
+/** Encode FMT_I11 (JSR label) */
+static int encode_i11 (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | pc_offset(info, 11);
+}
+
+/** Encode FMT_V and FMT_A (8 bit value) */
+static int encode_8 (line_info_t* info, encoder_t* enc) {
+  return enc->prototype | (info->immediate & 0xFF);
+}
+
+/** Encode FMT_16 (.FILL) */
+static int encode_16 (line_info_t* info, encoder_t* enc) {
+  return (enc->prototype | info->immediate) & 0xFFFF;
+}
+
+/** Encode a format with no specialized encoder by visiting each operand */
+static int encode_any (line_info_t* info, encoder_t* enc) {
+  int code = enc->prototype;
+
+  for (operand_t op = FMT_R1; op <= FMT_STR; op <<= 1) {
+    switch (op & enc->operands) {
+      case FMT_R1:    code |= DR(info);                    break;
+      case FMT_R2:    code |= SR1(info);                   break;
+      case FMT_R3:    code |= SR2(info);                   break;
+      case FMT_IMM5:  code |= info->immediate & 0x1F;      break;
+      case FMT_IMM6:  code |= info->immediate & 0x3F;      break;
+      case FMT_VEC8:
+      case FMT_ASC8:  code |= info->immediate & 0xFF;      break;
+      case FMT_PCO9:  code |= pc_offset(info, 9);          break;
+      case FMT_PCO11: code |= pc_offset(info, 11);         break;
+      case FMT_IMM16: code |= info->immediate & 0xFFFF;    break;
+      default:                                             break;
+    }
+  }
+
+  return code;
+}
+
+/** Choose the encoder function for an opcode and operand format */
+static encode_fnc_t choose_encoder (opcode_t opcode, operands_t operands) {
+  // pseudo-ops whose prototype is not the instruction they stand for
+  switch (opcode) {
+    case OP_BR:   return encode_br;
+    case OP_ZERO: return encode_zero;
+    case OP_COPY: return encode_copy;
+    case OP_NEG:  return encode_neg;
+    default:      break;
+  }
+
+  switch ((int) operands) {
+    case FMT_:     return encode_none;
+    case FMT_S:    return encode_none;
+    case FMT_RRR:  return encode_rrr;
+    case FMT_RRI5: return encode_rri5;
+    case FMT_RRI6: return encode_rri6;
+    case FMT_RR:   return encode_rr;
+    case FMT_R1:   return encode_r1;
+    case FMT_R:    return encode_r;
+    case FMT_RL:   return encode_rl;
+    case FMT_I11:  return encode_i11;
+    case FMT_V:    return encode_8;
+    case FMT_A:    return encode_8;
+    case FMT_16:   return encode_16;
+    default:       return encode_any;
+  }
+}
+
+void encode_init (void) {
+  for (opcode_t op = 0; op < NUM_OPCODES; op++) {
+    LC3_inst_t* inst = lc3_get_inst_info(op);
+
+    for (int form = 0; form < 2; form++) {
+      encoder_t* enc = &encoders[op][form];
+
+      if (inst == NULL || inst->forms[form].name == NULL) {
+        enc->prototype = 0;
+        enc->operands  = FMT_;
+        enc->encode    = NULL;
+      }
+      else {
+        enc->prototype = inst->forms[form].prototype;
+        enc->operands  = inst->forms[form].operands;
+        enc->encode    = choose_encoder(op, enc->operands);
+      }
+    }
+  }
+}
+
+encoder_t* encode_get (opcode_t opcode, int form) {
+  if (opcode < 0 || opcode >= NUM_OPCODES || form < 0 || form > 1)
+    return NULL;
+
+  encoder_t* enc = &encoders[opcode][form];
+  return (enc->encode != NULL) ? enc : NULL;
+}
+
+void encode_line (line_info_t* info) {
+  encoder_t* enc = &encoders[info->opcode][info->form];
+
+  info->machineCode = enc->encode(info, enc);
+}
@@ -0,0 +1,56 @@
+#ifndef __ENCODE_H__
+#define __ENCODE_H__
+
+/** @file encode.h
+ *  @brief interface to the table of per-form LC3 instruction encoders
+ *  @details Rather than looping over every possible operand type for each
+ *  instruction, pass two uses a table with one entry for every (opcode,
+ *  form) pair. The table is generated by <code>encode_init()</code> from
+ *  the <code>LC3_inst_t</code> information in <code>lc3.h</code>. Each entry
+ *  holds the prototype of the instruction and a straight-line function for
+ *  its operand format that ORs the shifted fields into the prototype.
+ *  Encoding an instruction is then a table lookup and one indirect call.
+ */
+
+#include "assembler.h"
+
+/** Typedef of structure type */
+typedef struct encoder encoder_t;
+
+/** Signature of a function encoding one operand format
+ *  @param info - the line to encode
+ *  @param enc - the table entry for the opcode and form of the line
+ *  @return the 16 bit LC3 instruction
+ */
+typedef int (*encode_fnc_t)(line_info_t* info, encoder_t* enc);
+
+/** The information needed to encode one form of an instruction */
+struct encoder {
+  int          prototype;  /**< bits that are constant in this form     */
+  operands_t   operands;   /**< operands of this form                   */
+  encode_fnc_t encode;     /**< function that ORs in the operand fields */
+};
+
+/** The second word of <code>.NEG DR</code> (ADD DR,DR,#1). The first word,
+ *  NOT DR,DR, is produced by <code>encode_line()</code>.
+ */
+#define ENCODE_NEG_ADD(reg) (0x1021 | (((reg) & 7) << 9) | (((reg) & 7) << 6))
+
+/** Build the encoder table from the LC3 instruction information */
+void encode_init (void);
+
+/** Return the table entry for an opcode and form
+ *  @param opcode - the opcode of the instruction
+ *  @param form - the form of the instruction (0 or 1)
+ *  @return the entry, or NULL if there is none
+ */
+encoder_t* encode_get (opcode_t opcode, int form);
+
+/** Encode a line and store the result in its <code>machineCode</code> field.
+ *  A reference to a label that is not defined, or whose PC offset does not
+ *  fit, is reported using <code>asm_error()</code>.
+ *  @param info - the line to encode
+ */
+void encode_line (line_info_t* info);
+
+#endif /* __ENCODE_H__ */
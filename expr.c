@@ -0,0 +1,488 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "assembler.h"
+#include "expr.h"
+#include "mem.h"
+#include "symbol.h"
+#include "tokens.h"
+#include "util.h"
+
+/** The state of a constant during resolution */
+typedef enum const_state {
+  CONST_NEW,     /**< value not yet known                */
+  CONST_ACTIVE,  /**< being evaluated (on the DFS stack) */
+  CONST_DONE,    /**< value known                        */
+  CONST_BAD      /**< definition had an error            */
+} const_state_t;
+
+/** Typedef of structure type */
+typedef struct constant constant_t;
+
+/** A constant defined by <code>.EQU</code> */
+struct constant {
+  char*         name;       /**< name of the constant          */
+  char*         text;       /**< expression defining its value */
+  int           lineNum;    /**< line of the definition        */
+  int           fileNum;    /**< file of the definition        */
+  int           value;      /**< value, once state is DONE     */
+  int           usesLabel;  /**< value depends on a label      */
+  const_state_t state;      /**< progress of the evaluation    */
+};
+
+/** Typedef of structure type */
+typedef struct term term_t;
+
+/** One term of an expression */
+struct term {
+  int  sign;                   /**< +1 or -1                          */
+  int  isNumber;               /**< term is a number (value holds it) */
+  int  value;                  /**< value of a number                 */
+  char name[MAX_LINE_LENGTH];  /**< text of the term                  */
+};
+
+/** Typedef of structure type */
+typedef struct cursor cursor_t;
+
+/** Position within an expression */
+struct cursor {
+  const char* pos;    /**< start of the next term, or its operator */
+  int         first;  /**< the next term is the first one          */
+};
+
+/** Typedef of structure type */
+typedef struct frame frame_t;
+
+/** A constant being evaluated by <code>expr_resolve()</code> */
+struct frame {
+  int      index;      /**< the constant                         */
+  cursor_t cursor;     /**< next term of its definition          */
+  int      value;      /**< sum of the terms so far              */
+  int      childSign;  /**< sign of the constant being evaluated */
+  int      isBad;      /**< a term had an error                  */
+};
+
+/** The constants, in order of definition */
+static constant_t* constants;
+
+/** Number of constants defined */
+static int numConstants;
+
+/** Number of entries allocated in <code>constants</code> */
+static int capacity;
+
+/** Hash table of the constants (index + 1, 0 when empty) */
+static int* buckets;
+
+/** Number of entries in <code>buckets</code> (a power of two) */
+static int numBuckets;
+
+/** Hash a name (FNV-1a), ignoring case like the symbol table */
+static unsigned hash_name (const char* name) {
+  unsigned h = 2166136261u;
+
+  while (*name)
+    h = (h ^ (unsigned char) tolower((unsigned char) *name++)) * 16777619u;
+
+  return h;
+}
+
+/** Return the bucket holding a name, or the empty bucket where it belongs */
+static int* find_bucket (const char* name) {
+  unsigned mask = numBuckets - 1;
+  unsigned i    = hash_name(name) & mask;
+
+  while (buckets[i] != 0 &&
+         strcasecmp(constants[buckets[i] - 1].name, name) != 0)
+    i = (i + 1) & mask;
+
+  return &buckets[i];
+}
+
+/** Return the index of a constant, or -1 if there is none */
+static int find_constant (const char* name) {
+  return (numBuckets > 0) ? *find_bucket(name) - 1 : -1;
+}
+
+/** Double the hash table and insert the constants again */
+static void grow_buckets (void) {
+  mem_free(buckets);
+  numBuckets = (numBuckets > 0) ? 2 * numBuckets : 64;
+  buckets    = mem_calloc(MEM_SYMBOL, numBuckets, sizeof(int));
+
+  for (int i = 0; i < numConstants; i++)
+    *find_bucket(constants[i].name) = i + 1;
+}
+
+/** Return the end of the term starting at p. A leading <code>#-</code>,
+ *  <code>x-</code> (followed by a hex digit) or <code>-</code> is part of a
+ *  number.
+ */
+static const char* term_end (const char* p) {
+  if (p[0] == '#' && p[1] == '-')
+    p += 2;
+  else if ((p[0] == 'x' || p[0] == 'X') && p[1] == '-' && isxdigit((unsigned char) p[2]))
+    p += 2;
+  else if (*p != '\0')
+    p++;
+
+  while (*p != '\0' && *p != '+' && *p != '-')
+    p++;
+
+  return p;
+}
+
+/** Convert the text of a term to a number. Only numbers in one of the
+ *  forms <code>#-10</code>, <code>x-1F</code> or <code>10</code> are
+ *  accepted, so a term such as <code>ADD1</code> is a name.
+ */
+static int term_number (const char* s, int* value) {
+  int base = 10;
+
+  if (*s == '#') {
+    s++;
+  }
+  else if (*s == 'x' || *s == 'X') {
+    base = 16;
+    s++;
+  }
+
+  const char* digits = (*s == '-') ? s + 1 : s;
+  char*       end;
+
+  if (! isxdigit((unsigned char) *digits))
+    return 0;
+
+  long v = strtol(s, &end, base);
+
+  if (*end != '\0')
+    return 0;
+
+  *value = (int) v;
+  return 1;
+}
+
+/** Get the next term of an expression
+ *  @param cursor - position in the expression, advanced past the term
+ *  @param t - where the term is stored
+ *  @return 1 if there was a term, 0 at the end of the expression, -1 if
+ *  the term is empty or not a number or a valid label
+ */
+static int next_term (cursor_t* cursor, term_t* t) {
+  const char* p = cursor->pos;
+
+  if (*p == '\0')
+    return 0;
+
+  t->sign = 1;
+
+  if (! cursor->first) {
+    t->sign = (*p == '-') ? -1 : 1;
+    p++;
+  }
+
+  const char* end = term_end(p);
+  int         len = end - p;
+
+  memcpy(t->name, p, len);
+  t->name[len]  = '\0';
+  cursor->pos   = end;
+  cursor->first = 0;
+
+  if (len == 0)
+    return -1;
+
+  t->isNumber = term_number(t->name, &t->value);
+
+  if (! t->isNumber && ! util_is_valid_label(t->name))
+    return -1;
+
+  return 1;
+}
+
+int expr_is_expression (const char* text) {
+  return *text != '\0' && *term_end(text) != '\0';
+}
+
+int expr_check (const char* text) {
+  cursor_t cursor = { text, 1 };
+  term_t   t;
+  int      result;
+
+  while ((result = next_term(&cursor, &t)) > 0)
+    ;
+
+  if (result < 0) {
+    asm_error(ERR_BAD_EXPR, text);
+    return 0;
+  }
+
+  return 1;
+}
+
+/** Evaluate an expression using only values known now
+ *  @param text - the expression
+ *  @param value - where the value is stored
+ *  @param usesLabel - set if the value depends on the address of a label
+ *  @param report - report a name whose value is not known
+ *  @return 1 on success, 0 otherwise
+ */
+static int eval_known (const char* text, int* value, int* usesLabel,
+                       int report) {
+  cursor_t cursor = { text, 1 };
+  term_t   t;
+  int      sum = 0;
+
+  *usesLabel = 0;
+
+  while (next_term(&cursor, &t) > 0) {
+    int       index = t.isNumber ? -1 : find_constant(t.name);
+    symbol_t* sym   = NULL;
+
+    if (t.isNumber) {
+      sum += t.sign * t.value;
+    }
+    else if (index >= 0 && constants[index].state == CONST_DONE) {
+      sum += t.sign * constants[index].value;
+      *usesLabel |= constants[index].usesLabel;
+    }
+    else if (index < 0 && (sym = symbol_find_by_name(lc3_sym_tab, t.name))) {
+      sum += t.sign * sym->addr;
+      *usesLabel = 1;
+    }
+    else {
+      if (report)
+        asm_error(ERR_EXPR_NOT_KNOWN, t.name);
+
+      return 0;
+    }
+  }
+
+  *value = sum;
+  return 1;
+}
+
+void expr_define (const char* name, const char* text) {
+  if (find_constant(name) >= 0 ||
+      symbol_find_by_name(lc3_sym_tab, name) != NULL) {
+    asm_error(ERR_DUPLICATE_LABEL, name);
+    return;
+  }
+
+  if (! expr_check(text))
+    return;
+
+  if (numConstants == capacity) {
+    capacity  = (capacity > 0) ? 2 * capacity : 32;
+    constants = mem_realloc(MEM_SYMBOL, constants,
+                            capacity * sizeof(constant_t));
+  }
+
+  if (2 * (numConstants + 1) > numBuckets)
+    grow_buckets();
+
+  constant_t* c = &constants[numConstants];
+
+  c->name    = mem_strdup(MEM_SYMBOL, name);
+  c->text    = mem_strdup(MEM_SYMBOL, text);
+  c->lineNum = srcLineNum;
+  c->fileNum = srcFileNum;
+  c->value   = 0;
+  c->state   = eval_known(text, &c->value, &c->usesLabel, 0) ?
+               CONST_DONE : CONST_NEW;
+
+  *find_bucket(name) = ++numConstants;
+}
+
+int expr_is_constant (const char* name) {
+  return find_constant(name) >= 0;
+}
+
+int expr_eval_now (const char* text, int* value, int* usesLabel) {
+  return eval_known(text, value, usesLabel, 1);
+}
+
+/** Report an error on the line defining a constant */
+static void constant_error (constant_t* c, char* msg, const char* arg) {
+  int line   = srcLineNum;
+  int file   = srcFileNum;
+  srcLineNum = c->lineNum;
+  srcFileNum = c->fileNum;
+  asm_error(msg, arg);
+  srcLineNum = line;
+  srcFileNum = file;
+}
+
+/** Start evaluating a constant */
+static void push_frame (frame_t* stack, int* depth, int index) {
+  frame_t* f = &stack[(*depth)++];
+
+  f->index  = index;
+  f->cursor = (cursor_t) { constants[index].text, 1 };
+  f->value  = 0;
+  f->isBad  = 0;
+  constants[index].state = CONST_ACTIVE;
+}
+
+void expr_resolve (void) {
+  if (numConstants == 0)
+    return;
+
+  // each constant is on the stack at most once
+  frame_t* stack = mem_alloc(MEM_SYMBOL, numConstants * sizeof(frame_t));
+  term_t*  t     = mem_alloc(MEM_SYMBOL, sizeof(term_t));
+
+  for (int i = 0; i < numConstants; i++) {
+    if (constants[i].state != CONST_NEW)
+      continue;
+
+    int depth = 0;
+    push_frame(stack, &depth, i);
+
+    while (depth > 0) {
+      frame_t*    f = &stack[depth - 1];
+      constant_t* c = &constants[f->index];
+
+      if (next_term(&f->cursor, t) == 0) { // all terms done
+        c->value = f->value;
+        c->state = f->isBad ? CONST_BAD : CONST_DONE;
+
+        if (--depth > 0) {
+          frame_t* parent = &stack[depth - 1];
+
+          if (f->isBad)
+            parent->isBad = 1;
+          else
+            parent->value += parent->childSign * c->value;
+        }
+
+        continue;
+      }
+
+      if (t->isNumber) {
+        f->value += t->sign * t->value;
+        continue;
+      }
+
+      int       index = find_constant(t->name);
+      symbol_t* sym;
+
+      if (index < 0) {
+        if ((sym = symbol_find_by_name(lc3_sym_tab, t->name)) != NULL)
+          f->value += t->sign * sym->addr;
+        else {
+          constant_error(c, ERR_MISSING_LABEL, t->name);
+          f->isBad = 1;
+        }
+
+        continue;
+      }
+
+      switch (constants[index].state) {
+        case CONST_DONE:
+          f->value += t->sign * constants[index].value;
+          break;
+        case CONST_BAD:
+          f->isBad = 1;
+          break;
+        case CONST_ACTIVE: // depends on itself
+          constant_error(&constants[index], ERR_EQU_CYCLE, t->name);
+          f->isBad = 1;
+          break;
+        case CONST_NEW:
+          f->childSign = t->sign;
+          push_frame(stack, &depth, index);
+          break;
+      }
+    }
+  }
+
+  mem_free(t);
+  mem_free(stack);
+}
+
+/** Evaluate an expression after <code>expr_resolve()</code>
+ *  @param report - report names that are not defined
+ */
+static int eval_resolved (const char* text, int* value, int report) {
+  cursor_t cursor = { text, 1 };
+  term_t   t;
+  int      sum = 0;
+
+  while (next_term(&cursor, &t) > 0) {
+    int index = t.isNumber ? -1 : find_constant(t.name);
+
+    if (t.isNumber) {
+      sum += t.sign * t.value;
+    }
+    else if (index >= 0) {
+      if (constants[index].state != CONST_DONE)
+        return 0; // already reported
+
+      sum += t.sign * constants[index].value;
+    }
+    else {
+      symbol_t* sym = symbol_find_by_name(lc3_sym_tab, t.name);
+
+      if (sym == NULL) {
+        if (report)
+          asm_error(ERR_MISSING_LABEL, t.name);
+
+        return 0;
+      }
+
+      sum += t.sign * sym->addr;
+    }
+  }
+
+  *value = sum;
+  return 1;
+}
+
+int expr_eval (const char* text, int* value) {
+  return eval_resolved(text, value, 1);
+}
+
+int expr_eval_quiet (const char* text, int* value) {
+  return eval_resolved(text, value, 0);
+}
+
+void expr_for_each_label (const char* text, expr_label_fnc_t fnc,
+                          void* data) {
+  cursor_t cursor = { text, 1 };
+  term_t   t;
+
+  while (next_term(&cursor, &t) > 0) {
+    if (! t.isNumber && find_constant(t.name) < 0 &&
+        symbol_find_by_name(lc3_sym_tab, t.name) != NULL)
+      fnc(t.name, data);
+  }
+}
+
+void expr_for_each_constant (expr_constant_fnc_t fnc, void* data) {
+  for (int i = 0; i < numConstants; i++)
+    fnc(constants[i].name, constants[i].text, constants[i].lineNum,
+        constants[i].fileNum, data);
+}
+
+void expr_invalidate (void) {
+  for (int i = 0; i < numConstants; i++) {
+    if (constants[i].state != CONST_BAD)
+      constants[i].state = CONST_NEW;
+  }
+}
+
+void expr_reset (void) {
+  for (int i = 0; i < numConstants; i++) {
+    mem_free(constants[i].name);
+    mem_free(constants[i].text);
+  }
+
+  mem_free(constants);
+  mem_free(buckets);
+  constants    = NULL;
+  buckets      = NULL;
+  numConstants = capacity = numBuckets = 0;
+}
@@ -0,0 +1,126 @@
+#ifndef __EXPR_H__
+#define __EXPR_H__
+
+/** @file expr.h
+ *  @brief interface to symbolic constants and operand expressions
+ *  @details A constant is defined by either of
+ *  <pre>
+ *          .EQU SIZE, 40
+ *  SIZE    .EQU 40
+ *  </pre>
+ *  An expression is a sequence of terms separated by <code>+</code> or
+ *  <code>-</code> with no spaces, for example <code>TABLE+3</code>,
+ *  <code>SIZE-1</code> or <code>END-START</code>. A term is a number
+ *  (<code>#10</code>, <code>x1F</code> or <code>10</code>), a constant or a
+ *  label. Expressions may be used wherever an immediate value or a label
+ *  is expected.
+ *  <p>
+ *  A constant may refer to constants and labels defined later in the
+ *  source. Once pass one has assigned the address of every label,
+ *  <code>expr_resolve()</code> evaluates all constants in dependency
+ *  order, using a depth first search of the graph whose edges are the
+ *  constants named in each definition. Every constant is evaluated once and
+ *  every term is visited once, so resolution is linear in the size of the
+ *  definitions. A constant that depends on itself is reported as an error.
+ *  <p>
+ *  The operands of <code>.ORIG</code> and <code>.BLKW</code> decide the
+ *  addresses of the labels that follow them, so their value must be known
+ *  on the line where they appear. Constants whose terms are all known when
+ *  they are defined are evaluated immediately for this purpose.
+ *  <p>
+ *  Errors are reported using <code>asm_error()</code> on the current line,
+ *  except for errors found by <code>expr_resolve()</code>, which are
+ *  reported on the line defining the constant.
+ */
+
+/** Determine if the text of a token is an expression of more than one term.
+ *  A leading <code>#-</code> or <code>x-</code> is part of a number.
+ *  @param text - the text of the token
+ *  @return 1 if the text contains a <code>+</code> or <code>-</code>
+ *  operator, 0 otherwise
+ */
+int expr_is_expression (const char* text);
+
+/** Check the syntax of an expression, reporting ERR_BAD_EXPR if a term is
+ *  neither a number nor a valid label
+ *  @param text - the expression
+ *  @return 1 if the syntax is correct, 0 otherwise
+ */
+int expr_check (const char* text);
+
+/** Define a constant on the current line. A name that is already a
+ *  constant or a label is reported as a duplicate.
+ *  @param name - the name of the constant
+ *  @param text - the expression giving its value
+ */
+void expr_define (const char* name, const char* text);
+
+/** Determine if a name is a constant
+ *  @param name - the name
+ *  @return 1 if it was defined by <code>.EQU</code>, 0 otherwise
+ */
+int expr_is_constant (const char* name);
+
+/** Evaluate an expression whose value must be known on the current line of
+ *  pass one. Every constant it names must already have a value and every
+ *  label must already be defined.
+ *  @param text - the expression
+ *  @param value - where the value is stored
+ *  @param usesLabel - set to 1 if the value depends on the address of a
+ *  label, directly or through a constant, 0 otherwise
+ *  @return 1 on success, 0 if an error was reported
+ */
+int expr_eval_now (const char* text, int* value, int* usesLabel);
+
+/** Evaluate every constant in dependency order. Called once pass one has
+ *  defined all labels.
+ */
+void expr_resolve (void);
+
+/** Evaluate an expression after <code>expr_resolve()</code>. A name that is
+ *  neither a constant nor a label is reported as ERR_MISSING_LABEL. Using a
+ *  constant whose definition had an error fails without a further report.
+ *  @param text - the expression
+ *  @param value - where the value is stored
+ *  @return 1 on success, 0 otherwise
+ */
+int expr_eval (const char* text, int* value);
+
+/** Evaluate an expression as <code>expr_eval()</code> does, without
+ *  reporting any error
+ */
+int expr_eval_quiet (const char* text, int* value);
+
+/** A function called for each label of an expression */
+typedef void (*expr_label_fnc_t)(const char* name, void* data);
+
+/** Call a function for each label named by an expression, in order. The
+ *  labels a constant depends on are not included, nor terms after one that
+ *  is not valid.
+ *  @param text - the expression
+ *  @param fnc - the function, given the name and <code>data</code>
+ *  @param data - passed to the function
+ */
+void expr_for_each_label (const char* text, expr_label_fnc_t fnc,
+                          void* data);
+
+/** A function called for each constant */
+typedef void (*expr_constant_fnc_t)(const char* name, const char* text,
+                                    int lineNum, int fileNum, void* data);
+
+/** Call a function for each constant, in the order they were defined
+ *  @param fnc - the function, given the name, the expression defining the
+ *  constant, the line and file of the definition and <code>data</code>
+ *  @param data - passed to the function
+ */
+void expr_for_each_constant (expr_constant_fnc_t fnc, void* data);
+
+/** Mark every constant as needing evaluation again, after the addresses of
+ *  labels have changed. Call <code>expr_resolve()</code> afterwards.
+ */
+void expr_invalidate (void);
+
+/** Forget every constant */
+void expr_reset (void);
+
+#endif /* __EXPR_H__ */
@@ -0,0 +1,10 @@
+; Assembled with -O, the branch to BACK is not relaxed: the RET reads R7 and
+; every other register may be live there, so the offset stays out of range.
+        .ORIG x3000
+        JSR     SUB
+        HALT
+SUB     ADD     R1, R1, #1
+        BRp     BACK
+        .BLKW   300
+BACK    RET
+        .END
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "mem.h"
+#include "objfile.h"
+
+/** Lookup table converting a 4 bit value to its hex digit */
+static const char nibbleToHex[16] = {
+  '0', '1', '2', '3', '4', '5', '6', '7',
+  '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+/** Make sure there is room for <code>count</code> more words */
+static void image_reserve (lc3_image_t* image, int count) {
+  int needed = image->numWords + count;
+
+  if (needed > image->capacity) {
+    int capacity = (image->capacity > 0) ? image->capacity : 256;
+
+    while (capacity < needed)
+      capacity *= 2;
+
+    image->words    = mem_realloc(MEM_IMAGE, image->words, capacity * sizeof(LC3_WORD));
+    image->capacity = capacity;
+  }
+}
+
+/** Return the current segment, starting one if there is none */
+static lc3_segment_t* current_segment (lc3_image_t* image) {
+  if (image->numSegments == 0)
+    image_start_segment(image, image->origin);
+
+  return &image->segments[image->numSegments - 1];
+}
+
+void image_init (lc3_image_t* image, int origin) {
+  image->origin      = origin;
+  image->words       = NULL;
+  image->numWords    = 0;
+  image->capacity    = 0;
+  image->segments    = NULL;
+  image->numSegments = 0;
+  image->segCapacity = 0;
+}
+
+void image_term (lc3_image_t* image) {
+  mem_free(image->words);
+  mem_free(image->segments);
+  image_init(image, 0);
+}
+
+void image_start_segment (lc3_image_t* image, int origin) {
+  lc3_segment_t* seg = (image->numSegments > 0) ?
+                       &image->segments[image->numSegments - 1] : NULL;
+
+  if (seg == NULL || seg->numWords > 0) {
+    if (image->numSegments == image->segCapacity) {
+      image->segCapacity = (image->segCapacity > 0) ?
+                           2 * image->segCapacity : 4;
+      image->segments    = mem_realloc(MEM_IMAGE, image->segments,
+                           image->segCapacity * sizeof(lc3_segment_t));
+    }
+
+    seg           = &image->segments[image->numSegments++];
+    seg->first    = image->numWords;
+    seg->numWords = 0;
+  }
+
+  seg->origin = origin;
+
+  if (seg == image->segments)
+    image->origin = origin;
+}
+
+void image_add_word (lc3_image_t* image, int value) {
+  image_reserve(image, 1);
+  current_segment(image)->numWords++;
+  image->words[image->numWords++] = (LC3_WORD) value;
+}
+
+void image_add_words (lc3_image_t* image, int value, int count) {
+  if (count <= 0)
+    return;
+
+  image_reserve(image, count);
+  current_segment(image)->numWords += count;
+
+  for (int i = 0; i < count; i++)
+    image->words[image->numWords + i] = (LC3_WORD) value;
+
+  image->numWords += count;
+}
+
+/** Store one word as two big-endian bytes */
+static unsigned char* put_obj_word (unsigned char* p, int value) {
+  p[0] = (value >> 8) & 0xFF;
+  p[1] = value & 0xFF;
+  return p + 2;
+}
+
+LC3_WORD* image_flatten (lc3_image_t* image, int* origin, int* count,
+                         LC3_WORD** buf) {
+  int lo = -1, hi = 0;
+
+  *buf = NULL;
+
+  for (int i = 0; i < image->numSegments; i++) {
+    lc3_segment_t* seg = &image->segments[i];
+
+    if (seg->numWords > 0) {
+      if (lo < 0 || seg->origin < lo)
+        lo = seg->origin;
+
+      if (seg->origin + seg->numWords > hi)
+        hi = seg->origin + seg->numWords;
+    }
+  }
+
+  if (lo < 0 || image->numSegments < 2) {
+    *origin = image->origin;
+    *count  = image->numWords;
+    return image->words;
+  }
+
+  *origin = lo;
+  *count  = hi - lo;
+  *buf    = mem_calloc(MEM_OUTPUT, *count, sizeof(LC3_WORD));
+
+  for (int i = 0; i < image->numSegments; i++) {
+    lc3_segment_t* seg = &image->segments[i];
+
+    memcpy(*buf + (seg->origin - lo), image->words + seg->first,
+           seg->numWords * sizeof(LC3_WORD));
+  }
+
+  return *buf;
+}
+
+int image_write_obj (FILE* f, lc3_image_t* image) {
+  int       origin, count;
+  LC3_WORD* dense;
+  LC3_WORD* words = image_flatten(image, &origin, &count, &dense);
+  int       ok    = objfile_write(f, origin, words, count);
+
+  mem_free(dense);
+  return ok;
+}
+
+/** Store one word as four hex digits and a newline */
+static char* put_hex_word (char* p, int value) {
+  p[0] = nibbleToHex[(value >> 12) & 0xF];
+  p[1] = nibbleToHex[(value >>  8) & 0xF];
+  p[2] = nibbleToHex[(value >>  4) & 0xF];
+  p[3] = nibbleToHex[value & 0xF];
+  p[4] = '\n';
+  return p + 5;
+}
+
+int image_write_hex (FILE* f, lc3_image_t* image) {
+  int       origin, count;
+  LC3_WORD* dense;
+  LC3_WORD* words = image_flatten(image, &origin, &count, &dense);
+
+  size_t len = 5 * (count + 1);
+  char*  buf = mem_alloc(MEM_OUTPUT, len);
+  char*  p   = put_hex_word(buf, origin);
+
+  for (int i = 0; i < count; i++)
+    p = put_hex_word(p, words[i]);
+
+  int ok = (fwrite(buf, 1, len, f) == len);
+  mem_free(buf);
+  mem_free(dense);
+  return ok;
+}
+
+/** Return the number of zero words starting at words[i] (at most n - i) */
+static int zero_run (LC3_WORD* words, int i, int n) {
+  int j = i;
+
+  while (j < n && words[j] == 0)
+    j++;
+
+  return j - i;
+}
+
+/** Most words in one compact object record, leaving room to finish a short
+ *  zero run inside a data record
+ */
+#define MAX_RECORD_WORDS (0xFFFF - IMAGE_ZERO_RUN)
+
+/** Store the header of a compact object record */
+static unsigned char* put_record (unsigned char* p, int type, int addr,
+                                  int count) {
+  p = put_obj_word(p, type);
+  p = put_obj_word(p, addr & 0xFFFF);
+  return put_obj_word(p, count);
+}
+
+int image_write_sobj (FILE* f, lc3_image_t* image) {
+  // each record other than the first of a segment follows a zero run of
+  // at least IMAGE_ZERO_RUN words, or a record of MAX_RECORD_WORDS words
+  int maxRecords = 2 * (image->numWords / IMAGE_ZERO_RUN) +
+                   2 * (image->numWords / MAX_RECORD_WORDS) +
+                   2 * image->numSegments;
+
+  size_t         size = 2 * (2 + image->numWords + 3 * maxRecords);
+  unsigned char* buf  = mem_alloc(MEM_OUTPUT, size);
+  unsigned char* p    = put_obj_word(buf, IMAGE_SOBJ_MAGIC);
+
+  for (int s = 0; s < image->numSegments; s++) {
+    lc3_segment_t* seg   = &image->segments[s];
+    LC3_WORD*      words = image->words + seg->first;
+    int            n     = seg->numWords;
+    int            i     = 0;
+
+    while (i < n) {
+      int zeros = zero_run(words, i, n);
+
+      if (zeros >= IMAGE_ZERO_RUN) {
+        if (zeros > 0xFFFF)
+          zeros = 0xFFFF;
+
+        p  = put_record(p, IMAGE_REC_ZERO, seg->origin + i, zeros);
+        i += zeros;
+        continue;
+      }
+
+      int j = i; // extend the data until a long zero run or the end
+
+      while (j < n && j - i < MAX_RECORD_WORDS) {
+        zeros = zero_run(words, j, n);
+
+        if (zeros >= IMAGE_ZERO_RUN)
+          break;
+
+        j += (zeros > 0) ? zeros : 1;
+      }
+
+      p = put_record(p, IMAGE_REC_DATA, seg->origin + i, j - i);
+
+      for (; i < j; i++)
+        p = put_obj_word(p, words[i]);
+    }
+  }
+
+  p = put_obj_word(p, IMAGE_REC_END);
+
+  size_t len = p - buf;
+  int    ok  = (fwrite(buf, 1, len, f) == len);
+  mem_free(buf);
+  return ok;
+}
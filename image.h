@@ -0,0 +1,154 @@
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+/** @file image.h
+ *  @brief interface to the in-memory image of an assembled LC3 program
+ *  @details Pass two of the assembler places every word it generates into
+ *  an image instead of writing it directly to a file. Once the pass is
+ *  complete, the image is written in each of the requested formats. Each
+ *  format is built in a single buffer and written with one call to
+ *  <code>fwrite()</code>, so the cost of producing an additional format is
+ *  one linear scan of the words.
+ *  <p>
+ *  A program may contain several <code>.ORIG</code> blocks. Each one starts
+ *  a segment of the image. The words of all segments are kept in one array
+ *  in the order they were generated; a segment records where its words
+ *  begin in that array and the LC3 address of the first one.
+ *  <p>
+ *  The standard object and hex formats have a single origin. When there
+ *  are several segments, they are written from the lowest origin to the
+ *  end of the highest segment, and the gaps between segments are filled
+ *  with zeros. The compact (sparse) object format avoids both the gaps and
+ *  the zeros of large <code>.BLKW</code> areas. All of its words are
+ *  big-endian:
+ *  <pre>
+ *  IMAGE_SOBJ_MAGIC                   identifies the format
+ *  IMAGE_REC_DATA address count word* count literal words
+ *  IMAGE_REC_ZERO address count       count zero words
+ *  ...
+ *  IMAGE_REC_END                      end of the records
+ *  </pre>
+ *  A run of at least <code>IMAGE_ZERO_RUN</code> zero words is written as a
+ *  zero-fill record; shorter runs stay in the data records.
+ */
+
+#include <stdio.h>
+
+#include "lc3.h"
+
+/** First word of a compact object file ("S3") */
+#define IMAGE_SOBJ_MAGIC 0x5333
+
+/** Compact object record: end of the records */
+#define IMAGE_REC_END    0x0000
+
+/** Compact object record: address, count and count words */
+#define IMAGE_REC_DATA   0x0001
+
+/** Compact object record: address and count of zero words */
+#define IMAGE_REC_ZERO   0x0002
+
+/** Shortest run of zero words written as a zero-fill record. A record in
+ *  the middle of data costs six words (its own and the data record that
+ *  follows), so shorter runs are cheaper written literally.
+ */
+#define IMAGE_ZERO_RUN   8
+
+/** Typedef of structure type */
+typedef struct lc3_segment lc3_segment_t;
+
+/** The words generated by one <code>.ORIG</code> block */
+struct lc3_segment {
+  int origin;    /**< LC3 address of the first word         */
+  int first;     /**< index of the first word in the image */
+  int numWords;  /**< number of words in the segment       */
+};
+
+/** Typedef of structure type */
+typedef struct lc3_image lc3_image_t;
+
+/** The words of an assembled program, in one or more segments */
+struct lc3_image {
+  int            origin;       /**< LC3 address of the first segment   */
+  LC3_WORD*      words;        /**< the words of all segments          */
+  int            numWords;     /**< number of words currently in image */
+  int            capacity;     /**< number of words allocated          */
+  lc3_segment_t* segments;     /**< the segments, in source order      */
+  int            numSegments;  /**< number of segments                 */
+  int            segCapacity;  /**< number of segments allocated       */
+};
+
+/** Initialize an empty image
+ *  @param image - the image to initialize
+ *  @param origin - the LC3 address of the first word
+ */
+void image_init (lc3_image_t* image, int origin);
+
+/** Free the memory used by an image. The image may be reused after calling
+ *  <code>image_init()</code> again.
+ *  @param image - the image to free
+ */
+void image_term (lc3_image_t* image);
+
+/** Start a new segment. Words added afterwards belong to it. A segment
+ *  that has no words yet is reused rather than left empty.
+ *  @param image - the image
+ *  @param origin - the LC3 address of the first word of the segment
+ */
+void image_start_segment (lc3_image_t* image, int origin);
+
+/** Append a word to the current segment of the image. If no segment has
+ *  been started, one is started at the origin of the image.
+ *  @param image - the image
+ *  @param value - the value of the word (only the low 16 bits are used)
+ */
+void image_add_word (lc3_image_t* image, int value);
+
+/** Append <code>count</code> copies of a word to the current segment
+ *  @param image - the image
+ *  @param value - the value of the words
+ *  @param count - how many words to append
+ */
+void image_add_words (lc3_image_t* image, int value, int count);
+
+/** Lay the segments out as one block of words from the lowest origin,
+ *  filling the gaps with zeros. With a single segment the words of the
+ *  image are used as they are.
+ *  @param image - the image
+ *  @param origin - set to the LC3 address of the first word
+ *  @param count - set to the number of words
+ *  @param buf - set to memory the caller must free with
+ *  <code>mem_free()</code>, or NULL
+ *  @return the words
+ */
+LC3_WORD* image_flatten (lc3_image_t* image, int* origin, int* count,
+                         LC3_WORD** buf);
+
+/** Write the image as a binary object file. The first word written is the
+ *  origin, followed by the words of the image. All words are big-endian.
+ *  Several segments are written as one, with the gaps filled by zeros.
+ *  @param f - the file to write to
+ *  @param image - the image to write
+ *  @return 1 on success, 0 on a write error
+ */
+int image_write_obj (FILE* f, lc3_image_t* image);
+
+/** Write the image as a hex file. The content is the same as the object
+ *  file, but each word is written as four lower case hex digits on a
+ *  line by itself.
+ *  @param f - the file to write to
+ *  @param image - the image to write
+ *  @return 1 on success, 0 on a write error
+ */
+int image_write_hex (FILE* f, lc3_image_t* image);
+
+/** Write the image as a compact object file (see the description of the
+ *  format above). Each segment becomes data records, except for runs of
+ *  zero words, which become zero-fill records.
+ *  @param f - the file to write to
+ *  @param image - the image to write
+ *  @return 1 on success, 0 on a write error
+ */
+int image_write_sobj (FILE* f, lc3_image_t* image);
+
+#endif /* __IMAGE_H__ */
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "include.h"
+#include "mem.h"
+
+/** Typedef of structure type */
+typedef struct inclusion inclusion_t;
+
+/** A unit included at a line of the source file */
+struct inclusion {
+  inc_unit_t* unit;     /**< the unit                               */
+  int         lineNum;  /**< line of the source file including it   */
+};
+
+/** The units parsed without errors */
+static inc_unit_t* cache;
+
+/** The units of the current assembly parsed with errors */
+static inc_unit_t* discarded;
+
+/** Number of entries of the first chunk of inclusions, chunk K holds
+ *  INCLUSION_CHUNK << K entries
+ */
+#define INCLUSION_CHUNK 16
+
+/** The inclusions of the current assembly, srcFile N is entry N - 1. The
+ *  entries are kept in chunks that never move, as the encoder of the
+ *  pipelined assembler (see pipeline.h) reads them while more are added.
+ */
+static inclusion_t* chunks[32];
+static int          numInclusions;
+
+/** Name of the source file, or NULL */
+static char* sourceName;
+
+/** Identity of the source file, if it is known */
+static int  sourceKnown;
+static long sourceDev;
+static long sourceIno;
+
+/** Included files may be read */
+static int filesAllowed = 1;
+
+/** Units being parsed, innermost last */
+static inc_unit_t* stack[INCLUDE_MAX_DEPTH];
+static int         depth;
+
+/** Hash some text (64 bit FNV-1a) */
+static unsigned long long hash_text (const char* text, int length) {
+  unsigned long long h = 14695981039346656037ULL;
+
+  for (int i = 0; i < length; i++) {
+    h ^= (unsigned char) text[i];
+    h *= 1099511628211ULL;
+  }
+
+  return h;
+}
+
+/** Read a whole file
+ *  @param text - set to the content, to free with mem_free()
+ *  @param length - set to the length of the content
+ *  @param st - set to the status of the file
+ *  @return 1 on success, 0 if the file can not be read
+ */
+static int read_file (const char* file_name, char** text, int* length,
+                      struct stat* st) {
+  FILE* fp = fopen(file_name, "r");
+
+  if (fp == NULL)
+    return 0;
+
+  if (fstat(fileno(fp), st) != 0) {
+    fclose(fp);
+    return 0;
+  }
+
+  int capacity = (st->st_size > 0) ? st->st_size + 1 : 1024;
+  int count;
+
+  *text   = mem_alloc(MEM_SOURCE, capacity);
+  *length = 0;
+
+  while ((count = fread(*text + *length, 1, capacity - *length - 1, fp)) > 0) {
+    *length += count;
+
+    if (*length == capacity - 1) {
+      capacity *= 2;
+      *text     = mem_realloc(MEM_SOURCE, *text, capacity);
+    }
+  }
+
+  (*text)[*length] = '\0';
+  fclose(fp);
+  return 1;
+}
+
+/** Find an included file from the directory of the file including it
+ *  @return the name, to free with mem_free()
+ */
+static char* resolve (const char* file_name) {
+  const char* from  = (depth > 0) ? stack[depth - 1]->name : sourceName;
+  const char* slash = (from != NULL) ? strrchr(from, '/') : NULL;
+
+  if (file_name[0] == '/' || slash == NULL)
+    return mem_strdup(MEM_SOURCE, file_name);
+
+  int   dirLen = slash - from + 1;
+  char* name   = mem_alloc(MEM_SOURCE, dirLen + strlen(file_name) + 1);
+
+  memcpy(name, from, dirLen);
+  strcpy(name + dirLen, file_name);
+  return name;
+}
+
+/** Determine if a file is the source or a unit being parsed */
+static int being_included (long dev, long ino) {
+  if (sourceKnown && sourceDev == dev && sourceIno == ino)
+    return 1;
+
+  for (int i = 0; i < depth; i++) {
+    if (stack[i]->dev == dev && stack[i]->ino == ino)
+      return 1;
+  }
+
+  return 0;
+}
+
+/** Determine if the units included by a cached unit are unchanged
+ *  @param unit - the cached unit
+ *  @param name - the name the unit is included with
+ */
+static int deps_unchanged (inc_unit_t* unit, const char* name) {
+  if (unit->numDeps == 1)
+    return 1;
+
+  if (strcmp(unit->name, name) != 0) // its includes may be other files
+    return 0;
+
+  for (int i = 1; i < unit->numDeps; i++) {
+    inc_unit_t* dep = unit->deps[i];
+    char*       text;
+    int         length;
+    struct stat st;
+
+    if (! read_file(dep->name, &text, &length, &st))
+      return 0;
+
+    int same = (length == dep->length) &&
+               memcmp(text, dep->text, length) == 0 &&
+               ! being_included(st.st_dev, st.st_ino);
+    mem_free(text);
+
+    if (! same)
+      return 0;
+  }
+
+  return 1;
+}
+
+/** Add a unit to the units of another, if it is not there */
+static void add_dep (inc_unit_t* unit, inc_unit_t* dep) {
+  for (int i = 0; i < unit->numDeps; i++) {
+    if (unit->deps[i] == dep)
+      return;
+  }
+
+  if (unit->numDeps == unit->capDeps) {
+    unit->capDeps = 2 * unit->capDeps + 4;
+    unit->deps    = mem_realloc(MEM_SOURCE, unit->deps,
+                                unit->capDeps * sizeof(inc_unit_t*));
+  }
+
+  unit->deps[unit->numDeps++] = dep;
+}
+
+/** Return the index of a unit in the units of another */
+static int dep_index (inc_unit_t* unit, inc_unit_t* dep) {
+  for (int i = 0; i < unit->numDeps; i++) {
+    if (unit->deps[i] == dep)
+      return i;
+  }
+
+  return 0; // not reached, every unit included was added
+}
+
+/** Free a unit and its lines */
+static void free_unit (inc_unit_t* unit) {
+  line_info_t* next;
+
+  for (line_info_t* info = unit->lines; info != NULL; info = next) {
+    next = info->next;
+    mem_free(info->reference);
+    mem_free(info->label);
+    mem_free(info);
+  }
+
+  for (int i = 0; i < unit->numConsts; i++) {
+    mem_free(unit->consts[i].name);
+    mem_free(unit->consts[i].value);
+  }
+
+  mem_free(unit->consts);
+  mem_free(unit->deps);
+  mem_free(unit->text);
+  mem_free(unit->name);
+  mem_free(unit);
+}
+
+void include_set_source (const char* file_name) {
+  struct stat st;
+
+  mem_free(sourceName);
+  sourceName  = (file_name != NULL) ? mem_strdup(MEM_SOURCE, file_name) : NULL;
+  sourceKnown = (file_name != NULL) && stat(file_name, &st) == 0;
+
+  if (sourceKnown) {
+    sourceDev = st.st_dev;
+    sourceIno = st.st_ino;
+  }
+}
+
+void include_allow_files (int allow) {
+  filesAllowed = allow;
+}
+
+inc_unit_t* include_load (const char* file_name) {
+  if (! filesAllowed) {
+    asm_error(ERR_INCLUDE_NO_FILE, file_name);
+    return NULL;
+  }
+
+  char*       name = resolve(file_name);
+  char*       text;
+  int         length;
+  struct stat st;
+  inc_unit_t* unit;
+
+  if (! read_file(name, &text, &length, &st)) {
+    asm_error(ERR_OPEN_READ, name);
+    mem_free(name);
+    return NULL;
+  }
+
+  if (being_included(st.st_dev, st.st_ino) || depth == INCLUDE_MAX_DEPTH) {
+    asm_error(being_included(st.st_dev, st.st_ino) ? ERR_INCLUDE_CYCLE
+                                                   : ERR_INCLUDE_DEPTH, name);
+    mem_free(text);
+    mem_free(name);
+    return NULL;
+  }
+
+  unsigned long long hash = hash_text(text, length);
+
+  for (unit = cache; unit != NULL; unit = unit->next) {
+    if (unit->hash == hash && unit->length == length &&
+        memcmp(unit->text, text, length) == 0 && deps_unchanged(unit, name))
+      break;
+  }
+
+  if (unit != NULL) { // parsed before
+    mem_free(text);
+    mem_free(name);
+  }
+  else {
+    unit         = mem_calloc(MEM_SOURCE, 1, sizeof(inc_unit_t));
+    unit->hash   = hash;
+    unit->name   = name;
+    unit->text   = text;
+    unit->length = length;
+    unit->dev    = st.st_dev;
+    unit->ino    = st.st_ino;
+    add_dep(unit, unit);
+
+    stack[depth++] = unit;
+    int ok = asm_parse_unit(unit);
+    depth--;
+
+    if (ok) {
+      unit->next = cache;
+      cache      = unit;
+    }
+    else {
+      unit->next = discarded;
+      discarded  = unit;
+    }
+  }
+
+  if (depth > 0) { // included by the unit being parsed
+    for (int i = 0; i < unit->numDeps; i++)
+      add_dep(stack[depth - 1], unit->deps[i]);
+  }
+
+  return unit;
+}
+
+void include_add_constant (inc_unit_t* unit, const char* name,
+                           const char* value) {
+  if (unit->numConsts == unit->capConsts) {
+    unit->capConsts = 2 * unit->capConsts + 4;
+    unit->consts    = mem_realloc(MEM_SOURCE, unit->consts,
+                                  unit->capConsts * sizeof(inc_const_t));
+  }
+
+  inc_const_t* c = &unit->consts[unit->numConsts++];
+
+  c->name    = mem_strdup(MEM_STRING, name);
+  c->value   = mem_strdup(MEM_STRING, value);
+  c->lineNum = srcLineNum;
+  c->dep     = srcFileNum; // an inclusion until include_finish_unit()
+}
+
+/** Return entry <code>index</code> of the inclusions, allocating its
+ *  chunk if needed
+ */
+static inclusion_t* inclusion (int index) {
+  int chunk = 31 - __builtin_clz(index / INCLUSION_CHUNK + 1);
+  int first = INCLUSION_CHUNK * ((1 << chunk) - 1);
+
+  if (chunks[chunk] == NULL)
+    chunks[chunk] = mem_alloc(MEM_SOURCE,
+                              (INCLUSION_CHUNK << chunk) * sizeof(inclusion_t));
+
+  return &chunks[chunk][index - first];
+}
+
+int include_record (inc_unit_t* unit, int lineNum) {
+  for (int i = numInclusions - 1; i >= 0; i--) {
+    inclusion_t* inc = inclusion(i);
+
+    if (inc->unit == unit && inc->lineNum == lineNum)
+      return i + 1;
+
+    if (inc->lineNum != lineNum) // those of other lines are before
+      break;
+  }
+
+  *inclusion(numInclusions) = (inclusion_t) { unit, lineNum };
+  return ++numInclusions;
+}
+
+inc_unit_t* include_add_unit (const char* name, const char* text,
+                              int length) {
+  inc_unit_t* unit = mem_calloc(MEM_SOURCE, 1, sizeof(inc_unit_t));
+
+  unit->hash   = hash_text(text, length);
+  unit->name   = mem_strdup(MEM_SOURCE, name);
+  unit->text   = mem_alloc(MEM_SOURCE, length + 1);
+  unit->length = length;
+  memcpy(unit->text, text, length);
+  unit->text[length] = '\0';
+  add_dep(unit, unit);
+
+  unit->next = discarded; // freed with the units of this assembly
+  discarded  = unit;
+  return unit;
+}
+
+int include_count (void) {
+  return numInclusions;
+}
+
+inc_unit_t* include_unit (int srcFile) {
+  return inclusion(srcFile - 1)->unit;
+}
+
+int include_source_line (int srcFile, int lineNum) {
+  return (srcFile > 0) ? inclusion(srcFile - 1)->lineNum : lineNum;
+}
+
+const char* include_line_text (line_info_t* info, int* length) {
+  *length = info->srcLength;
+  return include_unit(info->srcFile)->text + info->srcOffset;
+}
+
+void include_finish_unit (inc_unit_t* unit) {
+  for (line_info_t* info = unit->lines; info != NULL; info = info->next)
+    info->srcFile = dep_index(unit, include_unit(info->srcFile));
+
+  for (int i = 0; i < unit->numConsts; i++)
+    unit->consts[i].dep = dep_index(unit, include_unit(unit->consts[i].dep));
+}
+
+/** Free a list of units */
+static void free_units (inc_unit_t* unit) {
+  inc_unit_t* next;
+
+  for (; unit != NULL; unit = next) {
+    next = unit->next;
+    free_unit(unit);
+  }
+}
+
+void include_reset (void) {
+  free_units(discarded);
+  discarded     = NULL;
+  numInclusions = 0;
+  depth         = 0;
+  mem_free(sourceName);
+  sourceName  = NULL;
+  sourceKnown = 0;
+}
+
+void include_term (void) {
+  free_units(cache);
+  cache = NULL;
+  include_reset();
+
+  for (int i = 0; i < 32; i++) {
+    mem_free(chunks[i]);
+    chunks[i] = NULL;
+  }
+}
@@ -0,0 +1,159 @@
+#ifndef __INCLUDE_H__
+#define __INCLUDE_H__
+
+/** @file include.h
+ *  @brief interface to included files and the cache of their parsed lines
+ *  @details The directive <code>.INCLUDE "file"</code> assembles the lines
+ *  of another file in its place. A relative name is found from the
+ *  directory of the file containing the directive. An included file is a
+ *  <b>unit</b> of code: it may define labels and constants and include
+ *  other files, but it may not contain <code>.ORIG</code> or
+ *  <code>.END</code>, and the operand of its <code>.BLKW</code> lines must
+ *  be a number, so that its layout does not depend on where it is used.
+ *  <p>
+ *  A unit is parsed once, with addresses starting at 0 and without adding
+ *  its labels to the symbol table. Its lines (and the constants it defines)
+ *  are kept in a cache, keyed by a hash of its content, until
+ *  <code>asm_term()</code>. Each <code>.INCLUDE</code> reads the file and
+ *  hashes it, and on a hit copies the parsed lines into the program,
+ *  relocated to the current address, and defines their labels and
+ *  constants. The lexer and parser never see the unit again, so a library
+ *  included by every file of a batch (see <code>batch.h</code>), or by
+ *  every request of the server, is only parsed once. A unit that includes
+ *  others is only reused if the files it included are unchanged. Units in
+ *  which errors are found are not cached, so their errors are reported each
+ *  time they are included.
+ *  <p>
+ *  Each line records the file it came from (<code>srcFile</code>), an
+ *  index into a table of inclusions of the current assembly: the unit and
+ *  the line of the source file that includes it (directly or through other
+ *  units). Diagnostics are reported as <code>file:line:column</code> of the
+ *  included file, and are ordered at the line of the outermost
+ *  <code>.INCLUDE</code>. Including a file that is already being included
+ *  (a cycle) is an error.
+ */
+
+#include "assembler.h"
+
+/** Maximum depth of nested includes */
+#define INCLUDE_MAX_DEPTH 16
+
+/** Typedef of structure type */
+typedef struct inc_unit inc_unit_t;
+
+/** Typedef of structure type */
+typedef struct inc_const inc_const_t;
+
+/** A constant defined by <code>.EQU</code> in a unit */
+struct inc_const {
+  char* name;     /**< name of the constant                          */
+  char* value;    /**< expression defining its value                 */
+  int   lineNum;  /**< line of the definition                        */
+  int   dep;      /**< unit of the definition (see srcFile of lines) */
+};
+
+/** An included file and its parsed lines */
+struct inc_unit {
+  unsigned long long hash;       /**< hash of the content                 */
+  char*              name;       /**< name of the file, as found          */
+  char*              text;       /**< content of the file                 */
+  int                length;     /**< length of the content               */
+  long               dev;        /**< identity of the file, to find cycles */
+  long               ino;
+  line_info_t*       lines;      /**< parsed lines, from address 0. Their
+                                      srcFile is an index in deps        */
+  int                numWords;   /**< number of words of the lines        */
+  inc_unit_t**       deps;       /**< units of the lines, deps[0] is this */
+  int                numDeps;    /**< number of entries in deps           */
+  int                capDeps;    /**< number of entries allocated         */
+  inc_const_t*       consts;     /**< constants defined                   */
+  int                numConsts;  /**< number of constants                 */
+  int                capConsts;  /**< number of constants allocated       */
+  inc_unit_t*        next;       /**< next unit of the cache (or of those
+                                      with errors)                        */
+};
+
+/** Set the name of the source file, from which included files are found.
+ *  Called after <code>asm_reset()</code>, before pass one.
+ *  @param file_name - the name, or <code>NULL</code> if the source is not a
+ *  file (names are then relative to the current directory)
+ */
+void include_set_source (const char* file_name);
+
+/** Allow or forbid reading included files. When forbidden, as by the
+ *  buffer API (see asmbuf.h), every <code>.INCLUDE</code> is an error.
+ *  @param allow - non-zero to allow it (the default)
+ */
+void include_allow_files (int allow);
+
+/** Find the unit of an included file, reading and parsing it if it is not
+ *  cached. Errors (a file that can not be read, a cycle) are reported. A
+ *  unit that is not cached is kept until <code>include_reset()</code>, as
+ *  its diagnostics refer to it.
+ *  @param file_name - the name given by <code>.INCLUDE</code>
+ *  @return the unit, or <code>NULL</code>
+ */
+inc_unit_t* include_load (const char* file_name);
+
+/** Record a constant defined by the unit being parsed
+ *  @param unit - the unit
+ *  @param name - name of the constant
+ *  @param value - expression defining it
+ */
+void include_add_constant (inc_unit_t* unit, const char* name,
+                           const char* value);
+
+/** Find the inclusion of a unit at a line of the source file, adding it
+ *  @param unit - the unit
+ *  @param lineNum - the line of the source file
+ *  @return the index of the inclusion (1 or more)
+ */
+int include_record (inc_unit_t* unit, int lineNum);
+
+/** Add a unit whose text is already known, without reading or parsing
+ *  it. Used to restore the inclusions of a program loaded from its
+ *  intermediate representation (see ir.h). The unit is not cached and is
+ *  kept until <code>include_reset()</code>.
+ *  @param name - name of the file
+ *  @param text - its content
+ *  @param length - the length of the content
+ *  @return the unit
+ */
+inc_unit_t* include_add_unit (const char* name, const char* text, int length);
+
+/** Return the number of inclusions of the current assembly */
+int include_count (void);
+
+/** Return the unit of an inclusion */
+inc_unit_t* include_unit (int srcFile);
+
+/** Return the line of the source file of an inclusion, or
+ *  <code>lineNum</code> if <code>srcFile</code> is 0 (the source file)
+ */
+int include_source_line (int srcFile, int lineNum);
+
+/** Return the text of a line of an included file and its length */
+const char* include_line_text (line_info_t* info, int* length);
+
+/** Turn the inclusions in the lines and constants of a unit just parsed
+ *  into indexes in its <code>deps</code>
+ */
+void include_finish_unit (inc_unit_t* unit);
+
+/** Parse a unit: its lines, constants and the units it includes. This is
+ *  done by the assembler (<code>assembler.c</code>), which keeps the state
+ *  of the file including it.
+ *  @param unit - the unit, whose text is set
+ *  @return 1 if no errors were found, 0 otherwise
+ */
+int asm_parse_unit (inc_unit_t* unit);
+
+/** Forget the inclusions of the current assembly and free the units that
+ *  are not cached. Called by <code>asm_reset()</code>.
+ */
+void include_reset (void);
+
+/** Free the cache. Called by <code>asm_term()</code>. */
+void include_term (void);
+
+#endif /* __INCLUDE_H__ */
@@ -0,0 +1,554 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "expr.h"
+#include "include.h"
+#include "ir.h"
+#include "mem.h"
+#include "symbol.h"
+
+/** Largest address accepted. Pass one does not stop at xFFFF, but sums of
+ *  addresses and sizes must not overflow.
+ */
+#define IR_MAX_ADDRESS 0x40000000
+
+/** Typedef of structure type */
+typedef struct ir_builder ir_builder_t;
+
+/** The representation being built by <code>ir_write()</code> */
+struct ir_builder {
+  symbol_t**  syms;       /**< the symbols, sorted by name         */
+  int         numSyms;    /**< number of symbols                   */
+  int         capSyms;    /**< number of symbols allocated         */
+  int*        order;      /**< index in the file of each symbol    */
+  symbol_t**  defined;    /**< the symbols in the order of the file */
+  ir_const_t* consts;     /**< the constants                       */
+  int         numConsts;  /**< number of constants                 */
+  int         capConsts;  /**< number of constants allocated       */
+  char*       chars;      /**< the strings                         */
+  size_t      numChars;   /**< number of characters                */
+  size_t      capChars;   /**< number of characters allocated      */
+};
+
+/** A line and its index, to find the index of a line from its address */
+typedef struct ir_index {
+  line_info_t* line;   /**< the line           */
+  int          index;  /**< its index in lines */
+} ir_index_t;
+
+/** Determine if the host stores integers little-endian, as the file does */
+static int little_endian (void) {
+  const uint16_t one = 1;
+
+  return *(const unsigned char*) &one == 1;
+}
+
+/** Append a string to the strings
+ *  @return its offset
+ */
+static int32_t add_string (ir_builder_t* b, const char* s) {
+  size_t len = strlen(s) + 1;
+
+  if (b->numChars + len > b->capChars) {
+    b->capChars = 2 * b->capChars + len + 1024;
+    b->chars    = mem_realloc(MEM_OUTPUT, b->chars, b->capChars);
+  }
+
+  memcpy(b->chars + b->numChars, s, len);
+  b->numChars += len;
+  return b->numChars - len;
+}
+
+/** Add a symbol of the table (see symbol_iterate()) */
+static void collect_symbol (symbol_t* sym, void* data) {
+  ir_builder_t* b = data;
+
+  if (b->numSyms == b->capSyms) {
+    b->capSyms = 2 * b->capSyms + 16;
+    b->syms    = mem_realloc(MEM_OUTPUT, b->syms,
+                             b->capSyms * sizeof(symbol_t*));
+  }
+
+  b->syms[b->numSyms++] = sym;
+}
+
+/** Add a constant (see expr_for_each_constant()) */
+static void collect_constant (const char* name, const char* text,
+                              int lineNum, int fileNum, void* data) {
+  ir_builder_t* b = data;
+
+  if (b->numConsts == b->capConsts) {
+    b->capConsts = 2 * b->capConsts + 16;
+    b->consts    = mem_realloc(MEM_OUTPUT, b->consts,
+                               b->capConsts * sizeof(ir_const_t));
+  }
+
+  b->consts[b->numConsts++] = (ir_const_t) { add_string(b, name),
+                                             add_string(b, text), lineNum,
+                                             fileNum };
+}
+
+/** Order symbols by name */
+static int compare_sym (const void* a, const void* b) {
+  return strcmp((*(symbol_t* const*) a)->name, (*(symbol_t* const*) b)->name);
+}
+
+/** Compare a name to the name of a symbol */
+static int compare_name (const void* key, const void* sym) {
+  return strcmp(key, (*(symbol_t* const*) sym)->name);
+}
+
+/** Find the index of a symbol in the file, or IR_NONE */
+static int32_t find_symbol (ir_builder_t* b, const char* name) {
+  symbol_t** sym = bsearch(name, b->syms, b->numSyms, sizeof(symbol_t*),
+                           compare_name);
+
+  return (sym != NULL) ? b->order[sym - b->syms] : IR_NONE;
+}
+
+/** Put the symbols in the order they were defined, that of the lines
+ *  defining them, so that reloading them builds the same table
+ */
+static void order_symbols (ir_builder_t* b, line_info_t* head) {
+  int n = 0;
+
+  b->order   = mem_alloc(MEM_OUTPUT, (b->numSyms + 1) * sizeof(int));
+  b->defined = mem_alloc(MEM_OUTPUT, (b->numSyms + 1) * sizeof(symbol_t*));
+
+  for (int i = 0; i < b->numSyms; i++)
+    b->order[i] = IR_NONE;
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    symbol_t** sym = (info->label == NULL) ? NULL :
+                     bsearch(info->label, b->syms, b->numSyms,
+                             sizeof(symbol_t*), compare_name);
+
+    if (sym != NULL && b->order[sym - b->syms] == IR_NONE) {
+      b->order[sym - b->syms] = n;
+      b->defined[n++]         = *sym;
+    }
+  }
+
+  for (int i = 0; i < b->numSyms; i++) {
+    if (b->order[i] == IR_NONE) {
+      b->order[i]     = n;
+      b->defined[n++] = b->syms[i];
+    }
+  }
+}
+
+/** Order lines by their address in memory */
+static int compare_line (const void* a, const void* b) {
+  line_info_t* l1 = ((const ir_index_t*) a)->line;
+  line_info_t* l2 = ((const ir_index_t*) b)->line;
+
+  return (l1 > l2) - (l1 < l2);
+}
+
+/** Find the index of a line, or IR_NONE */
+static int32_t find_line (ir_index_t* byLine, int numLines,
+                          line_info_t* line) {
+  if (line == NULL)
+    return IR_NONE;
+
+  ir_index_t  key   = { line, 0 };
+  ir_index_t* found = bsearch(&key, byLine, numLines, sizeof(ir_index_t),
+                              compare_line);
+
+  return (found != NULL) ? found->index : IR_NONE;
+}
+
+/** Find the symbol of an operand that is just a label, or IR_NONE */
+static int32_t operand_symbol (ir_builder_t* b, line_info_t* info) {
+  // the reference of a .STRINGZ is its text
+  if (info->reference == NULL || info->opcode == OP_STRINGZ ||
+      expr_is_expression(info->reference) ||
+      expr_is_constant(info->reference))
+    return IR_NONE;
+
+  return find_symbol(b, info->reference);
+}
+
+int ir_write (FILE* f, line_info_t* head, const char* text, int length,
+              int flags) {
+  ir_builder_t b;
+  int          numLines = 0;
+
+  memset(&b, 0, sizeof(b));
+  symbol_iterate(lc3_sym_tab, collect_symbol, &b);
+
+  if (b.numSyms > 0)
+    qsort(b.syms, b.numSyms, sizeof(symbol_t*), compare_sym);
+
+  order_symbols(&b, head);
+
+  int32_t* symNames = mem_alloc(MEM_OUTPUT,
+                                (b.numSyms + 1) * sizeof(int32_t));
+
+  for (int i = 0; i < b.numSyms; i++)
+    symNames[i] = add_string(&b, b.defined[i]->name);
+
+  expr_for_each_constant(collect_constant, &b);
+
+  for (line_info_t* info = head; info != NULL; info = info->next)
+    numLines++;
+
+  ir_index_t* byLine = mem_alloc(MEM_OUTPUT,
+                                 (numLines + 1) * sizeof(ir_index_t));
+  int         n      = 0;
+
+  for (line_info_t* info = head; info != NULL; info = info->next, n++)
+    byLine[n] = (ir_index_t) { info, n };
+
+  qsort(byLine, numLines, sizeof(ir_index_t), compare_line);
+
+  // the units of the inclusions, each once
+  int          numInclusions = include_count();
+  inc_unit_t** units         = mem_alloc(MEM_OUTPUT, (numInclusions + 1) *
+                                                     sizeof(inc_unit_t*));
+  int32_t*     unitNames     = mem_alloc(MEM_OUTPUT, (numInclusions + 1) *
+                                                     sizeof(int32_t));
+  int*         unitOf        = mem_alloc(MEM_OUTPUT, (numInclusions + 1) *
+                                                     sizeof(int));
+  int          numUnits      = 0;
+  size_t       numText       = length;
+
+  for (int i = 0; i < numInclusions; i++) {
+    inc_unit_t* unit = include_unit(i + 1);
+    int         u    = 0;
+
+    while (u < numUnits && units[u] != unit)
+      u++;
+
+    if (u == numUnits) {
+      unitNames[numUnits] = add_string(&b, unit->name);
+      units[numUnits++]   = unit;
+      numText            += unit->length;
+    }
+
+    unitOf[i] = u;
+  }
+
+  ir_line_t* lines = mem_alloc(MEM_OUTPUT,
+                               (numLines + 1) * sizeof(ir_line_t));
+
+  n = 0;
+
+  for (line_info_t* info = head; info != NULL; info = info->next, n++) {
+    int32_t symbol    = operand_symbol(&b, info);
+    int32_t reference = IR_NONE;
+    int32_t label     = IR_NONE;
+
+    if (symbol != IR_NONE)
+      reference = symNames[symbol];
+    else if (info->reference != NULL)
+      reference = add_string(&b, info->reference);
+
+    if (info->label != NULL) {
+      int32_t sym = find_symbol(&b, info->label);
+
+      label = (sym != IR_NONE) ? symNames[sym] : add_string(&b, info->label);
+    }
+
+    lines[n] = (ir_line_t) {
+      info->lineNum, info->address, info->machineCode, info->opcode,
+      info->form, info->reg1, info->reg2, info->reg3, info->immediate,
+      reference, symbol, info->immWidth, info->immSigned, label,
+      info->srcOffset, info->srcLength, info->srcFile,
+      find_line(byLine, numLines, info->pooledIn),
+      find_line(byLine, numLines, info->literal)
+    };
+  }
+
+  // the integers of the arrays, after the header
+  size_t words = 19 * (size_t) numLines + 2 * (size_t) b.numSyms +
+                 4 * (size_t) b.numConsts + 3 * (size_t) numUnits +
+                 2 * (size_t) numInclusions;
+
+  size_t         len  = IR_HEADER + 4 * words + b.numChars + numText;
+  unsigned char* buf  = mem_alloc(MEM_OUTPUT, len);
+  int32_t*       word = (int32_t*) (buf + 8);
+
+  memcpy(buf, "LC3R", 4);
+  buf[4] = IR_VERSION;
+  buf[5] = buf[6] = buf[7] = 0;
+  *word++ = flags;
+  *word++ = numLines;
+  *word++ = b.numSyms;
+  *word++ = b.numConsts;
+  *word++ = numUnits;
+  *word++ = numInclusions;
+  *word++ = b.numChars;
+  *word++ = numText;
+  *word++ = length;
+
+  memcpy(word, lines, numLines * sizeof(ir_line_t));
+  word += 19 * numLines;
+
+  for (int i = 0; i < b.numSyms; i++) {
+    *word++ = symNames[i];
+    *word++ = b.defined[i]->addr;
+  }
+
+  for (int i = 0; i < b.numConsts; i++, word += 4)
+    memcpy(word, &b.consts[i], sizeof(ir_const_t));
+
+  char*  chars = (char*) buf + IR_HEADER + 4 * words;
+  size_t pos   = length;
+
+  if (b.numChars > 0)
+    memcpy(chars, b.chars, b.numChars);
+
+  memcpy(chars + b.numChars, text, length);
+
+  for (int i = 0; i < numUnits; i++) {
+    *word++ = unitNames[i];
+    *word++ = pos;
+    *word++ = units[i]->length;
+    memcpy(chars + b.numChars + pos, units[i]->text, units[i]->length);
+    pos    += units[i]->length;
+  }
+
+  for (int i = 0; i < numInclusions; i++) {
+    *word++ = unitOf[i];
+    *word++ = include_source_line(i + 1, 0);
+  }
+
+  if (! little_endian()) {
+    for (int32_t* w = (int32_t*) (buf + 8); w < word; w++)
+      *w = __builtin_bswap32(*w);
+  }
+
+  int ok = fwrite(buf, 1, len, f) == len;
+
+  mem_free(buf);
+  mem_free(lines);
+  mem_free(unitOf);
+  mem_free(unitNames);
+  mem_free(units);
+  mem_free(byLine);
+  mem_free(symNames);
+  mem_free(b.chars);
+  mem_free(b.consts);
+  mem_free(b.defined);
+  mem_free(b.order);
+  mem_free(b.syms);
+  return ok;
+}
+
+/** Determine if an offset is IR_NONE or a string of the representation */
+static int valid_string (lc3_ir_t* ir, int32_t offset) {
+  return offset == IR_NONE || (offset >= 0 && offset < ir->numChars);
+}
+
+/** Determine if an index is IR_NONE or less than a count */
+static int valid_index (int32_t index, int count) {
+  return index >= IR_NONE && index < count;
+}
+
+/** Return the length of the text of a file
+ *  @param file - 0 for the source, or the inclusion + 1 of the file
+ */
+static int32_t file_length (lc3_ir_t* ir, int file) {
+  if (file == 0)
+    return ir->srcLength;
+
+  return ir->units[ir->inclusions[file - 1].unit].length;
+}
+
+/** Determine if a line number and a span are in the text of a file. A
+ *  file of N characters has at most N + 1 lines.
+ */
+static int valid_span (lc3_ir_t* ir, int file, int32_t lineNum,
+                       int32_t offset, int32_t length) {
+  int32_t fileLength = file_length(ir, file);
+
+  return lineNum >= 0 && lineNum <= fileLength + 1 && offset >= 0 &&
+         length >= 0 && offset <= fileLength && length <= fileLength - offset;
+}
+
+/** Determine if an opcode has a form, as a line to encode must */
+static int valid_form (int32_t opcode, int32_t form) {
+  if (opcode < 0 || opcode >= NUM_OPCODES || form < 0 || form > 1)
+    return 0;
+
+  LC3_inst_t* inst = lc3_get_inst_info(opcode);
+
+  return inst != NULL && inst->forms[form].name != NULL;
+}
+
+/** Check a line of the representation */
+static int valid_line (lc3_ir_t* ir, const ir_line_t* line) {
+  if ((line->opcode != OP_INVALID && ! valid_form(line->opcode, line->form)) ||
+      ! valid_index(line->reg1, 8) || ! valid_index(line->reg2, 8) ||
+      ! valid_index(line->reg3, 8) ||
+      ! valid_string(ir, line->reference) || ! valid_string(ir, line->label) ||
+      ! valid_index(line->symbol, ir->numSymbols) ||
+      ! valid_index(line->pooledIn, ir->numLines) ||
+      ! valid_index(line->literal, ir->numLines) ||
+      line->immWidth < 0 || line->immWidth > 16 ||
+      (line->immWidth != 0 && line->reference == IR_NONE) ||
+      (line->symbol != IR_NONE &&
+       line->reference != ir->symbols[line->symbol].name) ||
+      line->address < 0 || line->address > IR_MAX_ADDRESS ||
+      line->srcFile < 0 || line->srcFile > ir->numInclusions ||
+      ! valid_span(ir, line->srcFile, line->lineNum, line->srcOffset,
+                   line->srcLength))
+    return 0;
+
+  // the words of these are taken from their operand
+  if (line->opcode == OP_BLKW)
+    return line->immediate >= 0 && line->immediate <= 0x10000;
+
+  if (line->opcode == OP_STRINGZ)
+    return line->reference != IR_NONE &&
+           strlen(ir->chars + line->reference) >= 2; // the quotes
+
+  return 1;
+}
+
+/** Set the arrays of a representation and check its content
+ *  @return 1 on success, 0 if the content is not valid
+ */
+static int decode_ir (const unsigned char* data, size_t length,
+                      lc3_ir_t* ir) {
+  if (length < IR_HEADER || memcmp(data, "LC3R", 4) != 0 ||
+      data[4] != IR_VERSION)
+    return 0;
+
+  const int32_t* counts = (const int32_t*) (data + 8);
+
+  for (int i = 1; i < 9; i++) {
+    if (counts[i] < 0 || (size_t) counts[i] > length)
+      return 0;
+  }
+
+  ir->flags         = counts[0];
+  ir->numLines      = counts[1];
+  ir->numSymbols    = counts[2];
+  ir->numConsts     = counts[3];
+  ir->numUnits      = counts[4];
+  ir->numInclusions = counts[5];
+  ir->numChars      = counts[6];
+  ir->numText       = counts[7];
+  ir->srcLength     = counts[8];
+
+  size_t words = 19 * (size_t) ir->numLines + 2 * (size_t) ir->numSymbols +
+                 4 * (size_t) ir->numConsts + 3 * (size_t) ir->numUnits +
+                 2 * (size_t) ir->numInclusions;
+
+  if (IR_HEADER + 4 * words + ir->numChars + ir->numText != length ||
+      ir->srcLength > ir->numText ||
+      (ir->numChars > 0 && data[length - ir->numText - 1] != '\0'))
+    return 0;
+
+  ir->lines      = (const ir_line_t*) (data + IR_HEADER);
+  ir->symbols    = (const ir_symbol_t*) (ir->lines + ir->numLines);
+  ir->consts     = (const ir_const_t*) (ir->symbols + ir->numSymbols);
+  ir->units      = (const ir_unit_t*) (ir->consts + ir->numConsts);
+  ir->inclusions = (const ir_inclusion_t*) (ir->units + ir->numUnits);
+  ir->chars      = (const char*) (ir->inclusions + ir->numInclusions);
+  ir->text       = ir->chars + ir->numChars;
+
+  // the units and inclusions first, the spans of the others use them
+  for (int i = 0; i < ir->numUnits; i++) {
+    const ir_unit_t* u = &ir->units[i];
+
+    if (u->name == IR_NONE || ! valid_string(ir, u->name) || u->text < 0 ||
+        u->length < 0 || u->text > ir->numText ||
+        u->length > ir->numText - u->text)
+      return 0;
+  }
+
+  for (int i = 0; i < ir->numInclusions; i++) {
+    if (ir->inclusions[i].unit < 0 ||
+        ir->inclusions[i].unit >= ir->numUnits ||
+        ! valid_span(ir, 0, ir->inclusions[i].lineNum, 0, 0))
+      return 0;
+  }
+
+  for (int i = 0; i < ir->numSymbols; i++) {
+    if (ir->symbols[i].name == IR_NONE ||
+        ! valid_string(ir, ir->symbols[i].name) ||
+        ir->symbols[i].addr < 0 || ir->symbols[i].addr > IR_MAX_ADDRESS)
+      return 0;
+  }
+
+  for (int i = 0; i < ir->numConsts; i++) {
+    const ir_const_t* c = &ir->consts[i];
+
+    if (c->name == IR_NONE || ! valid_string(ir, c->name) ||
+        c->text == IR_NONE || ! valid_string(ir, c->text) ||
+        c->fileNum < 0 || c->fileNum > ir->numInclusions ||
+        ! valid_span(ir, c->fileNum, c->lineNum, 0, 0))
+      return 0;
+  }
+
+  for (int i = 0; i < ir->numLines; i++) {
+    if (! valid_line(ir, &ir->lines[i]))
+      return 0;
+  }
+
+  return 1;
+}
+
+int ir_open (const char* file_name, lc3_ir_t* ir) {
+  struct stat st;
+
+  memset(ir, 0, sizeof(lc3_ir_t));
+
+  if (! little_endian()) // the arrays are used in place
+    return ENOTSUP;
+
+  int fd = open(file_name, O_RDONLY);
+
+  if (fd < 0)
+    return errno;
+
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    return error;
+  }
+
+  if (st.st_size < IR_HEADER) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t         length = st.st_size;
+  unsigned char* data   = mmap(NULL, length, PROT_READ,
+                               MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd); // the mapping stays valid
+
+  if (data == MAP_FAILED)
+    return errno;
+
+  if (! decode_ir(data, length, ir)) {
+    munmap(data, length);
+    memset(ir, 0, sizeof(lc3_ir_t));
+    return EINVAL;
+  }
+
+  ir->data   = data;
+  ir->length = length;
+  return 0;
+}
+
+const char* ir_string (lc3_ir_t* ir, int32_t offset) {
+  return (offset == IR_NONE) ? NULL : ir->chars + offset;
+}
+
+void ir_unmap (lc3_ir_t* ir) {
+  if (ir->data != NULL)
+    munmap((void*) ir->data, ir->length);
+
+  memset(ir, 0, sizeof(lc3_ir_t));
+}
@@ -0,0 +1,184 @@
+#ifndef __IR_H__
+#define __IR_H__
+
+/** @file ir.h
+ *  @brief interface to the intermediate representation of a program
+ *  @details Selected by <code>-ir</code>, pass two writes a
+ *  <code>.lc3ir</code> file next to the object file. It holds what pass one
+ *  found: every line with its opcode, form, registers, immediate, operand,
+ *  address and source span, the symbol table, the constants of
+ *  <code>.EQU</code>, and the text of the source and included files. Given
+ *  a <code>.lc3ir</code> file instead of a source file,
+ *  <code>mylc3as</code> loads it with <code>asm_pass_one_ir()</code> and
+ *  runs pass two, producing the same outputs (the listing too) without
+ *  lexing or parsing a line. Other tools (a simulator, a linter, an editor)
+ *  map it with <code>ir_open()</code> and read the program as arrays.
+ *  <p>
+ *  The file is made of arrays of 32-bit little-endian integers, so a
+ *  little-endian host reads them in place:
+ *  <pre>
+ *  "LC3R" version 0 0 0                 identifies the format (version 1)
+ *  flags numLines numSymbols numConsts  the counts of the arrays
+ *  numUnits numInclusions numChars
+ *  numText srcLength
+ *  lines[numLines]                      see ir_line_t, in program order
+ *  symbols[numSymbols]                  name, address, in the order they
+ *                                       were defined
+ *  consts[numConsts]                    name, text, line, file, in the
+ *                                       order they were defined
+ *  units[numUnits]                      name, text, length
+ *  inclusions[numInclusions]            unit, line of the source file
+ *  chars[numChars]                      the strings, each ended by a 0
+ *  text[numText]                        the source, then the included files
+ *  </pre>
+ *  A string is the offset of its first character in <code>chars</code>,
+ *  and <code>IR_NONE</code> stands for no string or no line. The label of
+ *  a line, and its operand when it is just a label, share the name of the
+ *  symbol, and <code>symbol</code> is then the index of the symbol. The
+ *  source is the first <code>srcLength</code> characters of
+ *  <code>text</code>, and a <code>srcFile</code> N other than 0 is
+ *  inclusion N - 1, as in <code>include.h</code>. <code>ir_open()</code>
+ *  checks every offset and index, so a tool may use them without checking.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#include "assembler.h"
+
+/** Version of the format written */
+#define IR_VERSION 1
+
+/** Bytes of the header: magic, version and the nine counts */
+#define IR_HEADER 44
+
+/** No string, symbol or line */
+#define IR_NONE -1
+
+/** Flag: an operand of <code>.ORIG</code> or <code>.BLKW</code> depends on
+ *  the address of a label, so the optimizer may not move the code
+ */
+#define IR_LAYOUT_USES_LABELS 0x1
+
+/** Typedef of structure type */
+typedef struct ir_line ir_line_t;
+
+/** A line of the program, the fields of <code>line_info_t</code> */
+struct ir_line {
+  int32_t lineNum;      /**< line in its file                          */
+  int32_t address;      /**< LC3 address of the line                   */
+  int32_t machineCode;  /**< the 16 bit LC3 instruction                */
+  int32_t opcode;       /**< opcode_t of the line                      */
+  int32_t form;         /**< which form of the instruction             */
+  int32_t reg1;         /**< DR or SR, -1 if not present               */
+  int32_t reg2;         /**< SR1 or BaseR, -1 if not present           */
+  int32_t reg3;         /**< SR2, -1 if not present                    */
+  int32_t immediate;    /**< immediate value                           */
+  int32_t reference;    /**< string of the operand, or IR_NONE         */
+  int32_t symbol;       /**< symbol of the operand, or IR_NONE if it is
+                             not just a label                          */
+  int32_t immWidth;     /**< width of an immediate given by the operand */
+  int32_t immSigned;    /**< the immediate of immWidth is signed       */
+  int32_t label;        /**< string of the label, or IR_NONE           */
+  int32_t srcOffset;    /**< offset of the line in the text of its file */
+  int32_t srcLength;    /**< length of the line, without newline       */
+  int32_t srcFile;      /**< 0, or the inclusion + 1 of its file       */
+  int32_t pooledIn;     /**< line holding its pooled string, or IR_NONE */
+  int32_t literal;      /**< line of the literal of LD =value, or
+                             IR_NONE                                   */
+};
+
+/** Typedef of structure type */
+typedef struct ir_symbol ir_symbol_t;
+
+/** A label of the symbol table */
+struct ir_symbol {
+  int32_t name;  /**< string of its name  */
+  int32_t addr;  /**< its LC3 address     */
+};
+
+/** Typedef of structure type */
+typedef struct ir_const ir_const_t;
+
+/** A constant defined by <code>.EQU</code> */
+struct ir_const {
+  int32_t name;     /**< string of its name                */
+  int32_t text;     /**< string of the expression          */
+  int32_t lineNum;  /**< line of the definition            */
+  int32_t fileNum;  /**< 0, or the inclusion + 1 of its file */
+};
+
+/** Typedef of structure type */
+typedef struct ir_unit ir_unit_t;
+
+/** An included file */
+struct ir_unit {
+  int32_t name;    /**< string of its name              */
+  int32_t text;    /**< offset of its content in text   */
+  int32_t length;  /**< length of its content           */
+};
+
+/** Typedef of structure type */
+typedef struct ir_inclusion ir_inclusion_t;
+
+/** An included file, at a line of the source file */
+struct ir_inclusion {
+  int32_t unit;     /**< index of the unit                  */
+  int32_t lineNum;  /**< line of the source file including it */
+};
+
+/** Typedef of structure type */
+typedef struct lc3_ir lc3_ir_t;
+
+/** An intermediate representation opened by <code>ir_open()</code>. The
+ *  arrays point into the mapping of the file.
+ */
+struct lc3_ir {
+  const unsigned char*  data;           /**< the mapped file          */
+  size_t                length;         /**< its length               */
+  int                   flags;          /**< IR_LAYOUT_USES_LABELS    */
+  const ir_line_t*      lines;          /**< the lines                */
+  int                   numLines;       /**< number of lines          */
+  const ir_symbol_t*    symbols;        /**< the symbols              */
+  int                   numSymbols;     /**< number of symbols        */
+  const ir_const_t*     consts;         /**< the constants            */
+  int                   numConsts;      /**< number of constants      */
+  const ir_unit_t*      units;          /**< the included files       */
+  int                   numUnits;       /**< number of units          */
+  const ir_inclusion_t* inclusions;     /**< the inclusions           */
+  int                   numInclusions;  /**< number of inclusions     */
+  const char*           chars;          /**< the strings              */
+  int                   numChars;       /**< number of characters     */
+  const char*           text;           /**< the text of the files    */
+  int                   numText;        /**< number of characters     */
+  int                   srcLength;      /**< length of the source     */
+};
+
+/** Write the intermediate representation of the program
+ *  @param f - the file to write to
+ *  @param head - the first line of the program
+ *  @param text - the text of the source file
+ *  @param length - the number of characters of the text
+ *  @param flags - IR_LAYOUT_USES_LABELS or 0
+ *  @return 1 on success, 0 on a write error
+ */
+int ir_write (FILE* f, line_info_t* head, const char* text, int length,
+              int flags);
+
+/** Open and map an intermediate representation, checking its content
+ *  @param file_name - name of the file
+ *  @param ir - set to the representation, to close with
+ *  <code>ir_unmap()</code>
+ *  @return 0 on success, else the errno value of the failure (EINVAL if
+ *  the file is not valid, ENOTSUP on a big-endian host)
+ */
+int ir_open (const char* file_name, lc3_ir_t* ir);
+
+/** Return a string of the representation, or NULL for IR_NONE */
+const char* ir_string (lc3_ir_t* ir, int32_t offset);
+
+/** Unmap a representation opened by <code>ir_open()</code> */
+void ir_unmap (lc3_ir_t* ir);
+
+#endif /* __IR_H__ */
@@ -0,0 +1,640 @@
+/** @file lc3aot.c
+ *  @brief ahead-of-time translation of an object file to C
+ *  @details Translates an LC3 program into a C program that runs it, to be
+ *  compiled with the system compiler:
+ *  <pre><code>
+ *  lc3aot [-s file.sym] [-o file.c] file.obj
+ *  cc -O2 -o prog file.c
+ *  ./prog [runs]
+ *  </code></pre>
+ *  The code is found by following the branches and subroutine calls from
+ *  the origin, then from the labels of the symbol table (by default the
+ *  <code>.sym</code> next to the object file, if there is one), which are
+ *  the entry points of computed jumps. It is cut into basic blocks, and each
+ *  block becomes a labeled block of one C function: a direct branch is a
+ *  <code>goto</code>, a computed <code>JMP</code>, <code>JSRR</code> or
+ *  <code>RET</code> goes through a <code>switch</code> on the address of the
+ *  blocks, whose default is an interpreter loop. The condition codes are
+ *  lazy: the last value written to a register is kept, and a
+ *  <code>BR</code> tests its sign. The service routines (<code>GETC</code>
+ *  to <code>HALT</code>, and <code>GETS</code>) are calls to the C library;
+ *  another <code>TRAP</code> jumps to the address in its vector, if the
+ *  program set one.
+ *  <p>
+ *  Self-modifying code runs in the interpreter. A store into a block found
+ *  from the origin marks the block dirty when it changes a word, and leaves
+ *  the compiled code; a dirty block is then always interpreted. A block only
+ *  found from a label (often data) is compared with the original words
+ *  each time it is entered instead, so that stores into data stay fast. The
+ *  interpreter goes back to the compiled code at the start of a block.
+ *  Compiled with <code>-DLC3_INTERPRET</code>, the program only interprets,
+ *  to check the translation and measure what it gains. The optional
+ *  argument runs the program that many times, from a fresh memory.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "objfile.h"
+
+/** Number of words of LC3 memory */
+#define AOT_MEM_SIZE 0x10000
+
+/** How a word was found */
+enum aot_kind {
+  AOT_NONE,    /**< not reached, not translated        */
+  AOT_STATIC,  /**< reached from the origin            */
+  AOT_LABEL    /**< only reached from a label          */
+};
+
+/** The program and what is known of each word */
+static LC3_WORD      image[AOT_MEM_SIZE];
+static unsigned char loaded[AOT_MEM_SIZE];  /**< word is in the object file */
+static unsigned char kind[AOT_MEM_SIZE];    /**< see aot_kind               */
+static unsigned char leader[AOT_MEM_SIZE];  /**< a block starts here        */
+static int           blockOf[AOT_MEM_SIZE]; /**< index of the block (from 1)
+                                                 starting here              */
+static char*         labelOf[AOT_MEM_SIZE]; /**< label from the .sym        */
+
+/** Addresses still to explore */
+static int* work;
+static int  numWork;
+
+/** Add an address to explore */
+static void add_root (int addr) {
+  addr &= 0xFFFF;
+
+  if (loaded[addr])
+    work[numWork++] = addr;
+}
+
+/** Sign extend the low bits of a word */
+static int sext (int word, int bits) {
+  int m = 1 << (bits - 1);
+
+  return ((word & ((1 << bits) - 1)) ^ m) - m;
+}
+
+/** Determine if an instruction ends a block, adding the addresses it may
+ *  go to to the work list
+ */
+static int ends_block (int addr, LC3_WORD w) {
+  int next = (addr + 1) & 0xFFFF;
+
+  switch (w >> 12) {
+    case OP_BR:
+      if (((w >> 9) & 7) == 0)
+        return 0; // never taken
+
+      add_root(next + sext(w, 9));
+
+      if (((w >> 9) & 7) != 7)
+        add_root(next);
+      return 1;
+
+    case OP_JSR_JSRR:
+      if (w & 0x800)
+        add_root(next + sext(w, 11));
+      add_root(next);
+      return 1;
+
+    case OP_TRAP:
+      if ((w & 0xFF) != 0x25) // HALT does not return
+        add_root(next);
+      return 1;
+
+    case OP_JMP_RET:
+    case OP_RTI:
+    case OP_RESERVED:
+      return 1;
+  }
+
+  return 0;
+}
+
+/** Follow the code from the addresses of the work list */
+static void explore (enum aot_kind how) {
+  while (numWork > 0) {
+    int addr = work[--numWork];
+
+    leader[addr] = 1; // may split a block already found
+
+    if (kind[addr] != AOT_NONE)
+      continue;
+
+    for (;;) {
+      kind[addr] = how;
+
+      if (ends_block(addr, image[addr]))
+        break;
+
+      addr = (addr + 1) & 0xFFFF;
+
+      if (! loaded[addr])
+        break;
+
+      if (kind[addr] != AOT_NONE) { // falls into code already found
+        leader[addr] = 1;
+        break;
+      }
+    }
+  }
+}
+
+/** Read the labels of a .sym file
+ *  @return 0 on success, else the errno value of the failure
+ */
+static int read_labels (const char* file_name) {
+  FILE* f = fopen(file_name, "r");
+  char  line[256];
+  char  name[128];
+  int   addr;
+
+  if (f == NULL)
+    return errno;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    // the header lines have no address after the first word
+    if (sscanf(line, "// %127s %x", name, &addr) != 2 || addr < 0 ||
+        addr >= AOT_MEM_SIZE || labelOf[addr] != NULL)
+      continue;
+
+    labelOf[addr] = strdup(name);
+  }
+
+  fclose(f);
+  return 0;
+}
+
+/** Write the C code going to an address */
+static void emit_jump (FILE* f, int target) {
+  target &= 0xFFFF;
+
+  if (leader[target] && kind[target] != AOT_NONE)
+    fprintf(f, "goto L_%04X;", target);
+  else
+    fprintf(f, "{ pc = 0x%04X; goto dispatch; }", target);
+}
+
+/** Write the C code of an instruction
+ *  @return 1 if the code does not fall through
+ */
+static int emit_instruction (FILE* f, int addr, LC3_WORD w) {
+  int next = (addr + 1) & 0xFFFF;
+  int dr   = (w >> 9) & 7;
+  int sr1  = (w >> 6) & 7;
+  int nzp  = dr;
+
+  fprintf(f, "  /* x%04X */ ", addr);
+
+  switch (w >> 12) {
+    case OP_BR:
+      if (nzp == 0) {
+        fprintf(f, ";\n");
+        return 0;
+      }
+
+      if (nzp != 7)
+        fprintf(f, "if (TEST(%d)) ", nzp);
+      emit_jump(f, next + sext(w, 9));
+      fprintf(f, "\n");
+      return nzp == 7;
+
+    case OP_ADD:
+    case OP_AND:
+      fprintf(f, "r%d = r%d %c ", dr, sr1,
+              ((w >> 12) == OP_ADD) ? '+' : '&');
+
+      if (w & 0x20)
+        fprintf(f, "0x%04X;", sext(w, 5) & 0xFFFF);
+      else
+        fprintf(f, "r%d;", w & 7);
+      break;
+
+    case OP_NOT:
+      fprintf(f, "r%d = ~r%d;", dr, sr1);
+      break;
+
+    case OP_LD:
+      fprintf(f, "r%d = mem[0x%04X];", dr, (next + sext(w, 9)) & 0xFFFF);
+      break;
+
+    case OP_LDI:
+      fprintf(f, "r%d = mem[mem[0x%04X]];", dr,
+              (next + sext(w, 9)) & 0xFFFF);
+      break;
+
+    case OP_LDR:
+      fprintf(f, "r%d = mem[(uint16_t) (r%d + 0x%04X)];", dr, sr1,
+              sext(w, 6) & 0xFFFF);
+      break;
+
+    case OP_LEA: // does not set the condition codes
+      fprintf(f, "r%d = 0x%04X;\n", dr, (next + sext(w, 9)) & 0xFFFF);
+      return 0;
+
+    case OP_ST:
+      fprintf(f, "STORE(0x%04X, r%d, 0x%04X, dispatch);\n",
+              (next + sext(w, 9)) & 0xFFFF, dr, next);
+      return 0;
+
+    case OP_STI:
+      fprintf(f, "STORE(mem[0x%04X], r%d, 0x%04X, dispatch);\n",
+              (next + sext(w, 9)) & 0xFFFF, dr, next);
+      return 0;
+
+    case OP_STR:
+      fprintf(f, "STORE(r%d + 0x%04X, r%d, 0x%04X, dispatch);\n", sr1,
+              sext(w, 6) & 0xFFFF, dr, next);
+      return 0;
+
+    case OP_JSR_JSRR:
+      if (w & 0x800) {
+        fprintf(f, "r7 = 0x%04X; ", next);
+        emit_jump(f, next + sext(w, 11));
+      } else {
+        fprintf(f, "pc = r%d; r7 = 0x%04X; goto dispatch;", sr1, next);
+      }
+      fprintf(f, "\n");
+      return 1;
+
+    case OP_JMP_RET:
+      fprintf(f, "pc = r%d; goto dispatch;\n", sr1);
+      return 1;
+
+    case OP_TRAP:
+      fprintf(f, "r7 = 0x%04X; vec = 0x%02X; goto trap;\n", next, w & 0xFF);
+      return 1;
+
+    default: // RTI and the reserved opcode
+      fprintf(f, "pc = 0x%04X; goto illegal;\n", addr);
+      return 1;
+  }
+
+  fprintf(f, " cc = r%d;\n", dr);
+  return 0;
+}
+
+/** The start of the generated program, before the tables */
+static const char* prologue =
+  "#include <stdint.h>\n"
+  "#include <stdio.h>\n"
+  "#include <stdlib.h>\n"
+  "#include <string.h>\n"
+  "\n"
+  "/* sign extension of the low bits of an instruction */\n"
+  "#define SEXT(v, bits) ((uint16_t) ((((v) & ((1u << (bits)) - 1)) ^ \\\n"
+  "                      (1u << ((bits) - 1))) - (1u << ((bits) - 1))))\n"
+  "\n"
+  "/* the condition codes, from the last value written to a register */\n"
+  "#define TEST(nzp) ((((nzp) & 4) && (int16_t) cc < 0) || \\\n"
+  "                   (((nzp) & 2) && cc == 0) || \\\n"
+  "                   (((nzp) & 1) && (int16_t) cc > 0))\n"
+  "\n"
+  "/* a store that changes a compiled block leaves the compiled code */\n"
+  "#define STORE(a, v, next, exit) do {                     \\\n"
+  "    uint16_t a_ = (a), v_ = (v);                         \\\n"
+  "    if (owner[a_] != 0 && mem[a_] != v_) {               \\\n"
+  "      mem[a_] = v_; dirty[owner[a_]] = 1; anyDirty = 1;  \\\n"
+  "      pc = (next); goto exit;                            \\\n"
+  "    }                                                    \\\n"
+  "    mem[a_] = v_;                                        \\\n"
+  "  } while (0)\n"
+  "\n"
+  "/* the compiled code keeps the registers in variables, the interpreter\n"
+  "   in an array */\n"
+  "#define SAVE_REGS() (R[0] = r0, R[1] = r1, R[2] = r2, R[3] = r3, \\\n"
+  "                     R[4] = r4, R[5] = r5, R[6] = r6, R[7] = r7)\n"
+  "#define LOAD_REGS() (r0 = R[0], r1 = R[1], r2 = R[2], r3 = R[3], \\\n"
+  "                     r4 = R[4], r5 = R[5], r6 = R[6], r7 = R[7])\n"
+  "\n";
+
+/** Write the service routines, the interpreter and main() */
+static const char* epilogue =
+  "\n"
+  "trap:\n"
+  "  switch (vec) {\n"
+  "    case 0x20: r0 = read_char(); break;\n"
+  "    case 0x21: putchar(r0 & 0xFF); break;\n"
+  "    case 0x22:\n"
+  "      for (t = r0; mem[t] != 0; t++)\n"
+  "        putchar(mem[t] & 0xFF);\n"
+  "      break;\n"
+  "    case 0x23:\n"
+  "      fputs(\"Input a character> \", stdout);\n"
+  "      r0 = read_char();\n"
+  "      putchar(r0);\n"
+  "      break;\n"
+  "    case 0x24:\n"
+  "      for (t = r0; mem[t] != 0; t++) {\n"
+  "        putchar(mem[t] & 0xFF);\n"
+  "        if ((mem[t] >> 8) == 0)\n"
+  "          break;\n"
+  "        putchar(mem[t] >> 8);\n"
+  "      }\n"
+  "      break;\n"
+  "    case 0x25: return;\n"
+  "    case 0x26:\n"
+  "      for (t = r0; ; t++) {\n"
+  "        c = getchar();\n"
+  "        mem[t] = (c == EOF || c == '\\n') ? 0 : (c & 0xFF);\n"
+  "        dirty[owner[t]] = anyDirty = 1; /* dirty[0] is no block */\n"
+  "        if (mem[t] == 0)\n"
+  "          break;\n"
+  "      }\n"
+  "      break;\n"
+  "    default:\n"
+  "      if (mem[vec] == 0) {\n"
+  "        fprintf(stderr, \"no service routine for TRAP x%02X\\n\", vec);\n"
+  "        return;\n"
+  "      }\n"
+  "      pc = mem[vec];\n"
+  "      goto dispatch;\n"
+  "  }\n"
+  "  pc = r7;\n"
+  "  goto dispatch;\n"
+  "\n"
+  "illegal:\n"
+  "  fprintf(stderr, \"illegal instruction at x%04X\\n\", pc);\n"
+  "  return;\n"
+  "\n"
+  "interp:\n"
+  "  SAVE_REGS();\n"
+  "\n"
+  "  for (;;) {\n"
+  "    uint16_t ir = mem[pc], dr = (ir >> 9) & 7, sr = (ir >> 6) & 7;\n"
+  "\n"
+  "    pc++;\n"
+  "\n"
+  "    switch (ir >> 12) {\n"
+  "      case 0x0: if (TEST(dr)) pc += SEXT(ir, 9); break;\n"
+  "      case 0x1: R[dr] = R[sr] + ((ir & 0x20) ? SEXT(ir, 5) : R[ir & 7]);\n"
+  "                cc = R[dr]; break;\n"
+  "      case 0x2: R[dr] = mem[(uint16_t) (pc + SEXT(ir, 9))]; cc = R[dr];\n"
+  "                break;\n"
+  "      case 0x3: STORE(pc + SEXT(ir, 9), R[dr], pc, leave); break;\n"
+  "      case 0x4: t = (ir & 0x800) ? pc + SEXT(ir, 11) : R[sr];\n"
+  "                R[7] = pc; pc = t; break;\n"
+  "      case 0x5: R[dr] = R[sr] & ((ir & 0x20) ? SEXT(ir, 5) : R[ir & 7]);\n"
+  "                cc = R[dr]; break;\n"
+  "      case 0x6: R[dr] = mem[(uint16_t) (R[sr] + SEXT(ir, 6))];\n"
+  "                cc = R[dr]; break;\n"
+  "      case 0x7: STORE(R[sr] + SEXT(ir, 6), R[dr], pc, leave); break;\n"
+  "      case 0x9: R[dr] = ~R[sr]; cc = R[dr]; break;\n"
+  "      case 0xA: R[dr] = mem[mem[(uint16_t) (pc + SEXT(ir, 9))]];\n"
+  "                cc = R[dr]; break;\n"
+  "      case 0xB: t = mem[(uint16_t) (pc + SEXT(ir, 9))];\n"
+  "                STORE(t, R[dr], pc, leave); break;\n"
+  "      case 0xC: pc = R[sr]; break;\n"
+  "      case 0xE: R[dr] = pc + SEXT(ir, 9); break;\n"
+  "      case 0xF: R[7] = pc; vec = ir & 0xFF; goto leave_trap;\n"
+  "      default: pc--; goto illegal; /* RTI and the reserved opcode */\n"
+  "    }\n"
+  "\n"
+  "#ifndef LC3_INTERPRET\n"
+  "    if (isStart[pc])\n"
+  "      goto leave;\n"
+  "#endif\n"
+  "  }\n"
+  "\n"
+  "leave:\n"
+  "  LOAD_REGS();\n"
+  "  goto dispatch;\n"
+  "\n"
+  "leave_trap:\n"
+  "  LOAD_REGS();\n"
+  "  goto trap;\n"
+  "}\n"
+  "\n"
+  "int main (int argc, char* argv[]) {\n"
+  "  long runs = (argc > 1) ? atol(argv[1]) : 1;\n"
+  "\n"
+  "  for (int i = 0; i < NUM_BLOCKS; i++) {\n"
+  "    isStart[starts[i][0]] = 1;\n"
+  "    if (starts[i][2])\n"
+  "      for (int j = 0; j < starts[i][1]; j++)\n"
+  "        owner[(uint16_t) (starts[i][0] + j)] = i + 1;\n"
+  "  }\n"
+  "\n"
+  "  for (long r = 0; r < runs; r++) {\n"
+  "    memset(mem, 0, sizeof(mem));\n"
+  "    memset(dirty, 0, sizeof(dirty));\n"
+  "    for (int i = 0; i < NUM_WORDS; i++)\n"
+  "      mem[(uint16_t) (ORIGIN + i)] = image[i];\n"
+  "    run(ORIGIN);\n"
+  "  }\n"
+  "\n"
+  "  fflush(stdout);\n"
+  "  return 0;\n"
+  "}\n";
+
+/** Write the C program
+ *  @return 1 on success, 0 on a write error
+ */
+static int emit_program (FILE* f, lc3_obj_t* obj, const char* obj_name) {
+  int numBlocks = 0;
+
+  for (int a = 0; a < AOT_MEM_SIZE; a++) {
+    if (leader[a] && kind[a] != AOT_NONE)
+      blockOf[a] = ++numBlocks;
+  }
+
+  fprintf(f, "/* %s translated by lc3aot */\n\n", obj_name);
+  fputs(prologue, f);
+  fprintf(f, "#define ORIGIN     0x%04X\n", obj->origin);
+  fprintf(f, "#define NUM_WORDS  %d\n", obj->numWords);
+  fprintf(f, "#define NUM_BLOCKS %d\n\n", numBlocks);
+
+  fprintf(f, "static const uint16_t image[NUM_WORDS + 1] = {");
+  for (int i = 0; i < obj->numWords; i++)
+    fprintf(f, "%s0x%04X,", (i % 10 == 0) ? "\n  " : " ", obj->words[i]);
+  fprintf(f, "\n  0\n};\n\n");
+
+  // address, length and whether the block is marked dirty by stores
+  fprintf(f, "static const uint16_t starts[NUM_BLOCKS + 1][3] = {\n");
+  int* length = calloc(numBlocks + 1, sizeof(int));
+
+  for (int a = 0, b = 0; a < AOT_MEM_SIZE; a++) {
+    if (blockOf[a] != 0)
+      b = blockOf[a];
+    if (kind[a] == AOT_NONE)
+      b = 0;
+    if (b != 0)
+      length[b]++;
+  }
+
+  for (int a = 0; a < AOT_MEM_SIZE; a++) {
+    if (blockOf[a] != 0)
+      fprintf(f, "  { 0x%04X, %d, %d },\n", a, length[blockOf[a]],
+              kind[a] == AOT_STATIC);
+  }
+
+  fprintf(f, "  { 0, 0, 0 }\n};\n\n");
+  fprintf(f, "static uint16_t mem[0x10000];\n");
+  fprintf(f, "static uint16_t owner[0x10000];   /* block of a word, from 1 */\n");
+  fprintf(f, "static uint8_t  isStart[0x10000];\n");
+  fprintf(f, "static uint8_t  dirty[NUM_BLOCKS + 1];\n\n");
+  fprintf(f, "/* end of input reads as EOT (x04) */\n");
+  fprintf(f, "static uint16_t read_char (void) {\n");
+  fprintf(f, "  int c = getchar();\n\n");
+  fprintf(f, "  return (c == EOF) ? 0x04 : (c & 0xFF);\n}\n\n");
+
+  fprintf(f, "static void run (uint16_t pc) {\n");
+  fprintf(f, "  uint16_t r0 = 0, r1 = 0, r2 = 0, r3 = 0;\n");
+  fprintf(f, "  uint16_t r4 = 0, r5 = 0, r6 = 0, r7 = 0;\n");
+  fprintf(f, "  uint16_t R[8];\n");
+  fprintf(f, "  uint16_t cc   = 0;\n");
+  fprintf(f, "  uint16_t t, vec;\n");
+  fprintf(f, "  int      c, anyDirty = 0; /* a block is dirty */\n\n");
+  fprintf(f, "dispatch:\n");
+  fprintf(f, "#ifdef LC3_INTERPRET\n  goto interp;\n#else\n");
+  fprintf(f, "  switch (pc) {\n");
+
+  for (int a = 0; a < AOT_MEM_SIZE; a++) {
+    if (blockOf[a] != 0)
+      fprintf(f, "    case 0x%04X: goto L_%04X;\n", a, a);
+  }
+
+  fprintf(f, "    default: goto interp;\n  }\n#endif\n");
+
+  for (int a = 0; a < AOT_MEM_SIZE; a++) {
+    if (blockOf[a] == 0)
+      continue;
+
+    int b = blockOf[a];
+
+    fprintf(f, "\nL_%04X:", a);
+    if (labelOf[a] != NULL)
+      fprintf(f, " /* %s */", labelOf[a]);
+
+    if (kind[a] == AOT_STATIC)
+      fprintf(f, "\n  if (anyDirty && dirty[%d]) { pc = 0x%04X; goto interp; }\n",
+              b, a);
+    else
+      fprintf(f, "\n  if (memcmp(mem + 0x%04X, image + %d, %d * 2) != 0) "
+              "{ pc = 0x%04X; goto interp; }\n", a,
+              (a - obj->origin) & 0xFFFF, length[b], a);
+
+    int addr = a;
+    int done = 0;
+
+    for (int i = 0; i < length[b] && ! done; i++, addr = (addr + 1) & 0xFFFF)
+      done = emit_instruction(f, addr, image[addr]);
+
+    if (! done) {
+      fprintf(f, "  ");
+      emit_jump(f, addr);
+      fprintf(f, "\n");
+    }
+  }
+
+  fputs(epilogue, f);
+  free(length);
+  return ! ferror(f);
+}
+
+/** Replace the extension of a file name (or add it) */
+static char* with_extension (const char* file_name, const char* ext) {
+  const char* dot   = strrchr(file_name, '.');
+  const char* slash = strrchr(file_name, '/');
+  size_t      len   = (dot != NULL && (slash == NULL || dot > slash))
+                      ? (size_t) (dot - file_name) : strlen(file_name);
+  char*       name  = malloc(len + strlen(ext) + 1);
+
+  memcpy(name, file_name, len);
+  strcpy(name + len, ext);
+  return name;
+}
+
+/** Print how to use the program */
+static void usage (void) {
+  fprintf(stderr, "usage: lc3aot [-s file.sym] [-o file.c] file.obj\n");
+  exit(1);
+}
+
+int main (int argc, char* argv[]) {
+  const char* objName = NULL;
+  char*       symName = NULL;
+  char*       outName = NULL;
+  int         symGiven = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      symName  = strdup(argv[++i]);
+      symGiven = 1;
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outName = strdup(argv[++i]);
+    } else if (argv[i][0] != '-' && objName == NULL) {
+      objName = argv[i];
+    } else {
+      usage();
+    }
+  }
+
+  if (objName == NULL)
+    usage();
+
+  lc3_obj_t obj;
+  int       error = objfile_load(objName, &obj);
+
+  if (error != 0) {
+    fprintf(stderr, "lc3aot: %s: %s\n", objName, strerror(error));
+    return 1;
+  }
+
+  if (obj.numWords > AOT_MEM_SIZE)
+    obj.numWords = AOT_MEM_SIZE; // the rest is not in LC3 memory
+
+  for (int i = 0; i < obj.numWords; i++) {
+    int addr = (obj.origin + i) & 0xFFFF;
+
+    image[addr]  = obj.words[i];
+    loaded[addr] = 1;
+  }
+
+  if (symName == NULL)
+    symName = with_extension(objName, ".sym");
+
+  error = read_labels(symName);
+
+  if (error != 0 && (symGiven || error != ENOENT)) {
+    fprintf(stderr, "lc3aot: %s: %s\n", symName, strerror(error));
+    return 1;
+  }
+
+  // each word is pushed at most once per instruction reaching it
+  work = malloc(3 * (AOT_MEM_SIZE + 1) * sizeof(int));
+  add_root(obj.origin);
+  explore(AOT_STATIC);
+
+  for (int a = AOT_MEM_SIZE - 1; a >= 0; a--) {
+    if (labelOf[a] != NULL)
+      add_root(a);
+  }
+
+  explore(AOT_LABEL);
+
+  if (outName == NULL)
+    outName = with_extension(objName, ".c");
+
+  FILE* f = fopen(outName, "w");
+
+  if (f == NULL) {
+    fprintf(stderr, "lc3aot: %s: %s\n", outName, strerror(errno));
+    return 1;
+  }
+
+  int ok = emit_program(f, &obj, objName);
+
+  if (fclose(f) != 0 || ! ok) {
+    fprintf(stderr, "lc3aot: %s: write error\n", outName);
+    return 1;
+  }
+
+  objfile_free(&obj);
+  return 0;
+}
@@ -0,0 +1,191 @@
+/** @file lc3ar.c
+ *  @brief lists and extracts the archive of a batch
+ *  @details Reads an archive written by <code>mylc3as --archive</code> (see
+ *  <code>archive.h</code>):
+ *  <pre><code>
+ *  lc3ar -t file.lc3a                   list the entries and their members
+ *  lc3ar -x file.lc3a [source...]       write the members to their files
+ *  lc3ar -p file.lc3a source suffix     write a member to stdout
+ *  </code></pre>
+ *  Only the last entry of a source is used by <code>-x</code> and
+ *  <code>-p</code>, and <code>-x</code> without sources extracts the last
+ *  entry of every source. A member is written to the name of the file it
+ *  replaced, for example <code>prog.obj</code>, or <code>prog.diag</code>
+ *  for the diagnostics. The suffix of <code>-p</code> selects the member
+ *  whose name ends with it, for example <code>.sym</code>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+
+/** Print how to use the program */
+static void usage (void) {
+  fprintf(stderr, "usage: lc3ar -t file.lc3a\n"
+                  "       lc3ar -x file.lc3a [source...]\n"
+                  "       lc3ar -p file.lc3a source suffix\n");
+  exit(1);
+}
+
+/** Print the entries of the archive and their members */
+static int list (lc3_archive_t* ar) {
+  archive_entry_t  entry;
+  archive_member_t member;
+
+  for (int i = 0; i < ar->numEntries; i++) {
+    if (! archive_entry(ar, i, &entry)) {
+      fprintf(stderr, "lc3ar: entry %d is not valid\n", i);
+      return 1;
+    }
+
+    printf("%s: %d errors\n", entry.source, entry.numErrors);
+
+    const unsigned char* pos = entry.members;
+
+    while ((pos = archive_next_member(&entry, pos, &member)) != NULL)
+      printf("  %-30s %8lu\n", member.name, (unsigned long) member.length);
+  }
+
+  return 0;
+}
+
+/** Write the members of an entry to their files */
+static int extract (lc3_archive_t* ar, int i) {
+  archive_entry_t  entry;
+  archive_member_t member;
+  int              failed = 0;
+
+  if (! archive_entry(ar, i, &entry)) {
+    fprintf(stderr, "lc3ar: entry %d is not valid\n", i);
+    return 1;
+  }
+
+  const unsigned char* pos = entry.members;
+
+  while ((pos = archive_next_member(&entry, pos, &member)) != NULL) {
+    FILE* f = fopen(member.name, "wb");
+
+    if (f == NULL) {
+      fprintf(stderr, "lc3ar: %s: %s\n", member.name, strerror(errno));
+      failed = 1;
+      continue;
+    }
+
+    if (fwrite(member.data, 1, member.length, f) != member.length ||
+        fclose(f) != 0) {
+      fprintf(stderr, "lc3ar: %s: write error\n", member.name);
+      failed = 1;
+    }
+  }
+
+  return failed;
+}
+
+/** Typedef of structure type */
+typedef struct ar_source ar_source_t;
+
+/** The source of an entry and the index of the entry */
+struct ar_source {
+  const char* name;   /**< name of the source */
+  int         entry;  /**< index of the entry */
+};
+
+/** Order entries by source, then by position in the archive */
+static int compare_source (const void* a, const void* b) {
+  const ar_source_t* s1  = a;
+  const ar_source_t* s2  = b;
+  int                cmp = strcmp(s1->name, s2->name);
+
+  return (cmp != 0) ? cmp : s1->entry - s2->entry;
+}
+
+/** Write the last entry of each source */
+static int extract_all (lc3_archive_t* ar) {
+  ar_source_t*    sources = calloc(ar->numEntries + 1, sizeof(ar_source_t));
+  archive_entry_t entry;
+  int             n       = 0;
+  int             failed  = 0;
+
+  for (int i = 0; i < ar->numEntries; i++) {
+    if (archive_entry(ar, i, &entry)) {
+      sources[n++] = (ar_source_t) { entry.source, i };
+    }
+    else {
+      fprintf(stderr, "lc3ar: entry %d is not valid\n", i);
+      failed = 1;
+    }
+  }
+
+  // the entries of a source are together, the last one last
+  qsort(sources, n, sizeof(ar_source_t), compare_source);
+
+  for (int i = 0; i < n; i++) {
+    if (i + 1 == n || strcmp(sources[i].name, sources[i + 1].name) != 0)
+      failed |= extract(ar, sources[i].entry);
+  }
+
+  free(sources);
+  return failed;
+}
+
+int main (int argc, char* argv[]) {
+  lc3_archive_t ar;
+  int           failed = 0;
+
+  if (argc < 3 || argv[1][0] != '-' || strlen(argv[1]) != 2)
+    usage();
+
+  char mode = argv[1][1];
+
+  if ((mode == 't' && argc != 3) || (mode == 'p' && argc != 5) ||
+      (mode != 't' && mode != 'x' && mode != 'p'))
+    usage();
+
+  int error = archive_open(argv[2], &ar);
+
+  if (error != 0) {
+    fprintf(stderr, "lc3ar: %s: %s\n", argv[2], strerror(error));
+    return 1;
+  }
+
+  if (mode == 't') {
+    failed = list(&ar);
+  }
+  else if (mode == 'x' && argc == 3) {
+    failed = extract_all(&ar);
+  }
+  else if (mode == 'x') {
+    for (int i = 3; i < argc; i++) {
+      int entry = archive_find(&ar, argv[i]);
+
+      if (entry < 0) {
+        fprintf(stderr, "lc3ar: %s is not in the archive\n", argv[i]);
+        failed = 1;
+      }
+      else {
+        failed |= extract(&ar, entry);
+      }
+    }
+  }
+  else {
+    archive_entry_t  entry;
+    archive_member_t member;
+    int              i = archive_find(&ar, argv[3]);
+
+    if (i < 0 || ! archive_entry(&ar, i, &entry) ||
+        ! archive_find_member(&entry, argv[4], &member)) {
+      fprintf(stderr, "lc3ar: no member of %s ends with %s\n", argv[3],
+              argv[4]);
+      failed = 1;
+    }
+    else {
+      fwrite(member.data, 1, member.length, stdout);
+    }
+  }
+
+  archive_unmap(&ar);
+  return failed;
+}
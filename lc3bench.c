@@ -0,0 +1,229 @@
+/** @file lc3bench.c
+ *  @brief benchmark of the phases of the assembler
+ *  @details Assembles a file several times in memory and reports the time
+ *  and hardware counters of each phase (see <code>perf.h</code>), as CSV or
+ *  JSON, so the results of two builds can be compared:
+ *  <pre><code>
+ *  lc3bench [-n runs] [--csv|--json] file.asm
+ *  </code></pre>
+ *  Besides pass one, pass two and the output, the tokenizer and the symbol
+ *  table are measured as phases of their own: every line is tokenized
+ *  once, and the labels found by pass one are added to a new symbol table
+ *  and looked up. Nothing is written but the
+ *  report, the outputs are built in memory. A first run warms the caches
+ *  and is not counted.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LC3AS_VAR
+
+#include "assembler.h"
+#include "diag.h"
+#include "image.h"
+#include "include.h"
+#include "lexer.h"
+#include "perf.h"
+#include "tokens.h"
+
+/** Default number of runs counted */
+#define BENCH_RUNS 10
+
+/** The labels found by pass one, replayed by the symbol phase */
+static symbol_t* labels;
+static int       numLabels;
+static int       capLabels;
+
+/** Read a whole file
+ *  @param length - set to the length of the content
+ *  @return the content, or NULL if the file can not be read
+ */
+static char* read_source (const char* file_name, int* length) {
+  FILE* f = fopen(file_name, "r");
+
+  if (f == NULL)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  *length    = ftell(f);
+  char* text = malloc(*length + 1);
+  rewind(f);
+
+  if (fread(text, 1, *length, f) != (size_t) *length) {
+    free(text);
+    text = NULL;
+  }
+
+  fclose(f);
+  return text;
+}
+
+/** Tokenize every line of the source
+ *  @return the number of tokens, so the work is not optimized away
+ */
+static long lex_source (const char* text, int length) {
+  char line[MAX_LINE_LENGTH];
+  long tokens = 0;
+  int  end;
+
+  for (int pos = 0; pos < length; pos = end) {
+    const char* eol = memchr(text + pos, '\n', length - pos);
+
+    end = (eol != NULL) ? (eol - text) + 1 : length;
+
+    if (end - pos >= MAX_LINE_LENGTH)
+      continue; // an error in pass one
+
+    memcpy(line, text + pos, end - pos);
+    line[end - pos] = '\0';
+
+    for (lex_token_t* t = lex_line(line); t != NULL; t = lex_next())
+      tokens++;
+  }
+
+  return tokens;
+}
+
+/** Keep a label of the symbol table (see symbol_iterate()) */
+static void keep_label (symbol_t* sym, void* data) {
+  if (numLabels == capLabels) {
+    capLabels = 2 * capLabels + 64;
+    labels    = realloc(labels, capLabels * sizeof(symbol_t));
+  }
+
+  labels[numLabels++] = *sym;
+}
+
+/** Build a symbol table of the labels and look each one up
+ *  @return the number of labels found, so the work is not optimized away
+ */
+static long replay_symbols (void) {
+  sym_table_t* table = symbol_init(0); // as the assembler's
+  long         found = 0;
+
+  for (int i = 0; i < numLabels; i++)
+    symbol_add(table, labels[i].name, labels[i].addr);
+
+  for (int i = 0; i < numLabels; i++)
+    found += (symbol_find_by_name(table, labels[i].name) != NULL);
+
+  symbol_term(table);
+  return found;
+}
+
+/** Write the object file, hex file and symbol table in memory */
+static long write_outputs (void) {
+  char*  data;
+  size_t length;
+  FILE*  f = open_memstream(&data, &length);
+
+  image_write_obj(f, asm_get_image());
+  image_write_hex(f, asm_get_image());
+  lc3_write_sym_table(f);
+  fclose(f);
+  free(data);
+  return length;
+}
+
+/** Assemble the source once, attributing each phase
+ *  @return 1 on success, 0 if the source has errors
+ */
+static int run_once (const char* fileName, const char* text, int length,
+                     long* work) {
+  perf_set_phase(PERF_LEX);
+  *work += lex_source(text, length);
+
+  perf_set_phase(PERF_PASS_ONE);
+  asm_reset();
+  diag_init(DIAG_MAX_ERRORS);
+  include_set_source(fileName);
+  asm_pass_one_text(text, length);
+  perf_set_phase(PERF_NONE);
+
+  if (numErrors != 0)
+    return 0;
+
+  numLabels = 0;
+  symbol_iterate(lc3_sym_tab, keep_label, NULL);
+
+  perf_set_phase(PERF_SYMBOLS);
+  *work += replay_symbols();
+
+  perf_set_phase(PERF_PASS_TWO);
+  asm_generate(NULL);
+  perf_set_phase(PERF_NONE);
+
+  if (numErrors != 0)
+    return 0;
+
+  perf_set_phase(PERF_OUTPUT);
+  *work += write_outputs();
+  perf_set_phase(PERF_NONE);
+  return 1;
+}
+
+/** print usage statement for program */
+static void usage (void) {
+  fprintf(stderr, "Usage: lc3bench [-n runs] [--csv|--json] <ASM filename>\n");
+  fprintf(stderr, "  reports the time and hardware counters of each phase,"
+                  " per run\n");
+  fprintf(stderr, "  default %d runs, CSV\n", BENCH_RUNS);
+  exit(1);
+}
+
+int main (int argc, char* argv[]) {
+  int           runs   = BENCH_RUNS;
+  perf_format_t format = PERF_CSV;
+  int           i;
+
+  for (i = 1; i < argc - 1; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc - 1)
+      runs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--csv") == 0)
+      format = PERF_CSV;
+    else if (strcmp(argv[i], "--json") == 0)
+      format = PERF_JSON;
+    else
+      usage(); // this exits
+  }
+
+  if (i != argc - 1 || runs < 1)
+    usage(); // this exits
+
+  int   length;
+  char* text = read_source(argv[i], &length);
+  long  work = 0;
+
+  if (text == NULL) {
+    fprintf(stderr, ERR_OPEN_READ, argv[i]);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  asm_init();
+
+  if (! run_once(argv[i], text, length, &work)) { // warm up, and check the source
+    diag_flush(stderr);
+    return 1;
+  }
+
+  int available = perf_init();
+
+  if (available == 0)
+    fprintf(stderr, "hardware counters not available, only time measured\n");
+
+  for (int r = 0; r < runs; r++)
+    run_once(argv[i], text, length, &work);
+
+  perf_report(stdout, format, argv[i], runs);
+  perf_term();
+  asm_term();
+  diag_term();
+  free(labels);
+  free(text);
+  return (work < 0); // never, but the work is used
+}
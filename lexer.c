@@ -0,0 +1,196 @@
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include "expr.h"
+#include "lexer.h"
+#include "tokens.h"
+#include "util.h"
+
+/** The tokens of the current line */
+static lex_token_t tokens[LEX_MAX_TOKENS];
+
+/** The text of the tokens, each terminated by a '\0' */
+static char text[2 * MAX_LINE_LENGTH];
+
+/** Text shared by all comma tokens */
+static char commaText[] = ",";
+
+/** Number of tokens in the current line */
+static int numTokens;
+
+/** Index of the next token returned by <code>lex_next()</code> */
+static int nextToken;
+
+/** Determine if a character ends a token */
+static int is_delimiter (char c) {
+  return c == '\0' || c == ',' || c == ';' || isspace((unsigned char) c);
+}
+
+/** Determine if a token starts like a number: <code>#</code>, a digit, a
+ *  sign followed by a digit, or <code>x</code> followed by a hex digit.
+ *  Names such as <code>BASE</code> or <code>FACE</code> are labels even
+ *  though their text is valid hex.
+ */
+static int starts_number (const char* s) {
+  if (*s == '#')
+    return 1;
+
+  if (*s == 'x' || *s == 'X') {
+    s++;
+
+    if (*s == '-' || *s == '+')
+      s++;
+
+    return isxdigit((unsigned char) *s);
+  }
+
+  if (*s == '-' || *s == '+')
+    s++;
+
+  return isdigit((unsigned char) *s);
+}
+
+/** Start a new token at the given column */
+static lex_token_t* new_token (int column) {
+  lex_token_t* t = &tokens[numTokens++];
+
+  memset(t, 0, sizeof(lex_token_t));
+  t->column = column;
+  return t;
+}
+
+/** Classify a token that is not a comma or string */
+static void classify_word (lex_token_t* t) {
+  char* s = t->text;
+
+  if ((s[0] == 'R' || s[0] == 'r') && s[1] >= '0' && s[1] <= '7' &&
+      s[2] == '\0') {
+    t->type  = LEX_REG;
+    t->value = s[1] - '0';
+    return;
+  }
+
+  int op = (isalpha((unsigned char) s[0]) || s[0] == '.') ?
+           util_get_opcode(s) : -1;
+
+  if (op >= 0) {
+    LC3_inst_t* inst = lc3_get_inst_info(op);
+
+    t->type  = LEX_OP;
+    t->value = op;
+
+    if (op == OP_BR)
+      t->cond = util_parse_cond(s + 2);
+    else if (inst->forms[1].name != NULL &&
+             strcasecmp(s, inst->forms[0].name) != 0)
+      t->form = 1; // e.g. JSR or RET, the form of ADD depends on operands
+
+    return;
+  }
+
+  if (strcasecmp(s, ".EQU") == 0) {
+    t->type = LEX_EQU;
+    return;
+  }
+
+  if (strcasecmp(s, ".INCLUDE") == 0) {
+    t->type = LEX_INCLUDE;
+    return;
+  }
+
+  if (strcasecmp(s, ".LTORG") == 0) {
+    t->type = LEX_LTORG;
+    return;
+  }
+
+  if (s[0] == '=' && s[1] != '\0') { // LD R1,=value
+    t->type     = LEX_LITERAL;
+    t->isNumber = ! expr_is_expression(s + 1) && starts_number(s + 1) &&
+                  lc3_get_int(s + 1, &t->value);
+    t->isLabel  = util_is_valid_label(s + 1);
+    return;
+  }
+
+  if (expr_is_expression(s)) { // before numbers, which accept "3+4" as 3
+    t->type = LEX_EXPR;
+    return;
+  }
+
+  t->isNumber = starts_number(s) && lc3_get_int(s, &t->value);
+  t->isLabel  = util_is_valid_label(s);
+
+  if (t->isNumber)
+    t->type = LEX_IMM;
+  else if (t->isLabel)
+    t->type = LEX_LABEL;
+  else
+    t->type = LEX_BAD;
+}
+
+lex_token_t* lex_line (char* line) {
+  char* p = line;
+  char* w = text;
+
+  numTokens = nextToken = 0;
+
+  while (numTokens < LEX_MAX_TOKENS) {
+    while (*p != '\0' && isspace((unsigned char) *p))
+      p++;
+
+    if (*p == '\0' || *p == ';')
+      break;
+
+    lex_token_t* t = new_token(p - line + 1);
+
+    if (*p == ',') {
+      t->type = LEX_COMMA;
+      t->text = commaText;
+      p++;
+    }
+    else if (*p == '"') {
+      // keep the quotes, convert escape sequences
+      t->type = LEX_STRING;
+      t->text = w;
+      *w++    = *p++;
+
+      while (*p != '\0' && *p != '\n' && *p != '\r' && ! t->isClosed) {
+        if (*p == '"')
+          t->isClosed = 1;
+
+        if (*p == '\\' && p[1] != '\0') {
+          *w++ = lc3_escaped_char(p[1]);
+          p   += 2;
+        }
+        else {
+          *w++ = *p++;
+        }
+      }
+
+      *w++ = '\0';
+    }
+    else {
+      t->text = w;
+
+      while (! is_delimiter(*p))
+        *w++ = *p++;
+
+      *w++ = '\0';
+      classify_word(t);
+    }
+  }
+
+  return lex_next();
+}
+
+lex_token_t* lex_next (void) {
+  return (nextToken < numTokens) ? &tokens[nextToken++] : NULL;
+}
+
+lex_token_t* lex_peek (void) {
+  return (nextToken < numTokens) ? &tokens[nextToken] : NULL;
+}
+
+lex_token_t* lex_current (void) {
+  return (nextToken > 0) ? &tokens[nextToken - 1] : NULL;
+}
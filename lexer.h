@@ -0,0 +1,95 @@
+#ifndef __LEXER_H__
+#define __LEXER_H__
+
+/** @file lexer.h
+ *  @brief interface to a lexer producing classified LC3 tokens
+ *  @details The lexer splits a source line into tokens exactly as
+ *  <code>tokenize_line()</code> does (whitespace and commas separate tokens,
+ *  commas are returned, a semi-colon starts a comment, quoted strings keep
+ *  their quotes and have escape sequences converted). In the same pass it
+ *  classifies each token, so the parser never needs to compare the text of
+ *  a token against the opcode or register names again. Each token is
+ *  classified once:
+ *  <ul>
+ *  <li>a comma or quoted string</li>
+ *  <li>a register (<code>R0-R7</code>) and its number</li>
+ *  <li>an LC3 op or pseudo-op, its opcode, the form the name selects
+ *      (e.g. <code>JSR</code> vs <code>JSRR</code>) and, for
+ *      <code>BR</code>, its condition code</li>
+ *  <li>otherwise, whether it is a number (and its value) and whether it is
+ *      a valid label. A token such as <code>x10</code> is both, and the
+ *      operand type expected decides how it is used. Only a token
+ *      starting with <code>#</code>, <code>x</code> and a hex digit, a
+ *      digit or a sign is a number, so a name such as <code>BASE</code> is
+ *      a label even though its text is valid hex.</li>
+ *  <li>the <code>.EQU</code>, <code>.INCLUDE</code> and <code>.LTORG</code>
+ *      directives, and expressions such as <code>TABLE+3</code> (see
+ *      <code>expr.h</code>)</li>
+ *  <li>a literal, <code>=</code> followed by a number, label or expression
+ *      (see <code>literal.h</code>). Whether the rest is a number (and its
+ *      value) or a valid label is set as for other tokens.</li>
+ *  </ul>
+ */
+
+#include "lc3.h"
+
+/** Maximum number of tokens kept for one line. Longer lines are reported
+ *  as having extra operands.
+ */
+#define LEX_MAX_TOKENS 16
+
+/** The classes of token */
+typedef enum lex_type {
+  LEX_COMMA,   /**< a comma                                     */
+  LEX_STRING,  /**< a quoted string                             */
+  LEX_REG,     /**< a register, number in value                 */
+  LEX_OP,      /**< an op or pseudo-op, opcode in value         */
+  LEX_IMM,     /**< a number, value in value                    */
+  LEX_LABEL,   /**< a valid label that is not a number          */
+  LEX_EXPR,    /**< an expression of several terms              */
+  LEX_EQU,     /**< the .EQU directive                          */
+  LEX_INCLUDE, /**< the .INCLUDE directive                      */
+  LEX_LTORG,   /**< the .LTORG directive                        */
+  LEX_LITERAL, /**< =value, the text after = classified below   */
+  LEX_BAD      /**< none of the above                           */
+} lex_type_t;
+
+/** Typedef of structure type */
+typedef struct lex_token lex_token_t;
+
+/** A classified token */
+struct lex_token {
+  lex_type_t type;      /**< class of the token                           */
+  char*      text;      /**< text of the token                            */
+  int        column;    /**< column of the token in the line (1 based)    */
+  int        value;     /**< register, opcode or number, based on type    */
+  int        form;      /**< LEX_OP: the form named by the token          */
+  int        cond;      /**< LEX_OP: condition code of a BR               */
+  int        isNumber;  /**< text converts to a number (value holds it)   */
+  int        isLabel;   /**< text is a valid label                        */
+  int        isClosed;  /**< LEX_STRING: the closing quote was found      */
+};
+
+/** Split a line into classified tokens. The line is not modified, the text
+ *  of the tokens is kept by the lexer until the next call.
+ *  @param line - the source line
+ *  @return the first token, or NULL if the line has no tokens
+ */
+lex_token_t* lex_line (char* line);
+
+/** Return the next token of the line
+ *  @return the next token or NULL if there are no more tokens
+ */
+lex_token_t* lex_next (void);
+
+/** Return the next token of the line without consuming it
+ *  @return the next token or NULL if there are no more tokens
+ */
+lex_token_t* lex_peek (void);
+
+/** Return the token most recently returned by <code>lex_line()</code> or
+ *  <code>lex_next()</code>, or NULL
+ */
+lex_token_t* lex_current (void);
+
+#endif /* __LEXER_H__ */
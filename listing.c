@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "expr.h"
+#include "include.h"
+#include "listing.h"
+#include "mem.h"
+
+/** Typedef of structure type */
+typedef struct xref xref_t;
+
+/** A label, where it is defined and the lines that reference it */
+struct xref {
+  char* name;      /**< name of the label                 */
+  int   addr;      /**< LC3 address of the label          */
+  int   defLine;   /**< line on which the label is defined */
+  int*  refLines;  /**< lines referencing the label       */
+  int   numRefs;   /**< number of entries in refLines     */
+  int   capacity;  /**< number of entries allocated       */
+};
+
+/** Typedef of structure type */
+typedef struct xref_table xref_table_t;
+
+/** The labels of the cross reference and the line being scanned */
+struct xref_table {
+  xref_t* xrefs;      /**< the labels, sorted by name       */
+  int     numLabels;  /**< number of entries in xrefs       */
+  int     lineNum;    /**< line of the source referencing them */
+};
+
+/** The text of the source file being listed */
+static const char* srcText;
+
+/** The number of characters in <code>srcText</code> */
+static int srcLength;
+
+/** Offset in <code>srcText</code> of the next line not yet listed */
+static int srcPos;
+
+/** Number of source lines listed so far */
+static int srcLine;
+
+/** Write the next source line, preceded by the text in <code>prefix</code> */
+static void list_source_line (FILE* f, const char* prefix) {
+  const char* start = srcText + srcPos;
+  const char* eol   = memchr(start, '\n', srcLength - srcPos);
+  int         len   = (eol != NULL) ? eol - start : srcLength - srcPos;
+
+  srcPos += (eol != NULL) ? len + 1 : len;
+  srcLine++;
+
+  if (len > 0 && start[len - 1] == '\r')
+    len--;
+
+  fprintf(f, "%s(%4d) %.*s\n", prefix, srcLine, len, start);
+}
+
+/** List source lines (comments, blank lines) that generated nothing */
+static void list_until (FILE* f, int offset) {
+  while (srcPos < offset && srcPos < srcLength)
+    list_source_line(f, "             ");
+}
+
+/** Write a line of an included file, with its file and line number */
+static void list_included_line (FILE* f, line_info_t* info, LC3_WORD* words,
+                                int numWords) {
+  int first = 0;
+
+  if (info->srcLength > 0) { // else added by the optimizer
+    int         length;
+    const char* text = include_line_text(info, &length);
+
+    if (numWords == 0)
+      fprintf(f, "x%04X        ", info->address & 0xFFFF);
+    else
+      fprintf(f, "x%04X  x%04X ", info->address & 0xFFFF, words[first++]);
+
+    fprintf(f, "(%s:%d) %.*s\n", include_unit(info->srcFile)->name,
+            info->lineNum, length, text);
+  }
+
+  for (int i = first; i < numWords; i++)
+    fprintf(f, "x%04X  x%04X\n", (info->address + i) & 0xFFFF, words[i]);
+}
+
+void listing_start (FILE* f, const char* text, int length) {
+  srcText   = text;
+  srcLength = length;
+  srcPos    = 0;
+  srcLine   = 0;
+}
+
+void listing_write_line (FILE* f, line_info_t* info, LC3_WORD* words,
+                         int numWords) {
+  char prefix[16];
+
+  if (info->srcFile != 0) { // included, listed after the .INCLUDE line
+    list_included_line(f, info, words, numWords);
+    return;
+  }
+
+  if (info->srcOffset < srcPos) { // added by the optimizer, source is listed
+    for (int i = 0; i < numWords; i++)
+      fprintf(f, "x%04X  x%04X\n", (info->address + i) & 0xFFFF, words[i]);
+
+    return;
+  }
+
+  list_until(f, info->srcOffset);
+
+  if (numWords == 0)
+    sprintf(prefix, "x%04X        ", info->address & 0xFFFF);
+  else
+    sprintf(prefix, "x%04X  x%04X ", info->address & 0xFFFF, words[0]);
+
+  list_source_line(f, prefix);
+
+  for (int i = 1; i < numWords; i++)
+    fprintf(f, "x%04X  x%04X\n", (info->address + i) & 0xFFFF, words[i]);
+}
+
+/** Order cross reference entries by name, ignoring case like the symbol
+ *  table
+ */
+static int compare_xref (const void* a, const void* b) {
+  return strcasecmp(((const xref_t*) a)->name, ((const xref_t*) b)->name);
+}
+
+/** Record that a line references the label */
+static void add_reference (xref_t* xref, int lineNum) {
+  if (xref->numRefs == xref->capacity) {
+    xref->capacity = (xref->capacity > 0) ? 2 * xref->capacity : 4;
+    xref->refLines = mem_realloc(MEM_OUTPUT, xref->refLines, xref->capacity * sizeof(int));
+  }
+
+  xref->refLines[xref->numRefs++] = lineNum;
+}
+
+/** Record a reference of the current line to a label of its operand (see
+ *  expr_for_each_label())
+ */
+static void reference_label (const char* name, void* data) {
+  xref_table_t* table = data;
+  xref_t        key   = { (char*) name };
+  xref_t*       xref  = bsearch(&key, table->xrefs, table->numLabels,
+                                sizeof(xref_t), compare_xref);
+
+  if (xref != NULL)
+    add_reference(xref, table->lineNum);
+}
+
+/** Write the cross reference of every label defined in the program */
+static void list_xref (FILE* f, line_info_t* head) {
+  int numLabels = 0;
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    if (info->label != NULL)
+      numLabels++;
+  }
+
+  if (numLabels == 0)
+    return;
+
+  xref_t* xrefs = mem_calloc(MEM_OUTPUT, numLabels, sizeof(xref_t));
+  int     n     = 0;
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    if (info->label != NULL) {
+      xrefs[n].name    = info->label;
+      xrefs[n].addr    = info->address;
+      xrefs[n].defLine = include_source_line(info->srcFile, info->lineNum);
+      n++;
+    }
+  }
+
+  qsort(xrefs, numLabels, sizeof(xref_t), compare_xref);
+
+  xref_table_t table = { xrefs, numLabels };
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    // the reference of a .STRINGZ is its text
+    if (info->reference != NULL && info->opcode != OP_STRINGZ &&
+        info->opcode != OP_INVALID) {
+      table.lineNum = include_source_line(info->srcFile, info->lineNum);
+      expr_for_each_label(info->reference, reference_label, &table);
+    }
+  }
+
+  fprintf(f, "\nCross reference\n");
+  fprintf(f, "Label              Address  Defined  Referenced\n");
+
+  for (int i = 0; i < numLabels; i++) {
+    fprintf(f, "%-18s x%04X    %5d   ", xrefs[i].name, xrefs[i].addr & 0xFFFF,
+            xrefs[i].defLine);
+
+    for (int j = 0; j < xrefs[i].numRefs; j++)
+      fprintf(f, " %d", xrefs[i].refLines[j]);
+
+    fprintf(f, "\n");
+    mem_free(xrefs[i].refLines);
+  }
+
+  mem_free(xrefs);
+}
+
+void listing_finish (FILE* f, line_info_t* head) {
+  list_until(f, srcLength);
+  list_xref(f, head);
+}
@@ -0,0 +1,44 @@
+#ifndef __LISTING_H__
+#define __LISTING_H__
+
+/** @file listing.h
+ *  @brief interface to functions writing an assembler listing file
+ *  @details A listing shows every source line together with the LC3 address
+ *  and machine code generated for it. Rows are written by
+ *  <code>asm_pass_two()</code> as each line is encoded. The source text is
+ *  taken from the buffer read by <code>asm_pass_one()</code> using the span
+ *  recorded in each <code>line_info_t</code>, so the source file is never
+ *  read a second time. Lines that generate more than one word
+ *  (<code>.BLKW/.STRINGZ</code>) are followed by one row per additional word.
+ *  The listing ends with a cross reference of all the labels.
+ */
+
+#include <stdio.h>
+
+#include "assembler.h"
+
+/** Begin a listing
+ *  @param f - the listing file
+ *  @param text - the text of the source file
+ *  @param length - the number of characters in the text
+ */
+void listing_start (FILE* f, const char* text, int length);
+
+/** Write the listing row(s) for one source line. Any source lines between
+ *  the previous line written and this one (comments, blank lines) are
+ *  written first.
+ *  @param f - the listing file
+ *  @param info - the encoded source line
+ *  @param words - the words generated by the line
+ *  @param numWords - how many words the line generated
+ */
+void listing_write_line (FILE* f, line_info_t* info, LC3_WORD* words,
+                         int numWords);
+
+/** Write the remaining source lines and the label cross reference
+ *  @param f - the listing file
+ *  @param head - the list of source lines built by pass one
+ */
+void listing_finish (FILE* f, line_info_t* head);
+
+#endif /* __LISTING_H__ */
@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "field.h"
+#include "literal.h"
+#include "mem.h"
+
+/** Typedef of structure type */
+typedef struct lit_copy lit_copy_t;
+
+/** A literal of a list of lines and its copy (see lit_relink()) */
+struct lit_copy {
+  line_info_t* line;  /**< the literal  */
+  line_info_t* copy;  /**< its copy     */
+};
+
+/** Determine if two literals have the same value */
+static int same_value (line_info_t* a, line_info_t* b) {
+  if ((a->reference == NULL) != (b->reference == NULL))
+    return 0;
+
+  if (a->reference != NULL)
+    return strcmp(a->reference, b->reference) == 0;
+
+  return ((a->immediate ^ b->immediate) & 0xFFFF) == 0;
+}
+
+/** Add a line to a table, growing it as needed */
+static void add_entry (line_info_t*** table, int* num, int* cap,
+                       line_info_t* line) {
+  if (*num == *cap) {
+    *cap   = (*cap > 0) ? 2 * *cap : 16;
+    *table = mem_realloc(MEM_LINE_INFO, *table, *cap * sizeof(line_info_t*));
+  }
+
+  (*table)[(*num)++] = line;
+}
+
+void lit_use (lit_pool_t* pool, line_info_t* ld, line_info_t* value) {
+  line_info_t* found = NULL;
+
+  for (int i = 0; i < pool->numWaiting && found == NULL; i++) {
+    if (same_value(pool->waiting[i], value))
+      found = pool->waiting[i];
+  }
+
+  // the placed literals within reach are the last ones
+  for (int i = pool->numPlaced - 1; i >= 0 && found == NULL; i--) {
+    line_info_t* lit = pool->placed[i];
+
+    if (! fieldFits(lit->address - ld->address - 1, 9, 1))
+      break;
+
+    if (same_value(lit, value))
+      found = lit;
+  }
+
+  if (found != NULL) {
+    mem_free(value->reference);
+    mem_free(value);
+    ld->literal = found;
+    return;
+  }
+
+  value->literal = value;
+  ld->literal    = value;
+  add_entry(&pool->waiting, &pool->numWaiting, &pool->capWaiting, value);
+}
+
+int lit_place (lit_pool_t* pool, line_info_t* after, int addr) {
+  int count = pool->numWaiting;
+
+  for (int i = 0; i < count; i++) {
+    line_info_t* lit = pool->waiting[i];
+
+    lit->address = addr + i;
+    lit->next    = after->next;
+    after->next  = lit;
+    after        = lit;
+    add_entry(&pool->placed, &pool->numPlaced, &pool->capPlaced, lit);
+  }
+
+  pool->numWaiting = 0;
+  return count;
+}
+
+void lit_new_block (lit_pool_t* pool) {
+  pool->numPlaced = 0;
+}
+
+void lit_term (lit_pool_t* pool) {
+  for (int i = 0; i < pool->numWaiting; i++) {
+    mem_free(pool->waiting[i]->reference);
+    mem_free(pool->waiting[i]);
+  }
+
+  mem_free(pool->waiting);
+  mem_free(pool->placed);
+  memset(pool, 0, sizeof(lit_pool_t));
+}
+
+/** Order copies by the address in memory of the literal */
+static int compare_copy (const void* a, const void* b) {
+  uintptr_t x = (uintptr_t) ((const lit_copy_t*) a)->line;
+  uintptr_t y = (uintptr_t) ((const lit_copy_t*) b)->line;
+
+  return (x > y) - (x < y);
+}
+
+void lit_relink (line_info_t* lines, line_info_t* copies) {
+  int n = 0;
+
+  for (line_info_t* line = lines; line != NULL; line = line->next)
+    n += (line->literal == line);
+
+  if (n == 0)
+    return;
+
+  lit_copy_t*  table = mem_alloc(MEM_LINE_INFO, n * sizeof(lit_copy_t));
+  line_info_t* copy  = copies;
+
+  n = 0;
+
+  for (line_info_t* line = lines; line != NULL; line = line->next) {
+    if (line->literal == line) {
+      table[n++]    = (lit_copy_t) { line, copy };
+      copy->literal = copy;
+    }
+
+    copy = copy->next;
+  }
+
+  qsort(table, n, sizeof(lit_copy_t), compare_copy);
+  copy = copies;
+
+  for (line_info_t* line = lines; line != NULL; line = line->next) {
+    if (line->literal != NULL && line->literal != line) {
+      lit_copy_t  key   = { line->literal, NULL };
+      lit_copy_t* found = bsearch(&key, table, n, sizeof(lit_copy_t),
+                                  compare_copy);
+
+      copy->literal = (found != NULL) ? found->copy : NULL;
+    }
+
+    copy = copy->next;
+  }
+
+  mem_free(table);
+}
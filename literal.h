@@ -0,0 +1,82 @@
+#ifndef __LITERAL_H__
+#define __LITERAL_H__
+
+/** @file literal.h
+ *  @brief interface to the literal pools of <code>LD</code>
+ *  @details <code>ADD</code> and <code>AND</code> have 5 bit immediates, so
+ *  a wider constant or an address is loaded from a <code>.FILL</code>.
+ *  Instead of writing the <code>.FILL</code> and its label, the operand of
+ *  an <code>LD</code> may be the value itself, after an <code>=</code>:
+ *  <pre>
+ *  LD R1, =#1234     LD R2, =x8000     LD R3, =TABLE     LD R4, =TABLE+2
+ *  </pre>
+ *  Pass one creates a <code>.FILL</code> of the value, the literal, which
+ *  waits in the pool of the block until a place for it is found. An equal
+ *  literal (same number, or same label or expression) already waiting, or
+ *  placed within reach of the <code>LD</code>, is used instead, so each
+ *  value is stored once per pool. The waiting literals are placed:
+ *  <ul>
+ *  <li>after <code>.LTORG</code>, to put them where they are needed;</li>
+ *  <li>after an unconditional branch (<code>BR</code>/<code>BRnzp</code>,
+ *      <code>JMP</code>, <code>RET</code>, <code>RTI</code> and
+ *      <code>HALT</code>), where execution never falls through;</li>
+ *  <li>before the <code>.END</code> or <code>.ORIG</code> closing the
+ *      block, or at the end of the program.</li>
+ *  </ul>
+ *  The <code>LD</code> keeps its literal in <code>literal</code> (a literal
+ *  points to itself), and pass two encodes the PC offset to it. The offset
+ *  must fit in 9 bits: if the pool is too far, pass two reports it, and a
+ *  <code>.LTORG</code> after a branch closer to the <code>LD</code> solves
+ *  it. The lines of a pool are added to the program when it is placed, so
+ *  the addresses of pass one count them. An included file must place its
+ *  literals itself, as its lines are reused wherever it is included.
+ */
+
+#include "assembler.h"
+
+/** Typedef of structure type */
+typedef struct lit_pool lit_pool_t;
+
+/** The literals of a block */
+struct lit_pool {
+  line_info_t** waiting;     /**< literals not placed yet, in order of use */
+  int           numWaiting;  /**< number of waiting literals               */
+  int           capWaiting;  /**< number of entries allocated              */
+  line_info_t** placed;      /**< literals placed in the block, by address */
+  int           numPlaced;   /**< number of placed literals                */
+  int           capPlaced;   /**< number of entries allocated              */
+};
+
+/** Give an <code>LD</code> its literal: an equal literal waiting or placed
+ *  within its reach, else the new one, which then waits for a place
+ *  @param pool - the pool of the block
+ *  @param ld - the line of the <code>LD</code>, at its address
+ *  @param value - a new <code>.FILL</code> of the value, not in the list of
+ *  lines. It is freed if an equal literal is used.
+ */
+void lit_use (lit_pool_t* pool, line_info_t* ld, line_info_t* value);
+
+/** Add the waiting literals to the list of lines
+ *  @param pool - the pool of the block
+ *  @param after - the line they are added after
+ *  @param addr - the address of the first one
+ *  @return the number of words added (0 if none were waiting)
+ */
+int lit_place (lit_pool_t* pool, line_info_t* after, int addr);
+
+/** Forget the placed literals, as a new block starts. No literal may be
+ *  waiting.
+ */
+void lit_new_block (lit_pool_t* pool);
+
+/** Free the tables of a pool and the literals still waiting */
+void lit_term (lit_pool_t* pool);
+
+/** Make the <code>LD</code> lines of a copy of a list of lines use the
+ *  copies of their literals
+ *  @param lines - the lines, whose literals are all placed
+ *  @param copies - the copy, with the same number of lines
+ */
+void lit_relink (line_info_t* lines, line_info_t* copies);
+
+#endif /* __LITERAL_H__ */
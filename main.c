@@ -29,16 +29,93 @@
  * @author <b>Fritz Sieker</b>
  */
 
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 
 #define LC3AS_VAR
 
 #include "assembler.h"
+#include "batch.h"
+#include "bio.h"
+#include "diag.h"
+#include "mem.h"
+#include "perf.h"
+#include "pipeline.h"
+#include "server.h"
+#include "watch.h"
+
+/** Output file selected by <code>-obj</code> */
+#define OUT_OBJ 0x1
+
+/** Output file selected by <code>-hex</code> */
+#define OUT_HEX 0x2
+
+/** Output file selected by <code>-sym</code> */
+#define OUT_SYM 0x4
+
+/** Output file selected by <code>-lst</code> or <code>--listing</code> */
+#define OUT_LST 0x8
+
+/** Output file selected by <code>-sobj</code> */
+#define OUT_SOBJ 0x10
+
+/** Output file selected by <code>-cost</code> */
+#define OUT_COST 0x20
+
+/** Output file selected by <code>-dbg</code> */
+#define OUT_DBG 0x40
+
+/** Output file selected by <code>-xref</code> */
+#define OUT_XREF 0x80
+
+/** Output file selected by <code>-ir</code> */
+#define OUT_IR 0x100
+
+/** Outputs produced when none are selected on the command line */
+#define OUT_DEFAULT (OUT_OBJ | OUT_SYM)
 
 /** print usage statement for program */
 static void usage (void) {
-  fprintf(stderr, "Usage: lc3as [-hex] <ASM filename>\n");
+  fprintf(stderr, "Usage: lc3as [-obj] [-hex] [-sobj] [-sym] [-lst|--listing]\n"
+                  "             [-cost] [-dbg] [-xref] [-ir] [-O]"
+                  " [--pool-strings] [--pipeline]\n"
+                  "             [--max-errors N] [--mem-stats]"
+                  " [--perf-counters csv|json]\n"
+                  "             [--io uring|threads] [--archive file]"
+                  " [--watch] <ASM filename>...\n");
+  fprintf(stderr, "       lc3as [outputs] [-O] <IR filename>\n");
+  fprintf(stderr, "       lc3as [--max-errors N] --serve <socket path>\n");
+  fprintf(stderr, "  default output is -obj -sym\n");
+  fprintf(stderr, "  -sobj writes a compact object file with zero-fill runs\n");
+  fprintf(stderr, "  -cost writes a static cost report per subroutine as JSON\n");
+  fprintf(stderr, "  -dbg writes a map of addresses to source lines\n");
+  fprintf(stderr, "  -xref writes an index of the lines referencing each"
+                  " label\n");
+  fprintf(stderr, "  -ir writes the lines and symbols found by pass one, from"
+                  " which a .lc3ir\n"
+                  "  file is assembled without reading the source again\n");
+  fprintf(stderr, "  assembly stops after N errors (default %d, 0 for no limit)\n",
+          DIAG_MAX_ERRORS);
+  fprintf(stderr, "  -O optimizes branches and removes no-op instructions\n");
+  fprintf(stderr, "  --pool-strings stores identical .STRINGZ strings, and"
+                  " strings ending\n"
+                  "  another, once at the end of their block\n");
+  fprintf(stderr, "  --pipeline reads, parses and encodes on separate threads"
+                  " (not with -O\n"
+                  "  or --pool-strings)\n");
+  fprintf(stderr, "  --archive appends the outputs and diagnostics of every"
+                  " file to one\n"
+                  "  archive instead of writing them to files\n");
+  fprintf(stderr, "  --mem-stats reports memory use to stderr\n");
+  fprintf(stderr, "  --perf-counters reports hardware counters per phase"
+                  " to stderr (one file,\n"
+                  "  not with --watch or --archive)\n");
+  fprintf(stderr, "  --watch stays resident and assembles the file on each"
+                  " save\n");
+  fprintf(stderr, "  several files are assembled as a batch, with batched I/O\n"
+                  "  (--io selects io_uring or a pool of threads,"
+                  " default io_uring if available)\n");
   exit (1);
 }
 
@@ -55,63 +132,417 @@ static char* check_for_asm_file (char* fname) {
   return 0;
 }
 
+/** Verify file has a <code>.lc3ir</code> suffix (see <code>ir.h</code>) */
+static char* check_for_ir_file (char* fname) {
+  int len = strlen(fname);
+
+  if (len >= 7) { // minimum length name is x.lc3ir
+    char* suffix = fname + len - 6;
+    if (strcmp(suffix, ".lc3ir") == 0)
+      return suffix;
+  }
+
+  return 0;
+}
+
+/** Convert a command line option to the output it selects
+ *  @param option - the command line option
+ *  @return the output bit, or 0 if the option is not recognized
+ */
+static int get_output_option (char* option) {
+  if (strcmp(option, "-obj") == 0)
+    return OUT_OBJ;
+
+  if (strcmp(option, "-hex") == 0)
+    return OUT_HEX;
+
+  if (strcmp(option, "-sym") == 0)
+    return OUT_SYM;
+
+  if (strcmp(option, "-sobj") == 0)
+    return OUT_SOBJ;
+
+  if (strcmp(option, "-cost") == 0)
+    return OUT_COST;
+
+  if (strcmp(option, "-dbg") == 0)
+    return OUT_DBG;
+
+  if (strcmp(option, "-xref") == 0)
+    return OUT_XREF;
+
+  if (strcmp(option, "-ir") == 0)
+    return OUT_IR;
+
+  if (strcmp(option, "-lst") == 0 || strcmp(option, "--listing") == 0)
+    return OUT_LST;
+
+  return 0;
+}
+
+/** Create the name of an output file from the name of the source file
+ *  @param asm_file - name of the source file (ends in .asm or .lc3ir)
+ *  @param suffix - suffix of the output file (e.g. ".obj")
+ *  @return a newly allocated name
+ */
+static char* make_file_name (char* asm_file, char* suffix) {
+  char* end       = check_for_asm_file(asm_file);
+  int   len       = ((end != NULL) ? end : check_for_ir_file(asm_file)) -
+                    asm_file;
+  char* file_name = malloc(len + strlen(suffix) + 1);
+
+  memcpy(file_name, asm_file, len);
+  strcpy(file_name + len, suffix);
+  return file_name;
+}
+
+/** Set the names of the outputs selected for a source file
+ *  @param asm_file - name of the source file (ends in .asm or .lc3ir)
+ *  @param selected - the outputs selected
+ *  @param outputs - set to the names of the outputs, or NULL
+ *  @param sym_file - set to the name of the symbol file, or NULL
+ */
+static void make_output_names (char* asm_file, int selected,
+                               asm_outputs_t* outputs, char** sym_file) {
+  *outputs  = (asm_outputs_t) { NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                                NULL };
+  *sym_file = NULL;
+
+  if (selected & OUT_OBJ)
+    outputs->obj_file_name = make_file_name(asm_file, ".obj");
+
+  if (selected & OUT_HEX)
+    outputs->hex_file_name = make_file_name(asm_file, ".hex");
+
+  if (selected & OUT_LST)
+    outputs->lst_file_name = make_file_name(asm_file, ".lst");
+
+  if (selected & OUT_SOBJ)
+    outputs->sobj_file_name = make_file_name(asm_file, ".sobj");
+
+  if (selected & OUT_COST)
+    outputs->cost_file_name = make_file_name(asm_file, ".cost.json");
+
+  if (selected & OUT_DBG)
+    outputs->dbg_file_name = make_file_name(asm_file, ".dbg");
+
+  if (selected & OUT_XREF)
+    outputs->xref_file_name = make_file_name(asm_file, ".xref");
+
+  if (selected & OUT_IR)
+    outputs->ir_file_name = make_file_name(asm_file, ".lc3ir");
+
+  if (selected & OUT_SYM)
+    *sym_file = make_file_name(asm_file, ".sym");
+}
+
+/** Free the names set by <code>make_output_names()</code> */
+static void free_output_names (asm_outputs_t* outputs, char* sym_file) {
+  free(outputs->obj_file_name);
+  free(outputs->hex_file_name);
+  free(outputs->lst_file_name);
+  free(outputs->sobj_file_name);
+  free(outputs->cost_file_name);
+  free(outputs->dbg_file_name);
+  free(outputs->xref_file_name);
+  free(outputs->ir_file_name);
+  free(sym_file);
+}
+
+/** Assemble several files with batched I/O (see <code>batch.h</code>)
+ *  @return the exit status of the program
+ */
+static int run_batch (char* asm_files[], int count, int selected,
+                      int maxErrors, int optimize, int backend,
+                      const char* archiveName, int memStats) {
+  batch_file_t* files = calloc(count, sizeof(batch_file_t));
+
+  for (int i = 0; i < count; i++) {
+    files[i].asm_file_name = asm_files[i];
+    make_output_names(asm_files[i], selected, &files[i].outputs,
+                      &files[i].sym_file_name);
+  }
+
+  asm_init();
+  int failed = batch_run(files, count, maxErrors, optimize, backend,
+                         archiveName);
+
+  if (failed < 0)
+    fprintf(stderr, "the requested I/O backend is not available\n");
+
+  for (int i = 0; i < count; i++)
+    free_output_names(&files[i].outputs, files[i].sym_file_name);
+
+  free(files);
+  mem_set_phase(MEM_TERM);
+  asm_term();
+  diag_term();
+
+  if (memStats)
+    mem_report(stderr);
+
+  return failed != 0;
+}
+
+/** Read the argument of <code>--max-errors</code>, exiting if it is not a
+ *  number of errors
+ */
+static int get_max_errors (const char* arg) {
+  char* end;
+  long  value = strtol(arg, &end, 10);
+
+  if (*arg == '\0' || *end != '\0' || value < 0 || value > INT_MAX)
+    usage(); // this exits
+
+  return (int) value;
+}
+
+/** Remove a partially written output file, if there was one */
+static void remove_file (char* file_name) {
+  if (file_name)
+    remove(file_name); // errors ignored
+}
+
 /** The entry point of the assembler. The program is invoked using:
  *  <pre><code>
- *  mylc3as [-hex] assembly_file_name
+ *  mylc3as [-obj] [-hex] [-sobj] [-sym] [-lst] [-cost] [-dbg] [-xref]
+ *          [-ir] [-O] [--pool-strings] [--pipeline] [--max-errors N]
+ *          [--mem-stats] [--perf-counters csv|json]
+ *          [--io uring|threads] [--archive file] [--watch]
+ *          assembly_file_name...
+ *  mylc3as [outputs] [-O] ir_file_name
+ *  mylc3as [--max-errors N] --serve socket_path
  *  </code></pre>
+ *  The second form assembles the intermediate representation written by
+ *  <code>-ir</code> (see <code>ir.h</code>) instead of a source file.
+ *  The third form runs a resident server (see <code>server.h</code>).
+ *  Several source files are assembled as a batch (see <code>batch.h</code>),
+ *  as is a single file with <code>--archive</code> (see
+ *  <code>archive.h</code>).
+ *  With <code>--watch</code> the program stays resident and assembles the
+ *  file each time it is saved (see <code>watch.h</code>).
+ *  Any combination of outputs may be requested and all of them are produced
+ *  by a single assembly.
  *  @param argc - count of arguments
  *  @param argv - an array of arguments
  */
 int main (int argc, char* argv[]) {
   char* asm_file = argv[argc -1];
+  int   selected = 0;
+  int   maxErrors = DIAG_MAX_ERRORS;
+  int   memStats = 0;
+  int   optimize = 0;
+  int   pooling = 0;
+  int   pipelined = 0;
+  int   backend = BIO_AUTO;
+  int   watching = 0;
+  int   perfFormat = -1;
+  char* archiveName = NULL;
+  int   fromIR = (check_for_ir_file(asm_file) != NULL);
+
+  if ((argc == 3 || argc == 5) && strcmp(argv[argc - 2], "--serve") == 0) {
+    if (argc == 5 && strcmp(argv[1], "--max-errors") != 0)
+      usage(); // this exits
+
+    if (argc == 5)
+      maxErrors = get_max_errors(argv[2]);
 
-  if (! check_for_asm_file(asm_file))
+    asm_init();
+    int result = server_run(argv[argc - 1], SERVER_TIMEOUT_MS, maxErrors);
+    asm_term();
+    return result;
+  }
+
+  if (argc < 2 || ! (check_for_asm_file(asm_file) || fromIR))
     usage(); // this exits
 
-  if (argc == 3) {
-    if (strcmp(argv[1], "-hex") == 0)
-      inHex = 1;
-    else
+  int first = argc - 1; // first source file
+
+  while (first > 1 && ! fromIR && check_for_asm_file(argv[first - 1]))
+    first--;
+
+  for (int i = 1; i < first; i++) {
+    if (strcmp(argv[i], "--io") == 0 && i + 1 < first) {
+      i++;
+
+      if (strcmp(argv[i], "uring") == 0)
+        backend = BIO_URING;
+      else if (strcmp(argv[i], "threads") == 0)
+        backend = BIO_THREADS;
+      else
+        usage(); // this exits
+
+      continue;
+    }
+
+    if (strcmp(argv[i], "--perf-counters") == 0 && i + 1 < first) {
+      i++;
+
+      if (strcmp(argv[i], "csv") == 0)
+        perfFormat = PERF_CSV;
+      else if (strcmp(argv[i], "json") == 0)
+        perfFormat = PERF_JSON;
+      else
+        usage(); // this exits
+
+      continue;
+    }
+
+    if (strcmp(argv[i], "--archive") == 0 && i + 1 < first) {
+      archiveName = argv[++i];
+      continue;
+    }
+
+    if (strcmp(argv[i], "--max-errors") == 0 && i + 1 < first) {
+      maxErrors = get_max_errors(argv[++i]);
+      continue;
+    }
+
+    if (strcmp(argv[i], "--mem-stats") == 0) {
+      memStats = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "-O") == 0) {
+      optimize = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--pool-strings") == 0) {
+      pooling = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--watch") == 0) {
+      watching = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--pipeline") == 0) {
+      pipelined = 1;
+      continue;
+    }
+
+    int output = get_output_option(argv[i]);
+
+    if (output == 0)
       usage(); // this exits
+
+    selected |= output;
   }
 
+  if (selected == 0)
+    selected = OUT_DEFAULT;
+
+  if (optimize || pooling) // the optimizer and pooling need every line first
+    pipelined = 0;
+
+  asm_set_pool_strings(pooling);
+
+  if (watching && (first < argc - 1 || archiveName != NULL))
+    usage(); // this exits
+
+  // the counters are reported for the phases of a single assembly
+  if (perfFormat >= 0 && (watching || first < argc - 1 || archiveName != NULL))
+    usage(); // this exits
+
+  // pass one is already done, on a single file, whose name -ir would take
+  if (fromIR && (watching || archiveName != NULL || pooling || pipelined ||
+                 (selected & OUT_IR)))
+    usage(); // this exits
+
+  if (first < argc - 1 || archiveName != NULL)
+    return run_batch(argv + first, argc - first, selected, maxErrors,
+                     optimize, backend, archiveName, memStats);
+
   asm_init();
+  diag_init(maxErrors);
 
-  char* obj_file = strdup(asm_file);
-  char* suffix   = check_for_asm_file(obj_file);
+  asm_outputs_t outputs;
+  char*         sym_file;
 
-  if (inHex)
-    strcpy(suffix, ".hex");
-  else
-    strcpy(suffix, ".obj");
+  make_output_names(asm_file, selected, &outputs, &sym_file);
+
+  if (watching) // returns on an error only
+    return watch_run(asm_file, sym_file, &outputs, maxErrors, optimize);
 
   numErrors = 0;
   srcLineNum = 0;
 
-  char* sym_file = strdup(asm_file);
-  suffix = check_for_asm_file(sym_file);
-  strcpy(suffix, ".sym");
+  if (perfFormat >= 0)
+    perf_init();
 
+  mem_set_phase(MEM_PASS_ONE);
+  perf_set_phase(PERF_PASS_ONE);
   printf("STARTING PASS 1\n");
-  asm_pass_one(asm_file, sym_file);
+
+  if (fromIR)
+    asm_pass_one_ir(asm_file, optimize ? NULL : sym_file);
+  else if (pipelined)
+    pipeline_pass_one(asm_file, sym_file, &outputs);
+  else
+    asm_pass_one(asm_file, optimize ? NULL : sym_file); // written after -O
+
+  diag_flush(stderr);
   printf("%d errors found in first pass\n", numErrors);
 
+  if (numErrors == 0 && optimize) {
+    int changes = asm_optimize();
+
+    if (changes < 0)
+      printf("optimizer not run: .ORIG/.BLKW operands depend on labels\n");
+    else
+      printf("%d optimizations made\n", changes);
+
+    if (numErrors == 0 && sym_file != NULL)
+      asm_write_sym(sym_file);
+
+    diag_flush(stderr);
+  }
+
   if (numErrors == 0) {
     srcLineNum = 0;
+    mem_set_phase(MEM_PASS_TWO);
+    perf_set_phase(PERF_PASS_TWO);
     printf("STARTING PASS 2\n");
-    asm_pass_two(obj_file);
+
+    if (pipelined)
+      pipeline_pass_two(&outputs);
+    else
+      asm_pass_two(&outputs);
+
+    diag_flush(stderr);
     printf("%d errors found in second pass\n", numErrors);
   }
 
-  if (numErrors > 0) {
-    remove(obj_file); // errors ignored
-    remove(sym_file); // errors ignored
+  int failed = (numErrors != 0);
+
+  if (failed) {
+    remove_file(outputs.obj_file_name);
+    remove_file(outputs.hex_file_name);
+    remove_file(outputs.lst_file_name);
+    remove_file(outputs.sobj_file_name);
+    remove_file(outputs.cost_file_name);
+    remove_file(outputs.dbg_file_name);
+    remove_file(outputs.xref_file_name);
+    remove_file(outputs.ir_file_name);
+    remove_file(sym_file);
   }
 
-  free(obj_file);
-  free(sym_file);
+  free_output_names(&outputs, sym_file);
 
+  mem_set_phase(MEM_TERM);
+  perf_set_phase(PERF_NONE);
   asm_term();
+  diag_term();
+
+  if (memStats)
+    mem_report(stderr);
+
+  if (perfFormat >= 0) {
+    perf_report(stderr, perfFormat, asm_file, 1);
+    perf_term();
+  }
 
-  return (numErrors != 0);
+  return failed;
 }
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mem.h"
+
+/** Stored in front of every block so it can be accounted when freed */
+typedef union mem_header {
+  struct {
+    size_t size;      /**< bytes requested by the caller */
+    int    category;  /**< category of the block         */
+  } info;
+  long double align;  /**< keep the user memory aligned */
+} mem_header_t;
+
+/** Counters for one category */
+typedef struct mem_stats {
+  long   allocs;  /**< number of allocations          */
+  long   frees;   /**< number of frees                */
+  long   live;    /**< blocks currently allocated     */
+  size_t bytes;   /**< bytes currently allocated      */
+  size_t peak;    /**< most bytes allocated at a time */
+} mem_stats_t;
+
+/** Names of the categories, for the report */
+static const char* categoryNames[MEM_NUM_CATEGORIES] = {
+  "line_info", "strings", "source", "symbols", "image", "diagnostics",
+  "output", "optimizer", "analysis", "batch"
+};
+
+/** Names of the phases, for the report */
+static const char* phaseNames[MEM_NUM_PHASES] = {
+  "init", "pass one", "pass two", "term"
+};
+
+/** Counters per category */
+static mem_stats_t stats[MEM_NUM_CATEGORIES];
+
+/** High-water mark of the bytes in use, per phase */
+static size_t phasePeak[MEM_NUM_PHASES];
+
+/** Phases that have been entered */
+static int phaseUsed[MEM_NUM_PHASES];
+
+/** The current phase */
+static mem_phase_t phase = MEM_INIT;
+
+/** Bytes in use over all categories */
+static size_t inUse;
+
+/** Protects the counters, the pipelined assembler allocates from several
+ *  threads
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Update the counters after a change in the bytes of a category */
+static void account (int category, long size, int blocks) {
+  mem_stats_t* s = &stats[category];
+
+  pthread_mutex_lock(&lock);
+
+  if (blocks > 0)
+    s->allocs += blocks;
+  else
+    s->frees -= blocks;
+
+  s->live  += blocks;
+  s->bytes += size;
+  inUse    += size;
+
+  if (s->bytes > s->peak)
+    s->peak = s->bytes;
+
+  if (inUse > phasePeak[phase])
+    phasePeak[phase] = inUse;
+
+  phaseUsed[phase] = 1;
+  pthread_mutex_unlock(&lock);
+}
+
+/** Report an allocation failure and exit */
+static void out_of_memory (size_t size) {
+  fprintf(stderr, "out of memory allocating %lu bytes\n", (unsigned long) size);
+  exit(2);
+}
+
+void* mem_alloc (mem_category_t category, size_t size) {
+  mem_header_t* h = malloc(sizeof(mem_header_t) + size);
+
+  if (h == NULL)
+    out_of_memory(size);
+
+  h->info.size     = size;
+  h->info.category = category;
+  account(category, size, 1);
+  return h + 1;
+}
+
+void* mem_calloc (mem_category_t category, size_t count, size_t size) {
+  void* p = mem_alloc(category, count * size);
+
+  memset(p, 0, count * size);
+  return p;
+}
+
+void* mem_realloc (mem_category_t category, void* ptr, size_t size) {
+  if (ptr == NULL)
+    return mem_alloc(category, size);
+
+  mem_header_t* h   = (mem_header_t*) ptr - 1;
+  size_t        old = h->info.size;
+
+  h = realloc(h, sizeof(mem_header_t) + size);
+
+  if (h == NULL)
+    out_of_memory(size);
+
+  h->info.size = size;
+  account(h->info.category, (long) size - (long) old, 0);
+  return h + 1;
+}
+
+char* mem_strdup (mem_category_t category, const char* s) {
+  size_t len = strlen(s) + 1;
+  char*  p   = mem_alloc(category, len);
+
+  memcpy(p, s, len);
+  return p;
+}
+
+void mem_free (void* ptr) {
+  if (ptr == NULL)
+    return;
+
+  mem_header_t* h = (mem_header_t*) ptr - 1;
+
+  account(h->info.category, - (long) h->info.size, -1);
+  free(h);
+}
+
+void mem_note (mem_category_t category, long size, int blocks) {
+  account(category, size, blocks);
+}
+
+void mem_set_phase (mem_phase_t newPhase) {
+  pthread_mutex_lock(&lock);
+  phase = newPhase;
+  phaseUsed[phase] = 1;
+
+  if (inUse > phasePeak[phase])
+    phasePeak[phase] = inUse;
+
+  pthread_mutex_unlock(&lock);
+}
+
+size_t mem_in_use (void) {
+  pthread_mutex_lock(&lock);
+  size_t bytes = inUse;
+  pthread_mutex_unlock(&lock);
+  return bytes;
+}
+
+void mem_report (FILE* f) {
+  long leakBlocks = 0;
+
+  fprintf(f, "Memory statistics\n");
+  fprintf(f, "%-12s %10s %10s %10s %12s %12s\n", "category", "allocs",
+          "frees", "live", "live bytes", "peak bytes");
+
+  for (int i = 0; i < MEM_NUM_CATEGORIES; i++) {
+    mem_stats_t* s = &stats[i];
+
+    fprintf(f, "%-12s %10ld %10ld %10ld %12lu %12lu\n", categoryNames[i],
+            s->allocs, s->frees, s->live, (unsigned long) s->bytes,
+            (unsigned long) s->peak);
+    leakBlocks += s->live;
+  }
+
+  fprintf(f, "\n%-12s %12s\n", "phase", "peak bytes");
+
+  for (int i = 0; i < MEM_NUM_PHASES; i++) {
+    if (phaseUsed[i])
+      fprintf(f, "%-12s %12lu\n", phaseNames[i], (unsigned long) phasePeak[i]);
+  }
+
+  fprintf(f, "\nstill allocated: %lu bytes in %ld blocks\n",
+          (unsigned long) inUse, leakBlocks);
+}
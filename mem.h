@@ -0,0 +1,92 @@
+#ifndef __MEM_H__
+#define __MEM_H__
+
+/** @file mem.h
+ *  @brief interface to the allocator used by the assembler
+ *  @details Every allocation made by the assembler goes through these
+ *  functions. Each is tagged with a category, so the number of
+ *  allocations and the bytes in use can be reported per category. The
+ *  high-water mark of the bytes in use is kept for each phase of an
+ *  assembly, and anything still allocated when the assembler terminates is
+ *  reported as a leak. The report is printed by <code>mylc3as
+ *  --mem-stats</code>.
+ *  <p>
+ *  The symbol table is allocated inside <code>symbol.c</code>, which is not
+ *  built on this interface. Its memory is recorded with
+ *  <code>mem_note()</code> using the size of the table and an estimate of
+ *  the size of each symbol node.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+/** The categories of allocation */
+typedef enum mem_category {
+  MEM_LINE_INFO,  /**< line_info_t structures                       */
+  MEM_STRING,     /**< labels and references copied from the source */
+  MEM_SOURCE,     /**< the text of the source file                  */
+  MEM_SYMBOL,     /**< symbol table (estimated, see above)          */
+  MEM_IMAGE,      /**< words of the assembled program               */
+  MEM_DIAG,       /**< diagnostic records                           */
+  MEM_OUTPUT,     /**< buffers used to write output files           */
+  MEM_OPT,        /**< tables used by the optimizer                 */
+  MEM_ANALYSIS,   /**< blocks and subroutines of the cost report    */
+  MEM_BATCH,      /**< requests and state of the files of a batch   */
+  MEM_NUM_CATEGORIES
+} mem_category_t;
+
+/** The phases of an assembly */
+typedef enum mem_phase {
+  MEM_INIT,       /**< asm_init()                  */
+  MEM_PASS_ONE,   /**< asm_pass_one()              */
+  MEM_PASS_TWO,   /**< asm_pass_two() and outputs  */
+  MEM_TERM,       /**< asm_term()                  */
+  MEM_NUM_PHASES
+} mem_phase_t;
+
+/** Allocate memory (as <code>malloc()</code>)
+ *  @param category - what the memory is used for
+ *  @param size - number of bytes
+ *  @return the memory, the program exits if none is available
+ */
+void* mem_alloc (mem_category_t category, size_t size);
+
+/** Allocate zeroed memory (as <code>calloc()</code>) */
+void* mem_calloc (mem_category_t category, size_t count, size_t size);
+
+/** Resize memory (as <code>realloc()</code>). The memory keeps its category
+ *  @param category - what the memory is used for (if ptr is NULL)
+ *  @param ptr - memory from this module, or NULL
+ *  @param size - new number of bytes
+ */
+void* mem_realloc (mem_category_t category, void* ptr, size_t size);
+
+/** Copy a string into newly allocated memory (as <code>strdup()</code>) */
+char* mem_strdup (mem_category_t category, const char* s);
+
+/** Free memory allocated by this module. NULL is ignored. */
+void mem_free (void* ptr);
+
+/** Record memory allocated (positive size) or freed (negative size)
+ *  outside of this module
+ *  @param category - what the memory is used for
+ *  @param size - number of bytes
+ *  @param blocks - number of allocations (negative when freed)
+ */
+void mem_note (mem_category_t category, long size, int blocks);
+
+/** Start a new phase. The high-water mark of the phase begins with the
+ *  bytes currently in use.
+ */
+void mem_set_phase (mem_phase_t phase);
+
+/** Return the number of bytes currently in use */
+size_t mem_in_use (void);
+
+/** Write the statistics: counts and bytes per category, the high-water
+ *  mark of each phase and the memory still in use (leaks)
+ *  @param f - where to write the report
+ */
+void mem_report (FILE* f);
+
+#endif /* __MEM_H__ */
@@ -0,0 +1,158 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mem.h"
+#include "objfile.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OBJFILE_X86 1
+#endif
+
+/** Swap the bytes of each word, one word at a time */
+static void swap_scalar (unsigned char* dst, const unsigned char* src,
+                         size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    unsigned char hi = src[2 * i];
+    dst[2 * i]     = src[2 * i + 1];
+    dst[2 * i + 1] = hi;
+  }
+}
+
+#ifdef OBJFILE_X86
+
+/** Swap the bytes of each word, 16 words at a time */
+__attribute__((target("avx2")))
+static void swap_avx2 (unsigned char* dst, const unsigned char* src,
+                       size_t count) {
+  const __m256i order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                         9, 8, 11, 10, 13, 12, 15, 14,
+                                         1, 0, 3, 2, 5, 4, 7, 6,
+                                         9, 8, 11, 10, 13, 12, 15, 14);
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) (src + 2 * i));
+    _mm256_storeu_si256((__m256i*) (dst + 2 * i),
+                        _mm256_shuffle_epi8(v, order));
+  }
+
+  swap_scalar(dst + 2 * i, src + 2 * i, count - i);
+}
+
+/** Swap the bytes of each word, 8 words at a time */
+__attribute__((target("ssse3")))
+static void swap_ssse3 (unsigned char* dst, const unsigned char* src,
+                        size_t count) {
+  const __m128i order = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                      9, 8, 11, 10, 13, 12, 15, 14);
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*) (src + 2 * i));
+    _mm_storeu_si128((__m128i*) (dst + 2 * i), _mm_shuffle_epi8(v, order));
+  }
+
+  swap_scalar(dst + 2 * i, src + 2 * i, count - i);
+}
+
+#endif
+
+/** Signature of the functions swapping bytes */
+typedef void (*swap_fnc_t)(unsigned char* dst, const unsigned char* src,
+                           size_t count);
+
+/** Choose the swap function for this processor */
+static swap_fnc_t choose_swap (void) {
+#ifdef OBJFILE_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    return swap_avx2;
+
+  if (__builtin_cpu_supports("ssse3"))
+    return swap_ssse3;
+#endif
+
+  return swap_scalar;
+}
+
+void objfile_swap (void* dst, const void* src, size_t count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  memmove(dst, src, 2 * count);
+#else
+  static swap_fnc_t chosen; // on first use, the same for every thread
+  swap_fnc_t        swap = __atomic_load_n(&chosen, __ATOMIC_RELAXED);
+
+  if (swap == NULL) {
+    swap = choose_swap();
+    __atomic_store_n(&chosen, swap, __ATOMIC_RELAXED);
+  }
+
+  swap(dst, src, count);
+#endif
+}
+
+int objfile_load (const char* file_name, lc3_obj_t* obj) {
+  struct stat st;
+  int         fd = open(file_name, O_RDONLY);
+
+  obj->origin   = 0;
+  obj->words    = NULL;
+  obj->numWords = 0;
+
+  if (fd < 0)
+    return errno;
+
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    return error;
+  }
+
+  if (st.st_size < 2 || (st.st_size & 1) != 0) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t         length = st.st_size;
+  unsigned char* map    = mmap(NULL, length, PROT_READ,
+                               MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd); // the mapping stays valid
+
+  if (map == MAP_FAILED)
+    return errno;
+
+  madvise(map, length, MADV_SEQUENTIAL);
+  obj->origin   = (map[0] << 8) | map[1];
+  obj->numWords = length / 2 - 1;
+  obj->words    = mem_alloc(MEM_IMAGE, (obj->numWords + 1) * sizeof(LC3_WORD));
+  objfile_swap(obj->words, map + 2, obj->numWords);
+  munmap(map, length);
+  return 0;
+}
+
+void objfile_free (lc3_obj_t* obj) {
+  mem_free(obj->words);
+  obj->words    = NULL;
+  obj->numWords = 0;
+}
+
+int objfile_write (FILE* f, int origin, const LC3_WORD* words, int count) {
+  size_t         len = 2 * ((size_t) count + 1);
+  unsigned char* buf = mem_alloc(MEM_OUTPUT, len);
+
+  buf[0] = (origin >> 8) & 0xFF;
+  buf[1] = origin & 0xFF;
+  objfile_swap(buf + 2, words, count);
+
+  int ok = (fwrite(buf, 1, len, f) == len);
+  mem_free(buf);
+  return ok;
+}
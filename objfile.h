@@ -0,0 +1,66 @@
+#ifndef __OBJFILE_H__
+#define __OBJFILE_H__
+
+/** @file objfile.h
+ *  @brief interface to loading and writing whole object files
+ *  @details <code>lc3_read_LC3_word()</code> reads one word per call. Tools
+ *  that consume object files (simulators, graders, comparisons) load them
+ *  with <code>objfile_load()</code> instead: the file is mapped, and its
+ *  words are converted from big-endian to host order into an array in a
+ *  single pass by <code>objfile_swap()</code>, which is then unmapped.
+ *  <p>
+ *  On x86 the conversion uses the widest byte shuffle the processor has
+ *  (AVX2, 16 words per step, or SSSE3, 8 words per step), chosen once at
+ *  run time, and finishes the last words one at a time. Elsewhere it is a
+ *  scalar loop that the compiler may vectorize. On a big-endian host it is
+ *  a copy. The conversion is its own inverse, so
+ *  <code>objfile_write()</code> uses it to write an object file with one
+ *  <code>fwrite()</code>.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "lc3.h"
+
+/** Typedef of structure type */
+typedef struct lc3_obj lc3_obj_t;
+
+/** The content of an object file */
+struct lc3_obj {
+  int       origin;    /**< LC3 address of the first word (first word of
+                            the file)                                     */
+  LC3_WORD* words;     /**< the words following the origin, in host order */
+  int       numWords;  /**< number of words                               */
+};
+
+/** Convert big-endian words to host order, or host order words to
+ *  big-endian. Neither array needs to be aligned, they may be the same.
+ *  @param dst - the converted words
+ *  @param src - the words to convert
+ *  @param count - the number of words
+ */
+void objfile_swap (void* dst, const void* src, size_t count);
+
+/** Load an object file
+ *  @param file_name - name of the file
+ *  @param obj - set to the content of the file, to free with
+ *  <code>objfile_free()</code>
+ *  @return 0 on success, else the errno value of the failure (EINVAL if the
+ *  file is empty or has an odd number of bytes)
+ */
+int objfile_load (const char* file_name, lc3_obj_t* obj);
+
+/** Free the words of an object loaded by <code>objfile_load()</code> */
+void objfile_free (lc3_obj_t* obj);
+
+/** Write an object file: the origin, then the words, all big-endian
+ *  @param f - the file to write to
+ *  @param origin - the LC3 address of the first word
+ *  @param words - the words in host order
+ *  @param count - the number of words
+ *  @return 1 on success, 0 on a write error
+ */
+int objfile_write (FILE* f, int origin, const LC3_WORD* words, int count);
+
+#endif /* __OBJFILE_H__ */
@@ -0,0 +1,398 @@
+#include <string.h>
+
+#include "assembler.h"
+#include "field.h"
+#include "mem.h"
+#include "opt.h"
+
+/** Number of LC3 addresses */
+#define NUM_ADDRESSES 0x10000
+
+/** The line generating the word at each LC3 address, or NULL */
+static line_info_t** byAddr;
+
+/** Record the line starting at each address */
+static void map_addresses (line_info_t* head) {
+  memset(byAddr, 0, NUM_ADDRESSES * sizeof(line_info_t*));
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    int addr = info->address & 0xFFFF;
+
+    if (line_size(info) > 0 && byAddr[addr] == NULL)
+      byAddr[addr] = info;
+  }
+}
+
+/** Determine if an instruction sets the condition codes from its DR */
+static int sets_cc (line_info_t* info) {
+  switch (info->opcode) {
+    case OP_ADD:  case OP_AND:  case OP_NOT:
+    case OP_LD:   case OP_LDI:  case OP_LDR:
+    case OP_ZERO: case OP_COPY: case OP_NEG:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/** Determine if an instruction transfers control or is not an instruction.
+ *  Such a line ends the straight-line code examined by the optimizer.
+ */
+static int ends_block (line_info_t* info) {
+  switch (info->opcode) {
+    case OP_BR:       case OP_JSR_JSRR: case OP_JMP_RET: case OP_RTI:
+    case OP_TRAP:     case OP_GETC:     case OP_OUT:     case OP_PUTS:
+    case OP_IN:       case OP_PUTSP:    case OP_HALT:    case OP_GETS:
+    case OP_ORIG:     case OP_END:      case OP_BLKW:    case OP_FILL:
+    case OP_STRINGZ:  case OP_RESERVED:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/** Return the next line that generates code, skipping removed lines and
+ *  lines containing only a label. NULL at the end of the program.
+ *  @param labelled - set to 1 if a label was passed or is on the result
+ */
+static line_info_t* next_code (line_info_t* info, int* labelled) {
+  for (info = info->next; info != NULL; info = info->next) {
+    if (info->label != NULL)
+      *labelled = 1;
+
+    if (info->opcode != OP_INVALID)
+      return info;
+  }
+
+  return NULL;
+}
+
+/** Determine if the condition codes are certainly set again, before being
+ *  tested, by the code executed after a line
+ */
+static int cc_dead_after (line_info_t* info) {
+  int          labelled = 0;
+  line_info_t* next     = next_code(info, &labelled);
+
+  return next != NULL && sets_cc(next);
+}
+
+/** Determine if straight-line code starting at a line tests the condition
+ *  codes before setting them. Code after a transfer of control is not
+ *  examined.
+ */
+static int cc_tested_at (line_info_t* info) {
+  int labelled = 0;
+
+  while (info != NULL && info->opcode == OP_INVALID)
+    info = next_code(info, &labelled);
+
+  for (; info != NULL; info = next_code(info, &labelled)) {
+    if (info->opcode == OP_BR)
+      return (info->reg1 & 7) != 7;
+
+    if (sets_cc(info) || ends_block(info))
+      return 0;
+  }
+
+  return 0;
+}
+
+/** Determine if a line reads a register */
+static int reads_reg (line_info_t* info, int reg) {
+  switch (info->opcode) {
+    case OP_ADD: case OP_AND:
+      return info->reg2 == reg || (info->form == 0 && info->reg3 == reg);
+    case OP_NOT: case OP_LDR: case OP_COPY:
+      return info->reg2 == reg;
+    case OP_ST:  case OP_STI: case OP_NEG:
+      return info->reg1 == reg;
+    case OP_STR:
+      return info->reg1 == reg || info->reg2 == reg;
+    default:
+      return 0;
+  }
+}
+
+/** Determine if a line sets a register */
+static int writes_reg (line_info_t* info, int reg) {
+  switch (info->opcode) {
+    case OP_ADD:  case OP_AND:  case OP_NOT:
+    case OP_LD:   case OP_LDI:  case OP_LDR:
+    case OP_LEA:  case OP_ZERO: case OP_COPY: case OP_NEG:
+      return info->reg1 == reg;
+    default:
+      return 0;
+  }
+}
+
+/** Determine if straight-line code starting at a line certainly sets a
+ *  register before reading it. A JSR or a TRAP sets R7 and HALT ends the
+ *  program; any other transfer of control may read the register.
+ */
+static int reg_dead_at (line_info_t* info, int reg) {
+  int labelled = 0;
+
+  while (info != NULL && info->opcode == OP_INVALID)
+    info = next_code(info, &labelled);
+
+  for (; info != NULL; info = next_code(info, &labelled)) {
+    if (reads_reg(info, reg))
+      return 0;
+
+    if (writes_reg(info, reg) || info->opcode == OP_HALT)
+      return 1;
+
+    if (ends_block(info)) {
+      switch (info->opcode) {
+        case OP_JSR_JSRR:
+          return reg == 7 && (info->form == 1 || info->reg2 != 7);
+        case OP_TRAP:  case OP_GETC:  case OP_OUT:  case OP_PUTS:
+        case OP_IN:    case OP_PUTSP: case OP_GETS:
+          return reg == 7;
+        default:
+          return 0;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/** Choose the register of the trampoline of a branch, R7 if possible
+ *  @return a register that is not live at the target, or -1 if there is none
+ */
+static int scratch_reg (line_info_t* target) {
+  for (int reg = 7; reg >= 0; reg--) {
+    if (reg_dead_at(target, reg))
+      return reg;
+  }
+
+  return -1;
+}
+
+/** Turn a line into one that generates nothing, keeping its label */
+static void remove_line (line_info_t* info) {
+  mem_free(info->reference);
+  info->opcode    = OP_INVALID;
+  info->reference = NULL;
+  info->immWidth  = 0;
+}
+
+/** Add a line after another, created from the same source line */
+static line_info_t* add_line (line_info_t* after, opcode_t opcode, int form) {
+  line_info_t* info = mem_alloc(MEM_LINE_INFO, sizeof(line_info_t));
+
+  asm_init_line_info(info);
+  info->lineNum   = after->lineNum;
+  info->address   = after->address;
+  info->srcOffset = after->srcOffset;
+  info->srcLength = 0;
+  info->srcFile   = after->srcFile;
+  info->opcode    = opcode;
+  info->form      = form;
+  info->next      = after->next;
+  after->next     = info;
+  return info;
+}
+
+/** Determine if the target of a line fits the PC offset of the given width */
+static int target_fits (line_info_t* info, int target, int width) {
+  return fieldFits(target - info->address - 1, width, 1);
+}
+
+/** Thread branches through branches that are always taken after them */
+static int thread_jumps (line_info_t* head) {
+  int changes = 0;
+
+  for (line_info_t* br = head; br != NULL; br = br->next) {
+    int target, next;
+
+    if (br->opcode != OP_BR || br->reference == NULL ||
+        ! asm_get_target(br, &target))
+      continue;
+
+    line_info_t* to = byAddr[target & 0xFFFF];
+
+    if (to == NULL || to == br || to->opcode != OP_BR ||
+        to->reference == NULL || (br->reg1 & ~to->reg1 & 7) != 0 ||
+        ! asm_get_target(to, &next) || next == target ||
+        ! target_fits(br, next, 9))
+      continue;
+
+    mem_free(br->reference);
+    br->reference = mem_strdup(MEM_STRING, to->reference);
+    changes++;
+  }
+
+  return changes;
+}
+
+/** Remove branches to the next instruction, ADD Rx,Rx,#0 and pairs of
+ *  .NEG Rx that do not change the program
+ */
+static int remove_noops (line_info_t* head) {
+  int          changes = 0;
+  line_info_t* prev    = NULL; // previous line, if only reached from it
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    if (info->label != NULL)
+      prev = NULL;
+
+    if (info->opcode == OP_INVALID)
+      continue;
+
+    // condition codes already set from the register by the previous line
+    int ccFromPrev = prev != NULL && sets_cc(prev) &&
+                     prev->reg1 == info->reg1;
+    int target, labelled = 0;
+
+    if (info->opcode == OP_BR && asm_get_target(info, &target) &&
+        target == info->address + 1) {
+      remove_line(info);
+      changes++;
+      continue;
+    }
+
+    if (info->opcode == OP_ADD && info->form == 1 && info->immWidth == 0 &&
+        info->immediate == 0 && info->reg1 == info->reg2 &&
+        (ccFromPrev || cc_dead_after(info))) {
+      remove_line(info);
+      changes++;
+      continue;
+    }
+
+    if (info->opcode == OP_NEG) {
+      line_info_t* second = next_code(info, &labelled);
+
+      if (second != NULL && ! labelled && second->opcode == OP_NEG &&
+          second->reg1 == info->reg1 &&
+          (ccFromPrev || cc_dead_after(second))) {
+        remove_line(info);
+        remove_line(second);
+        changes += 2;
+        continue;
+      }
+    }
+
+    prev = info;
+  }
+
+  return changes;
+}
+
+/** Replace a branch whose target is out of range by a trampoline using a
+ *  register that is not live at the target
+ */
+static void relax_branch (line_info_t* br, int reg) {
+  char*        target = br->reference;
+  line_info_t* ld     = br;
+  int          cond   = ~br->reg1 & 7;
+
+  br->reference = NULL;
+
+  if (cond != 0) { // skip the trampoline when the branch is not taken
+    br->reg1      = cond;
+    br->immediate = 3;
+    ld            = add_line(br, OP_LD, 0);
+  }
+  else {
+    br->opcode = OP_LD;
+  }
+
+  ld->reg1      = reg;
+  ld->immediate = 1;
+
+  line_info_t* jmp = add_line(ld, OP_JMP_RET, 0);
+  jmp->reg2        = reg;
+
+  line_info_t* fill = add_line(jmp, OP_FILL, 0);
+  fill->reference   = target;
+  fill->immWidth    = 16;
+  fill->immSigned   = 1;
+}
+
+/** Replace a JSR whose target is out of range by a trampoline. The JSR
+ *  sets R7 anyway, so R7 holds the target until the JSRR sets it.
+ */
+static void relax_call (line_info_t* jsr) {
+  char* target = jsr->reference;
+
+  jsr->reference = NULL;
+  jsr->opcode    = OP_LD;
+  jsr->form      = 0;
+  jsr->reg1      = 7;
+  jsr->immediate = 2;
+
+  line_info_t* jsrr = add_line(jsr, OP_JSR_JSRR, 0);
+  jsrr->reg2        = 7;
+
+  line_info_t* skip = add_line(jsrr, OP_BR, 0); // return here, skip .FILL
+  skip->reg1        = 7;
+  skip->immediate   = 1;
+
+  line_info_t* fill = add_line(skip, OP_FILL, 0);
+  fill->reference   = target;
+  fill->immWidth    = 16;
+  fill->immSigned   = 1;
+}
+
+/** Relax every branch and JSR whose target is out of range */
+static int relax_branches (line_info_t* head) {
+  int changes = 0;
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    int isBranch = (info->opcode == OP_BR && (info->reg1 & 7) != 0);
+    int isCall   = (info->opcode == OP_JSR_JSRR && info->form == 1);
+    int target, reg = 7;
+
+    if ((! isBranch && ! isCall) || info->reference == NULL ||
+        ! asm_get_target(info, &target) ||
+        target_fits(info, target, isBranch ? 9 : 11) ||
+        cc_tested_at(byAddr[target & 0xFFFF]))
+      continue;
+
+    // a branch leaves the registers as they are, so its trampoline needs
+    // one that the code at the target sets before reading
+    if (isBranch && (reg = scratch_reg(byAddr[target & 0xFFFF])) < 0)
+      continue;
+
+    if (isBranch)
+      relax_branch(info, reg);
+    else
+      relax_call(info);
+
+    changes++;
+  }
+
+  return changes;
+}
+
+int opt_run (line_info_t* head) {
+  int total = 0;
+
+  byAddr = mem_alloc(MEM_OPT, NUM_ADDRESSES * sizeof(line_info_t*));
+
+  for (int round = 0; round < OPT_MAX_ROUNDS; round++) {
+    map_addresses(head);
+
+    int changes = thread_jumps(head) + remove_noops(head);
+
+    if (changes > 0) {
+      asm_layout();
+      map_addresses(head);
+    }
+
+    changes += relax_branches(head);
+
+    if (changes == 0)
+      break;
+
+    asm_layout();
+    total += changes;
+  }
+
+  mem_free(byAddr);
+  byAddr = NULL;
+  return total;
+}
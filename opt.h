@@ -0,0 +1,57 @@
+#ifndef __OPT_H__
+#define __OPT_H__
+
+/** @file opt.h
+ *  @brief interface to the optimizer of the lines found by pass one
+ *  @details The optimizer is selected by <code>mylc3as -O</code>. It works
+ *  on the list of <code>line_info_t</code> between the two passes, applying
+ *  the following changes until none of them applies:
+ *  <ul>
+ *  <li><b>jump threading</b>: a branch to a branch that is always taken
+ *      when the first one is (e.g. <code>BRz</code> to <code>BRnzp</code>)
+ *      goes directly to the target of the second branch, if the new offset
+ *      fits.</li>
+ *  <li><b>no-op removal</b>: a branch to the next instruction,
+ *      <code>ADD Rx,Rx,#0</code> and a pair of <code>.NEG Rx</code> are
+ *      removed. The last two set the condition codes, so they are only
+ *      removed when the codes are already set from Rx by the previous
+ *      instruction, or are set again by the next instruction before any
+ *      use.</li>
+ *  <li><b>branch relaxation</b>: a <code>BR</code> or <code>JSR</code>
+ *      whose target is out of range becomes a trampoline loading the
+ *      target address from a <code>.FILL</code> placed after it:
+ *      <pre>
+ *      BRz FAR  =>  BRnp #3       JSR FAR  =>  LD   R7, #2
+ *                   LD   Rx, #1                JSRR R7
+ *                   JMP  Rx                    BRnzp #1
+ *                   .FILL FAR                  .FILL FAR
+ *      </pre>
+ *      A JSR sets R7 anyway. A branch does not change any register, so Rx
+ *      is one that the straight-line code at the target sets before
+ *      reading it (R7 if possible, then R6 down to R0). On the path that
+ *      branches, the condition codes are those set by the <code>LD</code>.
+ *      A branch is therefore not relaxed when the code at its target may
+ *      read every register, e.g. a <code>RET</code>, or tests the codes
+ *      before setting them; pass two then reports its offset as out of
+ *      range.</li>
+ *  </ul>
+ *  After each round the addresses of all lines and labels are recomputed
+ *  with <code>asm_layout()</code>. A removed line becomes a line with no
+ *  instruction, so a label on it stays at the same place in the program.
+ *  Lines added by the optimizer have no <code>reference</code>; their PC
+ *  offset is stored in <code>immediate</code>.
+ */
+
+#include "assembler.h"
+
+/** Maximum number of rounds of changes */
+#define OPT_MAX_ROUNDS 64
+
+/** Optimize a list of lines. The list is only changed by adding lines after
+ *  existing ones, so its head stays the same.
+ *  @param head - the first line of the program
+ *  @return the number of changes made
+ */
+int opt_run (line_info_t* head);
+
+#endif /* __OPT_H__ */
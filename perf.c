@@ -0,0 +1,288 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf.h"
+
+/** The counters */
+typedef enum perf_counter {
+  CNT_CYCLES,
+  CNT_INSTRUCTIONS,
+  CNT_BRANCH_MISSES,
+  CNT_L1D_MISSES,
+  CNT_LLC_MISSES,
+  CNT_PAGE_FAULTS,
+  NUM_COUNTERS
+} perf_counter_t;
+
+/** Cache event: the cache, a read access, a miss */
+#define CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/** The event of each counter and its name in the reports */
+static const struct {
+  unsigned int       type;
+  unsigned long long config;
+  const char*        name;
+} events[NUM_COUNTERS] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       "cycles"        },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     "instructions"  },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,    "branch_misses" },
+  { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D),
+                                                        "l1d_misses"    },
+  { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL),
+                                                        "llc_misses"    },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page_faults"   },
+};
+
+/** Names of the phases in the reports */
+static const char* phaseNames[PERF_NUM_PHASES] = {
+  "none", "lex", "pass_one", "symbols", "pass_two", "output"
+};
+
+/** Names of the values derived from the counters, in the reports */
+static const char* derivedNames[4] = {
+  "ipc", "branch_mpki", "l1d_mpki", "llc_mpki"
+};
+
+/** Descriptor of each counter, -1 if it is not available */
+static int fds[NUM_COUNTERS];
+
+/** Position of each counter in the values read, -1 if not available */
+static int slot[NUM_COUNTERS];
+
+/** Number of counters in the group */
+static int numOpen;
+
+/** Descriptor of the leader of the group, the first counter opened */
+static int leader = -1;
+
+/** perf_init() was called */
+static int enabled;
+
+/** The current phase */
+static perf_phase_t phase;
+
+/** The counts and time when the phase last changed */
+static unsigned long long lastValues[NUM_COUNTERS];
+static unsigned long long lastNs;
+
+/** The counts and time of each phase */
+static double             counts[PERF_NUM_PHASES][NUM_COUNTERS];
+static unsigned long long phaseNs[PERF_NUM_PHASES];
+static int                ran[PERF_NUM_PHASES];
+
+/** Current time in nanoseconds */
+static unsigned long long now_ns (void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Open the event of a counter in the group
+ *  @return the descriptor, or -1 if it is not available
+ */
+static int open_counter (perf_counter_t counter) {
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = events[counter].type;
+  attr.config         = events[counter].config;
+  attr.disabled       = (leader < 0); // the group starts when it is complete
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                        PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+/** Read the counters of the group, scaled if it was multiplexed
+ *  @param values - set to the value of each counter
+ */
+static void read_counters (unsigned long long values[NUM_COUNTERS]) {
+  unsigned long long buf[3 + NUM_COUNTERS]; // nr, enabled, running, values
+  ssize_t            len = (3 + numOpen) * sizeof(buf[0]);
+
+  if (leader < 0 || read(leader, buf, sizeof(buf)) != len)
+    return;
+
+  double scale = (buf[2] > 0 && buf[2] < buf[1]) ? (double) buf[1] / buf[2]
+                                                 : 1.0;
+
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    if (slot[i] >= 0)
+      values[i] = (unsigned long long) (buf[3 + slot[i]] * scale);
+  }
+}
+
+int perf_init (void) {
+  perf_term();
+  memset(counts, 0, sizeof(counts));
+  memset(phaseNs, 0, sizeof(phaseNs));
+  memset(ran, 0, sizeof(ran));
+
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    fds[i]  = open_counter(i);
+    slot[i] = (fds[i] >= 0) ? numOpen++ : -1;
+
+    if (leader < 0)
+      leader = fds[i];
+  }
+
+  if (leader >= 0) {
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  enabled = 1;
+  phase   = PERF_NONE;
+  memset(lastValues, 0, sizeof(lastValues));
+  read_counters(lastValues);
+  lastNs = now_ns();
+  return numOpen;
+}
+
+int perf_enabled (void) {
+  return enabled;
+}
+
+void perf_set_phase (perf_phase_t newPhase) {
+  if (! enabled)
+    return;
+
+  unsigned long long values[NUM_COUNTERS];
+  unsigned long long ns = now_ns();
+
+  memcpy(values, lastValues, sizeof(values));
+  read_counters(values);
+
+  for (int i = 0; i < NUM_COUNTERS; i++)
+    counts[phase][i] += values[i] - lastValues[i];
+
+  phaseNs[phase] += ns - lastNs;
+  ran[phase]      = 1;
+  phase           = newPhase;
+  lastNs          = ns;
+  memcpy(lastValues, values, sizeof(values));
+}
+
+/** Misses per thousand instructions, or a negative value if not known */
+static double per_kinst (double misses, double instructions, int available) {
+  return (available && instructions > 0) ? 1000.0 * misses / instructions
+                                         : -1.0;
+}
+
+/** Write a number, or the text for a missing value */
+static void put_value (FILE* f, double value, const char* missing,
+                       const char* fmt) {
+  if (value < 0)
+    fputs(missing, f);
+  else
+    fprintf(f, fmt, value);
+}
+
+void perf_report (FILE* f, perf_format_t format, const char* label, int runs) {
+  const char* missing = (format == PERF_CSV) ? "" : "null";
+  int         first   = 1;
+
+  if (runs < 1)
+    runs = 1;
+
+  if (format == PERF_CSV) {
+    fprintf(f, "label,phase,time_ns");
+
+    for (int i = 0; i < NUM_COUNTERS; i++)
+      fprintf(f, ",%s", events[i].name);
+
+    for (int i = 0; i < 4; i++)
+      fprintf(f, ",%s", derivedNames[i]);
+
+    fputc('\n', f);
+  }
+  else {
+    fprintf(f, "{\"label\": \"%s\", \"runs\": %d, \"phases\": [", label, runs);
+  }
+
+  for (int p = PERF_NONE + 1; p < PERF_NUM_PHASES; p++) {
+    if (! ran[p])
+      continue;
+
+    double  c[NUM_COUNTERS];
+    double* n = counts[p];
+    int     haveInst = (slot[CNT_INSTRUCTIONS] >= 0);
+
+    for (int i = 0; i < NUM_COUNTERS; i++)
+      c[i] = (slot[i] >= 0) ? n[i] / runs : -1.0;
+
+    double derived[4] = {
+      (haveInst && c[CNT_CYCLES] > 0) ? c[CNT_INSTRUCTIONS] / c[CNT_CYCLES]
+                                      : -1.0,
+      per_kinst(c[CNT_BRANCH_MISSES], c[CNT_INSTRUCTIONS],
+                slot[CNT_BRANCH_MISSES] >= 0),
+      per_kinst(c[CNT_L1D_MISSES], c[CNT_INSTRUCTIONS],
+                slot[CNT_L1D_MISSES] >= 0),
+      per_kinst(c[CNT_LLC_MISSES], c[CNT_INSTRUCTIONS],
+                slot[CNT_LLC_MISSES] >= 0)
+    };
+
+    if (format == PERF_CSV) {
+      fprintf(f, "%s,%s,%.0f", label, phaseNames[p],
+              (double) phaseNs[p] / runs);
+
+      for (int i = 0; i < NUM_COUNTERS; i++) {
+        fputc(',', f);
+        put_value(f, c[i], missing, "%.0f");
+      }
+
+      for (int i = 0; i < 4; i++) {
+        fputc(',', f);
+        put_value(f, derived[i], missing, "%.3f");
+      }
+
+      fputc('\n', f);
+    }
+    else {
+      fprintf(f, "%s\n  {\"phase\": \"%s\", \"time_ns\": %.0f",
+              first ? "" : ",", phaseNames[p], (double) phaseNs[p] / runs);
+
+      for (int i = 0; i < NUM_COUNTERS; i++) {
+        fprintf(f, ", \"%s\": ", events[i].name);
+        put_value(f, c[i], missing, "%.0f");
+      }
+
+      for (int i = 0; i < 4; i++) {
+        fprintf(f, ", \"%s\": ", derivedNames[i]);
+        put_value(f, derived[i], missing, "%.3f");
+      }
+
+      fputc('}', f);
+    }
+
+    first = 0;
+  }
+
+  if (format == PERF_JSON)
+    fprintf(f, "\n]}\n");
+}
+
+void perf_term (void) {
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    if (enabled && fds[i] >= 0)
+      close(fds[i]);
+
+    fds[i]  = -1;
+    slot[i] = -1;
+  }
+
+  numOpen = 0;
+  leader  = -1;
+  enabled = 0;
+}
@@ -0,0 +1,81 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+/** @file perf.h
+ *  @brief interface to the hardware performance counters of the phases
+ *  @details Timing alone does not say why a phase is slow. When enabled by
+ *  <code>perf_init()</code> (<code>mylc3as --perf-counters</code>, or the
+ *  <code>lc3bench</code> tool), the counters of the process are opened with
+ *  <code>perf_event_open()</code> as one group, so they are read together
+ *  with a single <code>read()</code>:
+ *  cycles, instructions, branch misses, L1 data cache read misses, last
+ *  level cache misses and page faults, counted in user space.
+ *  <p>
+ *  Like the memory statistics (see <code>mem.h</code>), the counts are
+ *  attributed to the current phase: <code>perf_set_phase()</code> reads the
+ *  counters and adds what was counted since the last call to the phase
+ *  that was current. The counters are only read when the phase changes,
+ *  so the phases must be coarse. In <code>mylc3as</code> the tokenizer and
+ *  the symbol table are part of pass one, as they run for every line;
+ *  <code>lc3bench</code> measures them as phases of their own.
+ *  <p>
+ *  A counter the processor or kernel does not provide (e.g. in a virtual
+ *  machine, or with <code>perf_event_paranoid</code> too high) is reported
+ *  as missing, and the others are still used. The time of each phase is
+ *  always measured. If a group is multiplexed with other events, the counts
+ *  are scaled by the time it ran.
+ *  <p>
+ *  The results are written as CSV (one line per phase, empty fields for
+ *  missing counters) or JSON (<code>null</code> for missing counters), with
+ *  the instructions per cycle and misses per thousand instructions, so
+ *  builds can be compared.
+ */
+
+#include <stdio.h>
+
+/** The phases counts are attributed to */
+typedef enum perf_phase {
+  PERF_NONE,       /**< not counted (startup, reporting)    */
+  PERF_LEX,        /**< tokenizer (lc3bench only)           */
+  PERF_PASS_ONE,   /**< asm_pass_one()                      */
+  PERF_SYMBOLS,    /**< symbol table (lc3bench only)        */
+  PERF_PASS_TWO,   /**< asm_pass_two(), encoding the lines  */
+  PERF_OUTPUT,     /**< writing the output files            */
+  PERF_NUM_PHASES
+} perf_phase_t;
+
+/** Formats of <code>perf_report()</code> */
+typedef enum perf_format {
+  PERF_CSV,   /**< comma separated values, with a header line */
+  PERF_JSON   /**< one JSON object                             */
+} perf_format_t;
+
+/** Open the counters and start counting in no phase. Calling it again
+ *  clears the counts.
+ *  @return the number of counters available (0 if none, the time of each
+ *  phase is still measured)
+ */
+int perf_init (void);
+
+/** Determine if the counters were enabled by <code>perf_init()</code> */
+int perf_enabled (void);
+
+/** Attribute what was counted since the last call to the current phase,
+ *  then make <code>phase</code> current. Does nothing unless
+ *  <code>perf_init()</code> was called.
+ *  @param phase - the new phase
+ */
+void perf_set_phase (perf_phase_t phase);
+
+/** Write the counts of each phase that ran
+ *  @param f - the file to write to
+ *  @param format - PERF_CSV or PERF_JSON
+ *  @param label - name of what was measured (e.g. the source file)
+ *  @param runs - counts are divided by this number (runs of a benchmark)
+ */
+void perf_report (FILE* f, perf_format_t format, const char* label, int runs);
+
+/** Close the counters */
+void perf_term (void);
+
+#endif /* __PERF_H__ */
@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+#include "diag.h"
+#include "include.h"
+#include "pipeline.h"
+
+/** Typedef of structure type */
+typedef struct pipe_rec pipe_rec_t;
+
+/** A record passed between two stages */
+struct pipe_rec {
+  int          pos;   /**< offset of a line in the source, -1 at the end */
+  int          end;   /**< offset after the line                         */
+  line_info_t* info;  /**< the line checked by pass one, NULL at the end */
+  line_info_t* last;  /**< last line added with it (by a .INCLUDE)       */
+};
+
+/** Typedef of structure type */
+typedef struct pipe_ring pipe_ring_t;
+
+/** A bounded ring with one producer and one consumer. The indexes only
+ *  increase, each is written by one side and kept on its own cache line.
+ */
+struct pipe_ring {
+  pipe_rec_t recs[PIPE_RING_SIZE];  /**< the records                   */
+  unsigned   head;                  /**< next record read (consumer)   */
+  char       pad[64];               /**< keeps head and tail apart     */
+  unsigned   tail;                  /**< next record written (producer) */
+};
+
+/** Values of <code>stage</code>, set by the calling thread */
+#define STAGE_PASS_ONE 0  /**< only lines that cannot fail are encoded */
+#define STAGE_PASS_TWO 1  /**< every line is encoded                   */
+#define STAGE_DISCARD  2  /**< pass one failed, nothing more is encoded */
+
+/** Lines read from the source, from the reader to the calling thread */
+static pipe_ring_t lines;
+
+/** Lines checked by pass one, from the calling thread to the encoder */
+static pipe_ring_t infos;
+
+/** The stage of the assembly */
+static int stage;
+
+/** The threads are running */
+static int running;
+
+static pthread_t reader;
+static pthread_t encoder;
+
+/** The source file, its text and its length */
+static FILE* srcFile;
+static char* srcText;
+static int   srcLength;
+
+/** The listing file, or NULL */
+static FILE* lst;
+
+/** Add a record to a ring, waiting while it is full */
+static void ring_put (pipe_ring_t* ring, pipe_rec_t rec) {
+  unsigned tail = ring->tail;
+
+  while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ==
+         PIPE_RING_SIZE)
+    sched_yield();
+
+  ring->recs[tail & (PIPE_RING_SIZE - 1)] = rec;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/** Remove a record from a ring
+ *  @param wait - wait while the ring is empty
+ *  @return 1 if a record was removed, 0 if the ring is empty
+ */
+static int ring_get (pipe_ring_t* ring, pipe_rec_t* rec, int wait) {
+  unsigned head = ring->head;
+
+  while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+    if (! wait)
+      return 0;
+
+    sched_yield();
+  }
+
+  *rec = ring->recs[head & (PIPE_RING_SIZE - 1)];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/** The reader: read the source and pass each complete line */
+static void* read_lines (void* arg) {
+  int done  = 0; // bytes read
+  int start = 0; // offset of the line not yet passed
+
+  while (done < srcLength) {
+    int want  = srcLength - done;
+    int count = fread(srcText + done, 1,
+                      (want < PIPE_READ_SIZE) ? want : PIPE_READ_SIZE, srcFile);
+
+    if (count <= 0)
+      break; // the file is shorter than it was, the rest stays zero
+
+    for (char* p = srcText + done; ; p++) {
+      p = memchr(p, '\n', srcText + done + count - p);
+
+      if (p == NULL)
+        break;
+
+      ring_put(&lines, (pipe_rec_t) { start, p - srcText + 1, NULL });
+      start = p - srcText + 1;
+    }
+
+    done += count;
+  }
+
+  if (start < done)
+    ring_put(&lines, (pipe_rec_t) { start, done, NULL });
+
+  ring_put(&lines, (pipe_rec_t) { -1, -1, NULL });
+  return NULL;
+}
+
+/** The encoder: encode the lines in order as soon as possible */
+static void* encode_lines (void* arg) {
+  line_info_t* next  = NULL; // first line received and not encoded
+  line_info_t* last  = NULL; // last line received
+  int          done  = 0;    // every line was received
+  int          retry = 1;    // next may be encodable, lines were received
+  pipe_rec_t   rec;
+
+  for (;;) {
+    int progress = 0;
+
+    while (! done && ring_get(&infos, &rec, 0)) {
+      progress = 1;
+      retry    = 1;
+
+      if (rec.info == NULL) {
+        done = 1;
+      }
+      else {
+        if (next == NULL)
+          next = rec.info;
+
+        last = rec.last;
+      }
+    }
+
+    int now = __atomic_load_n(&stage, __ATOMIC_ACQUIRE);
+
+    // past the limit of errors, the lines are received but not encoded
+    if (now == STAGE_DISCARD || diag_limit_reached())
+      next = NULL;
+
+    while (next != NULL && ! diag_limit_reached() &&
+           (now == STAGE_PASS_TWO || (retry && asm_can_encode(next)))) {
+      asm_generate_line(next, lst);
+      next     = (next == last) ? NULL : next->next; // next was received
+      progress = 1;
+    }
+
+    retry = 0; // stalled on next until more lines are received
+
+    if (done && (next == NULL || now == STAGE_DISCARD))
+      break;
+
+    if (! progress)
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+/** Let the encoder finish or stop, and wait for it */
+static void stop_encoder (int how) {
+  __atomic_store_n(&stage, how, __ATOMIC_RELEASE);
+  pthread_join(encoder, NULL);
+  running = 0;
+  asm_generate_end((how == STAGE_PASS_TWO) ? lst : NULL);
+}
+
+void pipeline_pass_one (char* asm_file_name, char* sym_file_name,
+                        asm_outputs_t* outputs) {
+  struct stat st;
+
+  running = 0;
+  srcFile = open_read_or_error(asm_file_name);
+
+  if (srcFile == NULL)
+    return;
+
+  if (fstat(fileno(srcFile), &st) != 0 || ! S_ISREG(st.st_mode)) {
+    fclose(srcFile);
+    asm_pass_one(asm_file_name, sym_file_name);
+    return;
+  }
+
+  srcLength = st.st_size;
+  srcText   = asm_source_buffer(srcLength);
+  include_set_source(asm_file_name);
+  lst       = NULL;
+
+  if (outputs->lst_file_name != NULL)
+    lst = open_write_or_error(outputs->lst_file_name);
+
+  memset(&lines, 0, sizeof(lines));
+  memset(&infos, 0, sizeof(infos));
+  stage   = STAGE_PASS_ONE;
+  running = 1;
+  asm_generate_begin(lst);
+  pthread_create(&reader, NULL, read_lines, NULL);
+  pthread_create(&encoder, NULL, encode_lines, NULL);
+
+  pipe_rec_t rec;
+
+  while (ring_get(&lines, &rec, 1) && rec.pos >= 0) {
+    if (diag_limit_reached())
+      continue; // the reader still passes every line
+
+    line_info_t* last;
+    line_info_t* info = asm_scan_line(rec.pos, rec.end, &last);
+
+    if (info != NULL)
+      ring_put(&infos, (pipe_rec_t) { 0, 0, info, last });
+  }
+
+  pthread_join(reader, NULL);
+  fclose(srcFile);
+
+  line_info_t* last;
+  line_info_t* info = asm_scan_end(&last); // literals after the last line
+
+  if (info != NULL)
+    ring_put(&infos, (pipe_rec_t) { 0, 0, info, last });
+
+  ring_put(&infos, (pipe_rec_t) { 0, 0, NULL, NULL });
+  asm_scan_finish();
+
+  if (numErrors == 0 && sym_file_name != NULL)
+    asm_write_sym(sym_file_name);
+
+  if (numErrors != 0) {
+    stop_encoder(STAGE_DISCARD);
+
+    if (lst != NULL)
+      fclose(lst);
+  }
+}
+
+void pipeline_pass_two (asm_outputs_t* outputs) {
+  if (! running) { // the source was not a regular file
+    asm_pass_two(outputs);
+    return;
+  }
+
+  stop_encoder(STAGE_PASS_TWO);
+
+  if (lst != NULL && fclose(lst) != 0)
+    asm_error(ERR_WRITE, outputs->lst_file_name);
+
+  asm_write_outputs(outputs);
+}
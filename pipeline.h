@@ -0,0 +1,62 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+/** @file pipeline.h
+ *  @brief interface to the pipelined assembler
+ *  @details Selected by <code>mylc3as --pipeline</code>. The work of both
+ *  passes is split between three threads, connected by bounded single
+ *  producer, single consumer rings of line records:
+ *  <ol>
+ *  <li>the <b>reader</b> reads the source file in blocks of
+ *      <code>PIPE_READ_SIZE</code> bytes and passes the offsets of each
+ *      complete line</li>
+ *  <li>the calling thread classifies the tokens of each line, checks its
+ *      syntax, defines its label and assigns its address
+ *      (<code>asm_scan_line()</code>), then passes the line on</li>
+ *  <li>the <b>encoder</b> encodes the lines in order into the image and
+ *      writes their listing rows. A line is encoded as soon as
+ *      <code>asm_can_encode()</code> allows it. It stalls on a forward
+ *      reference until the label is defined or pass one is complete, while
+ *      it keeps receiving lines so the first pass never waits for it.</li>
+ *  </ol>
+ *  The rings use the GCC <code>__atomic</code> builtins, with release and
+ *  acquire ordering on their indexes, so a line is completely written
+ *  before the next stage sees it. A stage with nothing to do yields the
+ *  processor. The symbol table and constants are protected by a lock in
+ *  <code>assembler.c</code>, and the allocator and diagnostics are thread
+ *  safe.
+ *  <p>
+ *  Lines that could report an error are only encoded once
+ *  <code>pipeline_pass_two()</code> is called, so the messages and output
+ *  files are identical to those of the sequential assembler. The optimizer
+ *  needs every line before it starts, so <code>-O</code> is not pipelined.
+ */
+
+#include "assembler.h"
+
+/** Number of records in each ring (a power of 2) */
+#define PIPE_RING_SIZE 1024
+
+/** Number of bytes read at a time by the reader */
+#define PIPE_READ_SIZE 65536
+
+/** Perform the first pass, as <code>asm_pass_one()</code> does, with the
+ *  reader and encoder threads running. If pass one finds errors the threads
+ *  are stopped before returning. A source that is not a regular file is
+ *  assembled by <code>asm_pass_one()</code>.
+ *  @param asm_file_name - name of the file to assemble
+ *  @param sym_file_name - name of the symbol table file, or <code>NULL</code>
+ *  @param outputs - names of the files to produce, the listing is written
+ *  while the lines are encoded
+ */
+void pipeline_pass_one (char* asm_file_name, char* sym_file_name,
+                        asm_outputs_t* outputs);
+
+/** Perform the second pass, as <code>asm_pass_two()</code> does, by letting
+ *  the encoder complete the image, then write the output files. Only called
+ *  if no errors were found by <code>pipeline_pass_one()</code>.
+ *  @param outputs - the outputs given to <code>pipeline_pass_one()</code>
+ */
+void pipeline_pass_two (asm_outputs_t* outputs);
+
+#endif /* __PIPELINE_H__ */
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembler.h"
+#include "mem.h"
+#include "pool.h"
+
+/** Typedef of structure type */
+typedef struct pool_str pool_str_t;
+
+/** A string of a block */
+struct pool_str {
+  line_info_t* line;    /**< the .STRINGZ                                 */
+  const char*  text;    /**< its characters, without the quotes           */
+  int          length;  /**< number of characters                         */
+  int          index;   /**< position in the block                        */
+  int          owner;   /**< the longest string it is a suffix of (sorted
+                             position), itself if none                    */
+  int          shared;  /**< another string is a suffix of it or it is a
+                             suffix of another                            */
+};
+
+/** Order strings by their reversed text, a string before those it is a
+ *  suffix of. Identical strings are in the reverse order of the block, so
+ *  the first one of the block is the owner of the others.
+ */
+static int compare_reversed (const void* a, const void* b) {
+  const pool_str_t* s = a;
+  const pool_str_t* t = b;
+  int               i = s->length - 1;
+  int               j = t->length - 1;
+
+  for (; i >= 0 && j >= 0; i--, j--) {
+    if (s->text[i] != t->text[j])
+      return (unsigned char) s->text[i] - (unsigned char) t->text[j];
+  }
+
+  if (i != j)
+    return (i < 0) ? -1 : 1; // the shorter is a suffix of the other
+
+  return t->index - s->index;
+}
+
+/** Determine if a string is a suffix of another */
+static int is_suffix (pool_str_t* s, pool_str_t* t) {
+  return s->length <= t->length &&
+         memcmp(s->text, t->text + t->length - s->length, s->length) == 0;
+}
+
+/** Add a copy of the longest string of a group after a line */
+static line_info_t* add_copy (line_info_t* after, line_info_t* line) {
+  line_info_t* info = mem_alloc(MEM_LINE_INFO, sizeof(line_info_t));
+
+  *info           = *line;
+  info->label     = NULL; // the labels stay on the pooled lines
+  info->reference = mem_strdup(MEM_STRING, line->reference);
+  info->next      = after->next;
+  after->next     = info;
+  return info;
+}
+
+/** Pool the strings of one block
+ *  @param strs - the strings, in the order of the block
+ *  @param last - the last line of the block generating words or its
+ *  <code>.ORIG</code>, the copies are added after it
+ *  @return the number of words saved
+ */
+static int pool_block (pool_str_t* strs, int n, line_info_t* last) {
+  int saved = 0;
+
+  qsort(strs, n, sizeof(pool_str_t), compare_reversed);
+
+  for (int i = n - 1; i >= 0; i--) {
+    strs[i].owner  = i;
+    strs[i].shared = 0;
+
+    if (i + 1 < n && is_suffix(&strs[i], &strs[i + 1])) {
+      strs[i].owner  = strs[i + 1].owner;
+      strs[i].shared = 1;
+      strs[strs[i].owner].shared = 1;
+    }
+  }
+
+  // the copies are added in the order of the block
+  line_info_t** copies  = mem_calloc(MEM_OPT, n, sizeof(line_info_t*));
+  pool_str_t**  byIndex = mem_alloc(MEM_OPT, n * sizeof(pool_str_t*));
+
+  for (int i = 0; i < n; i++)
+    byIndex[strs[i].index] = &strs[i];
+
+  for (int i = 0; i < n; i++) {
+    pool_str_t* s = byIndex[i];
+
+    if (! s->shared)
+      continue;
+
+    pool_str_t* owner = &strs[s->owner];
+
+    if (copies[s->owner] == NULL) {
+      copies[s->owner] = add_copy(last, owner->line);
+      last             = copies[s->owner];
+      saved           -= owner->length + 1;
+    }
+
+    line_info_t* line = s->line;
+
+    saved          += s->length + 1;
+    mem_free(line->reference);
+    line->opcode    = OP_INVALID;
+    line->reference = NULL;
+    line->pooledIn  = copies[s->owner];
+    line->immediate = owner->length - s->length;
+  }
+
+  mem_free(byIndex);
+  mem_free(copies);
+  return saved;
+}
+
+int pool_run (line_info_t* head) {
+  int          saved   = 0;
+  int          cap     = 64;
+  int          n       = 0;
+  int          inBlock = 1; // lines before the first .ORIG are at x0000
+  line_info_t* last    = NULL;
+  pool_str_t*  strs    = mem_alloc(MEM_OPT, cap * sizeof(pool_str_t));
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    if (info->opcode == OP_ORIG || info->opcode == OP_END) {
+      if (n > 1)
+        saved += pool_block(strs, n, last);
+
+      n       = 0;
+      inBlock = (info->opcode == OP_ORIG);
+      last    = info;
+      continue;
+    }
+
+    if (! inBlock)
+      continue;
+
+    if (info->opcode != OP_INVALID) // a label at the end of the block stays
+      last = info;
+
+    if (info->opcode != OP_STRINGZ || info->reference == NULL)
+      continue;
+
+    if (n == cap) {
+      cap *= 2;
+      strs = mem_realloc(MEM_OPT, strs, cap * sizeof(pool_str_t));
+    }
+
+    // reference keeps the quotes
+    strs[n] = (pool_str_t) { info, info->reference + 1,
+                             strlen(info->reference) - 2, n, 0, 0 };
+    n++;
+  }
+
+  if (n > 1)
+    saved += pool_block(strs, n, last);
+
+  mem_free(strs);
+  return saved;
+}
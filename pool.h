@@ -0,0 +1,45 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+/** @file pool.h
+ *  @brief interface to the pooling of the strings of .STRINGZ
+ *  @details Selected by <code>mylc3as --pool-strings</code>, at the end of
+ *  pass one. Generated programs often repeat the same message, or one
+ *  message is the end of another:
+ *  <pre>
+ *  MSG1  .STRINGZ "fatal error"
+ *  MSG2  .STRINGZ "error"
+ *  MSG3  .STRINGZ "error"
+ *  </pre>
+ *  Within each <code>.ORIG</code> block, the strings are sorted by their
+ *  reversed text, so a string that is a suffix of others (including an
+ *  identical string) comes just before them. The longest string of each
+ *  group of two or more is copied once at the end of the block, and every
+ *  <code>.STRINGZ</code> of the group becomes a line with no words whose
+ *  label is at the copy, after the characters it does not share. Above,
+ *  the three lines take the 12 words of <code>"fatal error"</code>, and
+ *  <code>MSG2</code> and <code>MSG3</code> are 6 words after
+ *  <code>MSG1</code>. A string no other string shares with stays where it
+ *  is.
+ *  <p>
+ *  The pooled line keeps the copy in <code>pooledIn</code> and its offset
+ *  in the copy in <code>immediate</code>; <code>asm_layout()</code> then
+ *  gives its label the address in the copy. The copy is a
+ *  <code>.STRINGZ</code> line like the others, created from the source line
+ *  of the longest string, so <code>line_size()</code> and the listing count
+ *  and show its words. As with the optimizer, the strings are not pooled
+ *  if an operand of <code>.ORIG</code> or <code>.BLKW</code> depends on a
+ *  label, and the PC offsets to the moved strings must still fit.
+ */
+
+#include "assembler.h"
+
+/** Pool the strings of each <code>.ORIG</code> block. The list is only
+ *  changed by adding lines after existing ones, so its head stays the same.
+ *  The addresses must then be recomputed with <code>asm_layout()</code>.
+ *  @param head - the first line of the program
+ *  @return the number of words saved
+ */
+int pool_run (line_info_t* head);
+
+#endif /* __POOL_H__ */
@@ -0,0 +1,15 @@
+; Assembled with -O, the far branches become trampolines through a register
+; that the code at their target sets before reading (see relax.hex). The
+; program must still halt: WORK returns through R7, so the BRnzp to it may
+; not use R7.
+        .ORIG x3000
+        JSR     SUB
+        BRnzp   DONE          ; HALT at DONE, relaxed with R7
+SUB     ADD     R1, R1, #1
+        BRnzp   WORK          ; WORK reads R7, relaxed with R0
+        .BLKW   300
+WORK    ADD     R0, R7, #0
+        ADD     R2, R2, #1
+        RET
+DONE    HALT
+        .END
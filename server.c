@@ -0,0 +1,318 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "assembler.h"
+#include "diag.h"
+#include "server.h"
+
+/** Serializes use of the assembler, which is built on global state */
+static pthread_mutex_t asmLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Time allowed for one request, in milliseconds */
+static int requestTimeoutMs = SERVER_TIMEOUT_MS;
+
+/** Number of errors after which an assembly stops */
+static int maxErrorsPerRequest = DIAG_MAX_ERRORS;
+
+/** Typedef of structure type */
+typedef struct response response_t;
+
+/** The parts of a response, each held in memory until it is sent */
+struct response {
+  int    status;   /**< one of the SERVER_* values */
+  char*  obj;      /**< object file bytes          */
+  size_t objLen;   /**< length of obj              */
+  char*  sym;      /**< symbol table text          */
+  size_t symLen;   /**< length of sym              */
+  char*  diag;     /**< diagnostics text           */
+  size_t diagLen;  /**< length of diag             */
+};
+
+/** Return the current time in milliseconds of a monotonic clock */
+static long long now_ms (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/** Wait until the socket is ready or the deadline passes
+ *  @param fd - the socket
+ *  @param events - POLLIN or POLLOUT
+ *  @param deadline - time (from now_ms()) to give up, or -1 for no limit
+ *  @return 1 if ready, 0 on timeout or error
+ */
+static int wait_ready (int fd, short events, long long deadline) {
+  struct pollfd pfd = { fd, events, 0 };
+
+  for (;;) {
+    int wait = -1;
+
+    if (deadline >= 0) {
+      long long left = deadline - now_ms();
+      if (left <= 0)
+        return 0;
+      wait = (int) left;
+    }
+
+    int n = poll(&pfd, 1, wait);
+
+    if (n > 0)
+      return 1;
+
+    if (n == 0 || errno != EINTR)
+      return 0;
+  }
+}
+
+/** Read exactly <code>len</code> bytes
+ *  @return 1 on success, 0 on EOF, error or timeout
+ */
+static int read_full (int fd, void* buf, size_t len, long long deadline) {
+  char* p = buf;
+
+  while (len > 0) {
+    if (! wait_ready(fd, POLLIN, deadline))
+      return 0;
+
+    ssize_t n = read(fd, p, len);
+
+    if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN))
+      return 0;
+
+    if (n > 0) {
+      p   += n;
+      len -= n;
+    }
+  }
+
+  return 1;
+}
+
+/** Write exactly <code>len</code> bytes
+ *  @return 1 on success, 0 on error or timeout
+ */
+static int write_full (int fd, const void* buf, size_t len,
+                       long long deadline) {
+  const char* p = buf;
+
+  while (len > 0) {
+    if (! wait_ready(fd, POLLOUT, deadline))
+      return 0;
+
+    ssize_t n = write(fd, p, len);
+
+    if (n < 0 && errno != EINTR && errno != EAGAIN)
+      return 0;
+
+    if (n > 0) {
+      p   += n;
+      len -= n;
+    }
+  }
+
+  return 1;
+}
+
+/** Store a 32 bit value in network order */
+static char* put_u32 (char* p, size_t value) {
+  unsigned int v = htonl((unsigned int) value);
+  memcpy(p, &v, 4);
+  return p + 4;
+}
+
+/** Append a length and its bytes to the response buffer */
+static char* put_part (char* p, const char* data, size_t len) {
+  p = put_u32(p, len);
+
+  if (len > 0)
+    memcpy(p, data, len);
+
+  return p + len;
+}
+
+/** Send a response as a single write */
+static int send_response (int fd, response_t* resp, long long deadline) {
+  size_t len = 16 + resp->objLen + resp->symLen + resp->diagLen;
+  char*  buf = malloc(len);
+  char*  p   = put_u32(buf, resp->status);
+
+  p = put_part(p, resp->obj, resp->objLen);
+  p = put_part(p, resp->sym, resp->symLen);
+  p = put_part(p, resp->diag, resp->diagLen);
+
+  int ok = write_full(fd, buf, len, deadline);
+  free(buf);
+  return ok;
+}
+
+/** Assemble one program. The caller must hold <code>asmLock</code>. */
+static void assemble (const char* src, int len, response_t* resp) {
+  FILE* f;
+
+  asm_reset();
+  diag_init(maxErrorsPerRequest);
+  asm_pass_one_text(src, len);
+
+  if (numErrors == 0)
+    asm_generate(NULL);
+
+  resp->status = (numErrors == 0) ? SERVER_OK : SERVER_ERRORS;
+
+  if (numErrors == 0) {
+    f = open_memstream(&resp->obj, &resp->objLen);
+    image_write_obj(f, asm_get_image());
+    fclose(f);
+
+    f = open_memstream(&resp->sym, &resp->symLen);
+    lc3_write_sym_table(f);
+    fclose(f);
+  }
+
+  f = open_memstream(&resp->diag, &resp->diagLen);
+  diag_flush(f);
+  fclose(f);
+}
+
+/** Serve all the requests on one connection, then close it */
+static void* serve_client (void* arg) {
+  int fd = (int) (long) arg;
+
+  for (;;) {
+    unsigned int len;
+
+    // a connection may stay idle between requests
+    if (! read_full(fd, &len, 4, -1))
+      break;
+
+    long long  deadline = now_ms() + requestTimeoutMs;
+    response_t resp     = { SERVER_BAD_REQ };
+    char*      src      = NULL;
+
+    len = ntohl(len);
+
+    if (len > SERVER_MAX_SOURCE) {
+      send_response(fd, &resp, deadline);
+      break;
+    }
+
+    src = malloc(len + 1);
+
+    if (! read_full(fd, src, len, deadline)) {
+      free(src);
+      break;
+    }
+
+    long long left = deadline - now_ms();
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec  += left / 1000;
+    until.tv_nsec += (left % 1000) * 1000000;
+
+    if (until.tv_nsec >= 1000000000) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000;
+    }
+
+    if (left > 0 && pthread_mutex_timedlock(&asmLock, &until) == 0) {
+      assemble(src, len, &resp);
+      pthread_mutex_unlock(&asmLock);
+    }
+    else {
+      resp.status = SERVER_TIMEOUT;
+    }
+
+    free(src);
+    int ok = send_response(fd, &resp, deadline);
+    free(resp.obj);
+    free(resp.sym);
+    free(resp.diag);
+
+    if (! ok)
+      break;
+  }
+
+  close(fd);
+  return NULL;
+}
+
+int server_run (const char* socket_path, int timeoutMs, int maxErrors) {
+  struct sockaddr_un addr;
+  struct stat        st;
+
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket path '%s' too long\n", socket_path);
+    return 1;
+  }
+
+  // only a socket left by an earlier server is replaced
+  if (lstat(socket_path, &st) == 0) {
+    if (! S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "'%s' exists and is not a socket\n", socket_path);
+      return 1;
+    }
+
+    if (unlink(socket_path) != 0) {
+      perror(socket_path);
+      return 1;
+    }
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0) {
+    perror("socket");
+    return 1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket_path);
+
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+      listen(fd, 128) < 0) {
+    perror(socket_path);
+    close(fd);
+    return 1;
+  }
+
+  signal(SIGPIPE, SIG_IGN); // a client closing early must not kill us
+  requestTimeoutMs    = timeoutMs;
+  maxErrorsPerRequest = maxErrors;
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  for (;;) {
+    int client = accept(fd, NULL, NULL);
+
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE)
+        continue;
+      perror("accept");
+      break;
+    }
+
+    pthread_t thread;
+
+    if (pthread_create(&thread, &attr, serve_client, (void*) (long) client))
+      close(client);
+  }
+
+  pthread_attr_destroy(&attr);
+  close(fd);
+  return 1;
+}
@@ -0,0 +1,68 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+/** @file server.h
+ *  @brief interface to the resident assembler server
+ *  @details The server keeps the assembler initialized (tokens, opcode and
+ *  symbol tables) and assembles programs sent to it over a Unix domain
+ *  socket, avoiding the cost of starting a process per assembly. A client
+ *  may send any number of requests on one connection. Every value in the
+ *  protocol is an unsigned 32 bit integer in network (big-endian) order.
+ *  <p>
+ *  A request is the length of the source followed by the source text.
+ *  The response is:
+ *  <ol>
+ *  <li>a status (one of the <code>SERVER_*</code> values)</li>
+ *  <li>the length of the object file, followed by the object file (the same
+ *      bytes as a <code>.obj</code> file)</li>
+ *  <li>the length of the symbol table, followed by the symbol table (the
+ *      same text as a <code>.sym</code> file)</li>
+ *  <li>the length of the diagnostics, followed by the diagnostics (the
+ *      error messages, one per line)</li>
+ *  </ol>
+ *  The object file and symbol table are empty unless the status is
+ *  <code>SERVER_OK</code>.
+ *  <p>
+ *  Connections are served concurrently, each by its own thread. Reading
+ *  and parsing requests, and writing responses, proceed in parallel. The
+ *  assembler itself uses global state, so assemblies are serialized.
+ *  <p>
+ *  The timeout given to <code>server_run()</code> limits receiving a
+ *  request, waiting for the assembler and sending the response; a request
+ *  still waiting for the assembler when it expires is answered with
+ *  <code>SERVER_TIMEOUT</code>. An assembly that has started is not
+ *  interrupted, so the time other clients may wait for it is bounded only
+ *  by the size of the source (at most <code>SERVER_MAX_SOURCE</code>).
+ */
+
+/** Program assembled without errors */
+#define SERVER_OK       0
+
+/** Program contained errors, see the diagnostics */
+#define SERVER_ERRORS   1
+
+/** The request could not be assembled within the timeout */
+#define SERVER_TIMEOUT  2
+
+/** The request was malformed or too large, the connection is closed */
+#define SERVER_BAD_REQ  3
+
+/** Largest source accepted in a single request */
+#define SERVER_MAX_SOURCE (16 * 1024 * 1024)
+
+/** Default time allowed for one request, in milliseconds */
+#define SERVER_TIMEOUT_MS 2000
+
+/** Serve assembly requests on a Unix domain socket. This only returns if
+ *  the socket can not be created. The assembler must already be initialized
+ *  using <code>asm_init()</code>.
+ *  @param socket_path - path of the socket (replaced if it is a socket, an
+ *  error if it is any other file)
+ *  @param timeoutMs - time allowed for one request, in milliseconds
+ *  @param maxErrors - the number of errors after which an assembly stops,
+ *  0 for no limit
+ *  @return non-zero on error
+ */
+int server_run (const char* socket_path, int timeoutMs, int maxErrors);
+
+#endif /* __SERVER_H__ */
@@ -0,0 +1,328 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "diag.h"
+#include "include.h"
+#include "mem.h"
+#include "watch.h"
+
+/** Maximum number of outputs of a build (.sym and the asm_outputs_t) */
+#define WATCH_MAX_OUTPUTS (sizeof(asm_outputs_t) / sizeof(char*) + 1)
+
+/** Events that start a build at once */
+#define EVENTS_DONE (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/** Events that start a build once the file is quiet */
+#define EVENTS_BUSY (IN_MODIFY | IN_CREATE)
+
+/** An output file and the bytes it holds */
+typedef struct watch_output {
+  char*  name;      /**< name of the file                            */
+  char*  last;      /**< its content (from mem_alloc()), or NULL if it
+                         does not exist                              */
+  size_t lastLen;   /**< length of the content                       */
+  char*  built;     /**< content produced by this build, or NULL     */
+  size_t builtLen;  /**< length of the content built                 */
+} watch_output_t;
+
+/** The outputs, in the order they are produced */
+static watch_output_t outs[WATCH_MAX_OUTPUTS];
+static int            numOuts;
+
+/** The source of the last build, or NULL */
+static char* lastSrc;
+static int   lastSrcLen;
+
+/** Current time in milliseconds */
+static double now_ms (void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** Read a whole file into memory
+ *  @param category - what the content is used for
+ *  @param data - set to the content (with a '\0' added), to mem_free()
+ *  @param length - set to the length of the content
+ *  @return 1 on success, 0 if the file can not be read
+ */
+static int read_file (char* file_name, mem_category_t category, char** data,
+                      size_t* length) {
+  FILE* f = fopen(file_name, "r");
+
+  *data   = NULL;
+  *length = 0;
+
+  if (f == NULL)
+    return 0;
+
+  size_t capacity = 8192;
+  size_t count;
+
+  *data = mem_alloc(category, capacity);
+
+  while ((count = fread(*data + *length, 1, capacity - *length - 1, f)) > 0) {
+    *length += count;
+
+    if (*length == capacity - 1) {
+      capacity *= 2;
+      *data     = mem_realloc(category, *data, capacity);
+    }
+  }
+
+  (*data)[*length] = '\0';
+  fclose(f);
+  return 1;
+}
+
+/** Add an output to produce, reading its current content */
+static void add_output (char* file_name) {
+  if (file_name != NULL && numOuts < WATCH_MAX_OUTPUTS) {
+    watch_output_t* out = &outs[numOuts++];
+
+    out->name  = file_name;
+    out->built = NULL;
+
+    if (! read_file(file_name, MEM_OUTPUT, &out->last, &out->lastLen))
+      out->last = NULL;
+  }
+}
+
+/** Keep an output of the build (see asm_set_output_fnc) */
+static void keep_output (char* file_name, char* data, size_t length) {
+  for (int i = 0; i < numOuts; i++) {
+    if (outs[i].name == file_name) {
+      free(outs[i].built);
+      outs[i].built    = data;
+      outs[i].builtLen = length;
+      return;
+    }
+  }
+
+  free(data); // not requested
+}
+
+/** Write the outputs that changed, or remove them all if the build failed
+ *  @return the number of files written
+ */
+static int commit_outputs (int failed) {
+  int written = 0;
+
+  for (int i = 0; i < numOuts; i++) {
+    watch_output_t* out = &outs[i];
+
+    if (failed || out->built == NULL) {
+      free(out->built);
+      out->built = NULL;
+
+      if (failed && out->last != NULL) {
+        remove(out->name);
+        mem_free(out->last);
+        out->last = NULL;
+      }
+
+      continue;
+    }
+
+    if (out->last != NULL && out->lastLen == out->builtLen &&
+        memcmp(out->last, out->built, out->builtLen) == 0) {
+      free(out->built); // unchanged, the file is not written
+      out->built = NULL;
+      continue;
+    }
+
+    FILE* f  = fopen(out->name, "w");
+    int   ok = (f != NULL) &&
+               fwrite(out->built, 1, out->builtLen, f) == out->builtLen;
+
+    if (f != NULL && fclose(f) != 0)
+      ok = 0;
+
+    if (! ok) {
+      fprintf(stderr, "ERROR: ");
+      fprintf(stderr, ERR_WRITE, out->name);
+      fprintf(stderr, " (%s)\n", strerror(errno));
+      free(out->built);
+      out->built = NULL;
+      continue;
+    }
+
+    written++;
+
+    // the built text came from a memory stream, the last one is kept here
+    mem_free(out->last);
+    out->last    = mem_alloc(MEM_OUTPUT, out->builtLen + 1);
+    out->lastLen = out->builtLen;
+    memcpy(out->last, out->built, out->builtLen);
+    free(out->built);
+    out->built   = NULL;
+  }
+
+  return written;
+}
+
+/** Assemble the file if its source changed, and report the build
+ *  @param start - time of the event that started the build
+ */
+static void build (char* asm_file_name, char* sym_file_name,
+                   asm_outputs_t* outputs, int maxErrors, int optimize,
+                   double start) {
+  char*  src;
+  size_t length;
+  int    found = read_file(asm_file_name, MEM_SOURCE, &src, &length);
+
+  if (found && lastSrc != NULL && length == (size_t) lastSrcLen &&
+      memcmp(src, lastSrc, length) == 0) {
+    mem_free(src); // saved without a change
+    return;
+  }
+
+  asm_reset();
+  diag_init(maxErrors);
+
+  if (found) {
+    include_set_source(asm_file_name);
+    asm_pass_one_text(src, length);
+  }
+  else
+    asm_error(ERR_OPEN_READ, asm_file_name);
+
+  mem_free(lastSrc);
+  lastSrc    = src;
+  lastSrcLen = length;
+
+  if (numErrors == 0 && optimize)
+    asm_optimize();
+
+  if (numErrors == 0 && sym_file_name != NULL)
+    asm_write_sym(sym_file_name);
+
+  if (numErrors == 0) {
+    srcLineNum = 0;
+    asm_pass_two(outputs);
+  }
+
+  diag_flush(stderr);
+
+  int failed  = (numErrors != 0);
+  int written = commit_outputs(failed);
+
+  if (failed) {
+    mem_free(lastSrc); // build again on the next save, even if unchanged
+    lastSrc = NULL;
+  }
+
+  printf("%s: %d errors, %d of %d outputs written, %.3f ms\n", asm_file_name,
+         numErrors, written, failed ? 0 : numOuts, now_ms() - start);
+  fflush(stdout);
+}
+
+/** Read the events queued and note those about the file
+ *  @param base - the name of the file in its directory
+ *  @param done - set if a write was completed
+ *  @param busy - set if the file was modified
+ *  @return 1 on success, 0 if the events can not be read
+ */
+static int read_events (int fd, const char* base, int* done, int* busy) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len = read(fd, buf, sizeof(buf));
+
+  if (len < 0)
+    return (errno == EINTR);
+
+  for (char* p = buf; p < buf + len; ) {
+    struct inotify_event* ev = (struct inotify_event*) p;
+
+    if (ev->len > 0 && strcmp(ev->name, base) == 0) {
+      if (ev->mask & EVENTS_DONE)
+        *done = 1;
+      else if (ev->mask & EVENTS_BUSY)
+        *busy = 1;
+    }
+
+    p += sizeof(struct inotify_event) + ev->len;
+  }
+
+  return 1;
+}
+
+/** Wait for events on the inotify descriptor
+ *  @return 1 if there are events, 0 on a timeout
+ */
+static int wait_events (int fd, int timeout_ms) {
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  int           n;
+
+  while ((n = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR)
+    ;
+
+  return n > 0;
+}
+
+int watch_run (char* asm_file_name, char* sym_file_name,
+               asm_outputs_t* outputs, int maxErrors, int optimize) {
+  char* slash = strrchr(asm_file_name, '/');
+  char* dir   = (slash != NULL) ? strndup(asm_file_name, slash - asm_file_name + 1)
+                                : strdup(".");
+  char* base  = (slash != NULL) ? slash + 1 : asm_file_name;
+  int   fd    = inotify_init1(IN_CLOEXEC);
+
+  if (fd < 0 || inotify_add_watch(fd, dir, EVENTS_DONE | EVENTS_BUSY) < 0) {
+    fprintf(stderr, "cannot watch '%s' (%s)\n", dir, strerror(errno));
+    free(dir);
+    return 1;
+  }
+
+  free(dir);
+  numOuts = 0;
+  add_output(sym_file_name);
+  add_output(outputs->obj_file_name);
+  add_output(outputs->hex_file_name);
+  add_output(outputs->lst_file_name);
+  add_output(outputs->sobj_file_name);
+  add_output(outputs->cost_file_name);
+  add_output(outputs->dbg_file_name);
+  add_output(outputs->xref_file_name);
+  add_output(outputs->ir_file_name);
+  asm_set_output_fnc(keep_output);
+  printf("watching %s\n", asm_file_name);
+  build(asm_file_name, sym_file_name, outputs, maxErrors, optimize, now_ms());
+
+  for (;;) {
+    int done = 0, busy = 0;
+
+    if (! wait_events(fd, -1) || ! read_events(fd, base, &done, &busy))
+      break;
+
+    double start = now_ms();
+
+    while (done || busy) { // coalesce the events that follow
+      int wait = done ? 0 : WATCH_DEBOUNCE_MS;
+
+      if (! wait_events(fd, wait))
+        break;
+
+      if (! read_events(fd, base, &done, &busy))
+        break;
+
+      start = now_ms();
+    }
+
+    if (done || busy)
+      build(asm_file_name, sym_file_name, outputs, maxErrors, optimize, start);
+  }
+
+  fprintf(stderr, "cannot read events (%s)\n", strerror(errno));
+  asm_set_output_fnc(NULL);
+  close(fd);
+  return 1;
+}
@@ -0,0 +1,44 @@
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+/** @file watch.h
+ *  @brief interface to the resident watch mode
+ *  @details Selected by <code>mylc3as --watch file.asm</code>. The program
+ *  assembles the file, then stays resident and assembles it again each time
+ *  it is saved, until interrupted. The assembler is initialized once, and
+ *  the source and every output of the last build are kept in memory:
+ *  <ul>
+ *  <li>the directory of the file is watched with inotify, so a save by an
+ *      editor that writes a new file and renames it is seen too. A write
+ *      that is closed, or a rename onto the file, starts a build at once.
+ *      Other modifications wait until the file has been quiet for
+ *      <code>WATCH_DEBOUNCE_MS</code>, and the events queued meanwhile are
+ *      coalesced into one build.</li>
+ *  <li>a source identical to the last one built is not assembled again</li>
+ *  <li>the outputs are built in memory (see <code>asm_set_output_fnc()</code>)
+ *      and a file is only written when its bytes differ from the last
+ *      version, so tools watching the outputs only see real changes. Before
+ *      the first build the existing files are read for comparison.</li>
+ *  </ul>
+ *  Each build prints its diagnostics, the number of outputs written and the
+ *  time from the event to the last output written. A build with errors
+ *  removes the outputs, as a normal run does.
+ */
+
+#include "assembler.h"
+
+/** Time a modified file must be quiet before it is assembled */
+#define WATCH_DEBOUNCE_MS 50
+
+/** Assemble a file each time it changes. Only returns on an error.
+ *  @param asm_file_name - name of the file to assemble
+ *  @param sym_file_name - name of the symbol table file, or <code>NULL</code>
+ *  @param outputs - names of the other files to produce
+ *  @param maxErrors - limit on errors reported per build (0 for no limit)
+ *  @param optimize - run the optimizer (<code>-O</code>)
+ *  @return 1 (the exit status of the program)
+ */
+int watch_run (char* asm_file_name, char* sym_file_name,
+               asm_outputs_t* outputs, int maxErrors, int optimize);
+
+#endif /* __WATCH_H__ */
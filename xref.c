@@ -0,0 +1,438 @@
+#define _DEFAULT_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "expr.h"
+#include "include.h"
+#include "mem.h"
+#include "symbol.h"
+#include "xref.h"
+
+/** Bytes of the header: magic, version and the five counts */
+#define XREF_HEADER 28
+
+/** Typedef of structure type */
+typedef struct xref_pending xref_pending_t;
+
+/** A reference found, before the references are grouped by label */
+struct xref_pending {
+  int        sym;  /**< index of the label */
+  xref_ref_t ref;  /**< the reference      */
+};
+
+/** Typedef of structure type */
+typedef struct xref_builder xref_builder_t;
+
+/** The index being built by <code>xref_write()</code> */
+struct xref_builder {
+  xref_sym_t*     syms;        /**< the labels                      */
+  int             numSyms;     /**< number of labels                */
+  int             capSyms;     /**< number of labels allocated      */
+  int*            buckets;     /**< label index + 1, 0 if empty     */
+  int             numBuckets;  /**< number of buckets               */
+  xref_pending_t* pending;     /**< the references, in line order   */
+  int             numPending;  /**< number of references            */
+  int             capPending;  /**< number of references allocated  */
+  xref_ref_t      ref;         /**< the reference of the line       */
+};
+
+/** Names of the kinds, in the order of xref_kind_t */
+static const char* kindNames[XREF_NUM_KINDS] = {
+  "branch", "call", "load", "store", "lea", "fill", "other"
+};
+
+uint32_t xref_hash (const char* name) {
+  uint32_t hash = 2166136261u;
+
+  for (; *name != '\0'; name++)
+    hash = (hash ^ (unsigned char) tolower((unsigned char) *name)) * 16777619u;
+
+  return hash;
+}
+
+const char* xref_kind_name (xref_kind_t kind) {
+  return (kind >= 0 && kind < XREF_NUM_KINDS) ? kindNames[kind] : "?";
+}
+
+/** Find the bucket of a name: the bucket of the label, or the empty bucket
+ *  where it would be added
+ */
+static int* find_bucket (int* buckets, int numBuckets, xref_sym_t* syms,
+                         const char* name) {
+  unsigned i = xref_hash(name) & (numBuckets - 1);
+
+  while (buckets[i] != 0 && strcasecmp(syms[buckets[i] - 1].name, name) != 0)
+    i = (i + 1) & (numBuckets - 1);
+
+  return &buckets[i];
+}
+
+/** Kind of access of the operand of a line */
+static xref_kind_t kind_of (opcode_t opcode) {
+  switch (opcode) {
+    case OP_BR:       return XREF_BRANCH;
+    case OP_JSR_JSRR: return XREF_CALL;
+    case OP_LD:
+    case OP_LDI:
+    case OP_LDR:      return XREF_LOAD;
+    case OP_ST:
+    case OP_STI:
+    case OP_STR:      return XREF_STORE;
+    case OP_LEA:      return XREF_LEA;
+    case OP_FILL:     return XREF_FILL;
+    default:          return XREF_OTHER;
+  }
+}
+
+/** Add a label of the table (see symbol_iterate()) */
+static void collect_symbol (symbol_t* sym, void* data) {
+  xref_builder_t* b = data;
+
+  if (b->numSyms == b->capSyms) {
+    b->capSyms = 2 * b->capSyms + 16;
+    b->syms    = mem_realloc(MEM_OUTPUT, b->syms,
+                             b->capSyms * sizeof(xref_sym_t));
+  }
+
+  b->syms[b->numSyms++] = (xref_sym_t) { sym->name, sym->addr & 0xFFFF,
+                                         NULL, 0 };
+}
+
+/** Order labels by name, ignoring case */
+static int compare_sym (const void* a, const void* b) {
+  return strcasecmp(((const xref_sym_t*) a)->name,
+                    ((const xref_sym_t*) b)->name);
+}
+
+/** Record a reference of the current line to a label of its operand (see
+ *  expr_for_each_label())
+ */
+static void add_reference (const char* name, void* data) {
+  xref_builder_t* b   = data;
+  int             sym = *find_bucket(b->buckets, b->numBuckets, b->syms,
+                                     name) - 1;
+
+  if (sym < 0)
+    return; // a label of an included file that is not in the table
+
+  if (b->numPending == b->capPending) {
+    b->capPending = 2 * b->capPending + 64;
+    b->pending    = mem_realloc(MEM_OUTPUT, b->pending,
+                                b->capPending * sizeof(xref_pending_t));
+  }
+
+  b->pending[b->numPending++] = (xref_pending_t) { sym, b->ref };
+  b->syms[sym].numRefs++;
+}
+
+/** Find the index of the file of a line, adding it to the files
+ *  @param units - the units of the files (units[0] is NULL, the source)
+ *  @param numUnits - the number of files
+ */
+static int file_index (int srcFile, inc_unit_t** units, int* numUnits) {
+  if (srcFile == 0)
+    return 0;
+
+  inc_unit_t* unit = include_unit(srcFile);
+
+  for (int i = 1; i < *numUnits; i++) {
+    if (units[i] == unit)
+      return i;
+  }
+
+  units[*numUnits] = unit;
+  return (*numUnits)++;
+}
+
+/** Store a 32-bit little-endian integer */
+static unsigned char* put_u32 (unsigned char* p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+  return p + 4;
+}
+
+/** Read a 32-bit little-endian integer */
+static uint32_t get_u32 (const unsigned char* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+int xref_write (FILE* f, line_info_t* head) {
+  xref_builder_t b;
+  int            numLines = 0;
+
+  memset(&b, 0, sizeof(b));
+  symbol_iterate(lc3_sym_tab, collect_symbol, &b);
+
+  if (b.numSyms > 0)
+    qsort(b.syms, b.numSyms, sizeof(xref_sym_t), compare_sym);
+
+  for (b.numBuckets = 2; b.numBuckets < 2 * b.numSyms; b.numBuckets *= 2)
+    ;
+
+  b.buckets = mem_calloc(MEM_OUTPUT, b.numBuckets, sizeof(int));
+
+  for (int i = 0; i < b.numSyms; i++)
+    *find_bucket(b.buckets, b.numBuckets, b.syms, b.syms[i].name) = i + 1;
+
+  for (line_info_t* info = head; info != NULL; info = info->next)
+    numLines++;
+
+  inc_unit_t** units    = mem_alloc(MEM_OUTPUT,
+                                    (numLines + 1) * sizeof(inc_unit_t*));
+  int          numUnits = 1;
+
+  units[0] = NULL;
+
+  for (line_info_t* info = head; info != NULL; info = info->next) {
+    // the reference of a .STRINGZ is its text
+    if (info->reference == NULL || info->opcode == OP_STRINGZ ||
+        info->opcode == OP_INVALID)
+      continue;
+
+    b.ref = (xref_ref_t) { info->address & 0xFFFF, kind_of(info->opcode),
+                           info->lineNum,
+                           file_index(info->srcFile, units, &numUnits) };
+    expr_for_each_label(info->reference, add_reference, &b);
+  }
+
+  // group the references by label, keeping the order of the lines
+  xref_ref_t* refs  = mem_alloc(MEM_OUTPUT,
+                                (b.numPending + 1) * sizeof(xref_ref_t));
+  int*        first = mem_alloc(MEM_OUTPUT, (b.numSyms + 1) * sizeof(int));
+
+  for (int i = 0, n = 0; i < b.numSyms; i++) {
+    first[i] = n;
+    n       += b.syms[i].numRefs;
+  }
+
+  for (int i = 0; i < b.numSyms; i++)
+    b.syms[i].numRefs = 0;
+
+  for (int i = 0; i < b.numPending; i++) {
+    xref_sym_t* sym = &b.syms[b.pending[i].sym];
+
+    refs[first[b.pending[i].sym] + sym->numRefs++] = b.pending[i].ref;
+  }
+
+  size_t numChars = 1; // the name of the source file
+
+  for (int i = 0; i < b.numSyms; i++)
+    numChars += strlen(b.syms[i].name) + 1;
+
+  for (int i = 1; i < numUnits; i++)
+    numChars += strlen(units[i]->name) + 1;
+
+  size_t len = XREF_HEADER + 4 * ((size_t) b.numBuckets + 4 * b.numSyms +
+                                  3 * (size_t) b.numPending + numUnits) +
+               numChars;
+
+  unsigned char* buf   = mem_alloc(MEM_OUTPUT, len);
+  char*          chars = (char*) buf + len - numChars;
+  unsigned char* p     = buf;
+  int            pos   = 0;
+
+  memcpy(p, "LC3X", 4);
+  p[4] = XREF_VERSION;
+  p[5] = p[6] = p[7] = 0;
+  p    = put_u32(p + 8, numUnits);
+  p    = put_u32(p, b.numSyms);
+  p    = put_u32(p, b.numBuckets);
+  p    = put_u32(p, b.numPending);
+  p    = put_u32(p, numChars);
+
+  for (int i = 0; i < b.numBuckets; i++)
+    p = put_u32(p, b.buckets[i]);
+
+  for (int i = 0; i < b.numSyms; i++) {
+    p    = put_u32(p, pos);
+    p    = put_u32(p, b.syms[i].addr);
+    p    = put_u32(p, first[i]);
+    p    = put_u32(p, b.syms[i].numRefs);
+    strcpy(chars + pos, b.syms[i].name);
+    pos += strlen(b.syms[i].name) + 1;
+  }
+
+  for (int i = 0; i < b.numPending; i++) {
+    p = put_u32(p, refs[i].addr | (refs[i].kind << 16));
+    p = put_u32(p, refs[i].lineNum);
+    p = put_u32(p, refs[i].file);
+  }
+
+  p = put_u32(p, pos);
+  chars[pos++] = '\0';
+
+  for (int i = 1; i < numUnits; i++) {
+    p    = put_u32(p, pos);
+    strcpy(chars + pos, units[i]->name);
+    pos += strlen(units[i]->name) + 1;
+  }
+
+  int ok = fwrite(buf, 1, len, f) == len;
+
+  mem_free(buf);
+  mem_free(first);
+  mem_free(refs);
+  mem_free(units);
+  mem_free(b.pending);
+  mem_free(b.buckets);
+  mem_free(b.syms);
+  return ok;
+}
+
+/** Decode the content of an index
+ *  @return 1 on success, 0 if the content is not valid
+ */
+static int decode_index (const unsigned char* data, size_t length,
+                         xref_index_t* index) {
+  if (length < XREF_HEADER || memcmp(data, "LC3X", 4) != 0 ||
+      data[4] != XREF_VERSION)
+    return 0;
+
+  uint32_t numFiles   = get_u32(data + 8);
+  uint32_t numSyms    = get_u32(data + 12);
+  uint32_t numBuckets = get_u32(data + 16);
+  uint32_t numRefs    = get_u32(data + 20);
+  uint32_t numChars   = get_u32(data + 24);
+
+  // each count is bounded by the length before the sizes are added
+  if (numFiles == 0 || numFiles > length || numSyms > length ||
+      numBuckets > length || numRefs > length || numChars == 0 ||
+      numChars > length || numBuckets <= numSyms ||
+      (numBuckets & (numBuckets - 1)) != 0 ||
+      XREF_HEADER + 4 * ((size_t) numBuckets + 4 * (size_t) numSyms +
+                         3 * (size_t) numRefs + numFiles) +
+      numChars != length)
+    return 0;
+
+  const unsigned char* p = data + XREF_HEADER;
+
+  index->chars = mem_alloc(MEM_IMAGE, numChars);
+  memcpy(index->chars, data + length - numChars, numChars);
+
+  if (index->chars[numChars - 1] != '\0')
+    return 0;
+
+  index->buckets    = mem_alloc(MEM_IMAGE, numBuckets * sizeof(int));
+  index->numBuckets = numBuckets;
+
+  uint32_t used = 0; // an empty bucket must end every lookup
+
+  for (uint32_t i = 0; i < numBuckets; i++, p += 4) {
+    index->buckets[i] = get_u32(p);
+    used             += (index->buckets[i] != 0);
+
+    if ((uint32_t) index->buckets[i] > numSyms || used > numSyms)
+      return 0;
+  }
+
+  index->syms    = mem_alloc(MEM_IMAGE, (numSyms + 1) * sizeof(xref_sym_t));
+  index->refs    = mem_alloc(MEM_IMAGE, (numRefs + 1) * sizeof(xref_ref_t));
+  index->numSyms = numSyms;
+  index->numRefs = numRefs;
+
+  for (uint32_t i = 0; i < numSyms; i++, p += 16) {
+    uint32_t name  = get_u32(p);
+    uint32_t first = get_u32(p + 8);
+    uint32_t count = get_u32(p + 12);
+
+    if (name >= numChars || first > numRefs || count > numRefs - first)
+      return 0;
+
+    index->syms[i] = (xref_sym_t) { index->chars + name, get_u32(p + 4),
+                                    index->refs + first, count };
+  }
+
+  for (uint32_t i = 0; i < numRefs; i++, p += 12) {
+    uint32_t word = get_u32(p);
+    uint32_t file = get_u32(p + 8);
+
+    if ((word >> 16) >= XREF_NUM_KINDS || file >= numFiles)
+      return 0;
+
+    index->refs[i] = (xref_ref_t) { word & 0xFFFF, word >> 16, get_u32(p + 4),
+                                    file };
+  }
+
+  index->files    = mem_alloc(MEM_IMAGE, numFiles * sizeof(char*));
+  index->numFiles = numFiles;
+
+  for (uint32_t i = 0; i < numFiles; i++, p += 4) {
+    uint32_t name = get_u32(p);
+
+    if (name >= numChars)
+      return 0;
+
+    index->files[i] = index->chars + name;
+  }
+
+  return 1;
+}
+
+int xref_load (const char* file_name, xref_index_t* index) {
+  struct stat st;
+  int         fd = open(file_name, O_RDONLY);
+
+  memset(index, 0, sizeof(xref_index_t));
+
+  if (fd < 0)
+    return errno;
+
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    return error;
+  }
+
+  if (st.st_size < XREF_HEADER) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t         length = st.st_size;
+  unsigned char* data   = mmap(NULL, length, PROT_READ,
+                               MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd); // the mapping stays valid
+
+  if (data == MAP_FAILED)
+    return errno;
+
+  int ok = decode_index(data, length, index);
+
+  munmap(data, length);
+
+  if (! ok) {
+    xref_free(index);
+    return EINVAL;
+  }
+
+  return 0;
+}
+
+xref_sym_t* xref_lookup (xref_index_t* index, const char* name) {
+  if (index->numBuckets == 0)
+    return NULL;
+
+  int sym = *find_bucket(index->buckets, index->numBuckets, index->syms,
+                         name) - 1;
+
+  return (sym >= 0) ? &index->syms[sym] : NULL;
+}
+
+void xref_free (xref_index_t* index) {
+  mem_free(index->syms);
+  mem_free(index->refs);
+  mem_free(index->buckets);
+  mem_free(index->files);
+  mem_free(index->chars);
+  memset(index, 0, sizeof(xref_index_t));
+}
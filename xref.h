@@ -0,0 +1,130 @@
+#ifndef __XREF_H__
+#define __XREF_H__
+
+/** @file xref.h
+ *  @brief interface to the cross-reference index of the labels
+ *  @details Selected by <code>-xref</code>, pass two writes a
+ *  <code>.xref</code> file next to the object file. For each label of
+ *  <code>lc3_sym_tab</code>, it lists the lines whose operand names the
+ *  label (in <code>reference</code>, alone or as a term of an expression),
+ *  with the address of the line, its source line and the kind of access:
+ *  a branch, a call (<code>JSR</code>), a load (<code>LD</code>,
+ *  <code>LDI</code>, <code>LDR</code>), a store (<code>ST</code>,
+ *  <code>STI</code>, <code>STR</code>), a <code>LEA</code>, a
+ *  <code>.FILL</code> (including the literal of <code>LD =LABEL</code>), or
+ *  another use of its value. An editor or an analysis answers "who calls
+ *  this routine" from it without parsing the source.
+ *  <p>
+ *  The file is made of arrays of 32-bit little-endian integers, so it can
+ *  be read as is:
+ *  <pre>
+ *  "LC3X" version 0 0 0                 identifies the format (version 2)
+ *  numFiles numSymbols numBuckets numRefs numChars
+ *  buckets[numBuckets]                  symbol index + 1, 0 if empty
+ *  symbols[numSymbols]                  name, address, first ref, numRefs
+ *  refs[numRefs]                        address | kind &lt;&lt; 16, line,
+ *                                       file
+ *  files[numFiles]                      name (file 0 is the source file,
+ *                                       its name is empty)
+ *  chars[numChars]                      the names, each ended by a 0
+ *  </pre>
+ *  A name is the offset of its first character in <code>chars</code>. Case
+ *  is ignored in names, as in the symbol table: the symbols are sorted by
+ *  name ignoring case, and the refs of each symbol are consecutive
+ *  and in the order of the program. The buckets are a hash table of the
+ *  symbols: <code>numBuckets</code> is a power of two at least twice the
+ *  number of symbols, and a symbol is in the first empty bucket from the
+ *  FNV-1a hash of its name in lower case (see <code>xref_hash()</code>) modulo
+ *  <code>numBuckets</code>, so a lookup takes one or two probes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "assembler.h"
+
+/** Version of the format written */
+#define XREF_VERSION 2
+
+/** How a line uses a label */
+typedef enum xref_kind {
+  XREF_BRANCH,  /**< BR                              */
+  XREF_CALL,    /**< JSR                             */
+  XREF_LOAD,    /**< LD, LDI, LDR                    */
+  XREF_STORE,   /**< ST, STI, STR                    */
+  XREF_LEA,     /**< LEA                             */
+  XREF_FILL,    /**< .FILL, or the literal of an LD  */
+  XREF_OTHER,   /**< any other operand               */
+  XREF_NUM_KINDS
+} xref_kind_t;
+
+/** Typedef of structure type */
+typedef struct xref_ref xref_ref_t;
+
+/** A line referencing a label */
+struct xref_ref {
+  int         addr;     /**< LC3 address of the line       */
+  xref_kind_t kind;     /**< how the label is used         */
+  int         lineNum;  /**< line in its file              */
+  int         file;     /**< index of the file in the names */
+};
+
+/** Typedef of structure type */
+typedef struct xref_sym xref_sym_t;
+
+/** A label and its references */
+struct xref_sym {
+  const char* name;     /**< name of the label             */
+  int         addr;     /**< LC3 address of the label      */
+  xref_ref_t* refs;     /**< the lines referencing it      */
+  int         numRefs;  /**< number of entries in refs     */
+};
+
+/** Typedef of structure type */
+typedef struct xref_index xref_index_t;
+
+/** An index loaded by <code>xref_load()</code> */
+struct xref_index {
+  xref_sym_t*  syms;        /**< the labels, sorted by name          */
+  int          numSyms;     /**< number of labels                    */
+  xref_ref_t*  refs;        /**< the references of all labels        */
+  int          numRefs;     /**< number of references                */
+  int*         buckets;     /**< label index + 1, 0 if empty         */
+  int          numBuckets;  /**< number of buckets, a power of two   */
+  const char** files;       /**< names of the files, the first is ""  */
+  int          numFiles;    /**< number of files                     */
+  char*        chars;       /**< the names                           */
+};
+
+/** The hash of a name: 32-bit FNV-1a of its characters in lower case */
+uint32_t xref_hash (const char* name);
+
+/** Return the name of a kind ("branch", "call", ...) */
+const char* xref_kind_name (xref_kind_t kind);
+
+/** Write the index of the labels of the program
+ *  @param f - the file to write to
+ *  @param head - the first line of the program
+ *  @return 1 on success, 0 on a write error
+ */
+int xref_write (FILE* f, line_info_t* head);
+
+/** Load an index
+ *  @param file_name - name of the file
+ *  @param index - set to the index, to free with <code>xref_free()</code>
+ *  @return 0 on success, else the errno value of the failure (EINVAL if the
+ *  file is not a valid index)
+ */
+int xref_load (const char* file_name, xref_index_t* index);
+
+/** Find a label, ignoring case (<code>Loop</code> finds <code>LOOP</code>)
+ *  @param index - the index
+ *  @param name - the name of the label
+ *  @return the label and its references, or NULL if it is not in the index
+ */
+xref_sym_t* xref_lookup (xref_index_t* index, const char* name);
+
+/** Free an index loaded by <code>xref_load()</code> */
+void xref_free (xref_index_t* index);
+
+#endif /* __XREF_H__ */